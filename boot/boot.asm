@@ -171,8 +171,8 @@ nop
 OEMIdetifier db     'LARVAOS '
 BytesPerSector      dw 0x200
 SectorsPerCluster   db 0x4      ; Each cluster is 2KB.
-ReservedSectors     dw 0xC8     ; We reverse first 200 sectors for our kernel.
-                                ; So, the FAT REGION will start at sector 201.
+ReservedSectors     dw 0x100    ; We reverse first 256 sectors for our kernel.
+                                ; So, the FAT REGION will start at sector 257.
 FATcopies           db 0x02
 RootDirEntries      dw 0x200
 NumSectors          dw 0x00
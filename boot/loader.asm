@@ -3,9 +3,10 @@
 ; physical memory at address 0x7E00. First of all, to prepare to long mode, we
 ; need to check it is supported or not. That is done by using `cpuid`
 ; instruction and it's service: "EAX Maximum Input Value for Extended Function 
-; CPUID Information.". After that we load 100 sectors [6:105] which we have
-; spent for our kernel code (51200 bytes are enough for our kernel code). Now
-; the physical memory look like:
+; CPUID Information.". After that we load 218 sectors [6:223] which we have
+; spent for our kernel code (111616 bytes), and the shell in sectors [224:255],
+; the end of the reserved region of the file system. Now the physical memory
+; look like:
 ;              Memory
 ;      |-------------------| Max size
 ;      |      Free         | -> We will use this region for kernel code.
@@ -81,34 +82,49 @@ Start:
     test edx, (1<<26)       ; Bit 26: 1-GByte pages are available if 1.
     jz NotSupport           ; If zero flag is set, CPU doesn't support.
 
-    ; 4. Load the kernel file to address 0x0010000.
+    ; 4. Load the kernel file to address 0x0010000. Some BIOS can't read more
+    ; than 127 sectors at once, so we read the kernel in two halves.
 LoadKernel:
     mov si, ReadPacket
     mov word[si], 0x10          ; Packet size is 16 bytes.
-    mov word[si + 2], 0x64      ; We will load 100 sectors from the disk.
+    mov word[si + 2], 0x6D      ; We will load 109 sectors from the disk.
     mov word[si + 4], 0x00      ; Memory offset.
     mov word[si + 6], 0x1000    ; Memory segment. So, we will load the kernel
                                 ; code to physical memory at address: 0x1000 *
                                 ; 0x10 + 0x00 = 0x10000
     mov dword[si + 8], 0x06     ; We load from sector 7 from hard disk image to
-    mov dword[si + 12], 0x00    ; sector 107.
+    mov dword[si + 12], 0x00    ; sector 115.
 
     mov dl, [DriveID]           ; DriveID param.
     mov ah, 0x42                ; Use INT 13 Extensions - EXTENDED READ service.
     int 0x13                    ; Call the Disk Service.
     jc ReadError                ; Carry flag will be set if error.
 
-; Load the shell process to 0x20000 to run init process.
+    mov si, ReadPacket
+    mov word[si], 0x10          ; Packet size is 16 bytes.
+    mov word[si + 2], 0x6D      ; We will load 109 sectors from the disk.
+    mov word[si + 4], 0x00      ; Memory offset.
+    mov word[si + 6], 0x1DA0    ; Memory segment, right after the first half:
+                                ; 0x10000 + 109 * 512 = 0x1DA00
+    mov dword[si + 8], 0x73     ; We load from sector 116 from hard disk image
+    mov dword[si + 12], 0x00    ; to sector 224.
+
+    mov dl, [DriveID]           ; DriveID param.
+    mov ah, 0x42                ; Use INT 13 Extensions - EXTENDED READ service.
+    int 0x13                    ; Call the Disk Service.
+    jc ReadError                ; Carry flag will be set if error.
+
+; Load the shell process to 0x30000 to run init process.
 LoadShell:
     mov si, ReadPacket
     mov word[si], 0x10          ; Packet size is 16 bytes.
-    mov word[si + 2], 0x14      ; We will load 20 sectors from the disk.
+    mov word[si + 2], 0x20      ; We will load 32 sectors from the disk.
     mov word[si + 4], 0x00      ; Memory offset.
-    mov word[si + 6], 0x2000    ; Memory segment. So, we will load the user
-                                ; code to physical memory at address: 0x2000 *
-                                ; 0x10 + 0x00 = 0x20000
-    mov dword[si + 8], 0x6A     ; We load from sector 107 from hard disk image
-    mov dword[si + 12], 0x00    ; to sector 127.
+    mov word[si + 6], 0x3000    ; Memory segment. So, we will load the user
+                                ; code to physical memory at address: 0x3000 *
+                                ; 0x10 + 0x00 = 0x30000
+    mov dword[si + 8], 0xE0     ; We load from sector 225 from hard disk image
+    mov dword[si + 12], 0x00    ; to sector 256.
 
     mov dl, [DriveID]           ; DriveID param.
     mov ah, 0x42                ; Use INT 13 Extensions - EXTENDED READ service.
@@ -326,8 +342,8 @@ LMEntry:
     cld                 ; Clear direction flag.
     mov rdi, 0x200000   ; Destination address.
     mov rsi, 0x10000    ; Source address.
-    mov rcx, 51200/8    ; RCX acts as a counter, we will copy 100 sectors: 512
-                        ; * 100 = 51200 bytes.
+    mov rcx, 111616/8   ; RCX acts as a counter, we will copy 218 sectors: 512
+                        ; * 218 = 111616 bytes.
     rep movsq           ; Repeat quad-word one time.
 
     ; Since the kernel is relocated to the new virtual address which is far away
@@ -0,0 +1,318 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "acpi.h"
+#include "memory.h"
+#include "printk.h"
+
+/* Private define ------------------------------------------------------------*/
+#define EBDA_SEGMENT_POINTER            0x40E
+#define EBDA_SEARCH_SIZE                1024
+#define BIOS_AREA_START                 0xE0000
+#define BIOS_AREA_END                   0x100000
+#define RSDP_ALIGNMENT                  16
+#define RSDP_SIGNATURE                  "RSD PTR "
+#define RSDP_VERSION_1_SIZE             20
+
+#define MADT_SIGNATURE                  "APIC"
+#define MADT_ENTRY_LOCAL_APIC           0
+#define MADT_ENTRY_IO_APIC              1
+#define MADT_ENTRY_SOURCE_OVERRIDE      2
+#define MADT_ENTRY_LOCAL_APIC_OVERRIDE  5
+#define MADT_LOCAL_APIC_ENABLED         BIT(0)
+#define MADT_ISA_BUS                    0
+
+#define DEFAULT_LOCAL_APIC_ADDRESS      0xFEE00000
+#define DEFAULT_IO_APIC_ADDRESS         0xFEC00000
+
+/* Private type --------------------------------------------------------------*/
+typedef struct {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+    /* ACPI 2.0 and later. */
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__ ((packed)) RSDP;
+
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__ ((packed)) SDTHeader;
+
+typedef struct {
+    SDTHeader header;
+    uint32_t local_apic_address;
+    uint32_t flags;
+} __attribute__ ((packed)) MADT;
+
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+} __attribute__ ((packed)) MADTEntry;
+
+typedef struct {
+    MADTEntry entry;
+    uint8_t processor_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__ ((packed)) MADTLocalAPIC;
+
+typedef struct {
+    MADTEntry entry;
+    uint8_t io_apic_id;
+    uint8_t reserved;
+    uint32_t address;
+    uint32_t gsi_base;
+} __attribute__ ((packed)) MADTIOAPIC;
+
+typedef struct {
+    MADTEntry entry;
+    uint8_t bus;
+    uint8_t source;
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__ ((packed)) MADTSourceOverride;
+
+typedef struct {
+    MADTEntry entry;
+    uint16_t reserved;
+    uint64_t address;
+} __attribute__ ((packed)) MADTLocalAPICOverride;
+
+/* Private variable ----------------------------------------------------------*/
+static MADTInfo s_madt_info;
+
+/* Private function prototypes -----------------------------------------------*/
+static RSDP *FindRSDP(void);
+static RSDP *ScanRSDP(uint64_t start, uint64_t end);
+static bool IsChecksumValid(const void *data, uint32_t size);
+
+/**
+ * @brief   Map a table from its physical address, and check it.
+ *
+ * @return  The table, or NULL if it is invalid.
+ */
+static SDTHeader *MapTable(uint64_t address);
+
+/**
+ * @brief   Find the table with `signature` in the RSDT or the XSDT.
+ */
+static SDTHeader *FindTable(RSDP *rsdp, const char *signature);
+
+/**
+ * @brief   Machine without the MADT: one CPU, and the usual PC wiring.
+ */
+static void SetDefaultMADT(void);
+
+static void ParseMADT(MADT *madt);
+
+/* Public function -----------------------------------------------------------*/
+bool InitACPI(void)
+{
+    RSDP *rsdp = FindRSDP();
+    MADT *madt = NULL;
+
+    SetDefaultMADT();
+
+    if (rsdp == NULL) {
+        printk("ACPI: No RSDP.\n");
+        return false;
+    }
+
+    madt = (MADT *)FindTable(rsdp, MADT_SIGNATURE);
+    if (madt == NULL) {
+        printk("ACPI: No MADT.\n");
+        return false;
+    }
+
+    /* The boot CPU is listed again. */
+    s_madt_info.cpu_count = 0;
+    ParseMADT(madt);
+
+    printk("ACPI: %d CPUs, local APIC at %#lx, I/O APIC at %#lx.\n",
+           s_madt_info.cpu_count,
+           s_madt_info.local_apic_address,
+           s_madt_info.io_apic_address);
+
+    return true;
+}
+
+const MADTInfo *GetMADTInfo(void)
+{
+    return &s_madt_info;
+}
+
+/* Private function ----------------------------------------------------------*/
+static RSDP *FindRSDP(void)
+{
+    uint64_t ebda = (uint64_t)*(uint16_t *)PHY_TO_VIR(EBDA_SEGMENT_POINTER)
+                    << 4;
+    RSDP *rsdp = NULL;
+
+    if (ebda != 0) {
+        rsdp = ScanRSDP(ebda, ebda + EBDA_SEARCH_SIZE);
+    }
+
+    if (rsdp == NULL) {
+        rsdp = ScanRSDP(BIOS_AREA_START, BIOS_AREA_END);
+    }
+
+    return rsdp;
+}
+
+static RSDP *ScanRSDP(uint64_t start, uint64_t end)
+{
+    /* The first MB is mapped with the kernel. */
+    for (uint64_t address = start; address < end; address += RSDP_ALIGNMENT) {
+        RSDP *rsdp = (RSDP *)PHY_TO_VIR(address);
+
+        if (memcmp(rsdp->signature, RSDP_SIGNATURE, 8) == 0
+            && IsChecksumValid(rsdp, RSDP_VERSION_1_SIZE)) {
+            return rsdp;
+        }
+    }
+
+    return NULL;
+}
+
+static bool IsChecksumValid(const void *data, uint32_t size)
+{
+    const uint8_t *bytes = data;
+    uint8_t sum = 0;
+
+    for (uint32_t i = 0; i < size; i++) {
+        sum += bytes[i];
+    }
+
+    return sum == 0;
+}
+
+static SDTHeader *MapTable(uint64_t address)
+{
+    SDTHeader *header = NULL;
+
+    /* The tables are at the top of the RAM, above the kernel mapping. The
+     * length is only known after the header is mapped. */
+    header = MapDeviceMemory(address, sizeof(SDTHeader));
+    if (header == NULL
+        || MapDeviceMemory(address, header->length) == NULL
+        || !IsChecksumValid(header, header->length)) {
+        return NULL;
+    }
+
+    return header;
+}
+
+static SDTHeader *FindTable(RSDP *rsdp, const char *signature)
+{
+    bool extended = rsdp->revision >= 2 && rsdp->xsdt_address != 0;
+    uint32_t pointer_size = extended ? sizeof(uint64_t) : sizeof(uint32_t);
+    SDTHeader *root = NULL;
+    int count = 0;
+
+    root = MapTable(extended ? rsdp->xsdt_address : rsdp->rsdt_address);
+    if (root == NULL) {
+        return NULL;
+    }
+
+    count = (root->length - sizeof(SDTHeader)) / pointer_size;
+    for (int i = 0; i < count; i++) {
+        char *pointer = (char *)(root + 1) + i * pointer_size;
+        uint64_t address = extended ? *(uint64_t *)pointer
+                                    : *(uint32_t *)pointer;
+        SDTHeader *table = MapTable(address);
+
+        if (table != NULL && memcmp(table->signature, signature, 4) == 0) {
+            return table;
+        }
+    }
+
+    return NULL;
+}
+
+static void SetDefaultMADT(void)
+{
+    s_madt_info.local_apic_address = DEFAULT_LOCAL_APIC_ADDRESS;
+    s_madt_info.cpu_count = 1;
+    s_madt_info.cpu_apic_ids[0] = GetCPU()->apic_id;
+    s_madt_info.io_apic_address = DEFAULT_IO_APIC_ADDRESS;
+    s_madt_info.io_apic_gsi_base = 0;
+
+    for (int irq = 0; irq < ISA_IRQ_COUNT; irq++) {
+        s_madt_info.isa_irq_gsi[irq] = irq;
+        s_madt_info.isa_irq_flags[irq] = 0;
+    }
+}
+
+static void ParseMADT(MADT *madt)
+{
+    bool has_io_apic = false;
+
+    char *entry = (char *)(madt + 1);
+    char *end = (char *)madt + madt->header.length;
+
+    s_madt_info.local_apic_address = madt->local_apic_address;
+
+    while (entry + sizeof(MADTEntry) <= end) {
+        MADTEntry *header = (MADTEntry *)entry;
+
+        if (header->length < sizeof(MADTEntry)) {
+            break;
+        }
+
+        switch (header->type) {
+        case MADT_ENTRY_LOCAL_APIC: {
+            MADTLocalAPIC *local_apic = (MADTLocalAPIC *)entry;
+
+            if ((local_apic->flags & MADT_LOCAL_APIC_ENABLED)
+                && s_madt_info.cpu_count < CPU_MAXIMUM) {
+                s_madt_info.cpu_apic_ids[s_madt_info.cpu_count++] =
+                local_apic->apic_id;
+            }
+        }
+        break;
+        case MADT_ENTRY_IO_APIC: {
+            MADTIOAPIC *io_apic = (MADTIOAPIC *)entry;
+
+            /* Only the first one is used, it has the ISA IRQs. */
+            if (!has_io_apic) {
+                s_madt_info.io_apic_address = io_apic->address;
+                s_madt_info.io_apic_gsi_base = io_apic->gsi_base;
+                has_io_apic = true;
+            }
+        }
+        break;
+        case MADT_ENTRY_SOURCE_OVERRIDE: {
+            MADTSourceOverride *override = (MADTSourceOverride *)entry;
+
+            if (override->bus == MADT_ISA_BUS && override->source < ISA_IRQ_COUNT) {
+                s_madt_info.isa_irq_gsi[override->source] = override->gsi;
+                s_madt_info.isa_irq_flags[override->source] = override->flags;
+            }
+        }
+        break;
+        case MADT_ENTRY_LOCAL_APIC_OVERRIDE: {
+            MADTLocalAPICOverride *override = (MADTLocalAPICOverride *)entry;
+
+            s_madt_info.local_apic_address = override->address;
+        }
+        break;
+        default:
+            break;
+        }
+
+        entry += header->length;
+    }
+}
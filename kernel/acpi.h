@@ -0,0 +1,68 @@
+/**
+ * @file    acpi.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   ACPI tables. The firmware describes the machine in tables which
+ *          are found from the RSDP (Root System Description Pointer), it is
+ *          in the first KB of the EBDA or in the BIOS area 0xE0000-0xFFFFF,
+ *          on a 16 bytes boundary:
+ *
+ *           RSDP --> RSDT (32 bit pointers) or XSDT (64 bit pointers)
+ *                     |--> "APIC" MADT: local APIC of every CPU, ...
+ *                     |--> other tables, which we don't use
+ *
+ *          Only the MADT (Multiple APIC Description Table) is read, it lists
+ *          the CPUs by the ID of their local APIC, the I/O APIC, and the ISA
+ *          IRQs which are not wired to the GSI of the same number. Without
+ *          the MADT, the usual PC addresses are used, with the boot CPU only.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+
+/* Public define -------------------------------------------------------------*/
+#define ISA_IRQ_COUNT                   16
+
+/* Public type ---------------------------------------------------------------*/
+/**
+ * @brief   What the kernel uses from the MADT.
+ *
+ * @property local_apic_address - Physical address of the local APICs.
+ * @property cpu_count          - Number of enabled CPUs, the boot CPU too.
+ * @property cpu_apic_ids       - Local APIC ID of each CPU.
+ * @property io_apic_address    - Physical address of the first I/O APIC.
+ * @property io_apic_gsi_base   - First GSI of the I/O APIC.
+ * @property isa_irq_gsi        - GSI of each ISA IRQ.
+ * @property isa_irq_flags      - Polarity and trigger mode of each ISA IRQ.
+ */
+typedef struct {
+    uint64_t local_apic_address;
+    int cpu_count;
+    uint8_t cpu_apic_ids[CPU_MAXIMUM];
+    uint64_t io_apic_address;
+    uint32_t io_apic_gsi_base;
+    uint32_t isa_irq_gsi[ISA_IRQ_COUNT];
+    uint16_t isa_irq_flags[ISA_IRQ_COUNT];
+} MADTInfo;
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Find the ACPI tables and read the MADT. It maps the tables, so it
+ *          must run before the first process is created.
+ *
+ * @return  true    - The MADT is found.
+ * @return  false   - No ACPI tables, the boot CPU runs alone with the default
+ *                    APIC addresses.
+ */
+bool InitACPI(void);
+
+/**
+ * @brief   Content of the MADT, or the defaults without it.
+ */
+const MADTInfo *GetMADTInfo(void);
@@ -0,0 +1,198 @@
+#include <stddef.h>
+
+#include "apic.h"
+#include "cpu.h"
+#include "memory.h"
+#include "timer.h"
+#include "trap.h"
+#include "printk.h"
+#include "assert.h"
+
+/* Private define ------------------------------------------------------------*/
+#define LOCAL_APIC_EOI                  0x0B0
+#define LOCAL_APIC_SPURIOUS             0x0F0
+#define LOCAL_APIC_ICR_LOW              0x300
+#define LOCAL_APIC_ICR_HIGH             0x310
+#define LOCAL_APIC_LVT_TIMER            0x320
+#define LOCAL_APIC_LVT_LINT0            0x350
+#define LOCAL_APIC_LVT_LINT1            0x360
+#define LOCAL_APIC_TIMER_INITIAL        0x380
+#define LOCAL_APIC_TIMER_CURRENT        0x390
+#define LOCAL_APIC_TIMER_DIVIDE         0x3E0
+
+#define LOCAL_APIC_SOFTWARE_ENABLE      BIT(8)
+#define LOCAL_APIC_LVT_MASKED           BIT(16)
+#define LOCAL_APIC_LVT_NMI              0x400
+#define LOCAL_APIC_TIMER_TSC_DEADLINE   BIT(18)
+#define LOCAL_APIC_TIMER_DIVIDE_BY_16   0x3
+#define LOCAL_APIC_TIMER_MAXIMUM_COUNTS 0xFFFFFFFF
+
+#define CPUID_FEATURES                  1
+#define CPUID_FEATURE_TSC_DEADLINE      BIT(24)     /* ECX.           */
+#define MSR_TSC_DEADLINE                0x6E0
+
+#define LOCAL_APIC_ICR_INIT             0x4500
+#define LOCAL_APIC_ICR_STARTUP          0x4600
+#define LOCAL_APIC_ICR_PENDING          BIT(12)
+
+#define LOCAL_APIC_CALIBRATION_US       10000
+#define INIT_DELAY_US                   10000
+#define STARTUP_DELAY_US                200
+
+/* Private variable ----------------------------------------------------------*/
+static volatile uint32_t *s_local_apic = NULL;
+/* Timer counts per second, in one-shot mode. */
+static uint64_t s_timer_frequency = 0;
+static bool s_has_tsc_deadline = false;
+
+/* Private function prototypes -----------------------------------------------*/
+static inline uint32_t ReadLocalAPIC(uint32_t reg)
+{
+    return s_local_apic[reg / sizeof(uint32_t)];
+}
+
+static inline void WriteLocalAPIC(uint32_t reg, uint32_t value)
+{
+    s_local_apic[reg / sizeof(uint32_t)] = value;
+}
+
+static void EnableLocalAPIC(void);
+static void CalibrateLocalAPICTimer(void);
+static void SetupLocalAPICTimer(void);
+static void SendICR(uint8_t apic_id, uint32_t command);
+
+/* Public function -----------------------------------------------------------*/
+void InitLocalAPIC(uint64_t address)
+{
+    uint32_t regs[4] = {0};
+
+    s_local_apic = MapDeviceMemory(address, FRAME_SIZE);
+    ASSERT(s_local_apic != NULL);
+
+    CPUID(CPUID_FEATURES, regs);
+    s_has_tsc_deadline = (regs[2] & CPUID_FEATURE_TSC_DEADLINE) != 0;
+
+    /* The PIC, which is wired to LINT0 of the boot CPU, is masked. */
+    InitSecondaryLocalAPIC();
+
+    CalibrateLocalAPICTimer();
+    printk("Local APIC %u: timer at %lu kHz%s.\n",
+           GetCPU()->apic_id,
+           s_timer_frequency / 1000,
+           s_has_tsc_deadline ? ", TSC-deadline mode" : "");
+}
+
+void InitSecondaryLocalAPIC(void)
+{
+    EnableLocalAPIC();
+
+    WriteLocalAPIC(LOCAL_APIC_LVT_LINT0, LOCAL_APIC_LVT_MASKED);
+    WriteLocalAPIC(LOCAL_APIC_LVT_LINT1, LOCAL_APIC_LVT_NMI);
+
+    SetupLocalAPICTimer();
+}
+
+void SetLocalAPICTimer(uint64_t expiry)
+{
+    uint64_t now = 0;
+    uint64_t counts = 0;
+
+    if (s_has_tsc_deadline) {
+        WriteMSR(MSR_TSC_DEADLINE, expiry != 0 ? ClockToTSC(expiry) : 0);
+        return;
+    }
+
+    if (expiry == 0) {
+        WriteLocalAPIC(LOCAL_APIC_TIMER_INITIAL, 0);
+        return;
+    }
+
+    now = GetClockNanoseconds();
+    counts = expiry > now ?
+             NanosecondsToCycles(expiry - now, s_timer_frequency) : 0;
+
+    /* A count of 0 stops the timer, a longer delay fires early and is
+     * programmed again. */
+    if (counts == 0) {
+        counts = 1;
+    } else if (counts > LOCAL_APIC_TIMER_MAXIMUM_COUNTS) {
+        counts = LOCAL_APIC_TIMER_MAXIMUM_COUNTS;
+    }
+
+    WriteLocalAPIC(LOCAL_APIC_TIMER_INITIAL, counts);
+}
+
+void LocalAPICEOI(void)
+{
+    WriteLocalAPIC(LOCAL_APIC_EOI, 0);
+}
+
+void SendIPI(uint8_t apic_id, uint8_t vector)
+{
+    SendICR(apic_id, vector);
+}
+
+void StartCPU(uint8_t apic_id, uint64_t address)
+{
+    ASSERT(address % FRAME_SIZE == 0 && address < 0x100000);
+
+    /* The CPU starts in real mode at page:0 of the STARTUP vector. The second
+     * STARTUP is ignored by a CPU which got the first one. */
+    SendICR(apic_id, LOCAL_APIC_ICR_INIT);
+    DelayMicroseconds(INIT_DELAY_US);
+
+    for (int i = 0; i < 2; i++) {
+        SendICR(apic_id, LOCAL_APIC_ICR_STARTUP | (address / FRAME_SIZE));
+        DelayMicroseconds(STARTUP_DELAY_US);
+    }
+}
+
+/* Private function ----------------------------------------------------------*/
+static void EnableLocalAPIC(void)
+{
+    WriteLocalAPIC(LOCAL_APIC_SPURIOUS,
+                   LOCAL_APIC_SOFTWARE_ENABLE | LOCAL_APIC_SPURIOUS_VECTOR);
+}
+
+static void CalibrateLocalAPICTimer(void)
+{
+    uint32_t lvt = ReadLocalAPIC(LOCAL_APIC_LVT_TIMER);
+    uint32_t elapsed = 0;
+
+    /* The timer counts in one-shot mode with the interrupt masked. */
+    WriteLocalAPIC(LOCAL_APIC_LVT_TIMER, LOCAL_APIC_LVT_MASKED);
+    WriteLocalAPIC(LOCAL_APIC_TIMER_INITIAL, LOCAL_APIC_TIMER_MAXIMUM_COUNTS);
+
+    DelayMicroseconds(LOCAL_APIC_CALIBRATION_US);
+
+    elapsed = LOCAL_APIC_TIMER_MAXIMUM_COUNTS
+              - ReadLocalAPIC(LOCAL_APIC_TIMER_CURRENT);
+    WriteLocalAPIC(LOCAL_APIC_TIMER_INITIAL, 0);
+    WriteLocalAPIC(LOCAL_APIC_LVT_TIMER, lvt);
+
+    s_timer_frequency = (uint64_t)elapsed
+                        * (1000000 / LOCAL_APIC_CALIBRATION_US);
+    if (s_timer_frequency == 0) {
+        s_timer_frequency = 1;
+    }
+}
+
+static void SetupLocalAPICTimer(void)
+{
+    /* The mode is set before the first deadline is written. */
+    WriteLocalAPIC(LOCAL_APIC_TIMER_DIVIDE, LOCAL_APIC_TIMER_DIVIDE_BY_16);
+    WriteLocalAPIC(LOCAL_APIC_LVT_TIMER,
+                   LOCAL_APIC_TIMER_VECTOR
+                   | (s_has_tsc_deadline ? LOCAL_APIC_TIMER_TSC_DEADLINE : 0));
+    WriteLocalAPIC(LOCAL_APIC_TIMER_INITIAL, 0);
+}
+
+static void SendICR(uint8_t apic_id, uint32_t command)
+{
+    WriteLocalAPIC(LOCAL_APIC_ICR_HIGH, (uint32_t)apic_id << 24);
+    WriteLocalAPIC(LOCAL_APIC_ICR_LOW, command);
+
+    while (ReadLocalAPIC(LOCAL_APIC_ICR_LOW) & LOCAL_APIC_ICR_PENDING) {
+        __builtin_ia32_pause();
+    }
+}
@@ -0,0 +1,65 @@
+/**
+ * @file    apic.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Local APIC. Every CPU has its own local APIC, mapped at the same
+ *          physical address (uncached), each CPU reaches its own one there.
+ *          It is used for:
+ *          + Inter-processor interrupts (IPI): INIT and STARTUP start the
+ *            other CPUs, RESCHEDULE_VECTOR makes a CPU look at its run queue.
+ *          + The local timer, which is the only timer interrupt of every
+ *            CPU. It runs in one-shot mode for the next event of the CPU
+ *            (see timer.h), in TSC-deadline mode if the CPU supports it: the
+ *            deadline is then written as a TSC value, with no conversion. In
+ *            one-shot mode, the timer counts the bus clock, it is calibrated
+ *            once against the PIT.
+ *
+ *          The PIC is not used, the I/O APIC delivers the device interrupts.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Public define -------------------------------------------------------------*/
+#define LOCAL_APIC_TIMER_VECTOR         0x40
+#define RESCHEDULE_VECTOR               0x41
+#define LOCAL_APIC_SPURIOUS_VECTOR      0xFF
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Map the local APIC at `address` (from the MADT), enable the one of
+ *          the boot CPU and calibrate its timer.
+ */
+void InitLocalAPIC(uint64_t address);
+
+/**
+ * @brief   Enable the local APIC of a secondary CPU, and set up its timer.
+ */
+void InitSecondaryLocalAPIC(void);
+
+/**
+ * @brief   Fire the local APIC timer interrupt at `expiry` of the monotonic
+ *          clock, at once if it is over. 0 stops the timer.
+ */
+void SetLocalAPICTimer(uint64_t expiry);
+
+/**
+ * @brief   Send the end of interrupt to the local APIC.
+ */
+void LocalAPICEOI(void);
+
+/**
+ * @brief   Send `vector` to the CPU whose local APIC ID is `apic_id`.
+ */
+void SendIPI(uint8_t apic_id, uint8_t vector);
+
+/**
+ * @brief   Send INIT, then two STARTUP IPIs to start a secondary CPU in real
+ *          mode at `address` (page aligned, below 1MB).
+ */
+void StartCPU(uint8_t apic_id, uint64_t address);
@@ -1,3 +1,4 @@
+#include <format.h>
 #include "assert.h"
 #include "printk.h"
 
@@ -6,7 +7,7 @@
 void error_point(const char *file, uint64_t line)
 {
     char msg[ASSERTION_FAILURE_MESSAGE_MAX_SIZE] = {0}; 
-    sprintk(msg, "Assertion failed at %s:%d", file, line);
+    snprintf(msg, sizeof(msg), "Assertion failed at %s:%lu", file, line);
     panic(msg);
 }
 
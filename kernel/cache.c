@@ -0,0 +1,83 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "cache.h"
+#include "assert.h"
+
+/* Private function prototypes -----------------------------------------------*/
+/**
+ * @brief   Carve a new slab into objects, and add them to the free list.
+ *
+ * @return  false if the system is out of memory.
+ */
+static bool GrowCache(ObjectCache *cache);
+
+/* Public function -----------------------------------------------------------*/
+void InitObjectCache(ObjectCache *cache, const char *name, uint32_t size)
+{
+    ASSERT(size > 0 && size <= PAGE_SIZE);
+
+    cache->name = name;
+    cache->object_size = (size + 7) & ~7U;
+    cache->slab_size = cache->object_size <= FRAME_SIZE ? FRAME_SIZE
+                                                        : PAGE_SIZE;
+    cache->allocated = 0;
+    cache->free_list.next = NULL;
+}
+
+void *CacheAlloc(ObjectCache *cache)
+{
+    Page *object = cache->free_list.next;
+
+    if (object == NULL) {
+        if (!GrowCache(cache)) {
+            return NULL;
+        }
+
+        object = cache->free_list.next;
+    }
+
+    cache->free_list.next = object->next;
+    cache->allocated++;
+    memset(object, 0, cache->object_size);
+
+    return object;
+}
+
+void CacheFree(ObjectCache *cache, void *object)
+{
+    Page *page = (Page *)object;
+
+    ASSERT(cache->allocated > 0);
+
+    page->next = cache->free_list.next;
+    cache->free_list.next = page;
+    cache->allocated--;
+}
+
+/* Private function ----------------------------------------------------------*/
+static bool GrowCache(ObjectCache *cache)
+{
+    char *slab = NULL;
+
+    if (cache->slab_size == FRAME_SIZE) {
+        slab = AllocFrame();
+    } else {
+        slab = kalloc();
+    }
+
+    if (slab == NULL) {
+        return false;
+    }
+
+    for (uint32_t offset = 0;
+         offset + cache->object_size <= cache->slab_size;
+         offset += cache->object_size) {
+        Page *page = (Page *)(slab + offset);
+
+        page->next = cache->free_list.next;
+        cache->free_list.next = page;
+    }
+
+    return true;
+}
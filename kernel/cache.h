@@ -0,0 +1,59 @@
+/**
+ * @file    cache.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Object caches. Kernel objects which are created and destroyed
+ *          often (process control blocks, file descriptor tables, etc.) are
+ *          much smaller than a 2MB page, so each kind of object has its own
+ *          cache: the cache carves 4KB frames (or 2MB pages for objects larger
+ *          than a frame) into objects of its size, and keeps the released
+ *          objects in a free list, so allocating and releasing an object are
+ *          O(1) and never touch the page allocator again.
+ *
+ *          The memory of a cache is never given back to the page allocator.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include "memory.h"
+
+/* Public type ---------------------------------------------------------------*/
+/**
+ * @brief   Cache of objects of the same size.
+ *
+ * @property name           - Name of the objects, for debugging.
+ * @property object_size    - Size of an object, rounded up to 8 bytes.
+ * @property slab_size      - Size of the memory block carved into objects.
+ * @property allocated      - Number of objects in use.
+ * @property free_list      - Released objects.
+ */
+typedef struct {
+    const char *name;
+    uint32_t object_size;
+    uint32_t slab_size;
+    uint64_t allocated;
+    Page free_list;
+} ObjectCache;
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Initialize an empty cache of objects of `size` bytes, no memory is
+ *          taken until the first allocation.
+ */
+void InitObjectCache(ObjectCache *cache, const char *name, uint32_t size);
+
+/**
+ * @brief   Allocate a zeroed object.
+ *
+ * @return  The object, or NULL if the system is out of memory.
+ */
+void *CacheAlloc(ObjectCache *cache);
+
+/**
+ * @brief   Give an object back to its cache.
+ */
+void CacheFree(ObjectCache *cache, void *object);
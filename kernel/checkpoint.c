@@ -0,0 +1,564 @@
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "checkpoint.h"
+#include "file.h"
+#include "memory.h"
+#include "runtime.h"
+#include "cpu.h"
+#include "assert.h"
+
+/* Private define ------------------------------------------------------------*/
+#define CHECKPOINT_MAGIC                0x54504B43      /* "CKPT" */
+/* Frames of the user window. */
+#define CHECKPOINT_WINDOW_FRAMES        (PAGE_SIZE / FRAME_SIZE)
+/* "NAME.EXT" and its '\0'. */
+#define CHECKPOINT_NAME_SIZE            13
+/* CF, PF, AF, ZF, SF, DF and OF, the flags which user code can change. */
+#define CHECKPOINT_USER_RFLAGS          0xCD5
+
+/* Private type --------------------------------------------------------------*/
+/**
+ * @brief   Opened file of a checkpoint.
+ *
+ * @property fd         - File descriptor.
+ * @property dup_of     - Lower descriptor which shares the file descriptor
+ *                        entry (and the position) with this one, or -1.
+ */
+typedef struct {
+    int32_t fd;
+    int32_t dup_of;
+    uint32_t position;
+    char name[CHECKPOINT_NAME_SIZE];
+} CheckpointFile;
+
+/**
+ * @brief   Header at the beginning of a checkpoint file, in its first frame.
+ *
+ * @property program        - Program file of the process.
+ * @property program_cluster, program_size
+ *                          - Program file at the checkpoint, to find out if
+ *                            it changed.
+ * @property runtime_build  - Build of the shared runtime, 0 if the process
+ *                            doesn't use it.
+ * @property frame_slot     - For each frame of the user window, its index in
+ *                            the saved frames plus 1, 0 if it isn't saved.
+ */
+typedef struct {
+    uint32_t magic;
+    char program[CHECKPOINT_NAME_SIZE];
+    uint32_t program_cluster;
+    uint32_t program_size;
+    uint32_t runtime_build;
+    TrapFrame tf;
+    uint64_t fs_base;
+    VMArea vma[PROCESS_MAXIMUM_VMAS];
+    int32_t vma_count;
+    int32_t nice;
+    int32_t priority;
+    int32_t file_count;
+    CheckpointFile files[CHECKPOINT_MAXIMUM_FILES];
+    uint32_t frame_count;
+    uint16_t frame_slot[CHECKPOINT_WINDOW_FRAMES];
+} CheckpointHeader;
+
+/**
+ * @brief   Checkpoint file of restored processes, a forked child shares it
+ *          with its parent.
+ *
+ * @property frame_offset   - For each frame of the user window, its offset in
+ *                            the file, 0 if it isn't saved.
+ */
+typedef struct CheckpointImage {
+    int ref_count;
+    FCB *file;
+    uint32_t frame_offset[CHECKPOINT_WINDOW_FRAMES];
+} CheckpointImage;
+
+/* Private function prototypes -----------------------------------------------*/
+/**
+ * @brief   Check that a process can be saved by the current one.
+ *
+ * @return  0, or -ESRCH, -EINVAL, -EBUSY like Checkpoint().
+ */
+static int CheckProcess(Process *proc);
+
+/**
+ * @brief   Fill the header and copy the mapped frames of a process. Nothing
+ *          sleeps meanwhile, so the process doesn't run and the copy is
+ *          consistent.
+ *
+ * @param   frames  - Receives the frames, one page holds the whole window.
+ * @return  0, or -EMFILE.
+ */
+static int SaveProcess(Process *proc,
+                       CheckpointHeader *header,
+                       char *frames);
+
+static int SaveFiles(Process *proc, CheckpointHeader *header);
+static bool IsValidHeader(const CheckpointHeader *header, const FCB *fcb);
+
+/**
+ * @brief   Open the program of a checkpoint, the process holds it like
+ *          LoadProgram() does.
+ *
+ * @return  The file control block, NULL with `status` set on failure.
+ */
+static FCB *OpenProgram(Process *proc,
+                        const CheckpointHeader *header,
+                        int *status);
+
+static int RestoreFiles(Process *proc, const CheckpointHeader *header);
+
+/* Public function -----------------------------------------------------------*/
+int Checkpoint(int pid, const char *path)
+{
+    Process *current_proc = GetCurrentProcess();
+    Process *proc = current_proc;
+    CheckpointHeader *header = NULL;
+    char *frames = NULL;
+    FCB *fcb = NULL;
+    int status = 0;
+    int fd = 0;
+
+    ASSERT(sizeof(CheckpointHeader) <= FRAME_SIZE);
+
+    if (pid != 0) {
+        proc = FindProcess(pid);
+    }
+
+    status = CheckProcess(proc);
+    if (status < 0) {
+        return status;
+    }
+
+    fd = Open(current_proc, path);
+    if (fd < 0) {
+        return -ENOENT;
+    }
+
+    /* A restored process reads its frames from the file. */
+    fcb = current_proc->files->file[fd]->fcb;
+    if (fcb->open_count > 1) {
+        Close(current_proc, fd);
+        return -ETXTBSY;
+    }
+
+    header = AllocFrame();
+    frames = kalloc();
+    if (header == NULL || frames == NULL) {
+        status = -ENOMEM;
+        goto exit;
+    }
+
+    status = SaveProcess(proc, header, frames);
+    if (status < 0) {
+        goto exit;
+    }
+
+    if ((1 + header->frame_count) * FRAME_SIZE > fcb->file_size) {
+        status = -ENOSPC;
+        goto exit;
+    }
+
+    /* The header, which makes the file a checkpoint, is written last. */
+    status = WriteFileAt(fcb,
+                         frames,
+                         FRAME_SIZE,
+                         header->frame_count * FRAME_SIZE);
+    if (status >= 0) {
+        status = WriteFileAt(fcb, header, 0, FRAME_SIZE);
+    }
+
+    if (status > 0) {
+        status = 0;
+    }
+
+exit:
+    if (frames != NULL) {
+        kfree((uint64_t)frames);
+    }
+
+    if (header != NULL) {
+        FreeFrame(header);
+    }
+
+    Close(current_proc, fd);
+
+    return status;
+}
+
+int LoadCheckpoint(Process *proc, const char *path)
+{
+    CheckpointHeader *header = NULL;
+    CheckpointImage *image = NULL;
+    FCB *program = NULL;
+    FCB *fcb = NULL;
+    int status = 0;
+    int fd = 0;
+
+    /* The descriptor is closed at once, the files of the process go to their
+     * own descriptors. */
+    fd = Open(proc, path);
+    if (fd < 0) {
+        return -ENOENT;
+    }
+
+    fcb = proc->files->file[fd]->fcb;
+    RetainFile(fcb);
+    Close(proc, fd);
+
+    header = AllocFrame();
+    image = AllocFrame();
+    if (header == NULL || image == NULL) {
+        status = -ENOMEM;
+        goto exit;
+    }
+
+    if (ReadFileAt(fcb, header, 0, FRAME_SIZE) != FRAME_SIZE
+        || !IsValidHeader(header, fcb)) {
+        status = -ENOEXEC;
+        goto exit;
+    }
+
+    program = OpenProgram(proc, header, &status);
+    if (program == NULL) {
+        goto exit;
+    }
+
+    if (header->runtime_build != 0) {
+        status = MapRuntime(proc, header->runtime_build);
+    }
+
+    if (status == 0) {
+        status = RestoreFiles(proc, header);
+    }
+
+    if (status < 0) {
+        ReleaseFile(program);
+        goto exit;
+    }
+
+    /* The frames are read from the checkpoint, or from the program for the
+     * ones which were never loaded, by HandlePageFault(). */
+    image->ref_count = 1;
+    image->file = fcb;
+    for (int i = 0; i < CHECKPOINT_WINDOW_FRAMES; i++) {
+        image->frame_offset[i] = header->frame_slot[i] * FRAME_SIZE;
+    }
+
+    proc->image = program;
+    proc->checkpoint = image;
+    proc->vma_count = header->vma_count;
+    memcpy(proc->vma, header->vma, sizeof(proc->vma));
+
+    /* The process returns to user mode like a forked one, with the flags and
+     * the selectors of a user process whatever the file says. */
+    *proc->tf = header->tf;
+    proc->tf->cs = USER_CODE_SELECTOR;
+    proc->tf->ss = USER_DATA_SELECTOR;
+    proc->tf->rflags = (header->tf.rflags & CHECKPOINT_USER_RFLAGS) | 0x202;
+    proc->fs_base = header->fs_base;
+
+    proc->nice = header->nice;
+    proc->priority = header->priority;
+
+    fcb = NULL;
+    image = NULL;
+
+exit:
+    if (image != NULL) {
+        FreeFrame(image);
+    }
+
+    if (header != NULL) {
+        FreeFrame(header);
+    }
+
+    if (fcb != NULL) {
+        ReleaseFile(fcb);
+    }
+
+    return status;
+}
+
+bool ReadCheckpointFrame(Process *proc, uint64_t page, void *frame)
+{
+    CheckpointImage *image = proc->checkpoint;
+    uint64_t index = (page - USER_VIRTUAL_ADDRESS_BASE) / FRAME_SIZE;
+
+    if (image == NULL
+        || page < USER_VIRTUAL_ADDRESS_BASE
+        || index >= CHECKPOINT_WINDOW_FRAMES
+        || image->frame_offset[index] == 0) {
+        return false;
+    }
+
+    return ReadFileAt(image->file,
+                      frame,
+                      image->frame_offset[index],
+                      FRAME_SIZE) == FRAME_SIZE;
+}
+
+void InheritCheckpoint(Process *new_proc, Process *proc)
+{
+    new_proc->checkpoint = proc->checkpoint;
+
+    if (new_proc->checkpoint != NULL) {
+        new_proc->checkpoint->ref_count++;
+    }
+}
+
+void ReleaseCheckpoint(Process *proc)
+{
+    CheckpointImage *image = proc->checkpoint;
+
+    if (image == NULL) {
+        return;
+    }
+
+    proc->checkpoint = NULL;
+    image->ref_count--;
+
+    if (image->ref_count == 0) {
+        ReleaseFile(image->file);
+        FreeFrame(image);
+    }
+}
+
+/* Private function ----------------------------------------------------------*/
+static int CheckProcess(Process *proc)
+{
+    if (proc == NULL
+        || proc->state == PROCESS_SLOT_UNUSED
+        || proc->state == PROCESS_SLOT_ZOMBIE) {
+        return -ESRCH;
+    }
+
+    /* The threads and the ring workers of a process change its memory while
+     * it is saved. */
+    if ((proc->flags & (PROCESS_FLAG_KERNEL_THREAD | PROCESS_FLAG_THREAD))
+        || proc->image == NULL
+        || proc->first_thread != NULL
+        || proc->ring != NULL) {
+        return -EINVAL;
+    }
+
+    /* A process which never ran is still in spawn(), its registers aren't
+     * the ones of its program yet. */
+    if (proc != GetCurrentProcess()
+        && (proc->state == PROCESS_SLOT_RUNNING
+            || proc->usage.voluntary_switches
+               + proc->usage.involuntary_switches == 0)) {
+        return -EBUSY;
+    }
+
+    return 0;
+}
+
+static int SaveProcess(Process *proc,
+                       CheckpointHeader *header,
+                       char *frames)
+{
+    int status = 0;
+
+    memset(header, 0, FRAME_SIZE);
+    header->magic = CHECKPOINT_MAGIC;
+
+    GetFileName(proc->image, header->program);
+    header->program_cluster = proc->image->start_cluster;
+    header->program_size = proc->image->file_size;
+    header->runtime_build = GetRuntimeBuild(proc->page_map);
+
+    /* The trap frame is the one of the last entry to the kernel from user
+     * mode. The current process returns from checkpoint(), another one which
+     * is in a system call is interrupted. */
+    header->tf = *proc->tf;
+    if (proc == GetCurrentProcess()) {
+        header->tf.rax = CHECKPOINT_RESTORED;
+        header->fs_base = SaveFSBase();
+    } else {
+        if (proc->tf->trapno == SYSTEM_CALL_INTERRUPT_NUMBER
+            || proc->tf->trapno == SYSTEM_CALL_INSTRUCTION_TRAP) {
+            header->tf.rax = -EINTR;
+        }
+        header->fs_base = proc->fs_base;
+    }
+
+    header->vma_count = proc->vma_count;
+    memcpy(header->vma, proc->vma, sizeof(proc->vma));
+    header->nice = proc->nice;
+    header->priority = proc->priority;
+
+    status = SaveFiles(proc, header);
+    if (status < 0) {
+        return status;
+    }
+
+    for (int i = 0; i < CHECKPOINT_WINDOW_FRAMES; i++) {
+        void *frame = GetUserFrame(proc->page_map,
+                                   USER_VIRTUAL_ADDRESS_BASE + i * FRAME_SIZE);
+
+        if (frame != NULL) {
+            memcpy(&frames[header->frame_count * FRAME_SIZE],
+                   frame,
+                   FRAME_SIZE);
+            header->frame_count++;
+            header->frame_slot[i] = header->frame_count;
+        }
+    }
+
+    return 0;
+}
+
+static int SaveFiles(Process *proc, CheckpointHeader *header)
+{
+    for (int fd = USER_START_FD; fd < PROCESS_MAXIMUM_FILE_DESCRIPTOR; fd++) {
+        FD *file = proc->files->file[fd];
+        CheckpointFile *saved = &header->files[header->file_count];
+
+        if (file == NULL) {
+            continue;
+        }
+
+        if (header->file_count == CHECKPOINT_MAXIMUM_FILES) {
+            return -EMFILE;
+        }
+
+        saved->fd = fd;
+        saved->dup_of = -1;
+        saved->position = file->position;
+        GetFileName(file->fcb, saved->name);
+
+        for (int i = 0; i < header->file_count; i++) {
+            if (proc->files->file[header->files[i].fd] == file) {
+                saved->dup_of = header->files[i].fd;
+                break;
+            }
+        }
+
+        header->file_count++;
+    }
+
+    return 0;
+}
+
+static bool IsValidHeader(const CheckpointHeader *header, const FCB *fcb)
+{
+    if (header->magic != CHECKPOINT_MAGIC
+        || header->program[CHECKPOINT_NAME_SIZE - 1] != '\0'
+        || header->vma_count < 0
+        || header->vma_count > PROCESS_MAXIMUM_VMAS
+        || header->nice < 0
+        || header->nice > PROCESS_NICE_MAXIMUM
+        || header->priority < 0
+        || header->priority >= SCHEDULER_PRIORITY_LEVELS
+        || header->file_count < 0
+        || header->file_count > CHECKPOINT_MAXIMUM_FILES
+        || header->frame_count > CHECKPOINT_WINDOW_FRAMES
+        || (1 + header->frame_count) * FRAME_SIZE > fcb->file_size) {
+        return false;
+    }
+
+    /* The registers are loaded in the kernel, a non canonical rip, rsp or FS
+     * base would fault there. They are checked like CreateThread() and
+     * ArchPrctl() do. */
+    if (header->tf.rip < USER_RUNTIME_TEXT_BASE
+        || header->tf.rip >= USER_STACK_START
+        || header->tf.rsp <= USER_VIRTUAL_ADDRESS_BASE
+        || header->tf.rsp > USER_STACK_START
+        || (header->fs_base != 0
+            && (header->fs_base < USER_VIRTUAL_ADDRESS_BASE
+                || header->fs_base > USER_STACK_START - sizeof(uint64_t)))) {
+        return false;
+    }
+
+    for (int i = 0; i < header->vma_count; i++) {
+        if (header->vma[i].start < USER_VIRTUAL_ADDRESS_BASE
+            || header->vma[i].end > USER_STACK_START
+            || header->vma[i].start > header->vma[i].end) {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < header->file_count; i++) {
+        const CheckpointFile *file = &header->files[i];
+
+        if (file->fd < USER_START_FD
+            || file->fd >= PROCESS_MAXIMUM_FILE_DESCRIPTOR
+            || file->name[CHECKPOINT_NAME_SIZE - 1] != '\0') {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < CHECKPOINT_WINDOW_FRAMES; i++) {
+        if (header->frame_slot[i] > header->frame_count) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static FCB *OpenProgram(Process *proc,
+                        const CheckpointHeader *header,
+                        int *status)
+{
+    FCB *fcb = NULL;
+    int fd = 0;
+
+    fd = Open(proc, header->program);
+    if (fd < 0) {
+        *status = -ENOENT;
+        return NULL;
+    }
+
+    /* The frames which weren't saved are read from the program, at the
+     * offsets of the areas of the checkpoint. */
+    fcb = proc->files->file[fd]->fcb;
+    if (fcb->start_cluster != header->program_cluster
+        || fcb->file_size != header->program_size) {
+        Close(proc, fd);
+        *status = -ESTALE;
+        return NULL;
+    }
+
+    RetainFile(fcb);
+    Close(proc, fd);
+
+    return fcb;
+}
+
+static int RestoreFiles(Process *proc, const CheckpointHeader *header)
+{
+    for (int i = 0; i < header->file_count; i++) {
+        const CheckpointFile *file = &header->files[i];
+        int fd = 0;
+
+        /* The lower descriptor was restored first. */
+        if (file->dup_of >= 0) {
+            fd = DupFile(proc, file->dup_of, file->fd);
+            if (fd < 0) {
+                return -ENOEXEC;
+            }
+            continue;
+        }
+
+        fd = Open(proc, file->name);
+        if (fd < 0) {
+            return -ENOENT;
+        }
+
+        /* The descriptors are restored in order, so a new one is never a
+         * restored one. */
+        if (fd != file->fd) {
+            DupFile(proc, fd, file->fd);
+            Close(proc, fd);
+        }
+
+        proc->files->file[file->fd]->position = file->position;
+    }
+
+    return 0;
+}
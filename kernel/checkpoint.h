@@ -0,0 +1,109 @@
+/**
+ * @file    checkpoint.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Process checkpoint and restore. A job which takes long to set up
+ *          (tables to compute, files to parse, etc.) can save itself to a
+ *          file once it is ready, and be restarted from there later, without
+ *          its initialization.
+ *
+ *          checkpoint(pid, path) saves a process to the file `path`:
+ *          + the frames of its user window which are mapped, the frames of
+ *            the program which it never touched stay in the program file,
+ *          + its registers and TLS base, its virtual memory areas and the
+ *            name of its program,
+ *          + the name and the position of its opened files,
+ *          + its nice value and its priority level.
+ *
+ *          restore(path) creates a child of the caller from the file, like
+ *          spawn() does. Nothing is read but the header: the saved frames are
+ *          read from the checkpoint file at the first page fault on them, the
+ *          others from the program file, like a new program. The files are
+ *          opened again at the same descriptors and positions.
+ *
+ *          Checkpoint file:
+ *           |  frame N-1       |
+ *           |      ...         |
+ *           |  frame 0         |   saved frames, in address order
+ *           |  header          |   one frame, see CheckpointHeader
+ *
+ *          + The file system can't allocate clusters, so the checkpoint file
+ *            must exist and be large enough: (1 + frames) * FRAME_SIZE bytes,
+ *            at most 2MB + 4KB for the whole user window.
+ *          + The process must be single-threaded, without rings, and not
+ *            running on another CPU. A process which checkpoints itself
+ *            returns 0 from checkpoint(), and CHECKPOINT_RESTORED once it is
+ *            restored. A process which was in a system call returns -EINTR
+ *            from it once it is restored.
+ *          + The program must not change between checkpoint and restore, and
+ *            the shared runtime must be the same build.
+ *          + A real-time process is restored as a normal one, its admission
+ *            depends on the load at the time, it asks again.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include "process.h"
+
+/* Public define -------------------------------------------------------------*/
+#define CHECKPOINT_MAXIMUM_FILES        16
+/* checkpoint() returns it in a process restored from its own checkpoint. */
+#define CHECKPOINT_RESTORED             1
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Save the process `pid`, or the current process if `pid` is 0, to
+ *          the file `path`.
+ *
+ * @return  0       - Success.
+ *          -ESRCH  - No such process.
+ *          -EINVAL - The process is a thread, init or a kernel thread, or it
+ *                    has threads or rings.
+ *          -EBUSY  - The process runs on another CPU, or it never ran.
+ *          -EMFILE - The process has more than CHECKPOINT_MAXIMUM_FILES files
+ *                    opened.
+ *          -ENOENT - The file doesn't exist.
+ *          -ETXTBSY- The file is opened, or a process is restored from it.
+ *          -ENOSPC - The file is too small.
+ *          -ENOMEM - Out of memory.
+ */
+int Checkpoint(int pid, const char *path);
+
+/**
+ * @brief   Rebuild a process which restore() creates from the checkpoint file
+ *          `path`: set its registers, its program, its files and its
+ *          scheduling state. Its file descriptor table is empty.
+ *
+ * @return  0       - Success.
+ *          -ENOENT - The checkpoint file, the program or a file of the process
+ *                    doesn't exist.
+ *          -ENOEXEC- The file isn't a checkpoint, its registers are outside
+ *                    the user window, or the runtime isn't the same build.
+ *          -ESTALE - The program changed since the checkpoint.
+ *          -ENOMEM - Out of memory.
+ */
+int LoadCheckpoint(Process *proc, const char *path);
+
+/**
+ * @brief   Fill a frame of a restored process from its checkpoint file, if the
+ *          frame was saved.
+ *
+ * @param   page    - User virtual address of the frame.
+ * @return  true if the frame was read from the checkpoint.
+ */
+bool ReadCheckpointFrame(Process *proc, uint64_t page, void *frame);
+
+/**
+ * @brief   Share the checkpoint file of `proc` with `new_proc`, it is used by
+ *          fork(), like the program file.
+ */
+void InheritCheckpoint(Process *new_proc, Process *proc);
+
+/**
+ * @brief   Release the checkpoint file held by the process, it may have none.
+ */
+void ReleaseCheckpoint(Process *proc);
@@ -0,0 +1,206 @@
+#include <stddef.h>
+
+#include "cpu.h"
+#include "trap.h"
+#include "common.h"
+
+/* Private define ------------------------------------------------------------*/
+#define CPUID_STRUCTURED_FEATURES               7
+#define CPUID_STRUCTURED_FEATURE_FSGSBASE       BIT(0)      /* EBX.           */
+#define CR4_FSGSBASE                            BIT(16)
+#define CPUID_FEATURES                          1
+#define CPUID_FEATURE_APIC_ID_SHIFT             24          /* EBX.           */
+
+/* Descriptors of kernel.asm. */
+#define GDT_KERNEL_CODE                         0x0020980000000000ULL
+#define GDT_KERNEL_DATA                         0x0000920000000000ULL
+#define GDT_USER_DATA                           0x0000F20000000000ULL
+#define GDT_USER_CODE                           0x0020F80000000000ULL
+
+/* SYSCALL clears these flags, the interrupts stay disabled until the trap
+ * frame is built and SystemCall() enables them. */
+#define SYSCALL_FLAGS_MASK                      (BIT(8)     /* TF. */       \
+                                                 | BIT(9)   /* IF. */       \
+                                                 | BIT(10)  /* DF. */       \
+                                                 | BIT(18)) /* AC. */
+#define GDT_TSS_AVAILABLE                       0x89ULL     /* P=1, TYPE=1001.*/
+
+/* Private type --------------------------------------------------------------*/
+typedef struct {
+    uint16_t limit;
+    uint64_t address;
+} __attribute__ ((packed)) GDTPointer;
+
+/* The SYSCALL entry of trap.asm reaches these fields with fixed offsets. */
+_Static_assert(offsetof(CPU, kernel_stack) == CPU_KERNEL_STACK_OFFSET,
+               "CPU_KERNEL_STACK_OFFSET");
+_Static_assert(offsetof(CPU, user_stack) == CPU_USER_STACK_OFFSET,
+               "CPU_USER_STACK_OFFSET");
+
+/* Private variable ----------------------------------------------------------*/
+extern TSS TaskStateSegment; /* Extern from ASM. */
+static CPU s_cpus[CPU_MAXIMUM];
+static int s_cpu_count = 1;
+static bool s_has_fsgsbase = false;
+
+/* Private function prototypes -----------------------------------------------*/
+/**
+ * @brief   Point the GS base to the per-CPU data, and clear the user bases.
+ */
+static void LoadCPUBases(CPU *cpu);
+
+static uint8_t ReadInitialAPICId(void);
+
+/**
+ * @brief   Enable the SYSCALL instruction, it enters the kernel at
+ *          SystemCallEntry.
+ */
+static void EnableSystemCall(void);
+
+/* Public function -----------------------------------------------------------*/
+void InitCPU(void)
+{
+    CPU *cpu = &s_cpus[BOOT_CPU_ID];
+    uint32_t regs[4] = {0};
+
+    cpu->self = cpu;
+    cpu->id = BOOT_CPU_ID;
+    cpu->tss = &TaskStateSegment;
+    cpu->fs_base = 0;
+    cpu->apic_id = ReadInitialAPICId();
+    cpu->started = true;
+    cpu->online = true;
+
+    LoadCPUBases(cpu);
+    EnableSystemCall();
+
+    CPUID(0, regs);
+    if (regs[0] < CPUID_STRUCTURED_FEATURES) {
+        return;
+    }
+
+    CPUID(CPUID_STRUCTURED_FEATURES, regs);
+    if (regs[1] & CPUID_STRUCTURED_FEATURE_FSGSBASE) {
+        WriteCR4(ReadCR4() | CR4_FSGSBASE);
+        s_has_fsgsbase = true;
+    }
+}
+
+uint64_t SaveFSBase(void)
+{
+    CPU *cpu = GetCPU();
+
+    /* With FSGSBASE, the user can change its base without the kernel. */
+    if (s_has_fsgsbase) {
+        cpu->fs_base = ReadFSBase();
+    }
+
+    return cpu->fs_base;
+}
+
+void LoadFSBase(uint64_t base)
+{
+    CPU *cpu = GetCPU();
+
+    if (s_has_fsgsbase) {
+        WriteFSBase(base);
+    } else if (cpu->fs_base != base) {
+        /* The MSR write is slow, only the kernel changes the base here. */
+        WriteMSR(MSR_FS_BASE, base);
+    }
+
+    cpu->fs_base = base;
+}
+
+CPU *AddCPU(uint8_t apic_id)
+{
+    CPU *cpu = NULL;
+
+    if (s_cpu_count == CPU_MAXIMUM) {
+        return NULL;
+    }
+
+    cpu = &s_cpus[s_cpu_count];
+    cpu->self = cpu;
+    cpu->id = s_cpu_count;
+    cpu->apic_id = apic_id;
+    cpu->tss = &cpu->task_state;
+    s_cpu_count++;
+
+    return cpu;
+}
+
+void InitSecondaryCPU(CPU *cpu)
+{
+    uint64_t base = (uint64_t)&cpu->task_state;
+    uint64_t limit = sizeof(TSS) - 1;
+    GDTPointer pointer = {0};
+
+    /* The same descriptors as the boot CPU, but its own TSS, with no I/O
+     * permission bitmap. */
+    cpu->task_state.iopb = sizeof(TSS);
+    cpu->gdt[0] = 0;
+    cpu->gdt[1] = GDT_KERNEL_CODE;
+    cpu->gdt[2] = GDT_KERNEL_DATA;
+    cpu->gdt[3] = GDT_USER_DATA;
+    cpu->gdt[4] = GDT_USER_CODE;
+    cpu->gdt[5] = (limit & 0xFFFF)
+                  | (base & 0xFFFFFF) << 16
+                  | GDT_TSS_AVAILABLE << 40
+                  | ((limit >> 16) & 0xF) << 48
+                  | ((base >> 24) & 0xFF) << 56;
+    cpu->gdt[6] = base >> 32;
+
+    pointer.limit = sizeof(cpu->gdt) - 1;
+    pointer.address = (uint64_t)cpu->gdt;
+    LoadGDT(&pointer);
+    LoadTR(TSS_SELECTOR);
+
+    LoadCPUBases(cpu);
+    EnableSystemCall();
+
+    if (s_has_fsgsbase) {
+        WriteCR4(ReadCR4() | CR4_FSGSBASE);
+    }
+}
+
+CPU *GetCPUById(int id)
+{
+    return &s_cpus[id];
+}
+
+int GetCPUCount(void)
+{
+    return s_cpu_count;
+}
+
+/* Private function ----------------------------------------------------------*/
+static void LoadCPUBases(CPU *cpu)
+{
+    /* The kernel runs with its GS base, the user one is swapped in by the
+     * first return to ring 3. */
+    WriteMSR(MSR_GS_BASE, (uint64_t)cpu);
+    WriteMSR(MSR_KERNEL_GS_BASE, 0);
+    WriteMSR(MSR_FS_BASE, 0);
+}
+
+static uint8_t ReadInitialAPICId(void)
+{
+    uint32_t regs[4] = {0};
+
+    CPUID(CPUID_FEATURES, regs);
+
+    return regs[1] >> CPUID_FEATURE_APIC_ID_SHIFT;
+}
+
+static void EnableSystemCall(void)
+{
+    /* SYSCALL loads CS from STAR[47:32] and SS 8 above it, SYSRET loads SS
+     * from STAR[63:48] + 8 and CS 16 above it. */
+    WriteMSR(MSR_STAR,
+             (uint64_t)(USER_DATA_SELECTOR - 8) << 48
+             | (uint64_t)KERNEL_CODE_SELECTOR << 32);
+    WriteMSR(MSR_LSTAR, (uint64_t)SystemCallEntry);
+    WriteMSR(MSR_SFMASK, SYSCALL_FLAGS_MASK);
+    WriteMSR(MSR_EFER, ReadMSR(MSR_EFER) | EFER_SYSTEM_CALL_ENABLE);
+}
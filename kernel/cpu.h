@@ -0,0 +1,197 @@
+/**
+ * @file    cpu.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Per-CPU data and the FS base of the user threads.
+ *
+ *          The kernel keeps the data of the CPU it runs on at the GS base, so
+ *          it is reached with one `gs:` access instead of a global. GS belongs
+ *          to the kernel only: the user GS base waits in the kernel GS base
+ *          MSR, and the trap entry executes `swapgs` when it comes from ring 3,
+ *          as does the trap return before it goes back to ring 3:
+ *
+ *                          GS base         kernel GS base
+ *           ring 3         user (0)        per-CPU data
+ *           ring 0         per-CPU data    user (0)
+ *
+ *          FS belongs to user space, the FS base of a thread points to its
+ *          thread-local storage. It is part of the context of the thread,
+ *          which is saved and loaded by the context switch. When the CPU has
+ *          FSGSBASE, the base is read and written with rdfsbase/wrfsbase (a
+ *          few cycles) instead of the FS base MSR, but the user can change it
+ *          too, so it is read back when the thread is switched out.
+ *
+ *          The boot CPU uses the GDT and the TSS of kernel.asm, every
+ *          secondary CPU has its own copy of the GDT in its per-CPU data,
+ *          with the same selectors, pointing to its own TSS, so each CPU
+ *          enters the kernel on the stack of the process it runs.
+ *
+ *          The descriptors are in the order SYSCALL and SYSRET expect them:
+ *          SYSCALL loads the kernel code selector from STAR and the kernel
+ *          data one right after it, SYSRET the user data selector and the
+ *          user code one right after it. SYSCALL doesn't switch the stack,
+ *          the entry takes the kernel stack from the per-CPU data.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "common.h"
+
+/* Public define -------------------------------------------------------------*/
+#define MSR_EFER                        0xC0000080
+#define MSR_STAR                        0xC0000081
+#define MSR_LSTAR                       0xC0000082
+#define MSR_SFMASK                      0xC0000084
+#define MSR_FS_BASE                     0xC0000100
+#define MSR_GS_BASE                     0xC0000101
+#define MSR_KERNEL_GS_BASE              0xC0000102
+
+#define EFER_SYSTEM_CALL_ENABLE         BIT(0)
+#define EFER_NO_EXECUTE_ENABLE          BIT(11)
+
+/* Supervisor writes to read-only user pages fault, for copy-on-write. */
+#define CR0_WRITE_PROTECT               BIT(16)
+
+#define CPU_MAXIMUM                     8
+#define BOOT_CPU_ID                     0
+/* Null, kernel code and data, user data and code, and the TSS which takes
+ * two. */
+#define CPU_GDT_ENTRIES                 7
+#define KERNEL_CODE_SELECTOR            0x08
+#define KERNEL_DATA_SELECTOR            0x10
+#define USER_DATA_SELECTOR              (0x18 | 3)
+#define USER_CODE_SELECTOR              (0x20 | 3)
+#define TSS_SELECTOR                    0x28
+
+/* Offsets of the CPU fields which the system call entry uses. */
+#define CPU_KERNEL_STACK_OFFSET         8
+#define CPU_USER_STACK_OFFSET           16
+
+/* Public type ---------------------------------------------------------------*/
+/**
+ * @brief   The TSS (Task state segment) structure is used only for setting up
+ *          stack pointer for ring 0.
+ */
+typedef struct {
+    uint32_t res0;
+    uint64_t rsp0;
+    uint64_t rsp1;
+    uint64_t rsp2;
+    uint64_t res1;
+    uint64_t ist1;
+    uint64_t ist2;
+    uint64_t ist3;
+    uint64_t ist4;
+    uint64_t ist5;
+    uint64_t ist6;
+    uint64_t ist7;
+    uint64_t res2;
+    uint16_t res3;
+    uint16_t iopb;
+} __attribute__ ((packed)) TSS;
+
+/**
+ * @brief   Data of one CPU, at its GS base while it runs the kernel.
+ *
+ * @property self       - Address of the structure, read by GetCPU().
+ * @property kernel_stack - Top of the kernel stack of the running process,
+ *                          like the rsp0 of the TSS, for SYSCALL.
+ * @property user_stack - User stack pointer, saved by the SYSCALL entry until
+ *                        it is on the kernel stack.
+ * @property id         - CPU number, 0 for the boot CPU.
+ * @property tss        - Task state segment of the CPU.
+ * @property fs_base    - FS base loaded in the CPU.
+ * @property apic_id    - ID of the local APIC of the CPU.
+ * @property started    - The CPU runs the kernel code, the boot CPU can
+ *                        start the next one.
+ * @property online     - The CPU runs processes.
+ * @property gdt        - GDT of a secondary CPU.
+ * @property task_state - TSS of a secondary CPU.
+ * @property timer_event - Clock time programmed in the local APIC timer, 0
+ *                         if it is stopped.
+ * @property next_tick  - Clock time of the next scheduler tick, 0 while the
+ *                        CPU doesn't tick.
+ */
+typedef struct CPU {
+    struct CPU *self;
+    uint64_t kernel_stack;
+    uint64_t user_stack;
+    int id;
+    TSS *tss;
+    uint64_t fs_base;
+    uint8_t apic_id;
+    volatile bool started;
+    volatile bool online;
+    uint64_t gdt[CPU_GDT_ENTRIES];
+    TSS task_state;
+    uint64_t timer_event;
+    uint64_t next_tick;
+} CPU;
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Set up the per-CPU data of the boot CPU at the GS base, and enable
+ *          FSGSBASE if the CPU has it.
+ */
+void InitCPU(void);
+
+/**
+ * @brief   Data of the running CPU (gs:0).
+ */
+CPU *GetCPU(void);
+
+/**
+ * @brief   Take the per-CPU data of a new secondary CPU.
+ *
+ * @return  The data, or NULL if there are already CPU_MAXIMUM CPUs.
+ */
+CPU *AddCPU(uint8_t apic_id);
+
+/**
+ * @brief   Load the GDT, the TSS and the GS base of a secondary CPU, it runs on
+ *          the CPU itself.
+ */
+void InitSecondaryCPU(CPU *cpu);
+
+/**
+ * @brief   Data of the CPU number `id`, below GetCPUCount().
+ */
+CPU *GetCPUById(int id);
+
+/**
+ * @brief   Number of CPUs which were added, they may not be online.
+ */
+int GetCPUCount(void);
+
+/**
+ * @brief   FS base of the user thread which runs on the CPU, it is called
+ *          when the thread is switched out.
+ */
+uint64_t SaveFSBase(void);
+
+/**
+ * @brief   Load the FS base of the user thread which runs next on the CPU.
+ */
+void LoadFSBase(uint64_t base);
+
+/**
+ * @brief   Access control and segment base registers.
+ */
+uint64_t ReadCR0(void);
+void WriteCR0(uint64_t value);
+uint64_t ReadCR4(void);
+void WriteCR4(uint64_t value);
+uint64_t ReadFSBase(void);
+void WriteFSBase(uint64_t base);
+
+/**
+ * @brief   Load the GDT and reload the segment registers but FS and GS, and
+ *          load the task register.
+ */
+void LoadGDT(void *pointer);
+void LoadTR(uint16_t selector);
@@ -1,8 +1,35 @@
 #include "disk.h"
+#include "io.h"
+#include "process.h"
+#include "spinlock.h"
+
+/* Private define ------------------------------------------------------------*/
+#define DISK_STATUS_BUSY                0x80
+#define DISK_STATUS_DATA_REQUEST        0x08
+#define DISK_COMMAND_READ               0x20
+#define DISK_COMMAND_WRITE              0x30
+#define DISK_COMMAND_FLUSH_CACHE        0xE7
+
+/* Private variable ----------------------------------------------------------*/
+/* A process can be preempted in the middle of a transfer, the disk stays its
+ * own until the end of it. */
+static bool s_disk_busy = false;
+static WaitQueue s_disk_wait_queue;
+
+/* Private function prototypes -----------------------------------------------*/
+static void AcquireDisk(void);
+static void ReleaseDisk(void);
+
+/**
+ * @brief   Wait until the disk is not busy anymore, and return its status.
+ */
+static uint8_t WaitDiskReady(void);
 
 /* Public function -----------------------------------------------------------*/
 int DiskReadSectors(int lba, int sectors, void *buf)
 {
+    AcquireDisk();
+
     OutByte(0x1F6, (lba >> 24) | 0b11100000);    /* Port to send drive and bit
                                                   * 24 - 27 of LBA. */
     OutByte(0x1F2, sectors);                     /* Port to send number of
@@ -13,7 +40,7 @@ int DiskReadSectors(int lba, int sectors, void *buf)
                                                   * LBA. */
     OutByte(0x1F5, (uint8_t)(lba >> 16));        /* Port to send bit 16 - 23 of
                                                   * LBA. */
-    OutByte(0x1F7, 0x20);                        /* Command port, read with
+    OutByte(0x1F7, DISK_COMMAND_READ);           /* Command port, read with
                                                   * retry. */
                                                  /* 0x20 - READ SECTORS(S) */
                                                  /* 0x30 - WRITE SECTORS(S) */
@@ -39,5 +66,76 @@ int DiskReadSectors(int lba, int sectors, void *buf)
         }
     }
 
+    ReleaseDisk();
+
+    return 0;
+}
+
+int DiskWriteSectors(int lba, int sectors, const void *buf)
+{
+    const uint16_t *ptr = (const uint16_t *)buf;
+
+    AcquireDisk();
+
+    OutByte(0x1F6, (lba >> 24) | 0b11100000);
+    OutByte(0x1F2, sectors);
+    OutByte(0x1F3, (uint8_t)(lba & 0b11111111));
+    OutByte(0x1F4, (uint8_t)(lba >> 8));
+    OutByte(0x1F5, (uint8_t)(lba >> 16));
+    OutByte(0x1F7, DISK_COMMAND_WRITE);
+
+    for (int s = 0; s < sectors; s++) {
+        /* The disk asks for each sector once it took the previous one. */
+        while (!(WaitDiskReady() & DISK_STATUS_DATA_REQUEST)) {
+        }
+
+        for (int i = 0; i < 256; i++) {
+            OutWord(0x1F0, *ptr);
+            ptr++;
+        }
+    }
+
+    /* The sectors may still be in the cache of the disk, they are on the
+     * medium once the flush is done. */
+    WaitDiskReady();
+    OutByte(0x1F7, DISK_COMMAND_FLUSH_CACHE);
+    WaitDiskReady();
+
+    ReleaseDisk();
+
     return 0;
 }
+
+void DiskInterrupt(void)
+{
+    InByte(0x1F7);                               /* Status port. */
+}
+
+/* Private function ----------------------------------------------------------*/
+static void AcquireDisk(void)
+{
+    uint64_t flags = SaveInterrupts();
+
+    while (s_disk_busy) {
+        SleepOn(&s_disk_wait_queue);
+    }
+    s_disk_busy = true;
+    RestoreInterrupts(flags);
+}
+
+static void ReleaseDisk(void)
+{
+    s_disk_busy = false;
+    WakeUpOne(&s_disk_wait_queue);
+}
+
+static uint8_t WaitDiskReady(void)
+{
+    uint8_t status = InByte(0x1F7);
+
+    while (status & DISK_STATUS_BUSY) {
+        status = InByte(0x1F7);
+    }
+
+    return status;
+}
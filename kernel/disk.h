@@ -38,7 +38,8 @@
 /**
  * @brief       Read number of sectors from hard disk to memory. Each sector can
  *              be read into memory and is given a LBA (Logic Block Address)
- *              number.
+ *              number. A process which is preempted in the middle of a
+ *              transfer keeps the disk, the others sleep until it is done.
  * 
  * @param[in] lba       - Sector number.
  * @param[in] sectors   - Number of sectors to read.
@@ -46,3 +47,21 @@
  * @return int          - Zero if success.
  */
 int DiskReadSectors(int lba, int sectors, void *buf);
+
+/**
+ * @brief       Write number of sectors from memory to hard disk, and flush the
+ *              write cache of the disk, so they are on the medium when it
+ *              returns. The disk is held like in DiskReadSectors().
+ *
+ * @param[in] lba       - Sector number.
+ * @param[in] sectors   - Number of sectors to write, 1 to 255.
+ * @param[in] buf       - Buffer data.
+ * @return int          - Zero if success.
+ */
+int DiskWriteSectors(int lba, int sectors, const void *buf);
+
+/**
+ * @brief       Acknowledge the interrupt of the disk, by reading its status.
+ *              The driver polls the disk, so there is nothing else to do.
+ */
+void DiskInterrupt(void);
@@ -5,29 +5,40 @@
 
 #include "file.h"
 #include "disk.h"
+#include "keyboard.h"
 #include "assert.h"
 #include "memory.h"
 #include "printk.h"
+#include "spinlock.h"
+#include "template.h"
 
 /* Private define ------------------------------------------------------------*/
 #define ENTRY_EMPTY         0
 #define ENTRY_DELETED       0xE5
 #define START_CLUSTER_INDEX 2
+#define FILE_WRITE_MAXIMUM_SECTORS 128
 
 /* Private variable ----------------------------------------------------------*/
 static BPB s_BIOS_parameter_block = {0};
 static FCB *s_fcb_table = NULL;
 static FD *s_fd_table = NULL;
+/* The FCB and FD tables, and the counters of their entries, are shared by all
+ * the CPUs. The disk is read out of the lock, which is IRQ-safe. */
+static Spinlock s_file_lock = SPINLOCK_INITIALIZER;
 
 /* Private function prototype ------------------------------------------------*/
 BPB *GetBPB(void);
 
-int FindFileInRootDir(const char *filename, DirEntry* entry);
-
 static void GetRelativeFileName(DirEntry* entry, char *buf);
 
 static void ReadFileData(int start_cluster, int length, void *buf);
 
+/**
+ * @brief   Drop a reference to a file descriptor entry, the caller holds the
+ *          file lock.
+ */
+static void ReleaseFD(FD *fd);
+
 /**
  * @brief   We allocate a memory page for FCB table, so the maximum entries of
  *          this table is PAGE_SIZE / sizeof(FCB).
@@ -105,6 +116,10 @@ static inline int GetSignature(void)
 
 static int
 ReadRawData(uint32_t cluster_index, char *buf, uint32_t pos, uint32_t size);
+static int WriteRawData(uint32_t cluster_index,
+                        const char *buf,
+                        uint32_t pos,
+                        uint32_t size);
 
 /* Public function  ----------------------------------------------------------*/
 void InitFileSystem(void)
@@ -121,8 +136,8 @@ void InitFileSystem(void)
     uint16_t boot_signature = (((uint16_t)boot_signature_1) << 8)
                                 | boot_signature_2;
 
-    printk("Boot signature: %x\n", boot_signature);
-    printk("FAT16 signature: %x\n", GetSignature());
+    printk("Boot signature: %#x\n", boot_signature);
+    printk("FAT16 signature: %#x\n", GetSignature());
 
     ASSERT(boot_signature == 0x55AA);
     ASSERT(GetSignature() == 0x29);
@@ -130,10 +145,10 @@ void InitFileSystem(void)
     kfree(bpb);
 
     /* 2. Calculate root directory address. */
-    printk("FAT16 Root Directory base address: %x\n",
+    printk("FAT16 Root Directory base address: %#x\n",
            GetRootDirectoryStartSector() * GetBytesPerSector());
 
-    printk("FAT16 DATA region base address: %x\n",
+    printk("FAT16 DATA region base address: %#x\n",
             GetDataRegionStartSector() * GetBytesPerSector());
 
     /* 3. Initialize File control block table and file descriptor table. */
@@ -148,10 +163,34 @@ int Open(Process* proc, const char *file_name)
     int fd = -1;
     int file_desc_index = -1;
     int entry_index = 0;
+    uint64_t flags = 0;
+
+    /* 1. Find the file on the disk. And we use the entry index for the file
+          control block index and file descriptor index also. */
+    DirEntry entry = {0};
+    entry_index = FindFileInRootDir(file_name, &entry);
+    if (entry_index < 0) {
+        /* Not found the file on the disk. */
+        return -ENOENT;
+    }
+
+    if (entry.cluster_index < START_CLUSTER_INDEX) {
+        /* Sometime, when the file is just created, we can find it in root
+         * directory, but the data is not wrote to data section yet, so cluster
+         * index maybe is 0. In this case we will send a error to user.
+         * TODO: Return a try again error code. */
+        return -EAGAIN;
+    }
+
+    /* A template of an older version of the file releases its file control
+     * block, it is set up again below if nothing else holds it. */
+    CheckTemplates(entry_index, &entry);
+
+    flags = AcquireSpinlockIRQ(&s_file_lock);
 
-    /* 1. Find a file entry in the process. */
+    /* 2. Find a file entry in the process. */
     for (int i = USER_START_FD; i < PROCESS_MAXIMUM_FILE_DESCRIPTOR; i++) {
-        if (proc->file[i] == NULL) {
+        if (proc->files->file[i] == NULL) {
             fd = i;
             break;
         }
@@ -159,10 +198,11 @@ int Open(Process* proc, const char *file_name)
 
     if (fd == -1) {
         /* The process opened maximum files. */
+        ReleaseSpinlockIRQ(&s_file_lock, flags);
         return -EMFILE;
     }
 
-    /* 2. Find the table entry for FD. */
+    /* 3. Find the table entry for FD. */
     for (int i = 0; i < GetMaxEntriesOfFDTable(); i++) {
         if (s_fd_table[i].fcb == NULL) {
             file_desc_index = i;
@@ -172,26 +212,10 @@ int Open(Process* proc, const char *file_name)
 
     if (file_desc_index == -1) {
         /* No entry available. */
+        ReleaseSpinlockIRQ(&s_file_lock, flags);
         return -ENOMEM;
     }
 
-    /* 3. Find the file on the disk. And we use the entry index for the file
-          control block index and file descriptor index also. */
-    DirEntry entry = {0};
-    entry_index = FindFileInRootDir(file_name, &entry);
-    if (entry_index < 0) {
-        /* Not found the file on the disk. */
-        return -ENOENT;
-    }
-
-    if (entry.cluster_index < START_CLUSTER_INDEX) {
-        /* Sometime, when the file is just created, we can find it in root
-         * directory, but the data is not wrote to data section yet, so cluster
-         * index maybe is 0. In this case we will send a error to user.
-         * TODO: Return a try again error code. */
-        return -EAGAIN;
-    }
-
     /* 4. Update file control block entry. */
     if (s_fcb_table[entry_index].open_count == 0) {
         /* If this file is not opened yet, we setup the entry in FCB table. */
@@ -211,67 +235,207 @@ int Open(Process* proc, const char *file_name)
     s_fd_table[file_desc_index].open_count = 1;
 
     /* 6. Link the process file descriptor to the file descriptor entry. */
-    proc->file[fd] = &s_fd_table[file_desc_index];
+    proc->files->file[fd] = &s_fd_table[file_desc_index];
+
+    ReleaseSpinlockIRQ(&s_file_lock, flags);
 
     return fd;
 }
 
 void Close(Process* proc, int fd)
 {
-    if (proc->file[fd] == NULL) {
-        return;
+    uint64_t flags = AcquireSpinlockIRQ(&s_file_lock);
+
+    if (proc->files->file[fd] != NULL) {
+        ReleaseFD(proc->files->file[fd]);
+        proc->files->file[fd] = NULL;
     }
 
-    ASSERT (proc->file[fd]->fcb->open_count > 0);
-    proc->file[fd]->fcb->open_count--;
-    proc->file[fd]->open_count--;
+    ReleaseSpinlockIRQ(&s_file_lock, flags);
+}
 
-    /* We don't clear file control block, because, when the file is opened, the
-     * file data is cached in the table, and then we can easily retrieve th file
-     * info. */
-    if (proc->file[fd]->open_count == 0) {
-        /* If the FD count is zero, mean fd entry is not used, we save it to
-         * NULL. Otherwise, the file descriptor entry is used by others and we
-         * leave the FCB pointer unchanged. */
-        proc->file[fd]->fcb = NULL;
+int DupFile(Process *proc, int fd, int new_fd)
+{
+    uint64_t flags = 0;
+    FD *file = NULL;
+
+    if (fd < USER_START_FD || fd >= PROCESS_MAXIMUM_FILE_DESCRIPTOR
+        || new_fd < USER_START_FD || new_fd >= PROCESS_MAXIMUM_FILE_DESCRIPTOR) {
+        return -EBADF;
     }
 
-    proc->file[fd] = NULL;
+    flags = AcquireSpinlockIRQ(&s_file_lock);
+
+    file = proc->files->file[fd];
+    if (file == NULL) {
+        ReleaseSpinlockIRQ(&s_file_lock, flags);
+        return -EBADF;
+    }
+
+    /* The new descriptor shares the position with the old one. */
+    if (new_fd != fd) {
+        if (proc->files->file[new_fd] != NULL) {
+            ReleaseFD(proc->files->file[new_fd]);
+        }
+
+        file->fcb->open_count++;
+        file->open_count++;
+        proc->files->file[new_fd] = file;
+    }
+
+    ReleaseSpinlockIRQ(&s_file_lock, flags);
+
+    return new_fd;
+}
+
+void ShareFiles(Process *new_proc, Process *proc)
+{
+    uint64_t flags = AcquireSpinlockIRQ(&s_file_lock);
+
+    /* Copy FD table, so the new process will point to same FD entries. */
+    memcpy(new_proc->files, proc->files, sizeof(ProcessFiles));
+
+    for (int i = USER_START_FD; i < PROCESS_MAXIMUM_FILE_DESCRIPTOR; i++) {
+        if (new_proc->files->file[i] != NULL) {
+            /* We increase counters, means the new process will use them also. */
+            new_proc->files->file[i]->fcb->open_count++;
+            new_proc->files->file[i]->open_count++;
+        }
+    }
+
+    ReleaseSpinlockIRQ(&s_file_lock, flags);
+}
+
+void CloseFiles(Process *proc)
+{
+    uint64_t flags = AcquireSpinlockIRQ(&s_file_lock);
+
+    for (int i = USER_START_FD; i < PROCESS_MAXIMUM_FILE_DESCRIPTOR; i++) {
+        if (proc->files->file[i] != NULL) {
+            ReleaseFD(proc->files->file[i]);
+            proc->files->file[i] = NULL;
+        }
+    }
+
+    ReleaseSpinlockIRQ(&s_file_lock, flags);
+}
+
+void RetainFile(FCB *fcb)
+{
+    uint64_t flags = AcquireSpinlockIRQ(&s_file_lock);
+
+    fcb->open_count++;
+    ReleaseSpinlockIRQ(&s_file_lock, flags);
+}
+
+void ReleaseFile(FCB *fcb)
+{
+    uint64_t flags = AcquireSpinlockIRQ(&s_file_lock);
+
+    ASSERT(fcb->open_count > 0);
+    fcb->open_count--;
+    ReleaseSpinlockIRQ(&s_file_lock, flags);
 }
 
 int Read(Process* proc, int fd, void *buffer, int size)
 {
     uint32_t read_size;
 
-    if (proc->file[fd] == NULL) {
+    if (proc->files->file[fd] == NULL) {
         return -EBADF;
     }
 
-    uint32_t position = proc->file[fd]->position;
-    uint32_t file_size = proc->file[fd]->fcb->file_size;
+    uint32_t position = proc->files->file[fd]->position;
+    uint32_t file_size = proc->files->file[fd]->fcb->file_size;
 
     if (position + size > file_size) {
         /* Read the rest of file. */
         size = file_size - position;
     }
 
-    read_size = ReadRawData(proc->file[fd]->fcb->start_cluster,
+    read_size = ReadRawData(proc->files->file[fd]->fcb->start_cluster,
                             buffer,
                             position,
                             size);
 
-    proc->file[fd]->position += read_size;
+    proc->files->file[fd]->position += read_size;
 
     return read_size;
 }
 
+int ReadFileAt(FCB *fcb, void *buffer, uint32_t pos, uint32_t size)
+{
+    if (pos >= fcb->file_size) {
+        return 0;
+    }
+
+    if (pos + size > fcb->file_size) {
+        size = fcb->file_size - pos;
+    }
+
+    return ReadRawData(fcb->start_cluster, buffer, pos, size);
+}
+
+int WriteFileAt(FCB *fcb, const void *buffer, uint32_t pos, uint32_t size)
+{
+    /* The clusters of the file are all the space it has, the FAT and the
+     * directory entry are never written. */
+    if (pos > fcb->file_size || size > fcb->file_size - pos) {
+        return -ENOSPC;
+    }
+
+    return WriteRawData(fcb->start_cluster, buffer, pos, size);
+}
+
 int GetFileSize(Process *proc, int fd)
 {
-    if (proc->file[fd] == NULL) {
+    if (proc->files->file[fd] == NULL) {
         return -EBADF;
     }
 
-    return proc->file[fd]->fcb->file_size;
+    return proc->files->file[fd]->fcb->file_size;
+}
+
+void GetFileName(const FCB *fcb, char *name)
+{
+    /* The 8.3 name is padded with spaces. */
+    for (int i = 0; i < sizeof(fcb->name) && fcb->name[i] != ' '; i++) {
+        *name++ = fcb->name[i];
+    }
+
+    *name++ = '.';
+    for (int i = 0; i < sizeof(fcb->ext) && fcb->ext[i] != ' '; i++) {
+        *name++ = fcb->ext[i];
+    }
+
+    *name = '\0';
+}
+
+int PollFiles(Process *proc, PollFD *fds, int nfds)
+{
+    int ready = 0;
+
+    for (int i = 0; i < nfds; i++) {
+        fds[i].revents = 0;
+
+        if (fds[i].fd == STANDARD_INPUT) {
+            if (GetKeyBufferCount() > 0) {
+                fds[i].revents = fds[i].events & POLLIN;
+            }
+        } else if (fds[i].fd < USER_START_FD
+                   || fds[i].fd >= PROCESS_MAXIMUM_FILE_DESCRIPTOR
+                   || proc->files->file[fds[i].fd] == NULL) {
+            fds[i].revents = POLLNVAL;
+        } else {
+            fds[i].revents = fds[i].events & POLLIN;
+        }
+
+        if (fds[i].revents != 0) {
+            ready++;
+        }
+    }
+
+    return ready;
 }
 
 int Lstat(const char *pathname, DirEntry *statbuf)
@@ -408,6 +572,23 @@ static void GetRelativeFileName(DirEntry* entry, char *buf)
     *buf = '\0';
 }
 
+static void ReleaseFD(FD *fd)
+{
+    ASSERT (fd->fcb->open_count > 0);
+    fd->fcb->open_count--;
+    fd->open_count--;
+
+    /* We don't clear file control block, because, when the file is opened, the
+     * file data is cached in the table, and then we can easily retrieve th file
+     * info. */
+    if (fd->open_count == 0) {
+        /* If the FD count is zero, mean fd entry is not used, we save it to
+         * NULL. Otherwise, the file descriptor entry is used by others and we
+         * leave the FCB pointer unchanged. */
+        fd->fcb = NULL;
+    }
+}
+
 static void ReadFileData(int start_cluster, int length, void *buf)
 {
     /* Note that cluster start with index 2, so we need subtract to 2. */
@@ -418,10 +599,15 @@ static void ReadFileData(int start_cluster, int length, void *buf)
 
     uint16_t number_of_sector_need_to_read = length
                                              * GetSectorsPerCluster();
+    bool preemptible = false;
 
+    /* The buffer is private to the caller, a long transfer doesn't keep the
+     * CPU from the other processes. */
+    preemptible = EnterPreemptible();
     DiskReadSectors(file_data_start_sector,
                     number_of_sector_need_to_read,
                     buf);
+    LeavePreemptible(preemptible);
 }
 
 void InitFileControlBLock(void)
@@ -443,14 +629,16 @@ void InitFileDescriptorTable(void)
 static int
 ReadRawData(uint32_t cluster_index, char *buf, uint32_t pos, uint32_t size)
 {
-    uint16_t number_of_clusters_need_to_read
-        = GetNumberOfClustersStoringFileData(size);
-
     uint16_t start_cluster_need_to_read = cluster_index
                                           + pos / GetBytesPerCluster();
 
     uint16_t start_pos_in_cluster = pos % GetBytesPerCluster();
 
+    /* The data starts in the middle of the first cluster, so it can spread
+     * over one more cluster than its size needs. */
+    uint16_t number_of_clusters_need_to_read
+        = GetNumberOfClustersStoringFileData(start_pos_in_cluster + size);
+
     char *buffer = (char *)kalloc();
 
     ReadFileData(start_cluster_need_to_read,
@@ -461,5 +649,66 @@ ReadRawData(uint32_t cluster_index, char *buf, uint32_t pos, uint32_t size)
 
     kfree(buffer);
 
+    return size;
+}
+
+static int WriteRawData(uint32_t cluster_index,
+                        const char *buf,
+                        uint32_t pos,
+                        uint32_t size)
+{
+    uint32_t sector = (cluster_index - START_CLUSTER_INDEX)
+                      * GetSectorsPerCluster()
+                      + GetDataRegionStartSector()
+                      + pos / GetBytesPerSector();
+    uint32_t offset = pos % GetBytesPerSector();
+    uint32_t written = 0;
+    char *sector_data = NULL;
+    bool preemptible = false;
+
+    ASSERT(cluster_index >= START_CLUSTER_INDEX);
+
+    sector_data = AllocFrame();
+    if (sector_data == NULL) {
+        return -ENOMEM;
+    }
+
+    /* The buffer is private to the caller, like in ReadFileData(). */
+    preemptible = EnterPreemptible();
+
+    while (written < size) {
+        uint32_t length = size - written;
+        uint32_t sectors = length / GetBytesPerSector();
+
+        /* Whole sectors are written from the buffer, the disk takes up to 255
+         * of them in one command. */
+        if (offset == 0 && sectors > 0) {
+            if (sectors > FILE_WRITE_MAXIMUM_SECTORS) {
+                sectors = FILE_WRITE_MAXIMUM_SECTORS;
+            }
+
+            DiskWriteSectors(sector, sectors, buf + written);
+            sector += sectors;
+            written += sectors * GetBytesPerSector();
+            continue;
+        }
+
+        /* A partial sector keeps the bytes around the written ones. */
+        if (length > GetBytesPerSector() - offset) {
+            length = GetBytesPerSector() - offset;
+        }
+
+        DiskReadSectors(sector, 1, sector_data);
+        memcpy(sector_data + offset, buf + written, length);
+        DiskWriteSectors(sector, 1, sector_data);
+
+        sector++;
+        written += length;
+        offset = 0;
+    }
+
+    LeavePreemptible(preemptible);
+    FreeFrame(sector_data);
+
     return size;
 }
\ No newline at end of file
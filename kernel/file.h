@@ -12,6 +12,9 @@
 
 #define SECTOR_SIZE     512
 
+#define POLLIN          0x0001  /* There is data to read.                     */
+#define POLLNVAL        0x0020  /* Invalid file descriptor.                   */
+
 /* Public type ---------------------------------------------------------------*/
 
 /**
@@ -67,7 +70,7 @@ typedef struct {
  * @brief   File control block structure.
  * 
  */
-typedef struct {
+typedef struct FCB {
     char name[8];
     char ext[3];
     uint32_t start_cluster;
@@ -92,6 +95,15 @@ struct FD {
 
 typedef struct FD FD;
 
+/**
+ * @brief   Poll request, the layout is shared with user space `struct pollfd`.
+ */
+typedef struct {
+    int fd;
+    int16_t events;
+    int16_t revents;
+} PollFD;
+
 /* Public function prototype -------------------------------------------------*/
 void InitFileSystem(void);
 
@@ -100,4 +112,71 @@ void Close(Process* proc, int fd);
 int Read(Process* proc, int fd, void *buffer, int size);
 int Lstat(const char *pathname, DirEntry *statbuf);
 
-int GetFileSize(Process *proc, int fd);
\ No newline at end of file
+/**
+ * @brief   Read the directory entry of a file in the root directory.
+ * @return  Index of the entry, or -ENOENT.
+ */
+int FindFileInRootDir(const char *filename, DirEntry *entry);
+
+int GetFileSize(Process *proc, int fd);
+
+/**
+ * @brief   Give `new_proc` the same file descriptors as `proc`, it is used by
+ *          fork().
+ */
+void ShareFiles(Process *new_proc, Process *proc);
+
+/**
+ * @brief   Make `new_fd` of the process refer to the same file descriptor
+ *          entry as `fd`, like dup2(). An open `new_fd` is closed first.
+ *
+ * @return  `new_fd`, or -EBADF if a descriptor is out of range or `fd` isn't
+ *          open.
+ */
+int DupFile(Process *proc, int fd, int new_fd);
+
+/**
+ * @brief   Close every file descriptor of an exited process.
+ */
+void CloseFiles(Process *proc);
+
+/**
+ * @brief   Take or drop a reference to a file control block without a file
+ *          descriptor, the program of a process holds one.
+ */
+void RetainFile(FCB *fcb);
+void ReleaseFile(FCB *fcb);
+
+/**
+ * @brief   Read `size` bytes at `pos` of an opened file without a file
+ *          descriptor. It is used to load program pages on demand, the file
+ *          control block is held by the process image.
+ *
+ * @return  Number of bytes read, it is less than `size` at the end of file.
+ */
+int ReadFileAt(FCB *fcb, void *buffer, uint32_t pos, uint32_t size);
+
+/**
+ * @brief   Write `size` bytes at `pos` of an opened file without a file
+ *          descriptor. The file system can't allocate clusters, so the file
+ *          isn't grown: the bytes must be within its size. The buffer must be
+ *          private to the caller, the process can be preempted during the
+ *          transfer.
+ *
+ * @return  `size`, -ENOSPC if the bytes are beyond the end of the file, or
+ *          -ENOMEM.
+ */
+int WriteFileAt(FCB *fcb, const void *buffer, uint32_t pos, uint32_t size);
+
+/**
+ * @brief   Get the name of a file as "NAME.EXT", `name` holds 13 bytes.
+ */
+void GetFileName(const FCB *fcb, char *name);
+
+/**
+ * @brief   Check which of the `nfds` file descriptors in `fds` are ready, set
+ *          their `revents` and return the number of ready descriptors. The
+ *          standard input is ready when a key is buffered, opened files are
+ *          always ready because the disk is read synchronously.
+ */
+int PollFiles(Process *proc, PollFD *fds, int nfds);
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include <stddef.h>
+
+#include "ioapic.h"
+#include "acpi.h"
+#include "cpu.h"
+#include "memory.h"
+#include "printk.h"
+#include "assert.h"
+
+/* Private define ------------------------------------------------------------*/
+#define IO_APIC_REGISTER_SELECT         0x00
+#define IO_APIC_WINDOW                  0x10
+
+#define IO_APIC_VERSION                 0x01
+#define IO_APIC_REDIRECTION_TABLE       0x10
+#define IO_APIC_MAXIMUM_ENTRY_SHIFT     16
+
+#define IO_APIC_ACTIVE_LOW              BIT(13)
+#define IO_APIC_LEVEL_TRIGGERED         BIT(15)
+#define IO_APIC_MASKED                  BIT(16)
+#define IO_APIC_DESTINATION_SHIFT       56
+
+/* MPS INTI flags of the interrupt source overrides. */
+#define MADT_POLARITY_MASK              0x3
+#define MADT_POLARITY_ACTIVE_LOW        0x3
+#define MADT_TRIGGER_MASK               0xC
+#define MADT_TRIGGER_LEVEL              0xC
+
+/* Private variable ----------------------------------------------------------*/
+static volatile uint32_t *s_io_apic = NULL;
+static uint32_t s_gsi_base = 0;
+static uint32_t s_entry_count = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t ReadIOAPIC(uint32_t reg);
+static void WriteIOAPIC(uint32_t reg, uint32_t value);
+static void WriteRedirection(uint32_t gsi, uint64_t entry);
+
+/* Public function -----------------------------------------------------------*/
+void InitIOAPIC(uint64_t address, uint32_t gsi_base)
+{
+    s_io_apic = MapDeviceMemory(address, FRAME_SIZE);
+    ASSERT(s_io_apic != NULL);
+
+    s_gsi_base = gsi_base;
+    s_entry_count = (ReadIOAPIC(IO_APIC_VERSION)
+                     >> IO_APIC_MAXIMUM_ENTRY_SHIFT & 0xFF) + 1;
+
+    for (uint32_t i = 0; i < s_entry_count; i++) {
+        WriteRedirection(gsi_base + i, IO_APIC_MASKED);
+    }
+
+    printk("I/O APIC: %u entries from GSI %u.\n", s_entry_count, gsi_base);
+}
+
+void EnableIRQ(uint8_t irq)
+{
+    const MADTInfo *madt = GetMADTInfo();
+    uint64_t entry = IRQ_VECTOR_BASE + irq;
+    uint16_t flags = 0;
+
+    ASSERT(irq < ISA_IRQ_COUNT);
+    flags = madt->isa_irq_flags[irq];
+
+    /* ISA interrupts are active high and edge triggered, unless the MADT
+     * says otherwise. */
+    if ((flags & MADT_POLARITY_MASK) == MADT_POLARITY_ACTIVE_LOW) {
+        entry |= IO_APIC_ACTIVE_LOW;
+    }
+
+    if ((flags & MADT_TRIGGER_MASK) == MADT_TRIGGER_LEVEL) {
+        entry |= IO_APIC_LEVEL_TRIGGERED;
+    }
+
+    entry |= (uint64_t)GetCPUById(BOOT_CPU_ID)->apic_id
+             << IO_APIC_DESTINATION_SHIFT;
+
+    WriteRedirection(madt->isa_irq_gsi[irq], entry);
+}
+
+/* Private function ----------------------------------------------------------*/
+static uint32_t ReadIOAPIC(uint32_t reg)
+{
+    s_io_apic[IO_APIC_REGISTER_SELECT / sizeof(uint32_t)] = reg;
+    return s_io_apic[IO_APIC_WINDOW / sizeof(uint32_t)];
+}
+
+static void WriteIOAPIC(uint32_t reg, uint32_t value)
+{
+    s_io_apic[IO_APIC_REGISTER_SELECT / sizeof(uint32_t)] = reg;
+    s_io_apic[IO_APIC_WINDOW / sizeof(uint32_t)] = value;
+}
+
+static void WriteRedirection(uint32_t gsi, uint64_t entry)
+{
+    uint32_t reg = 0;
+
+    if (gsi < s_gsi_base || gsi - s_gsi_base >= s_entry_count) {
+        printk("I/O APIC: GSI %u is not handled.\n", gsi);
+        return;
+    }
+
+    /* The entry is masked while it is written in two halves. */
+    reg = IO_APIC_REDIRECTION_TABLE + 2 * (gsi - s_gsi_base);
+    WriteIOAPIC(reg, IO_APIC_MASKED);
+    WriteIOAPIC(reg + 1, (uint32_t)(entry >> 32));
+    WriteIOAPIC(reg, (uint32_t)entry);
+}
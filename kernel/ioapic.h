@@ -0,0 +1,38 @@
+/**
+ * @file    ioapic.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   I/O APIC. It replaces the 8259 PIC: every device interrupt line
+ *          (GSI, Global System Interrupt) has a redirection entry which
+ *          gives its vector, its polarity and trigger mode, and the local
+ *          APIC it is sent to.
+ *
+ *          The ISA IRQs are wired to the GSI with the same number, unless the
+ *          MADT overrides it (the PIT IRQ 0 is usually on GSI 2). They are
+ *          sent to the boot CPU, at IRQ_VECTOR_BASE + IRQ as before, and they
+ *          are acknowledged with LocalAPICEOI().
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+
+/* Public define -------------------------------------------------------------*/
+#define IRQ_VECTOR_BASE                 32
+#define ISA_IRQ_KEYBOARD                1
+#define ISA_IRQ_PRIMARY_ATA             14
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Map the I/O APIC at `address`, its first entry is `gsi_base`, and
+ *          mask all its entries.
+ */
+void InitIOAPIC(uint64_t address, uint32_t gsi_base);
+
+/**
+ * @brief   Deliver the ISA `irq` to the boot CPU at IRQ_VECTOR_BASE + irq.
+ */
+void EnableIRQ(uint8_t irq);
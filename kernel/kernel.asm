@@ -22,12 +22,15 @@ GDT64:
     dq 0            ; First entry is NULL.
 CodeSegDes64:       ; Next entry is Code Segment Descriptor.
     dq 0x0020980000000000
-CodeSegDes64Ring3:
-    dq 0x0020F80000000000   ; DPL is ring 3, we make new code segment descriptor
-                            ; that run with privilege level 3.
+DataSegDes64:       ; Kernel data, SYSCALL loads its selector to SS.
+    dq 0x0000920000000000
 DataSegDes64Ring3:
     dq 0x0000F20000000000   ; And make data segment descriptor that run with
                             ; privilege level 3 also and writable.
+CodeSegDes64Ring3:
+    dq 0x0020F80000000000   ; DPL is ring 3, we make new code segment descriptor
+                            ; that run with privilege level 3. SYSRET needs it
+                            ; right after the user data descriptor.
 TaskStateSegDes64:          ; Task state segment descriptor.
     dw TssLen - 1           ; First two bytes are the lower 16 bits of TSS limit
     dw 0                    ; Lower 24 bits of base address is set to 0.
@@ -51,11 +54,22 @@ TaskStateSegment:
                             ; don't use the IO permission bitmap.
 TssLen: equ $-TaskStateSegment
 
+; Code of the secondary CPUs, assembled on its own at 0x8000 (trampoline.asm),
+; the boot CPU copies it there before it starts them.
+section .rodata
+global TrampolineStart
+global TrampolineEnd
+
+TrampolineStart:
+    incbin "trampoline.bin"
+TrampolineEnd:
+
 section .text
 extern KMain
 
 global Start        ; Declare the start of the kernel globally so that linker
                     ; will find it.
+global KernelEnd    ; The idle loop, the secondary CPUs end there too.
 
 Start:
     ; 1. Load GDT and IDT.
@@ -73,22 +87,12 @@ SetTSS:
     mov [rdi + 7], al
     shr rax, 8
     mov [rdi + 8], eax
-    mov ax, 0x20                    ; Tss des is 5th entry, so we move 0x20.
+    mov ax, 0x28                    ; Tss des is 6th entry, so we move 0x28.
     ltr ax                          ; Load TSS.
 
-    ; 3. Initialize PIT - Programable Interval Timer.
-InitializePIT:
-    mov al, 0b00110100  ; Initialize PIT mode command register, FORM=0, MODE=010
-                        ; , ACCESS=11, CHANNEL=00.
-    out 0x43, al        ; Address of mode command register is 0x43. We use out
-                        ; instruction to write the value in al to the register.
-    mov ax, 11931       ; The interval we want to set to fire the interrupt each
-                        ; 100Hz (CPU count with 1.2Mega Hz): 1193182/100 = 11931
-    out 0x40, al        ; Address of data register channel 0 is 0x40. To set
-    mov al, ah          ; interval, we out lower byte first and out higher byte
-    out 0x40, al        ; after that.
-
-    ; 4. Initialize PIC - Programable Interrupt Controller.
+    ; 3. Initialize PIC - Programable Interrupt Controller. The local APICs and
+    ; the I/O APIC deliver the interrupts, the PIC is only remapped, so its
+    ; spurious interrupts don't look like exceptions, and fully masked.
 InitializePIC:
     mov al, 0b00010001  ; Initialize PIC command register bits[7:4]=0001,
                         ; bits[3:0]=0001.
@@ -110,12 +114,11 @@ InitializePIC:
     out 0x21, al
     out 0xA1, al
 
-    mov al, 0b11111100  ; Masking all interrupts, except IRQ0 for the timer
-    out 0x21, al        ; interrupt we used and IRQ1 for keyboard.
-    mov al, 0b11111111
+    mov al, 0b11111111  ; Masking all interrupts.
+    out 0x21, al
     out 0xA1, al
 
-    ; 5. Load code segment descriptor to cs register.
+    ; 4. Load code segment descriptor to cs register.
     push 0x08           ; Push Code Selector.
     mov rax, KernelEntry
     push rax            ; Push Kernel entry address.
@@ -123,7 +126,7 @@ InitializePIC:
     retf                ; we load code segment descriptor by far return to
                         ; `caller` with caller address is KernelEntry.
 
-    ; 6. Jump to kernel main.
+    ; 5. Jump to kernel main.
 KernelEntry:
     xor ax, ax
     mov ss, ax
@@ -133,7 +136,8 @@ KernelEntry:
     call KMain
 
     ; If no tasks to run, the kernel go to here, we still enable interrupt for
-    ; IDLE task.
+    ; IDLE task. KMain ends in StartIdleLoop, which jumps here with the kernel
+    ; lock released.
 KernelEnd:
     sti
     hlt
@@ -2,6 +2,7 @@
 #include "printk.h"
 #include "process.h"
 #include "io.h"
+#include "spinlock.h"
 /* Private define ------------------------------------------------------------*/
 
 #define E0_SIGN                 (1 << 0)
@@ -23,6 +24,7 @@ static struct KeyboardBuffer {
 } s_keyboard_controller = {{0}, 0, 0, 500}; 
 
 /* Private variable ----------------------------------------------------------*/
+static WaitQueue s_keyboard_wait_queue;
 static unsigned char s_shift_code[256] = {
     [0x2A] = SHIFT,
     [0x36] = SHIFT,
@@ -94,27 +96,49 @@ void KeyboardHandler(void)
     ch[0] = ReadCharacter();
     if (ch[0] > 0) {
         WriteKeyBuffer(ch[0]);
-        /* Wakeup the process waiting for the keyboard. */
-        Wakeup(WAITING_KEYBOARD_PROCESS_WAIT_ID);
+        /* Wakeup the processes waiting for the keyboard, readers and
+         * pollers both check the buffer again. */
+        WakeUpAll(&s_keyboard_wait_queue);
     }
 }
 
 char ReadKeyBuffer(void)
 {
-    int front = s_keyboard_controller.front;
-
-    if (front == s_keyboard_controller.end) {
-        /* When a program wants to read a key, and there is no key in the buffer
-         * , we will put it into sleep. */
-        Sleep(WAITING_KEYBOARD_PROCESS_WAIT_ID);
+    int front = 0;
+    uint64_t flags = SaveInterrupts();
+
+    /* When a program wants to read a key, and there is no key in the buffer,
+     * we will put it into sleep. Another reader may take the key first. The
+     * interrupts stay disabled until it sleeps, so no key press is missed. */
+    while (s_keyboard_controller.front == s_keyboard_controller.end) {
+        SleepOn(&s_keyboard_wait_queue);
     }
 
+    front = s_keyboard_controller.front;
+
     s_keyboard_controller.front = (s_keyboard_controller.front + 1)
                                     % s_keyboard_controller.size;
 
+    RestoreInterrupts(flags);
     return s_keyboard_controller.buffer[front];
 }
 
+WaitQueue *GetKeyboardWaitQueue(void)
+{
+    return &s_keyboard_wait_queue;
+}
+
+int GetKeyBufferCount(void)
+{
+    int count = s_keyboard_controller.end - s_keyboard_controller.front;
+
+    if (count < 0) {
+        count += s_keyboard_controller.size;
+    }
+
+    return count;
+}
+
 /* Private function ----------------------------------------------------------*/
 static char ReadCharacter(void)
 {
@@ -1,6 +1,17 @@
 #pragma once
 #include <stdint.h>
+#include "process.h"
 
 /* Public function prototype -------------------------------------------------*/
 void KeyboardHandler(void);
-char ReadKeyBuffer(void);
\ No newline at end of file
+char ReadKeyBuffer(void);
+
+/**
+ * @brief   Get number of characters which can be read without sleeping.
+ */
+int GetKeyBufferCount(void);
+
+/**
+ * @brief   Wait queue of the processes which wait for a key press.
+ */
+WaitQueue *GetKeyboardWaitQueue(void);
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include <stddef.h>
+
+#include "kstack.h"
+#include "memory.h"
+#include "printk.h"
+#include "assert.h"
+
+/* Private define ------------------------------------------------------------*/
+#define KERNEL_STACK_WORDS              (KERNEL_STACK_SIZE / sizeof(uint64_t))
+
+/* The free list link is kept right above the canary, it is set back to the
+ * pattern when the stack is allocated. */
+#define KERNEL_STACK_LINK_WORD          1
+
+/* Private variable ----------------------------------------------------------*/
+static Page s_free_stacks;
+static uint32_t s_high_water = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+/**
+ * @brief   Carve a 2MB page into stacks filled with the pattern, and add them
+ *          to the free list.
+ *
+ * @return  false if the system is out of memory.
+ */
+static bool GrowKernelStacks(void);
+
+/**
+ * @brief   Number of bytes of the stack which were used, from its top to its
+ *          deepest word which isn't the pattern.
+ */
+static uint32_t MeasureKernelStack(uint64_t *stack);
+
+/* Public function -----------------------------------------------------------*/
+void *AllocKernelStack(void)
+{
+    Page *page = s_free_stacks.next;
+    uint64_t *stack = NULL;
+
+    if (page == NULL) {
+        if (!GrowKernelStacks()) {
+            return NULL;
+        }
+
+        page = s_free_stacks.next;
+    }
+
+    stack = (uint64_t *)page - KERNEL_STACK_LINK_WORD;
+    s_free_stacks.next = page->next;
+    stack[KERNEL_STACK_LINK_WORD] = KERNEL_STACK_PATTERN;
+
+    return stack;
+}
+
+void FreeKernelStack(void *stack)
+{
+    uint64_t *words = stack;
+    uint32_t used = 0;
+    Page *page = NULL;
+
+    if (!IsKernelStackIntact(stack)) {
+        panic("Kernel stack overflow.");
+    }
+
+    used = MeasureKernelStack(words);
+    if (used > s_high_water) {
+        s_high_water = used;
+        printk("Kernel stack high-water mark: %u of %u bytes.\n",
+               used,
+               KERNEL_STACK_SIZE);
+    }
+
+    /* Fill the used part again, the rest still holds the pattern. */
+    for (uint32_t i = KERNEL_STACK_WORDS - used / sizeof(uint64_t);
+         i < KERNEL_STACK_WORDS;
+         i++) {
+        words[i] = KERNEL_STACK_PATTERN;
+    }
+
+    page = (Page *)&words[KERNEL_STACK_LINK_WORD];
+    page->next = s_free_stacks.next;
+    s_free_stacks.next = page;
+}
+
+bool IsKernelStackIntact(void *stack)
+{
+    return *(uint64_t *)stack == KERNEL_STACK_PATTERN;
+}
+
+uint32_t GetKernelStackHighWater(void)
+{
+    return s_high_water;
+}
+
+/* Private function ----------------------------------------------------------*/
+static bool GrowKernelStacks(void)
+{
+    char *page = kalloc();
+
+    if (page == NULL) {
+        return false;
+    }
+
+    for (uint32_t offset = 0; offset < PAGE_SIZE; offset += KERNEL_STACK_SIZE) {
+        uint64_t *stack = (uint64_t *)(page + offset);
+        Page *link = (Page *)&stack[KERNEL_STACK_LINK_WORD];
+
+        for (uint32_t i = 0; i < KERNEL_STACK_WORDS; i++) {
+            stack[i] = KERNEL_STACK_PATTERN;
+        }
+
+        link->next = s_free_stacks.next;
+        s_free_stacks.next = link;
+    }
+
+    return true;
+}
+
+static uint32_t MeasureKernelStack(uint64_t *stack)
+{
+    uint32_t i = KERNEL_STACK_LINK_WORD + 1;
+
+    while (i < KERNEL_STACK_WORDS && stack[i] == KERNEL_STACK_PATTERN) {
+        i++;
+    }
+
+    return (KERNEL_STACK_WORDS - i) * sizeof(uint64_t);
+}
@@ -0,0 +1,67 @@
+/**
+ * @file    kstack.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Kernel stacks. Every process has its own kernel stack, which is
+ *          used when the process enters the kernel mode. The stacks are
+ *          KERNEL_STACK_SIZE (16KB), they are carved from 2MB pages and the
+ *          released stacks are kept in a free list.
+ *
+ *          The kernel is mapped with 2MB pages, so there is no guard page
+ *          under a stack. Instead, the stack is filled with a known pattern,
+ *          and the lowest word is a canary which is checked on every context
+ *          switch and when the stack is released:
+ *
+ *           |top               |   <- TaskStateSegment.rsp0
+ *           |  trap frame      |
+ *           |  used ...        |
+ *           |------------------|   <- high-water mark
+ *           |  pattern ...     |
+ *           |  canary          |
+ *           |bottom            |
+ *
+ *          The pattern is written once when a stack is carved. When the stack
+ *          is released, the deepest word which isn't the pattern gives its
+ *          high-water mark, and only the used part is filled again, so
+ *          neither creating nor releasing a process touches the whole stack.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Public define -------------------------------------------------------------*/
+#define KERNEL_STACK_SIZE               (16 * 1024)         /* 16KB.          */
+#define KERNEL_STACK_PATTERN            0x57AC57AC57AC57ACULL
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Allocate a kernel stack. It isn't zeroed, the caller only
+ *          initializes the frames it puts on the top of the stack.
+ *
+ * @return  The bottom of the stack, or NULL if the system is out of memory.
+ */
+void *AllocKernelStack(void);
+
+/**
+ * @brief   Record the high-water mark of the stack and give it back to the
+ *          free list.
+ */
+void FreeKernelStack(void *stack);
+
+/**
+ * @brief   Check the canary of the stack.
+ *
+ * @return  false if the stack overflowed.
+ */
+bool IsKernelStackIntact(void *stack);
+
+/**
+ * @brief   Deepest use of a kernel stack in bytes, over every stack which was
+ *          released since boot.
+ */
+uint32_t GetKernelStackHighWater(void);
@@ -0,0 +1,319 @@
+#include <errno.h>
+#include <string.h>
+
+#include "loader.h"
+#include "file.h"
+#include "template.h"
+#include "checkpoint.h"
+#include "memory.h"
+#include "printk.h"
+#include "assert.h"
+
+/* Private function prototypes -----------------------------------------------*/
+/**
+ * @brief   Describe an ELF64 executable as virtual memory areas.
+ *
+ * @return  Number of areas, or -ENOEXEC if the file is invalid.
+ */
+static int BuildElfAreas(FCB *fcb,
+                         ElfHeader *header,
+                         VMArea *vma,
+                         uint64_t *entry);
+
+/**
+ * @brief   Describe a flat binary as virtual memory areas.
+ *
+ * @return  Number of areas, or -ENOEXEC if the file is too big.
+ */
+static int BuildFlatAreas(FCB *fcb, VMArea *vma, uint64_t *entry);
+
+/* Public function -----------------------------------------------------------*/
+int LoadProgram(Process *proc, const char *filename, uint64_t *entry)
+{
+    VMArea vma[PROCESS_MAXIMUM_VMAS];
+    ElfHeader header = {0};
+    FCB *fcb = NULL;
+    int count = 0;
+    int fd = 0;
+
+    fd = Open(proc, filename);
+    if (fd < 0) {
+        return -ENOENT;
+    }
+
+    fcb = proc->files->file[fd]->fcb;
+    memset(vma, 0, sizeof(vma));
+
+    if (ReadFileAt(fcb, &header, 0, sizeof(header)) == sizeof(header)
+        && header.magic == ELF_MAGIC) {
+        count = BuildElfAreas(fcb, &header, vma, entry);
+    } else {
+        count = BuildFlatAreas(fcb, vma, entry);
+    }
+
+    if (count < 0) {
+        Close(proc, fd);
+        return count;
+    }
+
+    /* The process keeps the file control block of its program, the frames
+     * are read from it after the file descriptor is closed. */
+    RetainFile(fcb);
+    Close(proc, fd);
+    ReleaseImage(proc);
+
+    proc->image = fcb;
+    proc->vma_count = count;
+    memcpy(proc->vma, vma, sizeof(vma));
+
+    /* Release the old program, and reload the page map to flush stale
+     * translations of the user window. A process built by spawn() has no
+     * program yet, and its page map isn't loaded. The frames of a template
+     * are only released once they are unmapped. */
+    if (proc == GetCurrentProcess()) {
+        ReleaseUVM(proc->page_map);
+        SwitchVM(proc->page_map);
+    }
+
+    ReleaseTemplate(proc);
+
+    return 0;
+}
+
+VMArea *FindVMArea(Process *proc, uint64_t address)
+{
+    for (int i = 0; i < proc->vma_count; i++) {
+        if (address >= proc->vma[i].start && address < proc->vma[i].end) {
+            return &proc->vma[i];
+        }
+    }
+
+    return NULL;
+}
+
+bool HandlePageFault(Process *proc, uint64_t address, uint64_t error_code)
+{
+    uint64_t page = FRAME_ALIGN_DOWN(address);
+    VMArea *vma = NULL;
+    uint32_t flags = 0;
+    char *frame = NULL;
+    bool restored = false;
+
+    if (proc == NULL) {
+        return false;
+    }
+
+    /* Only the areas of the program are loaded on demand, the runtime text
+     * and the kernel are always mapped. */
+    vma = FindVMArea(proc, address);
+    if (vma == NULL) {
+        return false;
+    }
+
+    /* A write to a frame shared with a template takes a copy of it, any
+     * other fault on a mapped frame is an access rights violation. */
+    if (error_code & PAGE_FAULT_PRESENT) {
+        return (error_code & PAGE_FAULT_WRITE)
+               && (vma->flags & VMA_WRITE)
+               && CopyOnWrite(proc->page_map, page);
+    }
+
+    if (((error_code & PAGE_FAULT_WRITE) && !(vma->flags & VMA_WRITE))
+        || ((error_code & PAGE_FAULT_INSTRUCTION_FETCH)
+            && !(vma->flags & VMA_EXEC))) {
+        return false;
+    }
+
+    /* A thread of the process on another CPU faulted on the same frame, and
+     * it was mapped while this CPU waited to enter the kernel. */
+    if (IsUserFrameMapped(proc->page_map, page)) {
+        return true;
+    }
+
+    frame = AllocFrame();
+    if (frame == NULL) {
+        printk("DEBUG: Out of memory at page fault %#lx.\n", address);
+        return false;
+    }
+
+    /* A frame saved by a checkpoint replaces the program data. */
+    restored = ReadCheckpointFrame(proc, page, frame);
+
+    /* Segments are not required to be page aligned, so one frame can hold
+     * the end of an area and the start of the next one. Fill the frame from
+     * every area it overlaps, and give it the rights of all of them. */
+    for (int i = 0; i < proc->vma_count; i++) {
+        VMArea *area = &proc->vma[i];
+        uint64_t start = page > area->file_start ? page : area->file_start;
+        uint64_t end = page + FRAME_SIZE < area->file_end ?
+                       page + FRAME_SIZE : area->file_end;
+
+        if (page + FRAME_SIZE <= area->start || page >= area->end) {
+            continue;
+        }
+
+        flags |= area->flags;
+
+        if (start < end && !restored) {
+            ReadFileAt(proc->image,
+                       frame + (start - page),
+                       area->file_offset + (start - area->file_start),
+                       end - start);
+        }
+    }
+
+    if (!MapUserFrame(proc->page_map, page, frame, flags)) {
+        FreeFrame(frame);
+        return false;
+    }
+
+    return true;
+}
+
+void InheritImage(Process *new_proc, Process *proc)
+{
+    new_proc->image = proc->image;
+    new_proc->vma_count = proc->vma_count;
+    memcpy(new_proc->vma, proc->vma, sizeof(proc->vma));
+
+    if (new_proc->image != NULL) {
+        RetainFile(new_proc->image);
+    }
+
+    InheritCheckpoint(new_proc, proc);
+}
+
+void ReleaseImage(Process *proc)
+{
+    if (proc->image != NULL) {
+        ReleaseFile(proc->image);
+        proc->image = NULL;
+    }
+
+    ReleaseCheckpoint(proc);
+    proc->vma_count = 0;
+}
+
+/* Private function ----------------------------------------------------------*/
+static int BuildElfAreas(FCB *fcb,
+                         ElfHeader *header,
+                         VMArea *vma,
+                         uint64_t *entry)
+{
+    ElfProgramHeader program[ELF_MAXIMUM_PROGRAM_HEADERS];
+    uint64_t highest = USER_VIRTUAL_ADDRESS_BASE;
+    bool entry_is_valid = false;
+    int size = 0;
+    int count = 0;
+
+    if (header->class != ELF_CLASS_64
+        || header->data != ELF_DATA_LITTLE_ENDIAN
+        || header->type != ELF_TYPE_EXECUTABLE
+        || header->machine != ELF_MACHINE_X86_64
+        || header->program_header_size != sizeof(ElfProgramHeader)
+        || header->program_header_count > ELF_MAXIMUM_PROGRAM_HEADERS) {
+        printk("DEBUG: Unsupported ELF executable.\n");
+        return -ENOEXEC;
+    }
+
+    size = header->program_header_count * sizeof(ElfProgramHeader);
+    if (ReadFileAt(fcb, program, header->program_header_offset, size)
+        != size) {
+        return -ENOEXEC;
+    }
+
+    for (int i = 0; i < header->program_header_count; i++) {
+        ElfProgramHeader *segment = &program[i];
+        uint64_t end = segment->virtual_address + segment->memory_size;
+
+        if (segment->type != ELF_PROGRAM_TYPE_LOAD
+            || segment->memory_size == 0) {
+            continue;
+        }
+
+        /* Keep the last area for the stack. */
+        if (count == PROCESS_MAXIMUM_VMAS - 1
+            || segment->file_size > segment->memory_size
+            || segment->virtual_address < USER_VIRTUAL_ADDRESS_BASE
+            || end < segment->virtual_address
+            || end > USER_STACK_START
+            || segment->offset + segment->file_size > fcb->file_size) {
+            printk("DEBUG: Invalid ELF segment %d.\n", i);
+            return -ENOEXEC;
+        }
+
+        vma[count].start = FRAME_ALIGN_DOWN(segment->virtual_address);
+        vma[count].end = FRAME_ALIGN_UP(end);
+        vma[count].file_start = segment->virtual_address;
+        vma[count].file_end = segment->virtual_address + segment->file_size;
+        vma[count].file_offset = segment->offset;
+        vma[count].flags = VMA_READ;
+
+        if (segment->flags & ELF_PROGRAM_FLAG_WRITE) {
+            vma[count].flags |= VMA_WRITE;
+        }
+
+        if (segment->flags & ELF_PROGRAM_FLAG_EXEC) {
+            vma[count].flags |= VMA_EXEC;
+            if (header->entry >= segment->virtual_address
+                && header->entry < end) {
+                entry_is_valid = true;
+            }
+        }
+
+        if (vma[count].end > highest) {
+            highest = vma[count].end;
+        }
+
+        count++;
+    }
+
+    if (!entry_is_valid) {
+        printk("DEBUG: ELF entry point %#lx is not executable.\n",
+               header->entry);
+        return -ENOEXEC;
+    }
+
+    if (highest < USER_STACK_START) {
+        vma[count].start = highest;
+        vma[count].end = USER_STACK_START;
+        vma[count].flags = VMA_READ | VMA_WRITE;
+        count++;
+    }
+
+    *entry = header->entry;
+
+    return count;
+}
+
+static int BuildFlatAreas(FCB *fcb, VMArea *vma, uint64_t *entry)
+{
+    uint64_t end = USER_VIRTUAL_ADDRESS_BASE + fcb->file_size;
+    int count = 0;
+
+    if (fcb->file_size == 0 || end > USER_STACK_START) {
+        printk("DEBUG: Invalid program size %u.\n", fcb->file_size);
+        return -ENOEXEC;
+    }
+
+    /* The flat binary doesn't tell its sections apart, so the whole file
+     * keeps every access right. */
+    vma[count].start = USER_VIRTUAL_ADDRESS_BASE;
+    vma[count].end = FRAME_ALIGN_UP(end);
+    vma[count].file_start = USER_VIRTUAL_ADDRESS_BASE;
+    vma[count].file_end = end;
+    vma[count].file_offset = 0;
+    vma[count].flags = VMA_READ | VMA_WRITE | VMA_EXEC;
+    count++;
+
+    if (vma[0].end < USER_STACK_START) {
+        vma[count].start = vma[0].end;
+        vma[count].end = USER_STACK_START;
+        vma[count].flags = VMA_READ | VMA_WRITE;
+        count++;
+    }
+
+    *entry = USER_VIRTUAL_ADDRESS_BASE;
+
+    return count;
+}
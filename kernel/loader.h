@@ -0,0 +1,149 @@
+/**
+ * @file    loader.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Program loader. exec() doesn't copy the program to memory anymore,
+ *          it only describes the user window of the process as a few virtual
+ *          memory areas, and every 4KB frame is read from the program file at
+ *          the first page fault on it.
+ *
+ *          Two formats are supported, they are told apart by the magic number:
+ *          + ELF64 executables: every PT_LOAD segment becomes one area with
+ *            the permissions of the segment (R/W/X), the bytes between
+ *            p_filesz and p_memsz (.bss) are never read from the disk, they
+ *            are zero frames.
+ *          + Flat binaries: the whole file is one readable, writable and
+ *            executable area at USER_VIRTUAL_ADDRESS_BASE, as before.
+ *
+ *          In both cases, the rest of the user window up to USER_STACK_START
+ *          is an anonymous writable area, which holds the user stack.
+ *
+ *          Process virtual memory of an ELF program:
+ *           |0x600000          |
+ *           |  stack (RW)      |   anonymous, zero frames on demand
+ *           |      ...         |
+ *           |  .data .bss (RW) |
+ *           |  .rodata (R)     |
+ *           |  .text (RX)      |   frames read from the file on demand
+ *           |0x400000          |
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include "process.h"
+
+/* Public define -------------------------------------------------------------*/
+#define ELF_MAGIC                       0x464C457F      /* "\x7F" "ELF" */
+#define ELF_CLASS_64                    2
+#define ELF_DATA_LITTLE_ENDIAN          1
+#define ELF_TYPE_EXECUTABLE             2
+#define ELF_MACHINE_X86_64              62
+#define ELF_MAXIMUM_PROGRAM_HEADERS     16
+
+#define ELF_PROGRAM_TYPE_LOAD           1
+#define ELF_PROGRAM_FLAG_EXEC           BIT(0)
+#define ELF_PROGRAM_FLAG_WRITE          BIT(1)
+#define ELF_PROGRAM_FLAG_READ           BIT(2)
+
+/* Page fault error code bits. */
+#define PAGE_FAULT_PRESENT              BIT(0)
+#define PAGE_FAULT_WRITE                BIT(1)
+#define PAGE_FAULT_INSTRUCTION_FETCH    BIT(4)
+
+/* Public type ---------------------------------------------------------------*/
+/**
+ * @brief   ELF64 file header.
+ */
+typedef struct {
+    uint32_t magic;
+    uint8_t class;
+    uint8_t data;
+    uint8_t version;
+    uint8_t os_abi;
+    uint8_t abi_version;
+    uint8_t padding[7];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t elf_version;
+    uint64_t entry;
+    uint64_t program_header_offset;
+    uint64_t section_header_offset;
+    uint32_t flags;
+    uint16_t header_size;
+    uint16_t program_header_size;
+    uint16_t program_header_count;
+    uint16_t section_header_size;
+    uint16_t section_header_count;
+    uint16_t section_name_index;
+} __attribute__((packed)) ElfHeader;
+
+/**
+ * @brief   ELF64 program header, it describes one segment.
+ */
+typedef struct {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t virtual_address;
+    uint64_t physical_address;
+    uint64_t file_size;
+    uint64_t memory_size;
+    uint64_t align;
+} __attribute__((packed)) ElfProgramHeader;
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Replace the user memory of the current process by the program in
+ *          `filename`. The program file is validated before the old memory is
+ *          released, so the process is untouched on failure. Nothing is read
+ *          from the program but its headers, the frames are loaded by
+ *          HandlePageFault().
+ *
+ * @param   proc        - Current process, which is running exec(), or a new
+ *                        process which spawn() builds and which never ran.
+ * @param   filename    - Program file.
+ * @param   entry       - Receives the entry point of the program.
+ * @return  0           - Success.
+ *          -ENOENT     - The file doesn't exist.
+ *          -ENOEXEC    - The file isn't a valid program.
+ */
+int LoadProgram(Process *proc, const char *filename, uint64_t *entry);
+
+/**
+ * @brief   Find the virtual memory area of the process which contains
+ *          `address`.
+ *
+ * @return  The area, or NULL if the address isn't mapped.
+ */
+VMArea *FindVMArea(Process *proc, uint64_t address);
+
+/**
+ * @brief   Handle a page fault in the user window of the process: allocate a
+ *          frame, fill it from the program file (or the checkpoint file of a
+ *          restored process) and map it with the access rights of its area,
+ *          or copy a copy-on-write frame of a template at its first write.
+ *
+ * @param   proc        - Current process.
+ * @param   address     - Fault address (CR2).
+ * @param   error_code  - Page fault error code.
+ * @return  true        - The frame is mapped, the instruction can be restarted.
+ * @return  false       - Invalid access, or out of memory.
+ */
+bool HandlePageFault(Process *proc, uint64_t address, uint64_t error_code);
+
+/**
+ * @brief   Share the program file of `proc` with `new_proc`, it is used by
+ *          fork(), frames which are not loaded yet are still read from it,
+ *          or from its checkpoint file.
+ */
+void InheritImage(Process *new_proc, Process *proc);
+
+/**
+ * @brief   Release the program file held by the process, and its checkpoint
+ *          file.
+ */
+void ReleaseImage(Process *proc);
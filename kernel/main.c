@@ -8,15 +8,39 @@
 #include "process.h"
 #include "syscall.h"
 #include "file.h"
+#include "workqueue.h"
+#include "cpu.h"
+#include "acpi.h"
+#include "apic.h"
+#include "smp.h"
+#include "ioapic.h"
+#include "timer.h"
+#include "vdso.h"
 
 void KMain(void)
 {
+    InitCPU();
+    LockKernel();
     InitIDT();
     printk("Retrieve memory map:\n");
     RetrieveMemoryInfo();
     InitMemory();
+    InitTimer();
+    InitVDSO();
     InitFileSystem();
     InitSystemCall();
+
+    /* Without the MADT, the kernel runs on the boot CPU only. */
+    InitACPI();
+    InitLocalAPIC(GetMADTInfo()->local_apic_address);
+    InitIOAPIC(GetMADTInfo()->io_apic_address,
+               GetMADTInfo()->io_apic_gsi_base);
+    EnableIRQ(ISA_IRQ_KEYBOARD);
+    EnableIRQ(ISA_IRQ_PRIMARY_ATA);
+
     InitProcess();
+    InitWorkQueues();
+    StartSecondaryCPUs();
     printk("Finished kernel initialization. Welcome to LARVA-OS.\n");
+    StartIdleLoop();
 }
\ No newline at end of file
@@ -2,7 +2,12 @@
 #include <string.h>
 #include "memory.h"
 #include "printk.h"
+#include "trap.h"
+#include "cpu.h"
 #include "assert.h"
+#include "workqueue.h"
+#include "spinlock.h"
+#include "process.h"
 
 /* Private define ------------------------------------------------------------*/
 #define MEMORY_MAX_FREE_REGIONS                 50
@@ -16,16 +21,63 @@
 #define MEMORY_REGION_COUNT_BASE_ADDR           0x9000
 #define MEMORY_REGION_STRUCTURES_BASE_ADDR      0x9008
 
+/* The NXE bit of the extended feature enable register allows the no-execute
+ * bit in the page table entries. */
+#define CPUID_EXTENDED_FEATURES                 0x80000001
+#define CPUID_EXTENDED_FEATURE_NO_EXECUTE       BIT(20)
+
+/* Free frames are zeroed ahead by a worker, AllocFrame() only zeroes a frame
+ * itself when there is no zeroed frame left. */
+#define FRAME_ZEROED_LOW_WATERMARK              16
+#define FRAME_ZEROED_HIGH_WATERMARK             128
+#define FRAME_ZEROED_BATCH                      16
+
+/* 2MB pages of device memory, in every page map. */
+#define MEMORY_MAX_DEVICE_PAGES                 8
+#define DEVICE_PAGE_ATTRIBUTES                                                 \
+    (TABLE_ENTRY_PRESENT_ATTRIBUTE | TABLE_ENTRY_WRITABLE_ATTRIBUTE            \
+     | TABLE_ENTRY_WRITE_THROUGH_ATTRIBUTE | TABLE_ENTRY_CACHE_DISABLE_ATTRIBUTE)
+
 /* Private variable ----------------------------------------------------------*/
 static FreeMemoryRegion s_free_memory_regions[MEMORY_MAX_FREE_REGIONS];
 extern char l_kernel_end;
 static Page s_free_memory_page_head;
 static uint64_t s_free_memory_end_address = 0;
 static uint64_t s_total_mem = 0;
+static Page s_free_frame_head;
+static Page s_zeroed_frame_head;
+static uint32_t s_zeroed_frame_count = 0;
+static bool s_no_execute = false;
+static uint64_t s_kernel_page_map = 0;
+static uint64_t s_device_pages[MEMORY_MAX_DEVICE_PAGES];
+static int s_device_page_count = 0;
+/* Free pages and frames. */
+static Spinlock s_memory_lock = SPINLOCK_INITIALIZER;
 
 /* Private function prototypes -----------------------------------------------*/
 static void FreeRegion(uint64_t v_start, uint64_t v_end);
 
+/**
+ * @brief   Pop a free page, or push a page to the free list, the caller holds
+ *          the memory lock.
+ */
+static void *PopFreePage(void);
+static void PushFreePage(uint64_t addr);
+static void PushFreeFrame(void *frame);
+
+/**
+ * @brief   Map the device pages in a new page map.
+ */
+static bool MapDevicePages(uint64_t map);
+
+/**
+ * @brief   Work function which zeroes a batch of free frames, and moves them
+ *          to the list of zeroed frames.
+ */
+static void ZeroFreeFrames(void *data);
+
+static Work s_zero_frames_work = WORK_INITIALIZER(ZeroFreeFrames, NULL);
+
 /**
  * @brief   This function find PML4 table entry according to the `v` virtual
  *          address.
@@ -78,6 +130,28 @@ static PageDir FindPageDirPointerTableEntry(uint64_t map,
                                             int alloc,
                                             uint32_t attr);
 
+/**
+ * @brief   Find the page table which maps 4KB frames of the `v` virtual
+ *          address. The page directory entry of `v` must not map a 2MB page.
+ *
+ * @param map           - Page map level 4 table.
+ * @param v             - Virtual address.
+ * @param alloc         - If true, allocate a page table if it doesn't exist.
+ * @return PageTableEntry*
+ */
+static PageTableEntry *FindPageTable(uint64_t map, uint64_t v, int alloc);
+
+/**
+ * @brief   Free the frames mapped by a page table, and the table itself.
+ */
+static void FreePageTable(PageTableEntry *pt);
+
+/**
+ * @brief   Enable the no-execute bit in page table entries if the processor
+ *          supports it.
+ */
+static void EnableNoExecute(void);
+
 static void FreePages(uint64_t map, uint64_t v_start, uint64_t v_end);
 
 static void FreePML4Table(uint64_t map);
@@ -108,12 +182,12 @@ void RetrieveMemoryInfo(void)
             free_memory_region_count++;
         }
 
-        printk("Physical Address: %x   size: %uKB   type: %u\n",
+        printk("Physical Address: %#lx   size: %luKB   type: %u\n",
                 mem_map[i].address,
                 mem_map[i].length/1024,
-                (uint64_t)mem_map[i].type);
+                mem_map[i].type);
     }
-    printk("Total Free Memory: %uKB\n", s_total_mem/1024);
+    printk("Total Free Memory: %luKB\n", s_total_mem/1024);
 
     for (int i = 0; i < free_memory_region_count; i++)
     {
@@ -139,7 +213,7 @@ void RetrieveMemoryInfo(void)
         page = page->next;
     }
 
-    printk("Virtual Free Memory: %x->%x\n",
+    printk("Virtual Free Memory: %p->%#lx\n",
             start_page,
             s_free_memory_end_address);
 }
@@ -149,10 +223,63 @@ void InitMemory(void)
     uint64_t kernel_map = SetupKVM();
     ASSERT(kernel_map);
 
+    EnableNoExecute();
+
+    /* The kernel writes to user memory on behalf of system calls, the write
+     * to a copy-on-write frame or to the shared runtime text must fault like
+     * a write of user code. */
+    WriteCR0(ReadCR0() | CR0_WRITE_PROTECT);
+
+    s_kernel_page_map = kernel_map;
     SwitchVM(kernel_map);
     printk("Memory Manage is working now.\n");
 }
 
+void InitSecondaryMemory(void)
+{
+    /* The kernel page map has no user pages, but the process maps which the
+     * CPU loads later have no-execute pages. */
+    if (s_no_execute) {
+        WriteMSR(MSR_EFER, ReadMSR(MSR_EFER) | EFER_NO_EXECUTE_ENABLE);
+    }
+
+    WriteCR0(ReadCR0() | CR0_WRITE_PROTECT);
+    SwitchVM(s_kernel_page_map);
+}
+
+void *MapDeviceMemory(uint64_t phys, uint64_t size)
+{
+    uint64_t end = PAGE_ALIGN_UP(phys + size);
+
+    for (uint64_t page = PAGE_ALIGN_DOWN(phys);
+         page < end;
+         page += PAGE_SIZE) {
+        /* The RAM of the kernel mapping is cached, it is left as it is. */
+        bool mapped = PHY_TO_VIR(page) < s_free_memory_end_address;
+
+        for (int i = 0; i < s_device_page_count && !mapped; i++) {
+            mapped = s_device_pages[i] == page;
+        }
+
+        if (mapped) {
+            continue;
+        }
+
+        if (s_device_page_count == MEMORY_MAX_DEVICE_PAGES
+            || !MapPages(s_kernel_page_map,
+                         PHY_TO_VIR(page),
+                         PHY_TO_VIR(page) + PAGE_SIZE,
+                         page,
+                         DEVICE_PAGE_ATTRIBUTES)) {
+            return NULL;
+        }
+
+        s_device_pages[s_device_page_count++] = page;
+    }
+
+    return (void *)PHY_TO_VIR(phys);
+}
+
 void SwitchVM(uint64_t map)
 {
     LoadCR3(VIR_TO_PHY(map));
@@ -208,44 +335,28 @@ bool SetupUVM(uint64_t map, uint64_t start_location, int size)
 
 void kfree(uint64_t addr)
 {
-    /* Check the address is aligned. */
-    ASSERT_ADDR_IS_ALIGNED(addr);
-
-     /* Check the address is not within kernel and not out of memory. */
-    ASSERT(addr >= (uint64_t)&l_kernel_end);
-    ASSERT(addr + PAGE_SIZE <= VIRTUAL_ADDRESS_END);
-
-    /* To free memory, we just add it to the free memory page linked list. */
-    Page *page_address = (Page *)addr;
-    page_address->next = s_free_memory_page_head.next;
-    s_free_memory_page_head.next = page_address;
+    AcquireSpinlock(&s_memory_lock);
+    PushFreePage(addr);
+    ReleaseSpinlock(&s_memory_lock);
 }
 
 void* kalloc(void)
 {
-    Page *page_address = s_free_memory_page_head.next;
+    void *page = NULL;
 
-    if (page_address != NULL) {
-        /* Check the address is aligned. */
-        ASSERT_ADDR_IS_ALIGNED((uint64_t)page_address);
+    AcquireSpinlock(&s_memory_lock);
+    page = PopFreePage();
+    ReleaseSpinlock(&s_memory_lock);
 
-        /* Check the address is not within kernel and not out of memory. */
-        ASSERT((uint64_t)page_address >= (uint64_t)&l_kernel_end);
-        ASSERT((uint64_t)page_address + PAGE_SIZE <= VIRTUAL_ADDRESS_END);
-
-        s_free_memory_page_head.next = page_address->next;
-    }
-
-    return (void *)page_address;
+    return page;
 }
 
 uint64_t SetupKVM(void)
 {
-    uint64_t kernel_page_map = (uint64_t)kalloc();
+    /* Paging tables are 4KB, they are allocated as frames. */
+    uint64_t kernel_page_map = (uint64_t)AllocFrame();
 
     if (kernel_page_map != 0) {
-        memset((void *)kernel_page_map, 0, PAGE_SIZE);
-
         /* Map the kernel to the same physical address. */
         bool status =
         MapPages(kernel_page_map,
@@ -254,7 +365,7 @@ uint64_t SetupKVM(void)
                 VIR_TO_PHY(KERNEL_VIRTUAL_ADDRESS_BASE),
                 TABLE_ENTRY_PRESENT_ATTRIBUTE | TABLE_ENTRY_WRITABLE_ATTRIBUTE);
 
-        if (!status) {
+        if (!status || !MapDevicePages(kernel_page_map)) {
             FreeVM(kernel_page_map);
             kernel_page_map = 0;
         }
@@ -268,16 +379,101 @@ uint64_t GetTotalMem(void)
     return s_total_mem;
 }
 
+uint64_t GetFreeMemory(void)
+{
+    uint64_t size = 0;
+
+    AcquireSpinlock(&s_memory_lock);
+
+    for (Page *page = s_free_memory_page_head.next;
+         page != NULL;
+         page = page->next) {
+        size += PAGE_SIZE;
+    }
+
+    for (Page *frame = s_free_frame_head.next;
+         frame != NULL;
+         frame = frame->next) {
+        size += FRAME_SIZE;
+    }
+
+    size += (uint64_t)s_zeroed_frame_count * FRAME_SIZE;
+
+    ReleaseSpinlock(&s_memory_lock);
+
+    return size;
+}
+
 bool CopyUVM(uint64_t new_page, uint64_t current_page, int size)
 {
     bool status = false;
     unsigned int index = 0;
     PageDir pd = NULL;
     uint64_t start = 0;
+    bool preemptible = false;
+
+    pd = FindPageDirPointerTableEntry(current_page,
+                                      USER_VIRTUAL_ADDRESS_BASE,
+                                      0,
+                                      0);
+    index = (USER_VIRTUAL_ADDRESS_BASE >> 21) & 0x1FF;
+
+    if (pd == NULL || (pd[index] & TABLE_ENTRY_PRESENT_ATTRIBUTE) == 0) {
+        /* No frame of the program is loaded yet. */
+        return true;
+    }
+
+    /* The program is mapped frame by frame, copy the present frames with the
+     * same access rights, the others are still loaded on demand. */
+    if ((pd[index] & TABLE_ENTRY_ENTRY_ATTRIBUTE) == 0) {
+        PageTableEntry *pt = (PageTableEntry *)
+                             PHY_TO_VIR(FRAME_ADDRESS(pd[index]));
+
+        for (int i = 0; i < TOTAL_PAGE_TABLE_ENTRIES; i++) {
+            if ((pt[i] & TABLE_ENTRY_PRESENT_ATTRIBUTE) == 0) {
+                continue;
+            }
+
+            void *frame = AllocFrame();
+            uint32_t flags = 0;
+
+            if (frame == NULL) {
+                FreeVM(new_page);
+                return false;
+            }
+
+            memcpy(frame, (void *)PHY_TO_VIR(FRAME_ADDRESS(pt[i])), FRAME_SIZE);
+
+            /* A frame which is still copy-on-write is copied right away. */
+            if (pt[i] & (TABLE_ENTRY_WRITABLE_ATTRIBUTE
+                         | TABLE_ENTRY_COPY_ON_WRITE_ATTRIBUTE)) {
+                flags |= VMA_WRITE;
+            }
+
+            if ((pt[i] & TABLE_ENTRY_NO_EXECUTE_ATTRIBUTE) == 0) {
+                flags |= VMA_EXEC;
+            }
+
+            if (!MapUserFrame(new_page,
+                              USER_VIRTUAL_ADDRESS_BASE + i * FRAME_SIZE,
+                              frame,
+                              flags)) {
+                FreeFrame(frame);
+                FreeVM(new_page);
+                return false;
+            }
+        }
+
+        return true;
+    }
 
     void * page = kalloc();
     if (page != NULL) {
+        /* The page is private until it is mapped, the 2MB don't keep the CPU
+         * from the other processes. */
+        preemptible = EnterPreemptible();
         memset(page, 0, PAGE_SIZE);
+        LeavePreemptible(preemptible);
         status = MapPages(new_page,
                             USER_VIRTUAL_ADDRESS_BASE,
                             USER_VIRTUAL_ADDRESS_BASE + PAGE_SIZE,
@@ -298,7 +494,10 @@ bool CopyUVM(uint64_t new_page, uint64_t current_page, int size)
 
                 start = PHY_TO_VIR(PAGE_ADDRESS(pd[index]));
 
+                /* exit() waits for us, the parent page stays. */
+                preemptible = EnterPreemptible();
                 memcpy(page, (void*)start, size);
+                LeavePreemptible(preemptible);
             } else {
                 kfree((uint64_t)page);
                 FreeVM(new_page);
@@ -314,6 +513,282 @@ bool CopyUVM(uint64_t new_page, uint64_t current_page, int size)
     return status;
 }
 
+bool MapSharedUVM(uint64_t map, uint64_t v, uint64_t page)
+{
+    PageDir pd = NULL;
+    unsigned int index = (v >> 21) & 0x1FF;
+
+    ASSERT_ADDR_IS_ALIGNED(v);
+    ASSERT_ADDR_IS_ALIGNED(page);
+
+    /* Intermediate tables are shared with the writable user page, so they
+     * keep the writable attribute, only the page entry is read-only. */
+    pd = FindPageDirPointerTableEntry(map,
+                                      v,
+                                      1,
+                                      TABLE_ENTRY_PRESENT_ATTRIBUTE
+                                      | TABLE_ENTRY_WRITABLE_ATTRIBUTE
+                                      | TABLE_ENTRY_USER_ATTRIBUTE);
+    if (pd == NULL) {
+        return false;
+    }
+
+    if (pd[index] & TABLE_ENTRY_PRESENT_ATTRIBUTE) {
+        return PAGE_ADDRESS(pd[index]) == VIR_TO_PHY(page);
+    }
+
+    pd[index] = (PageDirEntry)(VIR_TO_PHY(page)
+                               | TABLE_ENTRY_PRESENT_ATTRIBUTE
+                               | TABLE_ENTRY_USER_ATTRIBUTE
+                               | TABLE_ENTRY_ENTRY_ATTRIBUTE);
+
+    return true;
+}
+
+void ReleaseUVM(uint64_t map)
+{
+    FreePages(map,
+            USER_VIRTUAL_ADDRESS_BASE,
+            USER_VIRTUAL_ADDRESS_BASE + PAGE_SIZE);
+}
+
+bool MapUserFrame(uint64_t map, uint64_t v, void *frame, uint32_t flags)
+{
+    PageTableEntry *pt = FindPageTable(map, v, 1);
+    unsigned int index = (v >> 12) & 0x1FF;
+    PageTableEntry entry = 0;
+
+    if (pt == NULL) {
+        return false;
+    }
+
+    ASSERT((pt[index] & TABLE_ENTRY_PRESENT_ATTRIBUTE) == 0);
+
+    entry = VIR_TO_PHY(frame)
+            | TABLE_ENTRY_PRESENT_ATTRIBUTE
+            | TABLE_ENTRY_USER_ATTRIBUTE;
+
+    if (flags & VMA_WRITE) {
+        entry |= TABLE_ENTRY_WRITABLE_ATTRIBUTE;
+    }
+
+    if ((flags & VMA_EXEC) == 0 && s_no_execute) {
+        entry |= TABLE_ENTRY_NO_EXECUTE_ATTRIBUTE;
+    }
+
+    if (flags & VMA_SHARED) {
+        entry |= TABLE_ENTRY_SHARED_ATTRIBUTE;
+    }
+
+    if (flags & VMA_COPY_ON_WRITE) {
+        entry |= TABLE_ENTRY_COPY_ON_WRITE_ATTRIBUTE;
+    }
+
+    pt[index] = entry;
+
+    return true;
+}
+
+bool IsUserFrameMapped(uint64_t map, uint64_t v)
+{
+    PageTableEntry *pt = FindPageTable(map, v, 0);
+
+    return pt != NULL
+           && (pt[(v >> 12) & 0x1FF] & TABLE_ENTRY_PRESENT_ATTRIBUTE) != 0;
+}
+
+void *GetUserFrame(uint64_t map, uint64_t v)
+{
+    PageTableEntry *pt = FindPageTable(map, v, 0);
+    unsigned int index = (v >> 12) & 0x1FF;
+
+    if (pt == NULL || (pt[index] & TABLE_ENTRY_PRESENT_ATTRIBUTE) == 0) {
+        return NULL;
+    }
+
+    return (void *)PHY_TO_VIR(FRAME_ADDRESS(pt[index]));
+}
+
+uint32_t GetUserFrameCount(uint64_t map)
+{
+    PageTableEntry *pt = FindPageTable(map, USER_VIRTUAL_ADDRESS_BASE, 0);
+    uint32_t count = 0;
+
+    for (int i = 0; pt != NULL && i < TOTAL_PAGE_TABLE_ENTRIES; i++) {
+        if (pt[i] & TABLE_ENTRY_PRESENT_ATTRIBUTE) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+bool ShareUserFrames(uint64_t map, uint64_t source)
+{
+    PageTableEntry *pt = FindPageTable(source, USER_VIRTUAL_ADDRESS_BASE, 0);
+
+    for (int i = 0; pt != NULL && i < TOTAL_PAGE_TABLE_ENTRIES; i++) {
+        uint32_t flags = VMA_SHARED;
+
+        if ((pt[i] & TABLE_ENTRY_PRESENT_ATTRIBUTE) == 0) {
+            continue;
+        }
+
+        /* The writable frames are mapped read-only, the first write takes
+         * a copy in CopyOnWrite(). */
+        if (pt[i] & TABLE_ENTRY_WRITABLE_ATTRIBUTE) {
+            flags |= VMA_COPY_ON_WRITE;
+        }
+
+        if ((pt[i] & TABLE_ENTRY_NO_EXECUTE_ATTRIBUTE) == 0) {
+            flags |= VMA_EXEC;
+        }
+
+        if (!MapUserFrame(map,
+                          USER_VIRTUAL_ADDRESS_BASE + i * FRAME_SIZE,
+                          (void *)PHY_TO_VIR(FRAME_ADDRESS(pt[i])),
+                          flags)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CopyOnWrite(uint64_t map, uint64_t v)
+{
+    PageDir pd = FindPageDirPointerTableEntry(map, v, 0, 0);
+    PageTableEntry *pt = NULL;
+    unsigned int index = (v >> 21) & 0x1FF;
+    void *frame = NULL;
+
+    /* A 2MB page (the runtime text, the kernel) is never copy-on-write, and
+     * FindPageTable() doesn't accept it. */
+    if (pd == NULL
+        || (pd[index] & TABLE_ENTRY_PRESENT_ATTRIBUTE) == 0
+        || (pd[index] & TABLE_ENTRY_ENTRY_ATTRIBUTE) != 0) {
+        return false;
+    }
+
+    pt = FindPageTable(map, v, 0);
+    index = (v >> 12) & 0x1FF;
+    if ((pt[index] & TABLE_ENTRY_PRESENT_ATTRIBUTE) == 0) {
+        return false;
+    }
+
+    if (pt[index] & TABLE_ENTRY_WRITABLE_ATTRIBUTE) {
+        return true;
+    }
+
+    if ((pt[index] & TABLE_ENTRY_COPY_ON_WRITE_ATTRIBUTE) == 0) {
+        return false;
+    }
+
+    frame = AllocFrame();
+    if (frame == NULL) {
+        return false;
+    }
+
+    memcpy(frame, (void *)PHY_TO_VIR(FRAME_ADDRESS(pt[index])), FRAME_SIZE);
+
+    /* The page fault already dropped the read-only translation of this CPU,
+     * the threads of the process never share copy-on-write frames (see
+     * template.h), so no other CPU has it. */
+    pt[index] = VIR_TO_PHY(frame)
+                | (pt[index] & TABLE_ENTRY_NO_EXECUTE_ATTRIBUTE)
+                | TABLE_ENTRY_PRESENT_ATTRIBUTE
+                | TABLE_ENTRY_WRITABLE_ATTRIBUTE
+                | TABLE_ENTRY_USER_ATTRIBUTE;
+
+    return true;
+}
+
+bool BreakCopyOnWrite(uint64_t map)
+{
+    PageTableEntry *pt = FindPageTable(map, USER_VIRTUAL_ADDRESS_BASE, 0);
+
+    for (int i = 0; pt != NULL && i < TOTAL_PAGE_TABLE_ENTRIES; i++) {
+        if ((pt[i] & TABLE_ENTRY_COPY_ON_WRITE_ATTRIBUTE)
+            && !CopyOnWrite(map, USER_VIRTUAL_ADDRESS_BASE + i * FRAME_SIZE)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void *AllocFrame(void)
+{
+    Page *frame = NULL;
+    bool is_zeroed = true;
+    bool refill = false;
+
+    AcquireSpinlock(&s_memory_lock);
+
+    frame = s_zeroed_frame_head.next;
+    if (frame != NULL) {
+        s_zeroed_frame_head.next = frame->next;
+        s_zeroed_frame_count--;
+    } else {
+        if (s_free_frame_head.next == NULL) {
+            /* Carve a new page into frames. */
+            char *page = PopFreePage();
+            if (page == NULL) {
+                ReleaseSpinlock(&s_memory_lock);
+                return NULL;
+            }
+
+            for (uint64_t offset = 0;
+                 offset < PAGE_SIZE;
+                 offset += FRAME_SIZE) {
+                PushFreeFrame(page + offset);
+            }
+        }
+
+        frame = s_free_frame_head.next;
+        s_free_frame_head.next = frame->next;
+        is_zeroed = false;
+    }
+
+    refill = s_zeroed_frame_count < FRAME_ZEROED_LOW_WATERMARK
+             && s_free_frame_head.next != NULL;
+
+    ReleaseSpinlock(&s_memory_lock);
+
+    /* The frame is ours, it is zeroed out of the lock. A zeroed frame only
+     * has its link left to clear. */
+    if (is_zeroed) {
+        frame->next = NULL;
+    } else {
+        memset(frame, 0, FRAME_SIZE);
+    }
+
+    if (refill) {
+        QueueWork(GetSystemWorkQueue(), &s_zero_frames_work);
+    }
+
+    return frame;
+}
+
+void FreeFrame(void *frame)
+{
+    AcquireSpinlock(&s_memory_lock);
+    PushFreeFrame(frame);
+    ReleaseSpinlock(&s_memory_lock);
+}
+
+uint64_t GetUVMPage(uint64_t map, uint64_t v)
+{
+    PageDir pd = FindPageDirPointerTableEntry(map, v, 0, 0);
+    unsigned int index = (v >> 21) & 0x1FF;
+
+    if (pd == NULL || (pd[index] & TABLE_ENTRY_PRESENT_ATTRIBUTE) == 0) {
+        return 0;
+    }
+
+    return PHY_TO_VIR(PAGE_ADDRESS(pd[index]));
+}
+
 /* Private function ----------------------------------------------------------*/
 static void FreeRegion(uint64_t v_start, uint64_t v_end)
 {
@@ -328,6 +803,104 @@ static void FreeRegion(uint64_t v_start, uint64_t v_end)
     }
 }
 
+static void *PopFreePage(void)
+{
+    Page *page_address = s_free_memory_page_head.next;
+
+    if (page_address != NULL) {
+        /* Check the address is aligned. */
+        ASSERT_ADDR_IS_ALIGNED((uint64_t)page_address);
+
+        /* Check the address is not within kernel and not out of memory. */
+        ASSERT((uint64_t)page_address >= (uint64_t)&l_kernel_end);
+        ASSERT((uint64_t)page_address + PAGE_SIZE <= VIRTUAL_ADDRESS_END);
+
+        s_free_memory_page_head.next = page_address->next;
+    }
+
+    return (void *)page_address;
+}
+
+static void PushFreePage(uint64_t addr)
+{
+    /* Check the address is aligned. */
+    ASSERT_ADDR_IS_ALIGNED(addr);
+
+     /* Check the address is not within kernel and not out of memory. */
+    ASSERT(addr >= (uint64_t)&l_kernel_end);
+    ASSERT(addr + PAGE_SIZE <= VIRTUAL_ADDRESS_END);
+
+    /* To free memory, we just add it to the free memory page linked list. */
+    Page *page_address = (Page *)addr;
+    page_address->next = s_free_memory_page_head.next;
+    s_free_memory_page_head.next = page_address;
+}
+
+static void PushFreeFrame(void *frame)
+{
+    Page *page = (Page *)frame;
+
+    ASSERT(FRAME_ALIGN_DOWN(frame) == (uint64_t)frame);
+    ASSERT((uint64_t)frame >= (uint64_t)&l_kernel_end);
+
+    page->next = s_free_frame_head.next;
+    s_free_frame_head.next = page;
+}
+
+static bool MapDevicePages(uint64_t map)
+{
+    for (int i = 0; i < s_device_page_count; i++) {
+        if (!MapPages(map,
+                      PHY_TO_VIR(s_device_pages[i]),
+                      PHY_TO_VIR(s_device_pages[i]) + PAGE_SIZE,
+                      s_device_pages[i],
+                      DEVICE_PAGE_ATTRIBUTES)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void ZeroFreeFrames(void *data)
+{
+    bool refill = false;
+
+    for (int i = 0; i < FRAME_ZEROED_BATCH; i++) {
+        Page *frame = NULL;
+
+        AcquireSpinlock(&s_memory_lock);
+        frame = s_free_frame_head.next;
+        if (frame == NULL
+            || s_zeroed_frame_count >= FRAME_ZEROED_HIGH_WATERMARK) {
+            ReleaseSpinlock(&s_memory_lock);
+            return;
+        }
+
+        s_free_frame_head.next = frame->next;
+        ReleaseSpinlock(&s_memory_lock);
+
+        /* Nobody else sees the frame while it is zeroed. */
+        memset(frame, 0, FRAME_SIZE);
+
+        AcquireSpinlock(&s_memory_lock);
+        frame->next = s_zeroed_frame_head.next;
+        s_zeroed_frame_head.next = frame;
+        s_zeroed_frame_count++;
+        ReleaseSpinlock(&s_memory_lock);
+    }
+
+    /* Give the CPU back between batches. */
+    AcquireSpinlock(&s_memory_lock);
+    refill = s_zeroed_frame_count < FRAME_ZEROED_HIGH_WATERMARK
+             && s_free_frame_head.next != NULL;
+    ReleaseSpinlock(&s_memory_lock);
+
+    if (refill) {
+        QueueWork(GetSystemWorkQueue(), &s_zero_frames_work);
+    }
+}
+
 static PageDirPointerTable
 FindPML4TableEntry(uint64_t map,
                     uint64_t v,
@@ -343,9 +916,8 @@ FindPML4TableEntry(uint64_t map,
                 PHY_TO_VIR(PAGE_DIRECTORY_TABLE_ADDRESS(map_entry[index]));
     } else if (alloc == 1) {
         /* New Page Directory not exist, we create new one. */
-        pdptr = (PageDirPointerTable)kalloc();
+        pdptr = (PageDirPointerTable)AllocFrame();
         if (pdptr != NULL) {
-            memset(pdptr, 0, PAGE_SIZE);
             map_entry[index] = (PageDirPointerTable)
                                 (VIR_TO_PHY(pdptr) | attribute);
         }
@@ -420,9 +992,8 @@ static PageDir FindPageDirPointerTableEntry(uint64_t map,
         pd = (PageDir) PHY_TO_VIR(PAGE_DIRECTORY_TABLE_ADDRESS(pdptr[index]));
     } else if (alloc == 1) {
         /* If Page Directory does not exist, we create new one. */
-        pd = (PageDir)kalloc();
+        pd = (PageDir)AllocFrame();
         if (pd != NULL) {
-            memset(pd, 0, PAGE_SIZE);
             pdptr[index] = (PageDir)(VIR_TO_PHY(pd) | attr);
         }
     }
@@ -443,10 +1014,17 @@ static void FreePages(uint64_t map, uint64_t v_start, uint64_t v_end)
             index = (v_start >> 21) & 0x1FF;
 
             /* The present bit should be set when we free it because the PDPT,
-             * the entry in the PDPT is pointing to 2MB physical address. */
-            if (pd[index] & TABLE_ENTRY_PRESENT_ATTRIBUTE) {
+             * the entry in the PDPT is pointing to 2MB physical address, or to
+             * a page table of 4KB frames. */
+            if ((pd[index] & TABLE_ENTRY_PRESENT_ATTRIBUTE) == 0) {
+                /* Nothing is mapped. */
+            } else if (pd[index] & TABLE_ENTRY_ENTRY_ATTRIBUTE) {
                 kfree(PHY_TO_VIR(PAGE_ADDRESS(pd[index])));
                 pd[index] = 0;
+            } else {
+                FreePageTable((PageTableEntry *)
+                              PHY_TO_VIR(FRAME_ADDRESS(pd[index])));
+                pd[index] = 0;
             }
         }
 
@@ -454,9 +1032,73 @@ static void FreePages(uint64_t map, uint64_t v_start, uint64_t v_end)
     } while (v_start + PAGE_SIZE <= v_end);
 }
 
+static PageTableEntry *FindPageTable(uint64_t map, uint64_t v, int alloc)
+{
+    PageTableEntry *pt = NULL;
+    PageDir pd = NULL;
+    unsigned int index = (v >> 21) & 0x1FF;
+
+    pd = FindPageDirPointerTableEntry(map,
+                                      v,
+                                      alloc,
+                                      TABLE_ENTRY_PRESENT_ATTRIBUTE
+                                      | TABLE_ENTRY_WRITABLE_ATTRIBUTE
+                                      | TABLE_ENTRY_USER_ATTRIBUTE);
+    if (pd == NULL) {
+        return NULL;
+    }
+
+    if (pd[index] & TABLE_ENTRY_PRESENT_ATTRIBUTE) {
+        ASSERT((pd[index] & TABLE_ENTRY_ENTRY_ATTRIBUTE) == 0);
+        pt = (PageTableEntry *)PHY_TO_VIR(FRAME_ADDRESS(pd[index]));
+    } else if (alloc == 1) {
+        /* Access rights are checked in the page table entries, the directory
+         * entry allows everything. */
+        pt = AllocFrame();
+        if (pt != NULL) {
+            pd[index] = (PageDirEntry)(VIR_TO_PHY(pt)
+                                       | TABLE_ENTRY_PRESENT_ATTRIBUTE
+                                       | TABLE_ENTRY_WRITABLE_ATTRIBUTE
+                                       | TABLE_ENTRY_USER_ATTRIBUTE);
+        }
+    }
+
+    return pt;
+}
+
+static void FreePageTable(PageTableEntry *pt)
+{
+    for (int i = 0; i < TOTAL_PAGE_TABLE_ENTRIES; i++) {
+        if ((pt[i] & TABLE_ENTRY_PRESENT_ATTRIBUTE)
+            && (pt[i] & TABLE_ENTRY_SHARED_ATTRIBUTE) == 0) {
+            FreeFrame((void *)PHY_TO_VIR(FRAME_ADDRESS(pt[i])));
+        }
+
+        pt[i] = 0;
+    }
+
+    FreeFrame(pt);
+}
+
+static void EnableNoExecute(void)
+{
+    uint32_t regs[4] = {0};
+
+    CPUID(CPUID_EXTENDED_FEATURES & 0x80000000, regs);
+    if (regs[0] < CPUID_EXTENDED_FEATURES) {
+        return;
+    }
+
+    CPUID(CPUID_EXTENDED_FEATURES, regs);
+    if (regs[3] & CPUID_EXTENDED_FEATURE_NO_EXECUTE) {
+        WriteMSR(MSR_EFER, ReadMSR(MSR_EFER) | EFER_NO_EXECUTE_ENABLE);
+        s_no_execute = true;
+    }
+}
+
 static void FreePML4Table(uint64_t map)
 {
-    kfree(map);
+    FreeFrame((void *)map);
 }
 
 static void FreePDTable(uint64_t map)
@@ -473,7 +1115,20 @@ static void FreePDTable(uint64_t map)
              * directory tables. */
             for (int j = 0; j < TOTAL_PAGE_DIR_TABLE_OF_EACH_PDPT; j++) {
                 if ((uint64_t)pdptr[j] & TABLE_ENTRY_PRESENT_ATTRIBUTE) {
-                    kfree(PHY_TO_VIR(PAGE_DIRECTORY_TABLE_ADDRESS(pdptr[j])));
+                    PageDir pd = (PageDir)
+                        PHY_TO_VIR(PAGE_DIRECTORY_TABLE_ADDRESS(pdptr[j]));
+
+                    /* Page tables outside of the user window (the data pages
+                     * of the vDSO) are freed with their directory. */
+                    for (int k = 0; k < TOTAL_PAGE_TABLE_ENTRIES; k++) {
+                        if ((pd[k] & TABLE_ENTRY_PRESENT_ATTRIBUTE)
+                            && (pd[k] & TABLE_ENTRY_ENTRY_ATTRIBUTE) == 0) {
+                            FreePageTable((PageTableEntry *)
+                                          PHY_TO_VIR(FRAME_ADDRESS(pd[k])));
+                        }
+                    }
+
+                    FreeFrame(pd);
                     pdptr[j] = 0;
                 }
             }
@@ -486,7 +1141,8 @@ static void FreePDPTable(uint64_t map)
     PageDirPointerTable *map_entry = (PageDirPointerTable *)map;
     for (int i = 0; i < TOTAL_PAGE_DIR_POINTER_TABLE; i++) {
         if ((uint64_t)map_entry[i] & TABLE_ENTRY_PRESENT_ATTRIBUTE) {
-            kfree(PHY_TO_VIR(PAGE_DIRECTORY_TABLE_ADDRESS(map_entry[i])));
+            FreeFrame((void *)
+                      PHY_TO_VIR(PAGE_DIRECTORY_TABLE_ADDRESS(map_entry[i])));
             map_entry[i] = 0;
         }
     }
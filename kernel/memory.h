@@ -128,6 +128,7 @@
 
 /* Public define -------------------------------------------------------------*/
 #define PAGE_SIZE                   (2 * 1024 * 1024)   /* 2MB.               */
+#define FRAME_SIZE                  4096                /* 4KB.               */
 #define KERNEL_VIRTUAL_ADDRESS_BASE 0xFFFF800000000000
 #define USER_VIRTUAL_ADDRESS_BASE   0x400000
 #define PHYSICAL_MEMORY_SIZE        0x40000000    /* 1GB. TODO: extend RAM.   */
@@ -145,6 +146,14 @@
  */
 #define PAGE_ALIGN_DOWN(v)  (((uint64_t)v>>21)<<21)
 
+/**
+ * @def Macros align the address to 4KB frame boundaries. User programs which
+ * are loaded on demand are mapped with 4KB frames, so every segment can have
+ * its own permissions.
+ */
+#define FRAME_ALIGN_UP(v)   (((uint64_t)(v) + FRAME_SIZE - 1) & ~(uint64_t)0xFFF)
+#define FRAME_ALIGN_DOWN(v) ((uint64_t)(v) & ~(uint64_t)0xFFF)
+
 /**
  * @def Macros convert between virtual address and physical address.
  */
@@ -157,7 +166,15 @@
 #define TABLE_ENTRY_PRESENT_ATTRIBUTE       BIT(0)
 #define TABLE_ENTRY_WRITABLE_ATTRIBUTE      BIT(1)
 #define TABLE_ENTRY_USER_ATTRIBUTE          BIT(2)
+#define TABLE_ENTRY_WRITE_THROUGH_ATTRIBUTE BIT(3)
+#define TABLE_ENTRY_CACHE_DISABLE_ATTRIBUTE BIT(4)
 #define TABLE_ENTRY_ENTRY_ATTRIBUTE         BIT(7)
+/* Available to software: the frame isn't owned by the page map. */
+#define TABLE_ENTRY_SHARED_ATTRIBUTE        BIT(9)
+/* Available to software: the frame is read-only until the first write, which
+ * copies it (it is shared too). */
+#define TABLE_ENTRY_COPY_ON_WRITE_ATTRIBUTE BIT(10)
+#define TABLE_ENTRY_NO_EXECUTE_ATTRIBUTE    (1ULL << 63)
 
 /**
  * @def Macros retrieve page table entry addresses by clear attributes bit.
@@ -166,6 +183,7 @@
 #define PAGE_DIRECTORY_POINTER_TABLE_ADDRESS(p)     (((uint64_t)p >> 12) << 12)
 #define PAGE_DIRECTORY_TABLE_ADDRESS(p)             (((uint64_t)p >> 12) << 12)
 #define PAGE_ADDRESS(p)                             (((uint64_t)p >> 21) << 21)
+#define FRAME_ADDRESS(p)            ((uint64_t)(p) & 0x000FFFFFFFFFF000)
 
 #define ADDR_IS_ALIGNED(a)              (((uint64_t)a % PAGE_SIZE) == 0)
 #define ASSERT_ADDR_IS_ALIGNED(a)       ASSERT(ADDR_IS_ALIGNED(a))
@@ -175,6 +193,19 @@
 /* Each PDP table also include 512 entries which point to page directory tables.
  */
 #define TOTAL_PAGE_DIR_TABLE_OF_EACH_PDPT           512
+/* Each page table include 512 entries which point to 4KB frames. */
+#define TOTAL_PAGE_TABLE_ENTRIES                    512
+
+/**
+ * @def Access rights of a virtual memory area.
+ */
+#define VMA_READ                    BIT(0)
+#define VMA_WRITE                   BIT(1)
+#define VMA_EXEC                    BIT(2)
+/* The frame is shared, it isn't freed with the page map. */
+#define VMA_SHARED                  BIT(3)
+/* The shared frame is copied at the first write. */
+#define VMA_COPY_ON_WRITE           BIT(4)
 
 /* Public type ---------------------------------------------------------------*/
 /**
@@ -215,6 +246,28 @@ typedef struct Page Page;
 typedef uint64_t PageDirEntry;
 typedef PageDirEntry* PageDir;
 typedef PageDir* PageDirPointerTable;
+typedef uint64_t PageTableEntry;
+
+/**
+ * @brief   Virtual memory area of a process which is mapped on demand. Frames
+ *          in [file_start, file_end) are read from the program file at
+ *          `file_offset`, the rest of the area is filled with zero.
+ *
+ * @property start          - Start address, aligned to FRAME_SIZE.
+ * @property end            - End address, aligned to FRAME_SIZE.
+ * @property file_start     - Virtual address of the first byte from the file.
+ * @property file_end       - End of the data from the file.
+ * @property file_offset    - Offset of `file_start` in the file.
+ * @property flags          - VMA_READ, VMA_WRITE, VMA_EXEC.
+ */
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint64_t file_start;
+    uint64_t file_end;
+    uint64_t file_offset;
+    uint32_t flags;
+} VMArea;
 
 /* Public function prototype -------------------------------------------------*/
 void LoadCR3(uint64_t map);
@@ -241,13 +294,132 @@ void SwitchVM(uint64_t map);
 bool SetupUVM(uint64_t map, uint64_t start_location, int size);
 
 /**
- * @brief   Setup kernel virtual memory, we can allocate a new free memory page
- *          (2MB) that is used as the new page map level 4 table.
+ * @brief   Setup kernel virtual memory, we can allocate a new free frame (4KB)
+ *          that is used as the new page map level 4 table.
  */
 uint64_t SetupKVM(void);
 
+/**
+ * @brief   Copy the user memory of `current_page` map to `new_page` map. The
+ *          user memory is either one 2MB page, or 4KB frames mapped on demand,
+ *          in which case only present frames are copied.
+ */
 bool CopyUVM(uint64_t new_page, uint64_t current_page, int size);
 
+/**
+ * @brief   Free the user memory (USER_VIRTUAL_ADDRESS_BASE page) of the map,
+ *          so it can be mapped again frame by frame. The caller must reload
+ *          CR3 if the map is in use.
+ */
+void ReleaseUVM(uint64_t map);
+
+/**
+ * @brief   Map a 4KB frame to user virtual address `v`.
+ *
+ * @param map           - Page map level 4 table.
+ * @param v             - User virtual address, aligned to FRAME_SIZE.
+ * @param frame         - Kernel virtual address of the frame.
+ * @param flags         - VMA_WRITE, VMA_EXEC access rights, VMA_SHARED if the
+ *                        frame must outlive the page map, VMA_COPY_ON_WRITE
+ *                        (with VMA_SHARED) if the frame is copied at the
+ *                        first write.
+ * @return true         - Success.
+ * @return false        - Out of memory.
+ */
+bool MapUserFrame(uint64_t map, uint64_t v, void *frame, uint32_t flags);
+
+/**
+ * @brief   Check if a 4KB frame is mapped at user virtual address `v`. A page
+ *          fault can be handled late, when a thread on another CPU already
+ *          mapped the frame.
+ */
+bool IsUserFrameMapped(uint64_t map, uint64_t v);
+
+/**
+ * @brief   Get kernel virtual address of the 4KB frame mapped at user virtual
+ *          address `v`, or NULL if nothing is mapped there.
+ */
+void *GetUserFrame(uint64_t map, uint64_t v);
+
+/**
+ * @brief   Number of 4KB frames mapped in the user window of the map.
+ */
+uint32_t GetUserFrameCount(uint64_t map);
+
+/**
+ * @brief   Map the frames of the user window of `source` to `map`, which has
+ *          none yet. The frames stay owned by `source`: the read-only ones are
+ *          shared, the writable ones are copied at the first write, so
+ *          `source` must outlive `map` and never be written again.
+ *
+ * @return  true        - Success.
+ * @return  false       - Out of memory, the caller frees `map`.
+ */
+bool ShareUserFrames(uint64_t map, uint64_t source);
+
+/**
+ * @brief   Give the frame mapped at `v` its own copy after a write fault on a
+ *          copy-on-write frame.
+ *
+ * @return  true        - The frame is writable, the write can be restarted.
+ * @return  false       - The frame isn't copy-on-write, or out of memory.
+ */
+bool CopyOnWrite(uint64_t map, uint64_t v);
+
+/**
+ * @brief   Copy every copy-on-write frame of the user window. The caller must
+ *          reload CR3 if the map is in use.
+ *
+ * @return  false       - Out of memory, some frames are still shared.
+ */
+bool BreakCopyOnWrite(uint64_t map);
+
+/**
+ * @brief   Map physical memory above the kernel mapping (device registers,
+ *          firmware tables) at PHY_TO_VIR(phys), with the cache disabled. The
+ *          mapping is kept in every page map created afterward, so it must be
+ *          done at boot, before the first process.
+ *
+ * @return  The kernel virtual address of `phys`, or NULL if too many pages
+ *          are mapped.
+ */
+void *MapDeviceMemory(uint64_t phys, uint64_t size);
+
+/**
+ * @brief   Load the kernel page map on a secondary CPU, which starts on the
+ *          page tables of the loader, and enable the no-execute bit there.
+ */
+void InitSecondaryMemory(void);
+
+/**
+ * @brief   Allocate and free 4KB frames. Frames are carved from kalloc() pages,
+ *          and are kept in their own free list once they are freed. A worker
+ *          of the system work queue keeps a few free frames zeroed ahead, so
+ *          AllocFrame() rarely zeroes a frame itself, it always returns a
+ *          zeroed frame. The free lists are shared by all CPUs, they are
+ *          protected by a spinlock.
+ */
+void *AllocFrame(void);
+void FreeFrame(void *frame);
+
+/**
+ * @brief   Map a page which is shared between virtual memories at `v`. The page
+ *          is read-only for user code, and it is never freed by FreeVM().
+ *
+ * @param map           - Page map level 4 table.
+ * @param v             - User virtual address, aligned to page size.
+ * @param page          - Kernel virtual address of the shared page.
+ * @return true         - The page is mapped (or was already mapped) at `v`.
+ * @return false        - Out of memory, or another page is mapped at `v`.
+ */
+bool MapSharedUVM(uint64_t map, uint64_t v, uint64_t page);
+
+/**
+ * @brief   Get kernel virtual address of the page mapped at user virtual
+ *          address `v`, or 0 if nothing is mapped there.
+ */
+uint64_t GetUVMPage(uint64_t map, uint64_t v);
+
 void FreeVM(uint64_t map);
 
 void kfree(uint64_t addr);
@@ -261,4 +433,9 @@ void kfree(uint64_t addr);
  */
 void* kalloc(void);
 
-uint64_t GetTotalMem(void);
\ No newline at end of file
+uint64_t GetTotalMem(void);
+
+/**
+ * @brief   Size of the free pages and frames, it walks the free lists.
+ */
+uint64_t GetFreeMemory(void);
\ No newline at end of file
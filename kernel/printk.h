@@ -1,9 +1,14 @@
 #pragma once
 
-/* NOTE: Currently, we only support %x, %d, %s, %u specifiers.
+/* NOTE: Formatting is done by vsnprintf() in libc, see <format.h> for the
+ * supported specifiers. Output longer than 1KB is truncated.
  */
 int printk(const char *format, ...);
 
-int sprintk(char *str, const char *format, ...);
+/**
+ * @brief   Write `size` characters of `buffer` to the screen as is, without
+ *          interpreting any format specifier.
+ */
+void WriteConsole(const char *buffer, int size);
 
-void ClrSrc(void);
\ No newline at end of file
+void ClrSrc(void);
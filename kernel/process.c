@@ -1,369 +1,2343 @@
 #include <errno.h>
+#include <stddef.h>
 #include <string.h>
 
 #include "process.h"
+#include "cache.h"
+#include "kstack.h"
+#include "workqueue.h"
 #include "file.h"
+#include "runtime.h"
+#include "loader.h"
 #include "printk.h"
 #include "assert.h"
+#include "smp.h"
+#include "vdso.h"
+#include "ring.h"
+#include "template.h"
+#include "checkpoint.h"
+#include "spinlock.h"
 
 /* Private Define ------------------------------------------------------------*/
-#define IDLE_PROCESS_PID                0
-#define USER_INIT_PROCESS_ADDRESS_BASE  0x20000         /* Our shell program. */
-#define SIZE_OF_INIT_PROCCESS           (512 * 20)      /* 20 sectors.        */
+#define USER_INIT_PROCESS_ADDRESS_BASE  0x30000         /* Our shell program. */
+#define SIZE_OF_INIT_PROCCESS           (512 * 32)      /* 32 sectors.        */
+#define NO_WAIT_ID                      0
+#define PID_BITMAP_WORDS                (PID_MAXIMUM / 64)
 
-/* Private variable ----------------------------------------------------------*/
+/* Memory a process needs, beside its process object: the kernel stack, the
+ * paging tables and the frames of a small program. */
+#define PROCESS_MEMORY_ESTIMATE         (KERNEL_STACK_SIZE + 64 * FRAME_SIZE)
+
+/* A zombie which still runs on another CPU is reaped at the next tick. */
+#define REAP_RETRY_DELAY                (MILLISECONDS_PER_TICK                \
+                                         * NANOSECONDS_PER_MILLISECOND)
+
+/* exit() looks again at the next tick for a thread preempted in the kernel. */
+#define EXIT_RETRY_DELAY                REAP_RETRY_DELAY
+
+/* Scheduler work which an interrupt left for the end of a system call. */
+#define DEFERRED_TICK                   BIT(0)
+#define DEFERRED_PREEMPT                BIT(1)
+
+#define WAIT_LINK_TO_PROCESS(link)      ((Process *)((char *)(link)           \
+                                         - offsetof(Process, wait_link)))
+
+/* Private type --------------------------------------------------------------*/
+/**
+ * @brief   Arguments of a process which spawn() creates, the caller copies
+ *          them to a frame and the new process pushes them on its stack.
+ *
+ * @property count      - Number of arguments.
+ * @property length     - Bytes of the strings, with their '\0'.
+ * @property strings    - The arguments, one after the other.
+ */
+typedef struct {
+    int count;
+    uint32_t length;
+    char strings[FRAME_SIZE - 8];
+} SpawnArguments;
 
-extern TSS TaskStateSegment; /* Extern from ASM. */
-static Process s_process_manager[MAXIMUM_NUMBER_OF_PROCESS];
-static int s_pid_num = 1;
+/* Private variable ----------------------------------------------------------*/
+/* Time quantum of each priority level, in timer ticks. */
+static const uint32_t s_quantum_ticks[SCHEDULER_PRIORITY_LEVELS] = {1, 2, 4, 8};
+
+static Process s_idle_processes[CPU_MAXIMUM];
+static Process *s_init_process = NULL;
+static ObjectCache s_process_cache;
+static ObjectCache s_process_files_cache;
+static uint64_t s_pid_bitmap[PID_BITMAP_WORDS];
+static int s_last_pid = 0;
+static Process *s_pid_hash[PID_HASH_BUCKETS];
+static uint32_t s_process_count = 0;
+static uint32_t s_process_limit = 0;
+/* Zombies waiting for a worker to release them, linked by `next`. */
+static Process *s_dead_procs = NULL;
+static Work s_reap_work;
 static Scheduler s_scheduler;
 
-/* Private function prototypes -----------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+
+/**
+ * @brief   Allocate a process object, its file descriptor table and a PID,
+ *          and add it to the PID hash table.
+ *
+ * @param   files   - File descriptor table of the thread group, or NULL to
+ *                    allocate a new one.
+ * @return  The process, or NULL if the limit of processes is reached or the
+ *          system is out of memory.
+ */
+static Process *AllocProcess(ProcessFiles *files);
+
+/**
+ * @brief   Release the process object, its file descriptor table (unless it
+ *          is a thread, which shares it) and its PID.
+ */
+static void FreeProcess(Process *proc);
+
+/**
+ * @brief   Take the next free PID after the last one given.
+ *
+ * @return  The PID, or -1 if every PID is used.
+ */
+static int AllocPID(void);
+
+/**
+ * @brief   Allocate a process with a kernel stack and a trap frame which
+ *          returns to user mode.
+ *
+ * @param   leader  - NULL for a new process with its own page map, or the
+ *                    process whose page map and files the new thread shares.
+ * @return  The process, or NULL if it can't be created.
+ */
+static Process *CreateNewProcess(Process *leader);
+
+/**
+ * @brief   Bind the shared runtime if the program loaded in the current page
+ *          map is prelinked with it, and set the trap frame and the TLS base
+ *          to enter the program with an empty stack.
+ *
+ * @return  0, or -errno if the runtime can't be bound.
+ */
+static int EnterProgram(Process *proc, uint64_t entry);
+
+/**
+ * @brief   First code of a process which spawn() creates, it runs before the
+ *          process enters user mode: it enters the program in its own page
+ *          map, and pushes the arguments on the user stack. The entry point
+ *          and the arguments are passed in the trap frame.
+ */
+static void StartSpawnedProcess(void);
+
+/**
+ * @brief   Copy the arguments of spawn() from the caller.
+ *
+ * @return  0, or -E2BIG.
+ */
+static int CopySpawnArguments(SpawnArguments *args, char *const argv[]);
+
+/**
+ * @brief   Apply the file actions of spawn() to the new process.
+ *
+ * @return  0, -EBADF or -EINVAL.
+ */
+static int ApplySpawnFileActions(Process *proc,
+                                 const SpawnFileAction *actions);
+
+/**
+ * @brief   Add the counters of `usage` to `total`.
+ */
+static void AddUsage(ProcessUsage *total, const ProcessUsage *usage);
+
+/**
+ * @brief   Write the program file name of a process, "NAME.EXT", to `name`, or
+ *          an empty string if it has none.
+ */
+static void GetProgramName(Process *proc, char *name);
+/**
+ * @brief   Set TaskStateSegment point to top of the process's kernel stack. So
+ *          when we jump from ring 3 to ring 0, the kernel stack will be used.
+ * 
+ * @param   proc 
+ * @return  none
+ */
+static void SetTSS(Process *proc);
+
+static void Schedule(void);
+
+static void SwitchProcess(Process *prev, Process *new);
+
+/**
+ * @brief   Push a process to the tail of the ready queue of its priority level
+ *          and mark it as ready. A normal process goes to the run queue of
+ *          `proc->cpu`.
+ */
+static void ReadyListPush(Process *proc);
+
+/**
+ * @brief   Make a process ready on the CPU which SelectCPU() chooses, and
+ *          interrupt that CPU if it isn't the current one.
+ */
+static void Enqueue(Process *proc);
+
+/**
+ * @brief   CPU which runs a process which becomes ready: the CPU it ran on
+ *          last if it is idle, or any idle CPU, or the last one anyway.
+ */
+static int SelectCPU(Process *proc);
+
+/**
+ * @brief   The CPU runs its idle process and has no ready process.
+ */
+static bool IsCPUIdle(int cpu);
+
+/**
+ * @brief   Take the next ready process from the longest run queue of another
+ *          CPU, for the current CPU.
+ *
+ * @return  The process, or NULL if no other CPU has a ready process.
+ */
+static Process *StealProcess(void);
+
+/**
+ * @brief   Run queue of another CPU with the most ready processes, or NULL if
+ *          they are all empty.
+ */
+static RunQueue *FindBusiestRunQueue(void);
+
+/**
+ * @brief   Check if a process, or a thread of it, runs on a CPU. Its stack and
+ *          page map are in use until the CPU switches to another process.
+ */
+static bool IsRunningOnCPU(Process *proc);
+
+/**
+ * @brief   Timer callback of SleepOnUntil(), wake up the process if it is still
+ *          sleeping.
+ */
+static void SleepTimerExpired(void *data);
+
+/**
+ * @brief   Do the tick or the preemption which interrupts left to the CPU.
+ *          While the process is switched out, it is marked as preempted in the
+ *          kernel if `in_kernel` is true.
+ */
+static void RunDeferredScheduling(bool in_kernel);
+
+/**
+ * @brief   Check if a thread of the process, other than `except`, is switched
+ *          out in the middle of the kernel.
+ */
+static bool HasPreemptedThread(Process *leader, Process *except);
+
+/**
+ * @brief   Put the current process to sleep in `queue`, or in no queue if it is
+ *          NULL, and run the next process.
+ */
+static void Block(WaitQueue *queue, int wait_id);
+
+/**
+ * @brief   Remove a sleeping process from its wait queue and make it ready.
+ */
+static void WakeUpProcess(Process *proc);
+
+/**
+ * @brief   Wait queue of the legacy wait_id API.
+ */
+static inline WaitQueue *GetWaitChannel(int wait_id)
+{
+    return &s_scheduler.wait_channels[(uint32_t)wait_id
+                                      % WAIT_CHANNEL_BUCKETS];
+}
+
+static void WaitQueuePush(WaitQueue *queue, Process *proc);
+static void WaitQueueRemove(Process *proc);
+
+/**
+ * @brief   Add `child` to the children of `parent`, zombies go to the head of
+ *          the list and running processes to the tail.
+ */
+static void AddChild(Process *parent, Process *child);
+static void RemoveChild(Process *parent, Process *child);
+
+/**
+ * @brief   Give the children of the exiting process to the init process.
+ */
+static void ReparentChildren(Process *proc);
+
+/**
+ * @brief   Add a thread to the thread list of its leader, or remove it.
+ */
+static void AddThread(Process *leader, Process *thread);
+static void RemoveThread(Process *leader, Process *thread);
+
+/**
+ * @brief   Take a process which isn't running off its ready queue, wait queue
+ *          and timer, it won't run again.
+ */
+static void StopProcess(Process *proc);
+
+/**
+ * @brief   Stop every thread of `leader` but `except`, they are reaped by a
+ *          worker.
+ */
+static void StopThreads(Process *leader, Process *except, int status);
+
+/**
+ * @brief   Make a process a zombie with `status`: it leaves the scheduler, its
+ *          children are adopted by init and its parent is woken up.
+ */
+static void ExitProcess(Process *proc, int status);
+
+/**
+ * @brief   Release the resources of a zombie and its process object.
+ */
+static void ReapProcess(Process *proc);
+
+/**
+ * @brief   Hand a zombie which nobody waits for anymore to the system work
+ *          queue, which reaps it.
+ */
+static void DeferReap(Process *proc);
+
+/**
+ * @brief   Work function which reaps the deferred zombies.
+ */
+static void ReapDeadProcesses(void *data);
+
+/**
+ * @brief   Add a process to the list of real-time processes, and account for
+ *          its utilization.
+ */
+static void AddDeadlineProcess(Process *proc);
+
+/**
+ * @brief   Remove a real-time process from the list, it becomes a normal
+ *          process.
+ */
+static void RemoveDeadlineProcess(Process *proc);
+
+/**
+ * @brief   Remove a ready process from its ready queue.
+ */
+static void ReadyListRemove(Process *proc);
+
+/**
+ * @brief   Pop the real-time process with the earliest deadline, or the first
+ *          process of the highest priority non-empty ready queue of the run
+ *          queue.
+ *
+ * @return  The process, or NULL if every ready queue is empty.
+ */
+static Process *ReadyListPop(RunQueue *rq);
+
+/**
+ * @brief   Pop the first normal process of the highest priority non-empty
+ *          ready queue of the run queue.
+ */
+static Process *RunQueuePop(RunQueue *rq);
+
+/**
+ * @brief   Raise one level the ready processes of a run queue which have
+ *          waited at least SCHEDULER_AGING_TICKS.
+ */
+static void AgeReadyProcesses(RunQueue *rq);
+
+/**
+ * @brief   Find the ready real-time process with the earliest deadline.
+ *
+ * @return  The process, it is not removed from the queue, or NULL.
+ */
+static Process *FindEarliestDeadline(void);
+
+/**
+ * @brief   Count deadline misses, and release the jobs of real-time processes
+ *          which reached their next period.
+ */
+static void DeadlineTick(void);
+
+/**
+ * @brief   Release a new job of a real-time process: refill its budget, and
+ *          wake it up if it is waiting for the job.
+ */
+static void ReleaseJob(Process *proc);
+
+/**
+ * @brief   Highest priority level the process can reach with its nice value.
+ */
+static inline int GetBasePriority(Process *proc)
+{
+    return proc->nice * SCHEDULER_PRIORITY_LEVELS / (PROCESS_NICE_MAXIMUM + 1);
+}
+
+/**
+ * @brief   The process runs user code, it owns a page map and an FS base.
+ */
+static inline bool HasUserContext(Process *proc)
+{
+    return proc->pid != IDLE_PROCESS_PID
+           && !(proc->flags & PROCESS_FLAG_KERNEL_THREAD);
+}
+
+static inline RunQueue *GetRunQueue(int cpu)
+{
+    return &s_scheduler.run_queues[cpu];
+}
+
+static inline RunQueue *GetLocalRunQueue(void)
+{
+    return GetRunQueue(GetCPU()->id);
+}
+
+List *RemoveProcessWithPID(HeadList *list, int pid);
+
+static void InitShellProcess(void);
+
+/* Public function -----------------------------------------------------------*/
+void InitProcess(void)
+{
+    uint64_t limit = 0;
+
+    InitObjectCache(&s_process_cache, "process", sizeof(Process));
+    InitObjectCache(&s_process_files_cache,
+                    "process_files",
+                    sizeof(ProcessFiles));
+
+    /* Every process needs memory which is not taken yet, so the limit leaves
+     * no process without memory to run. */
+    limit = GetFreeMemory() / (PROCESS_MEMORY_ESTIMATE
+                               + sizeof(Process)
+                               + sizeof(ProcessFiles));
+    s_process_limit = limit < PID_MAXIMUM - 1 ? limit : PID_MAXIMUM - 1;
+    printk("Process limit: %u\n", s_process_limit);
+
+    InitWork(&s_reap_work, ReapDeadProcesses, NULL);
+
+    /* Init IDLE process first. */
+    InitIdleProcess(BOOT_CPU_ID, 0);
+
+    /* Run INIT process (Shell). */
+    InitShellProcess();
+}
+
+Scheduler *GetScheduler(void)
+{
+    return &s_scheduler;
+}
+
+Process *GetCurrentProcess(void)
+{
+    return GetLocalRunQueue()->current_proc;
+}
+
+void InitIdleProcess(int cpu, uint64_t stack)
+{
+    Process *proc = &s_idle_processes[cpu];
+    RunQueue *rq = GetRunQueue(cpu);
+
+    /* The idle processes are not allocated, they all hold the PID 0. */
+    s_pid_bitmap[0] |= 1ULL << IDLE_PROCESS_PID;
+    proc->pid = IDLE_PROCESS_PID;
+    proc->page_map = PHY_TO_VIR(ReadCR3());
+    proc->state = PROCESS_SLOT_RUNNING;
+    proc->cpu = cpu;
+    proc->stack = stack;
+
+    rq->idle_proc = proc;
+    rq->current_proc = proc;
+}
+
+bool NeedsSchedulerTick(void)
+{
+    Process *proc = GetCurrentProcess();
+    RunQueue *rq = GetLocalRunQueue();
+
+    if (proc->sched_class == SCHEDULER_CLASS_DEADLINE
+        || (GetCPU()->id == BOOT_CPU_ID
+            && GetScheduler()->deadline_procs != NULL)) {
+        return true;
+    }
+
+    return proc != rq->idle_proc && rq->ready_count > 0;
+}
+
+void ScheduleIfStopped(void)
+{
+    /* Another CPU stopped the process while it was running here, by exit() or
+     * exec() in one of its threads. */
+    if (GetCurrentProcess()->state == PROCESS_SLOT_ZOMBIE) {
+        Schedule();
+    }
+}
+
+Process *FindProcess(int pid)
+{
+    Process *proc = NULL;
+
+    if (pid < 0 || pid >= PID_MAXIMUM) {
+        return NULL;
+    }
+
+    proc = s_pid_hash[pid % PID_HASH_BUCKETS];
+    while (proc != NULL && proc->pid != pid) {
+        proc = proc->hash_next;
+    }
+
+    return proc;
+}
+
+uint32_t GetProcessLimit(void)
+{
+    return s_process_limit;
+}
+
+void AccountCPUTime(bool user)
+{
+    Process *proc = GetCurrentProcess();
+    uint64_t now = __builtin_ia32_rdtsc();
+
+    if (user) {
+        proc->usage.user_cycles += now - proc->account_tsc;
+    } else {
+        proc->usage.system_cycles += now - proc->account_tsc;
+    }
+
+    proc->account_tsc = now;
+}
+
+int GetResourceUsage(int who, ResourceUsage *usage)
+{
+    Process *leader = GetThreadLeader(GetCurrentProcess());
+    ProcessUsage total = {0};
+    uint64_t ns[3];
+
+    /* The system call so far is system time of the caller. */
+    AccountCPUTime(false);
+
+    if (who == RUSAGE_SELF) {
+        AddUsage(&total, &leader->usage);
+        for (Process *thread = leader->first_thread;
+             thread != NULL;
+             thread = thread->next_thread) {
+            AddUsage(&total, &thread->usage);
+        }
+    } else if (who == RUSAGE_CHILDREN) {
+        total = leader->children_usage;
+    } else {
+        return -EINVAL;
+    }
+
+    ns[0] = CyclesToNanoseconds(total.user_cycles);
+    ns[1] = CyclesToNanoseconds(total.system_cycles);
+    ns[2] = CyclesToNanoseconds(total.wait_cycles);
+
+    usage->user_time.tv_sec = ns[0] / NANOSECONDS_PER_SECOND;
+    usage->user_time.tv_nsec = ns[0] % NANOSECONDS_PER_SECOND;
+    usage->system_time.tv_sec = ns[1] / NANOSECONDS_PER_SECOND;
+    usage->system_time.tv_nsec = ns[1] % NANOSECONDS_PER_SECOND;
+    usage->wait_time.tv_sec = ns[2] / NANOSECONDS_PER_SECOND;
+    usage->wait_time.tv_nsec = ns[2] % NANOSECONDS_PER_SECOND;
+    usage->voluntary_switches = total.voluntary_switches;
+    usage->involuntary_switches = total.involuntary_switches;
+    usage->system_calls = total.system_calls;
+
+    return 0;
+}
+
+int GetProcessList(ProcessInfo *list, int count)
+{
+    Process *proc = NULL;
+    int filled = 0;
+
+    AccountCPUTime(false);
+
+    /* The PID bitmap gives the processes in order, without a walk of the
+     * whole hash table. */
+    for (int word = 0; word < PID_BITMAP_WORDS && filled < count; word++) {
+        uint64_t bits = s_pid_bitmap[word];
+
+        while (bits != 0 && filled < count) {
+            int pid = word * 64 + __builtin_ctzll(bits);
+            ProcessInfo *info = &list[filled];
+
+            bits &= bits - 1;
+            proc = FindProcess(pid);
+            if (proc == NULL || pid == IDLE_PROCESS_PID) {
+                continue;
+            }
+
+            memset(info, 0, sizeof(ProcessInfo));
+            info->pid = pid;
+            info->parent_pid = proc->parent != NULL ? proc->parent->pid : 0;
+            info->leader_pid = GetThreadLeader(proc)->pid;
+            info->state = proc->state;
+            info->priority = proc->priority;
+            info->nice = proc->nice;
+            info->cpu = proc->cpu;
+            info->flags = proc->flags;
+            GetProgramName(proc, info->name);
+            info->user_time = CyclesToNanoseconds(proc->usage.user_cycles);
+            info->system_time = CyclesToNanoseconds(proc->usage.system_cycles);
+            info->wait_time = CyclesToNanoseconds(proc->usage.wait_cycles);
+            info->voluntary_switches = proc->usage.voluntary_switches;
+            info->involuntary_switches = proc->usage.involuntary_switches;
+            info->system_calls = proc->usage.system_calls;
+            filled++;
+        }
+    }
+
+    return filled;
+}
+
+void Yield(void)
+{
+    uint64_t flags = SaveInterrupts();
+    Process *proc = GetCurrentProcess();
+    RunQueue *rq = GetLocalRunQueue();
+
+    /* The idle process also looks for work on the other CPUs. */
+    if (rq->ready_bitmap == 0
+        && ListIsEmpty(&GetScheduler()->deadline_proc_list)
+        && (proc != rq->idle_proc || FindBusiestRunQueue() == NULL)) {
+        RestoreInterrupts(flags);
+        return;
+    }
+
+    /* Set the current process as ready, and push it to back of the ready
+     * queue of its level. */
+    proc->state = PROCESS_SLOT_READY;
+
+    /* We don't push the IDLE task to the ready list. */
+    if (proc->pid != IDLE_PROCESS_PID) {
+        ReadyListPush(proc);
+    }
+
+    /* Process switch. */
+    Schedule();
+    RestoreInterrupts(flags);
+}
+
+void SchedulerTick(void)
+{
+    Process *proc = GetCurrentProcess();
+    RunQueue *rq = GetLocalRunQueue();
+
+    /* A CPU doesn't tick while nothing waits in its run queue, ticks are
+     * counted from the clock. */
+    if (GetTicks() - rq->aged_ticks >= SCHEDULER_AGING_TICKS) {
+        AgeReadyProcesses(rq);
+        rq->aged_ticks = GetTicks();
+    }
+
+    /* The real-time processes are shared, one CPU updates them. */
+    if (GetCPU()->id == BOOT_CPU_ID) {
+        DeadlineTick();
+    }
+
+    if (proc->pid == IDLE_PROCESS_PID) {
+        Yield();
+        return;
+    }
+
+    if (proc->sched_class == SCHEDULER_CLASS_DEADLINE) {
+        if (proc->dl.budget > 0) {
+            proc->dl.budget--;
+        }
+
+        if (proc->dl.budget == 0) {
+            /* The job used its whole runtime, it is throttled until the next
+             * period. */
+            Sleep(DEADLINE_PROCESS_WAIT_ID);
+        } else {
+            Preempt();
+        }
+
+        return;
+    }
+
+    proc->used_ticks++;
+    if (proc->used_ticks < s_quantum_ticks[proc->priority]) {
+        /* The quantum is not over, but a woken up process may have higher
+         * priority. */
+        Preempt();
+        return;
+    }
+
+    /* The process used its whole quantum, it is CPU bound. */
+    if (proc->priority < SCHEDULER_PRIORITY_LEVELS - 1) {
+        proc->priority++;
+    }
+
+    proc->used_ticks = 0;
+    Yield();
+}
+
+void Preempt(void)
+{
+    Process *proc = GetCurrentProcess();
+    RunQueue *rq = GetLocalRunQueue();
+    Process *earliest = FindEarliestDeadline();
+
+    /* Real-time processes run before normal ones, and between themselves the
+     * earliest deadline first. */
+    if (earliest != NULL
+        && (proc->sched_class != SCHEDULER_CLASS_DEADLINE
+            || earliest->dl.absolute_deadline < proc->dl.absolute_deadline)) {
+        Yield();
+        return;
+    }
+
+    if (proc->sched_class == SCHEDULER_CLASS_DEADLINE) {
+        return;
+    }
+
+    /* The bits below the current level are the ready queues of higher
+     * priority. The IDLE task gives up the CPU to any ready process. */
+    if (proc->pid == IDLE_PROCESS_PID
+        || (rq->ready_bitmap & (BIT(proc->priority) - 1)) != 0) {
+        Yield();
+    }
+}
+
+void PreemptInterrupted(TrapFrame *tf, bool tick)
+{
+    Process *proc = GetCurrentProcess();
+    RunQueue *rq = GetLocalRunQueue();
+    bool in_kernel = (tf->cs & 3) != 3 && proc != rq->idle_proc;
+
+    rq->deferred |= tick ? DEFERRED_TICK : DEFERRED_PREEMPT;
+
+    /* The system call goes on, it is preempted at its end. */
+    if (in_kernel && proc->preempt_count != 0) {
+        return;
+    }
+
+    RunDeferredScheduling(in_kernel);
+}
+
+void DisablePreemption(void)
+{
+    /* The process can still move to another CPU until it is counted. */
+    uint64_t flags = SaveInterrupts();
+
+    GetCurrentProcess()->preempt_count++;
+    RestoreInterrupts(flags);
+}
+
+void EnablePreemption(void)
+{
+    uint64_t flags = SaveInterrupts();
+
+    ASSERT(GetCurrentProcess()->preempt_count > 0);
+
+    /* With the interrupts disabled, the caller is in a critical section or an
+     * exception handler, the work waits for the next interrupt. */
+    if (--GetCurrentProcess()->preempt_count == 0
+        && (flags & INTERRUPT_FLAG)
+        && GetLocalRunQueue()->deferred != 0) {
+        RunDeferredScheduling(true);
+    }
+
+    RestoreInterrupts(flags);
+}
+
+bool EnterPreemptible(void)
+{
+    /* Only the count taken by SystemCall() can be given back: a user page
+     * fault holds none, and a higher count is a critical section. */
+    if (GetCurrentProcess()->preempt_count != 1) {
+        return false;
+    }
+
+    EnablePreemption();
+    return true;
+}
+
+void LeavePreemptible(bool entered)
+{
+    if (entered) {
+        DisablePreemption();
+    }
+}
+
+int Nice(int increment)
+{
+    Process *proc = GetCurrentProcess();
+    int nice = proc->nice + increment;
+
+    /* There is no privileged user, so a negative increment can only give back
+     * what was given up. */
+    if (nice < 0) {
+        nice = 0;
+    } else if (nice > PROCESS_NICE_MAXIMUM) {
+        nice = PROCESS_NICE_MAXIMUM;
+    }
+
+    proc->nice = nice;
+    if (proc->priority < GetBasePriority(proc)) {
+        proc->priority = GetBasePriority(proc);
+    }
+
+    return nice;
+}
+
+int SetDeadline(uint32_t runtime, uint32_t period, uint32_t deadline)
+{
+    Scheduler *scheduler = GetScheduler();
+    Process *proc = GetCurrentProcess();
+    uint64_t utilization = 0;
+    uint64_t flags = 0;
+
+    if (runtime == 0) {
+        flags = SaveInterrupts();
+        RemoveDeadlineProcess(proc);
+        RestoreInterrupts(flags);
+        return 0;
+    }
+
+    /* The bound keeps the rounding and the utilization from wrapping. */
+    if (runtime > deadline
+        || deadline > period
+        || period > SCHEDULER_DEADLINE_MAXIMUM_PERIOD) {
+        return -EINVAL;
+    }
+
+    /* Round up to the timer resolution, the deadline is at least one tick
+     * because the runtime isn't 0. */
+    runtime = ((uint64_t)runtime + MILLISECONDS_PER_TICK - 1)
+              / MILLISECONDS_PER_TICK;
+    period = ((uint64_t)period + MILLISECONDS_PER_TICK - 1)
+             / MILLISECONDS_PER_TICK;
+    deadline = ((uint64_t)deadline + MILLISECONDS_PER_TICK - 1)
+               / MILLISECONDS_PER_TICK;
+    if (deadline == 0) {
+        return -EINVAL;
+    }
+
+    /* EDF meets every deadline as long as the total density (runtime over
+     * relative deadline) is not over 1, we keep a part of the CPU for normal
+     * processes. */
+    utilization = scheduler->deadline_utilization
+                  + (uint64_t)runtime * 1000 / deadline;
+    if (proc->sched_class == SCHEDULER_CLASS_DEADLINE) {
+        utilization -= (uint64_t)proc->dl.runtime * 1000 / proc->dl.deadline;
+    }
+
+    if (utilization > SCHEDULER_DEADLINE_UTILIZATION_LIMIT) {
+        return -EBUSY;
+    }
+
+    /* The timer interrupt walks the real-time processes. */
+    flags = SaveInterrupts();
+    RemoveDeadlineProcess(proc);
+    proc->dl.runtime = runtime;
+    proc->dl.period = period;
+    proc->dl.deadline = deadline;
+    proc->dl.release = GetTicks();
+    AddDeadlineProcess(proc);
+
+    ReleaseJob(proc);
+    RestoreInterrupts(flags);
+
+    return 0;
+}
+
+void DeadlineYield(void)
+{
+    Process *proc = GetCurrentProcess();
+    uint64_t flags = 0;
+
+    if (proc->sched_class != SCHEDULER_CLASS_DEADLINE) {
+        Yield();
+        return;
+    }
+
+    /* The timer interrupt must not release the job before it sleeps. */
+    flags = SaveInterrupts();
+    proc->dl.active = false;
+
+    if (GetTicks() >= proc->dl.release) {
+        /* The job finished late, the next one is already released. */
+        ReleaseJob(proc);
+    } else {
+        Sleep(DEADLINE_PROCESS_WAIT_ID);
+    }
+
+    RestoreInterrupts(flags);
+}
+
+int GetDeadlineMisses(void)
+{
+    return GetCurrentProcess()->dl.misses;
+}
+
+void Sleep(int wait_id)
+{
+    Block(GetWaitChannel(wait_id), wait_id);
+}
+
+void SleepOn(WaitQueue *queue)
+{
+    Block(queue, NO_WAIT_ID);
+}
+
+void SleepOnUntil(WaitQueue *queue, uint64_t expiry)
+{
+    /* The timer may not expire before the process sleeps. */
+    uint64_t flags = SaveInterrupts();
+    Process *proc = GetCurrentProcess();
+
+    AddTimer(&proc->timer, expiry, SleepTimerExpired, proc);
+    Block(queue, NO_WAIT_ID);
+    CancelTimer(&proc->timer);
+
+    RestoreInterrupts(flags);
+}
+
+bool WakeUpOne(WaitQueue *queue)
+{
+    uint64_t flags = SaveInterrupts();
+    bool woken = queue->first != NULL;
+
+    if (woken) {
+        WakeUpProcess(WAIT_LINK_TO_PROCESS(queue->first));
+    }
+
+    RestoreInterrupts(flags);
+    return woken;
+}
+
+void WakeUpAll(WaitQueue *queue)
+{
+    uint64_t flags = SaveInterrupts();
+
+    while (queue->first != NULL) {
+        WakeUpProcess(WAIT_LINK_TO_PROCESS(queue->first));
+    }
+
+    RestoreInterrupts(flags);
+}
+
+void Wakeup(int wait_id)
+{
+    uint64_t flags = SaveInterrupts();
+    WaitLink *link = GetWaitChannel(wait_id)->first;
+
+    /* Other ids can share the channel, only the matching processes are woken
+     * up. */
+    while (link != NULL) {
+        Process *proc = WAIT_LINK_TO_PROCESS(link);
+
+        link = link->next;
+        if (proc->wait_id == wait_id) {
+            WakeUpProcess(proc);
+        }
+    }
+
+    RestoreInterrupts(flags);
+}
+
+void Exit(int status)
+{
+    Process *proc = NULL;
+    Process *leader = NULL;
+
+    /* The process never comes back, the interrupts stay disabled until the
+     * switch. */
+    DisableInterrupts();
+    proc = GetCurrentProcess();
+    leader = GetThreadLeader(proc);
+
+    /* A thread which was switched out in the middle of the kernel may hold
+     * the disk, it gets out first. */
+    while (HasPreemptedThread(leader, proc)) {
+        SleepOnUntil(NULL, GetClockNanoseconds() + EXIT_RETRY_DELAY);
+    }
+
+    /* Every thread of the process exits with it. */
+    StopThreads(leader, proc, status);
+
+    if (proc != leader) {
+        /* The leader is the zombie which the parent reaps, the thread which
+         * called exit() is reaped by a worker. */
+        RemoveThread(leader, proc);
+        StopProcess(leader);
+        ExitProcess(leader, status);
+
+        proc->state = PROCESS_SLOT_ZOMBIE;
+        proc->exit_status = status;
+        CancelTimer(&proc->timer);
+        RemoveDeadlineProcess(proc);
+        DeferReap(proc);
+    } else {
+        ExitProcess(proc, status);
+    }
+
+    /* We re-schedule, the current process will be pop from ready list. */
+    Schedule();
+}
+
+int Wait(int pid, int *status, int options)
+{
+    /* The children belong to the process, any of its threads can wait. */
+    Process *proc = GetThreadLeader(GetCurrentProcess());
+    Process *child = NULL;
+
+    while (1) {
+        /* Zombies are at the head of the list, so the first child tells if
+         * any child exited. */
+        if (pid == -1) {
+            child = proc->first_child;
+        } else {
+            child = FindProcess(pid);
+        }
+
+        if (child == NULL || child->parent != proc) {
+            return -ECHILD;
+        }
+
+        if (child->state == PROCESS_SLOT_ZOMBIE) {
+            pid = child->pid;
+            if (status != NULL) {
+                *status = child->exit_status;
+            }
+
+            /* Its threads are already released to it. */
+            AddUsage(&proc->children_usage, &child->usage);
+            AddUsage(&proc->children_usage, &child->children_usage);
+
+            /* The child can't be waited for anymore, the cleanup is done by a
+             * worker, so the system call returns at once. */
+            RemoveChild(proc, child);
+            child->parent = NULL;
+            DeferReap(child);
+            return pid;
+        }
+
+        if (options & WAIT_NO_HANG) {
+            return 0;
+        }
+
+        SleepOn(&proc->child_exit_queue);
+    }
+}
+
+int Fork(void)
+{
+    Process *proc = NULL;
+    Process *current_proc = GetCurrentProcess();
+
+    proc = CreateNewProcess(NULL);
+    if (proc == NULL) {
+        printk("DEBUG: Failed to create new process.\n");
+        return -ENOMEM;
+    }
+
+    /* CopyUVM() releases the page map when it fails. */
+    if (!CopyUVM(proc->page_map, current_proc->page_map, PAGE_SIZE)) {
+        printk("DEBUG: Failed to copy virtual memory.\n");
+        FreeKernelStack((void *)proc->stack);
+        FreeProcess(proc);
+        return -ENOMEM;
+    }
+
+    if (!InheritRuntime(proc->page_map, current_proc->page_map)) {
+        printk("DEBUG: Failed to share the runtime.\n");
+        FreeVM(proc->page_map);
+        FreeKernelStack((void *)proc->stack);
+        FreeProcess(proc);
+        return -ENOMEM;
+    }
+
+    /* Frames which are not loaded yet are read from the same program. */
+    InheritImage(proc, GetThreadLeader(current_proc));
+
+    /* The new process points to the same FD entries. */
+    ShareFiles(proc, current_proc);
+
+    /* Copy the trap frame, therefore the new process will return to the same
+     * location as the current process does. */
+    memcpy(proc->tf, current_proc->tf, sizeof(TrapFrame));
+
+    /* This is return value in new process when it back to user mode. */
+    proc->tf->rax = 0;
+
+    /* The TLS of the child is at the same address. */
+    proc->fs_base = SaveFSBase();
+
+    /* The new process starts at the highest level its nice value allows. */
+    proc->nice = current_proc->nice;
+    proc->priority = GetBasePriority(proc);
+
+    /* A child forked by a thread is a child of the whole process. */
+    AddChild(GetThreadLeader(current_proc), proc);
+
+    /* Append it to a ready list, another CPU takes it if it is idle. */
+    proc->cpu = GetCPU()->id;
+    Enqueue(proc);
+
+    /* For current process, we return pid of new process. */
+    return proc->pid;
+}
+
+int Spawn(const char *path, char *const argv[], const SpawnFileAction *actions)
+{
+    Process *proc = NULL;
+    Process *current_proc = GetCurrentProcess();
+    SpawnArguments *args = NULL;
+    struct Template *template = NULL;
+    uint64_t entry = USER_VIRTUAL_ADDRESS_BASE;
+    int status = 0;
+
+    /* The arguments are in the memory of the caller, the new process gets
+     * them in a frame. */
+    args = AllocFrame();
+    if (args == NULL) {
+        return -ENOMEM;
+    }
+
+    status = CopySpawnArguments(args, argv);
+    if (status < 0) {
+        FreeFrame(args);
+        return status;
+    }
+
+    proc = CreateNewProcess(NULL);
+    if (proc == NULL) {
+        FreeFrame(args);
+        return -ENOMEM;
+    }
+
+    /* The program is opened with the descriptors of the new process, only
+     * its headers are read, and nothing is mapped until it runs. A program
+     * which has a template is cloned from it instead, without the disk. */
+    ShareFiles(proc, current_proc);
+    status = ApplySpawnFileActions(proc, actions);
+    template = FindTemplate(path);
+    if (status == 0 && template != NULL) {
+        status = CloneTemplate(proc, template);
+    } else if (status == 0) {
+        status = LoadProgram(proc, path, &entry);
+    }
+
+    if (status < 0) {
+        CloseFiles(proc);
+        FreeVM(proc->page_map);
+        FreeKernelStack((void *)proc->stack);
+        FreeProcess(proc);
+        FreeFrame(args);
+        return status;
+    }
+
+    /* ContextSwitch() returns to StartSpawnedProcess(), which returns to
+     * TrapReturn. The context moves one slot down, so the function is entered
+     * with the stack aligned like after a call. A clone resumes where its
+     * template stopped. */
+    if (proc->template == NULL) {
+        proc->tf->rip = entry;
+    }
+    proc->tf->rdi = (uint64_t)args;
+    proc->context -= 8;
+    memset((void *)proc->context, 0, 6*8);
+    *(uint64_t *)(proc->context + 6*8) = (uint64_t)StartSpawnedProcess;
+    *(uint64_t *)(proc->context + 7*8) = (uint64_t)TrapReturn;
+
+    proc->nice = current_proc->nice;
+    proc->priority = GetBasePriority(proc);
+    AddChild(GetThreadLeader(current_proc), proc);
+
+    proc->cpu = GetCPU()->id;
+    Enqueue(proc);
+
+    return proc->pid;
+}
+
+int Restore(const char *path)
+{
+    Process *proc = NULL;
+    Process *current_proc = GetCurrentProcess();
+    int status = 0;
+
+    proc = CreateNewProcess(NULL);
+    if (proc == NULL) {
+        return -ENOMEM;
+    }
+
+    /* The process only gets the files of its checkpoint, and it returns to
+     * TrapReturn with the saved registers, like a forked process. */
+    status = LoadCheckpoint(proc, path);
+    if (status < 0) {
+        CloseFiles(proc);
+        FreeVM(proc->page_map);
+        FreeKernelStack((void *)proc->stack);
+        FreeProcess(proc);
+        return status;
+    }
+
+    /* The saved level may be above what the nice value allows now. */
+    if (proc->priority < GetBasePriority(proc)) {
+        proc->priority = GetBasePriority(proc);
+    }
+    AddChild(GetThreadLeader(current_proc), proc);
+
+    proc->cpu = GetCPU()->id;
+    Enqueue(proc);
+
+    return proc->pid;
+}
+
+Process *CreateKernelThread(void (*entry)(void *data), void *data)
+{
+    return CreateProcessKernelThread(NULL, entry, data);
+}
+
+Process *CreateProcessKernelThread(Process *leader,
+                                   void (*entry)(void *data),
+                                   void *data)
+{
+    uint64_t *context = NULL;
+    Process *proc = NULL;
+
+    /* It writes to the user memory of the leader from another CPU. */
+    if (leader != NULL && UnshareTemplate(leader) < 0) {
+        return NULL;
+    }
+
+    proc = AllocProcess(leader != NULL ? leader->files : NULL);
+    if (proc == NULL) {
+        return NULL;
+    }
+
+    /* The files belong to the leader, they are not freed with the thread.
+     * A kernel thread runs with the interrupts disabled, and it is never
+     * preempted. */
+    proc->flags = PROCESS_FLAG_KERNEL_THREAD;
+    proc->preempt_count = 1;
+    if (leader != NULL) {
+        proc->flags |= PROCESS_FLAG_THREAD;
+    }
+
+    proc->stack = (uint64_t)AllocKernelStack();
+    if (proc->stack == 0) {
+        FreeProcess(proc);
+        return NULL;
+    }
+
+    proc->state = PROCESS_SLOT_INITIALIZED;
+    proc->page_map = s_idle_processes[BOOT_CPU_ID].page_map;
+
+    /* It faults in the user memory of the process like its threads do. */
+    if (leader != NULL) {
+        proc->leader = leader;
+        proc->page_map = leader->page_map;
+        proc->cpu = GetCPU()->id;
+        AddThread(leader, proc);
+    }
+
+    /* ContextSwitch() pops r15, r14, r13, r12, rbp, rbx and returns to
+     * KernelThreadStart, which calls entry (r12) with data (r13). 16 bytes are
+     * left on the top, so the stack is aligned when the entry is called. */
+    context = (uint64_t *)(proc->stack + KERNEL_STACK_SIZE - 16) - 7;
+    memset(context, 0, 7 * sizeof(uint64_t));
+    context[2] = (uint64_t)data;
+    context[3] = (uint64_t)entry;
+    context[6] = (uint64_t)KernelThreadStart;
+    proc->context = (uint64_t)context;
+
+    Enqueue(proc);
+
+    return proc;
+}
+
+int CreateThread(uint64_t entry, uint64_t stack, uint64_t arg)
+{
+    Process *current_proc = GetCurrentProcess();
+    Process *leader = GetThreadLeader(current_proc);
+    Process *thread = NULL;
+
+    /* The entry can be in the shared runtime, below the program. */
+    if (entry < USER_RUNTIME_TEXT_BASE
+        || entry >= USER_STACK_START
+        || stack <= USER_VIRTUAL_ADDRESS_BASE
+        || stack > USER_STACK_START) {
+        return -EINVAL;
+    }
+
+    thread = CreateNewProcess(leader);
+    if (thread == NULL) {
+        return -ENOMEM;
+    }
+
+    thread->tf->rip = entry;
+    thread->tf->rsp = stack;
+    thread->tf->rdi = arg;
+
+    thread->nice = current_proc->nice;
+    thread->priority = GetBasePriority(thread);
+
+    AddThread(leader, thread);
+    thread->cpu = GetCPU()->id;
+    Enqueue(thread);
+
+    return thread->pid;
+}
+
+void ExitThread(int status)
+{
+    Process *proc = GetCurrentProcess();
+
+    /* The main thread takes the whole process with it. */
+    if (!(proc->flags & PROCESS_FLAG_THREAD)) {
+        Exit(status);
+        return;
+    }
+
+    DisableInterrupts();
+    proc->state = PROCESS_SLOT_ZOMBIE;
+    proc->exit_status = status;
+    CancelTimer(&proc->timer);
+    RemoveDeadlineProcess(proc);
+
+    /* The zombie stays in the thread list until it is joined. */
+    WakeUpAll(&proc->leader->thread_exit_queue);
+
+    Schedule();
+}
+
+int JoinThread(int tid, int *status)
+{
+    Process *proc = GetCurrentProcess();
+    Process *leader = GetThreadLeader(proc);
+    Process *thread = NULL;
+
+    while (1) {
+        thread = FindProcess(tid);
+        if (thread == NULL
+            || thread == proc
+            || !(thread->flags & PROCESS_FLAG_THREAD)
+            || (thread->flags & PROCESS_FLAG_KERNEL_THREAD)
+            || thread->leader != leader) {
+            return -ESRCH;
+        }
+
+        if (thread->state == PROCESS_SLOT_ZOMBIE) {
+            if (status != NULL) {
+                *status = thread->exit_status;
+            }
+
+            RemoveThread(leader, thread);
+            DeferReap(thread);
+            return tid;
+        }
+
+        SleepOn(&leader->thread_exit_queue);
+    }
+}
+
+int Exec(Process *proc, const char *filename)
+{
+    uint64_t entry = USER_VIRTUAL_ADDRESS_BASE;
+
+    /* The other threads would lose their program under them. */
+    if (proc->leader != NULL || proc->first_thread != NULL) {
+        return -EBUSY;
+    }
+
+    /* The program is loaded on demand, only its headers are read here. */
+    if (LoadProgram(proc, filename, &entry) < 0) {
+        /* If we cannot load the file, we exit current process. */
+        printk("DEBUG: Cannot load %s.\n", filename);
+        Exit(EXIT_STATUS_EXEC_FAILURE);
+    }
+
+    if (EnterProgram(proc, entry) < 0) {
+        Exit(EXIT_STATUS_EXEC_FAILURE);
+    }
+
+    return 0;
+}
+
+int ArchPrctl(int code, uint64_t addr)
+{
+    Process *proc = GetCurrentProcess();
+    VMArea *vma = NULL;
+    VMArea *last = NULL;
+    /* A non canonical base would fault in the kernel when it is loaded, and
+     * the shared runtime text below the program must not be written. */
+    bool is_user = addr >= USER_VIRTUAL_ADDRESS_BASE
+                   && addr <= USER_STACK_START - sizeof(uint64_t);
+
+    switch (code) {
+    case ARCH_SET_FS:
+        /* A null base clears it. */
+        if (addr != 0 && !is_user) {
+            return -EPERM;
+        }
+
+        proc->fs_base = addr;
+        LoadFSBase(addr);
+        return 0;
+
+    case ARCH_GET_FS:
+        if (!is_user) {
+            return -EPERM;
+        }
+
+        /* With CR0.WP, a write of the kernel to a read-only area faults in
+         * the kernel and panics. */
+        vma = FindVMArea(GetThreadLeader(proc), addr);
+        last = FindVMArea(GetThreadLeader(proc), addr + sizeof(uint64_t) - 1);
+        if (vma == NULL || last == NULL
+            || !(vma->flags & VMA_WRITE) || !(last->flags & VMA_WRITE)) {
+            return -EFAULT;
+        }
+
+        *(uint64_t *)addr = SaveFSBase();
+        return 0;
+
+    default:
+        return -EINVAL;
+    }
+}
+
+/* Private function ----------------------------------------------------------*/
+static void AddUsage(ProcessUsage *total, const ProcessUsage *usage)
+{
+    total->user_cycles += usage->user_cycles;
+    total->system_cycles += usage->system_cycles;
+    total->wait_cycles += usage->wait_cycles;
+    total->voluntary_switches += usage->voluntary_switches;
+    total->involuntary_switches += usage->involuntary_switches;
+    total->system_calls += usage->system_calls;
+}
+
+static void GetProgramName(Process *proc, char *name)
+{
+    FCB *fcb = GetThreadLeader(proc)->image;
+
+    if (fcb == NULL) {
+        *name = '\0';
+        return;
+    }
+
+    GetFileName(fcb, name);
+}
+
+static int EnterProgram(Process *proc, uint64_t entry)
+{
+    uint64_t stack_start = USER_STACK_START;
+
+    /* Programs prelinked with the shared runtime keep its private data at the
+     * top of the page, so their stack starts below it. The header is only
+     * checked when the program maps its first byte. */
+    if (FindVMArea(proc, USER_VIRTUAL_ADDRESS_BASE) != NULL
+        && IsRuntimeProgram()) {
+        if (BindRuntime(proc) < 0) {
+            printk("DEBUG: Cannot bind the shared runtime.\n");
+            return -ENOEXEC;
+        }
+        stack_start = USER_RUNTIME_DATA_BASE;
+    }
+
+    /* Clear trap frame and set it to default mode. */
+    memset(proc->tf, 0, sizeof(TrapFrame));
+    proc->tf->cs = USER_CODE_SELECTOR;
+    proc->tf->rip = entry;
+    proc->tf->ss = USER_DATA_SELECTOR;
+    proc->tf->rsp = stack_start;
+    proc->tf->rflags = 0x202;
+
+    /* The start code of the new program sets up its own TLS. */
+    proc->fs_base = 0;
+    LoadFSBase(0);
+
+    return 0;
+}
+
+static void StartSpawnedProcess(void)
+{
+    Process *proc = GetCurrentProcess();
+    SpawnArguments *args = (SpawnArguments *)proc->tf->rdi;
+    uint64_t *argv = NULL;
+    char *strings = NULL;
+
+    /* A clone is already in its program, after the runtime and the TLS
+     * setup. */
+    if (proc->template == NULL && EnterProgram(proc, proc->tf->rip) < 0) {
+        FreeFrame(args);
+        Exit(EXIT_STATUS_EXEC_FAILURE);
+    }
+
+    /* The strings go on the top of the stack and the argv array below them,
+     * the stack stays aligned to 16 bytes for the start code, or for main()
+     * in a clone, whose stack top is the one of its template. */
+    strings = (char *)(proc->tf->rsp - args->length);
+    argv = (uint64_t *)(((uint64_t)strings - (args->count + 1) * 8) & ~0xFULL);
+    memcpy(strings, args->strings, args->length);
+
+    for (int i = 0; i < args->count; i++) {
+        argv[i] = (uint64_t)strings;
+        strings += strlen(strings) + 1;
+    }
+    argv[args->count] = 0;
+
+    proc->tf->rdi = args->count;
+    proc->tf->rsi = (uint64_t)argv;
+    proc->tf->rsp = (uint64_t)argv;
+
+    FreeFrame(args);
+}
+
+static int CopySpawnArguments(SpawnArguments *args, char *const argv[])
+{
+    size_t length = 0;
+
+    args->count = 0;
+    args->length = 0;
+
+    while (argv != NULL && argv[args->count] != NULL) {
+        length = strlen(argv[args->count]) + 1;
+        if (args->count == SPAWN_ARGUMENTS_MAXIMUM
+            || length > sizeof(args->strings) - args->length) {
+            return -E2BIG;
+        }
+
+        memcpy(&args->strings[args->length], argv[args->count], length);
+        args->length += length;
+        args->count++;
+    }
+
+    return 0;
+}
+
+static int ApplySpawnFileActions(Process *proc,
+                                 const SpawnFileAction *actions)
+{
+    int status = 0;
+
+    for (; actions != NULL && actions->action != 0; actions++) {
+        switch (actions->action) {
+        case SPAWN_FILE_CLOSE:
+            /* A copy to itself only checks that the descriptor is open. */
+            status = DupFile(proc, actions->fd, actions->fd);
+            if (status >= 0) {
+                Close(proc, actions->fd);
+            }
+            break;
+
+        case SPAWN_FILE_DUP2:
+            status = DupFile(proc, actions->fd, actions->new_fd);
+            break;
+
+        default:
+            status = -EINVAL;
+            break;
+        }
+
+        if (status < 0) {
+            return status;
+        }
+    }
+
+    return 0;
+}
+
+static Process *AllocProcess(ProcessFiles *files)
+{
+    Process *proc = NULL;
+    int pid = 0;
+
+    if (s_process_count >= s_process_limit) {
+        return NULL;
+    }
+
+    proc = CacheAlloc(&s_process_cache);
+    if (proc == NULL) {
+        return NULL;
+    }
+
+    proc->files = files;
+    if (files == NULL) {
+        proc->files = CacheAlloc(&s_process_files_cache);
+    }
+
+    pid = AllocPID();
+    if (proc->files == NULL || pid < 0) {
+        if (files == NULL && proc->files != NULL) {
+            CacheFree(&s_process_files_cache, proc->files);
+        }
+        CacheFree(&s_process_cache, proc);
+        return NULL;
+    }
+
+    proc->pid = pid;
+    proc->hash_next = s_pid_hash[pid % PID_HASH_BUCKETS];
+    s_pid_hash[pid % PID_HASH_BUCKETS] = proc;
+    s_process_count++;
+    GetVDSOData()->process_count = s_process_count;
+
+    return proc;
+}
+
+static void FreeProcess(Process *proc)
+{
+    Process **link = &s_pid_hash[proc->pid % PID_HASH_BUCKETS];
+
+    while (*link != proc) {
+        link = &(*link)->hash_next;
+    }
+    *link = proc->hash_next;
+
+    s_pid_bitmap[proc->pid / 64] &= ~(1ULL << (proc->pid % 64));
+    s_process_count--;
+    GetVDSOData()->process_count = s_process_count;
+
+    if (!(proc->flags & PROCESS_FLAG_THREAD)) {
+        CacheFree(&s_process_files_cache, proc->files);
+    }
+    CacheFree(&s_process_cache, proc);
+}
+
+static int AllocPID(void)
+{
+    int pid = s_last_pid + 1;
+
+    /* Next fit: PIDs are not reused right away. One more word than the bitmap
+     * is checked, for the bits before `pid` in its word. */
+    for (int i = 0; i <= PID_BITMAP_WORDS; i++) {
+        int word = 0;
+        uint64_t free = 0;
+
+        if (pid >= PID_MAXIMUM) {
+            pid = 0;
+        }
+
+        word = pid / 64;
+        free = ~s_pid_bitmap[word] & (~0ULL << (pid % 64));
+        if (free != 0) {
+            pid = word * 64 + __builtin_ctzll(free);
+            s_pid_bitmap[word] |= 1ULL << (pid % 64);
+            s_last_pid = pid;
+            return pid;
+        }
+
+        pid = (word + 1) * 64;
+    }
+
+    return -1;
+}
+
+static void SetTSS(Process *proc)
+{
+    /* We set TSS structure by assigning the top of the kernel stack to rsp0 in
+     * the task state segment of the CPU. */
+    CPU *cpu = GetCPU();
+
+    cpu->tss->rsp0 = proc->stack + KERNEL_STACK_SIZE;
+
+    /* SYSCALL doesn't use the TSS, its entry takes the stack from here. */
+    cpu->kernel_stack = cpu->tss->rsp0;
+}
+
+static void Schedule(void)
+{
+    RunQueue *rq = GetLocalRunQueue();
+    Process *prev_proc = rq->current_proc;
+    Process *current_proc = NULL;
+
+    current_proc = ReadyListPop(rq);
+    if (current_proc == NULL) {
+        current_proc = StealProcess();
+    }
+
+    if (current_proc == NULL) {
+        /* If no CPU has a ready process we run IDLE task next. */
+        current_proc = rq->idle_proc;
+    }
+
+    /* Get head ready process and make it as running on this CPU. */
+    current_proc->state = PROCESS_SLOT_RUNNING;
+    current_proc->cpu = GetCPU()->id;
+    rq->current_proc = current_proc;
+
+    /* What an interrupt left for the previous process is done by the switch. */
+    rq->deferred = 0;
+
+    /* Switch to new process. */
+    SwitchProcess(prev_proc, current_proc);
+}
+
+static void SwitchProcess(Process *prev, Process *new)
+{
+    uint64_t now = 0;
+
+    /* The process gave up the CPU, but it was the next one to run. */
+    if (prev == new) {
+        return;
+    }
+
+    /* The previous process ran in the kernel since its last accounting point,
+     * the new one waited since it was made ready. A process which is switched
+     * out while it is still ready was preempted. */
+    now = __builtin_ia32_rdtsc();
+    prev->usage.system_cycles += now - prev->account_tsc;
+    if (prev->state == PROCESS_SLOT_READY) {
+        prev->usage.involuntary_switches++;
+    } else {
+        prev->usage.voluntary_switches++;
+    }
+
+    if (new->ready_tsc != 0) {
+        new->usage.wait_cycles += now - new->ready_tsc;
+        new->ready_tsc = 0;
+    }
+    new->account_tsc = now;
+
+    /* The IDLE process of the boot CPU runs on the boot stack. */
+    if (prev->stack != 0 && !IsKernelStackIntact((void *)prev->stack)) {
+        printk("Kernel stack overflow in process %d.\n", prev->pid);
+        panic("Kernel stack overflow.");
+    }
+
+    SetTSS(new);
+
+    /* The kernel doesn't use FS, so the IDLE process and the kernel threads
+     * keep the base they find. */
+    if (HasUserContext(prev)) {
+        prev->fs_base = SaveFSBase();
+    }
+
+    if (HasUserContext(new)) {
+        LoadFSBase(new->fs_base);
+    }
+
+    /* Threads of the same process share the page map, the TLB is kept. */
+    if (new->page_map != prev->page_map) {
+        SwitchVM(new->page_map);
+    }
+
+    GetVDSOData()->context_switches++;
+
+    ContextSwitch(&prev->context, new->context);
+}
+
+static void ReadyListPush(Process *proc)
+{
+    RunQueue *rq = GetRunQueue(proc->cpu);
+
+    proc->state = PROCESS_SLOT_READY;
+    proc->ready_ticks = GetTicks();
+    proc->ready_tsc = __builtin_ia32_rdtsc();
+
+    if (proc->sched_class == SCHEDULER_CLASS_DEADLINE) {
+        ListPushBack(&GetScheduler()->deadline_proc_list, (List *)proc);
+        return;
+    }
+
+    ListPushBack(&rq->ready_proc_list[proc->priority], (List *)proc);
+    rq->ready_bitmap |= BIT(proc->priority);
+    rq->ready_count++;
+}
+
+static void Enqueue(Process *proc)
+{
+    uint64_t flags = SaveInterrupts();
+
+    proc->cpu = SelectCPU(proc);
+    ReadyListPush(proc);
+
+    /* The other CPU may be halted in its idle loop. */
+    if (proc->cpu != GetCPU()->id) {
+        SendReschedule(proc->cpu);
+    }
+
+    RestoreInterrupts(flags);
+}
+
+static int SelectCPU(Process *proc)
+{
+    if (IsCPUIdle(proc->cpu)) {
+        return proc->cpu;
+    }
+
+    for (int cpu = 0; cpu < GetCPUCount(); cpu++) {
+        if (IsCPUIdle(cpu)) {
+            return cpu;
+        }
+    }
+
+    return proc->cpu;
+}
+
+static bool IsCPUIdle(int cpu)
+{
+    RunQueue *rq = GetRunQueue(cpu);
+
+    return GetCPUById(cpu)->online
+           && rq->current_proc == rq->idle_proc
+           && rq->ready_count == 0;
+}
+
+static Process *StealProcess(void)
+{
+    RunQueue *busiest = FindBusiestRunQueue();
+
+    if (busiest == NULL) {
+        return NULL;
+    }
+
+    return RunQueuePop(busiest);
+}
 
-static Process *FindFreeProcessSlot(void);
-static Process *CreateNewProcess(void);
-/**
- * @brief   Set TaskStateSegment point to top of the process's kernel stack. So
- *          when we jump from ring 3 to ring 0, the kernel stack will be used.
- * 
- * @param   proc 
- * @return  none
- */
-static void SetTSS(Process *proc);
+static RunQueue *FindBusiestRunQueue(void)
+{
+    RunQueue *busiest = NULL;
 
-static void Schedule(void);
+    for (int cpu = 0; cpu < GetCPUCount(); cpu++) {
+        RunQueue *rq = GetRunQueue(cpu);
 
-static void SwitchProcess(Process *prev, Process *new);
+        if (cpu == GetCPU()->id || !GetCPUById(cpu)->online) {
+            continue;
+        }
 
-List *WaitListRemoveReadyProcess(HeadList *list, int wait_id);
+        if (rq->ready_count > 0
+            && (busiest == NULL || rq->ready_count > busiest->ready_count)) {
+            busiest = rq;
+        }
+    }
 
-List *RemoveProcessWithPID(HeadList *list, int pid);
+    return busiest;
+}
 
-/**
- * @brief   This function initialize the IDLE task. If the ready process list is
- *          empty, we run IDLE task. And the IDLE do nothing, just jump loop in
- *          KernelEnd, and enable interrupt, waiting for new context switch
- *          event, triggered by the timer interrupt.
- *          IDLE task always have PID 0, and this function should be call first.
- */ 
-static void InitIDLEProcess(void);
+static bool IsRunningOnCPU(Process *proc)
+{
+    for (int cpu = 0; cpu < GetCPUCount(); cpu++) {
+        Process *current_proc = GetRunQueue(cpu)->current_proc;
 
-static void InitShellProcess(void);
+        if (!GetCPUById(cpu)->online) {
+            continue;
+        }
 
-/* Public function -----------------------------------------------------------*/
-void InitProcess(void)
-{
-    /* Init IDLE process first. */
-    InitIDLEProcess();
+        if (current_proc == proc || current_proc->leader == proc) {
+            return true;
+        }
+    }
 
-    /* Run INIT process (Shell). */
-    InitShellProcess();
+    return false;
 }
 
-Scheduler *GetScheduler(void)
+static void SleepTimerExpired(void *data)
 {
-    return &s_scheduler;
+    Process *proc = (Process *)data;
+
+    if (proc->state == PROCESS_SLOT_SLEEPING) {
+        WakeUpProcess(proc);
+    }
 }
 
-void Yield(void)
+static void RunDeferredScheduling(bool in_kernel)
 {
-    Process *proc = NULL;
-    Scheduler *scheduler = GetScheduler();
-    HeadList *list = &scheduler->ready_proc_list;
+    Process *proc = GetCurrentProcess();
+    RunQueue *rq = GetLocalRunQueue();
+    uint32_t deferred = rq->deferred;
 
-    if (ListIsEmpty(list)) {
-        return;
+    rq->deferred = 0;
+    if (in_kernel) {
+        proc->flags |= PROCESS_FLAG_PREEMPTED;
     }
 
-    /* Get current process, set it as ready, and push it to back of the ready
-     * list. */
-    proc = scheduler->current_proc;
-    proc->state = PROCESS_SLOT_READY;
+    if (deferred & DEFERRED_TICK) {
+        SchedulerTick();
+    } else {
+        Preempt();
+    }
 
-    /* We don't push the IDLE task to the ready list. */
-    if (proc->pid != IDLE_PROCESS_PID) {
-        ListPushBack(list, (List *)proc);
+    proc->flags &= ~PROCESS_FLAG_PREEMPTED;
+}
+
+static bool HasPreemptedThread(Process *leader, Process *except)
+{
+    if (leader != except && (leader->flags & PROCESS_FLAG_PREEMPTED)) {
+        return true;
     }
 
-    /* Process switch. */
-    Schedule();
+    for (Process *thread = leader->first_thread;
+         thread != NULL;
+         thread = thread->next_thread) {
+        if (thread != except && (thread->flags & PROCESS_FLAG_PREEMPTED)) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
-void Sleep(int wait_id)
+static void Block(WaitQueue *queue, int wait_id)
 {
-    Process *proc = NULL;
-    Scheduler *scheduler = GetScheduler();
-    HeadList *list = &scheduler->wait_proc_list;
+    uint64_t flags = SaveInterrupts();
+    Process *proc = GetCurrentProcess();
 
-    /* Push current process to sleep process list. */
-    proc = scheduler->current_proc;
     proc->state = PROCESS_SLOT_SLEEPING;
     proc->wait_id = wait_id;
 
-    ListPushBack(list, (List *)proc);
+    /* The process blocks before its quantum is over, it is interactive. */
+    if (proc->priority > GetBasePriority(proc)) {
+        proc->priority--;
+    }
+    proc->used_ticks = 0;
+
+    if (queue != NULL) {
+        WaitQueuePush(queue, proc);
+    }
 
     /* Re-schedule to run next process. */
     Schedule();
+    RestoreInterrupts(flags);
 }
 
-void Wakeup(int wait_id)
+static void WakeUpProcess(Process *proc)
 {
-    Process *proc = NULL;
-    Scheduler *scheduler = GetScheduler();
-    HeadList *wait_list = &scheduler->wait_proc_list;
-    HeadList *ready_list = &scheduler->ready_proc_list;
+    ASSERT(proc->state == PROCESS_SLOT_SLEEPING);
 
-    /* Find correct processes which are wake up time and remove it from wait
-     * list. */
-    proc = (Process *)WaitListRemoveReadyProcess(wait_list, wait_id);
+    WaitQueueRemove(proc);
+    proc->wait_id = NO_WAIT_ID;
+    Enqueue(proc);
+}
+
+static void WaitQueuePush(WaitQueue *queue, Process *proc)
+{
+    WaitLink *link = &proc->wait_link;
 
-    while (proc != NULL)
-    {
-        /* Push the process to ready list if now is it's wakeup time. */
-        proc->state = PROCESS_SLOT_READY;
-        ListPushBack(ready_list, (List *)proc);
+    link->next = NULL;
+    link->prev = queue->last;
 
-        /* Check another processes in the wait list. */
-        proc = (Process *)WaitListRemoveReadyProcess(wait_list, wait_id);
+    if (queue->last != NULL) {
+        queue->last->next = link;
+    } else {
+        queue->first = link;
     }
+
+    queue->last = link;
+    proc->wait_queue = queue;
 }
 
-void Exit(void)
+static void WaitQueueRemove(Process *proc)
 {
-    Process *proc = NULL;
-    Scheduler *scheduler = GetScheduler();
-    HeadList *list = &scheduler->kill_proc_list;
+    WaitQueue *queue = proc->wait_queue;
+    WaitLink *link = &proc->wait_link;
 
-    proc = scheduler->current_proc;
-    proc->state = PROCESS_SLOT_KILLED;
+    if (queue == NULL) {
+        return;
+    }
 
-    ListPushBack(list, (List *)proc);
+    if (link->prev != NULL) {
+        link->prev->next = link->next;
+    } else {
+        queue->first = link->next;
+    }
 
-    /* We need to call Wakeup() function because the init process which is first
-     * process in this system is constantly calling Wait() function to do the
-     * cleaning up, and the process maybe is sleeping state. So we wake it up
-     * before we switch to another process.
-     */
-    Wakeup(INIT_PROCESS_WAIT_ID);
+    if (link->next != NULL) {
+        link->next->prev = link->prev;
+    } else {
+        queue->last = link->prev;
+    }
 
-    /* We re-schedule, the current process will be pop from ready list. */
-    Schedule();
+    link->next = NULL;
+    link->prev = NULL;
+    proc->wait_queue = NULL;
 }
 
-void Wait(int pid)
+static void AddChild(Process *parent, Process *child)
 {
-    Process *proc = NULL;
-    Scheduler *scheduler = GetScheduler();
-    HeadList *list = &scheduler->kill_proc_list;
+    child->parent = parent;
 
-    /* Forever loop to cleanup resources of all killed process. */
-    while (1) {
-        if (!ListIsEmpty(list)) {
-            proc = (Process *)RemoveProcessWithPID(list, pid);
-            if (proc != NULL) {
-                ASSERT(proc->state == PROCESS_SLOT_KILLED);
-
-                /* Cleanup the process. */
-                kfree(proc->stack);
-                FreeVM(proc->page_map);
-                
-                /* Close opened files. */
-                for (int i = USER_START_FD;
-                     i < PROCESS_MAXIMUM_FILE_DESCRIPTOR;
-                     i++) {
-
-                    if (proc->file[i] != NULL) {
-                        proc->file[i]->fcb->open_count--;
-                        proc->file[i]->open_count--;
-
-                        if (proc->file[i]->open_count == 0) {
-                            proc->file[i]->fcb = NULL;
-                        }
-                    }
-                }
-
-                memset(proc, 0, sizeof(Process));
-                break;
-            }
+    if (child->state == PROCESS_SLOT_ZOMBIE) {
+        child->prev_sibling = NULL;
+        child->next_sibling = parent->first_child;
+        if (parent->first_child != NULL) {
+            parent->first_child->prev_sibling = child;
+        } else {
+            parent->last_child = child;
+        }
+        parent->first_child = child;
+    } else {
+        child->next_sibling = NULL;
+        child->prev_sibling = parent->last_child;
+        if (parent->last_child != NULL) {
+            parent->last_child->next_sibling = child;
         } else {
-            /* Sleep if we don't have any killed process. */
-            Sleep(INIT_PROCESS_WAIT_ID);
+            parent->first_child = child;
         }
+        parent->last_child = child;
     }
 }
 
-int Fork(void)
+static void RemoveChild(Process *parent, Process *child)
 {
-    Process *proc = NULL;
-    Scheduler *scheduler = GetScheduler();
-    HeadList *list = &scheduler->ready_proc_list;
-    Process *current_proc = scheduler->current_proc;
-
-    proc = CreateNewProcess();
-    if (proc == NULL) {
-        printk("DEBUG: Failed to create new process.\n");
-        return -ENOMEM;
+    if (child->prev_sibling != NULL) {
+        child->prev_sibling->next_sibling = child->next_sibling;
+    } else {
+        parent->first_child = child->next_sibling;
     }
 
-    if (!CopyUVM(proc->page_map, current_proc->page_map, PAGE_SIZE)) {
-        printk("DEBUG: Failed to copy virtual memory.\n");
-        return -ENOMEM;
+    if (child->next_sibling != NULL) {
+        child->next_sibling->prev_sibling = child->prev_sibling;
+    } else {
+        parent->last_child = child->prev_sibling;
     }
 
-    /* Copy FD table, so the new process will point to same FD entries. */
-    memcpy(proc->file,
-           current_proc->file,
-           sizeof(FD *) * PROCESS_MAXIMUM_FILE_DESCRIPTOR);
+    child->next_sibling = NULL;
+    child->prev_sibling = NULL;
+    child->parent = NULL;
+}
+
+static void ReparentChildren(Process *proc)
+{
+    Process *init = s_init_process == proc ? NULL : s_init_process;
+    Process *child = NULL;
+    bool has_zombie = false;
+
+    while ((child = proc->first_child) != NULL) {
+        RemoveChild(proc, child);
 
-    /* Handling shared files. */
-    for (int i = USER_START_FD; i < PROCESS_MAXIMUM_FILE_DESCRIPTOR; i++)
-    {
-        if (proc->file[i] != NULL) {
-            /* We increase counters, means the new process will use them also. */
-            proc->file[i]->fcb->open_count++;
-            proc->file[i]->open_count++;
+        if (init != NULL) {
+            AddChild(init, child);
+            has_zombie |= child->state == PROCESS_SLOT_ZOMBIE;
         }
     }
 
-    /* Copy the trap frame, therefore the new process will return to the same
-     * location as the current process does. */
-    memcpy(proc->tf, current_proc->tf, sizeof(TrapFrame));
+    if (has_zombie) {
+        WakeUpAll(&init->child_exit_queue);
+    }
+}
 
-    /* This is return value in new process when it back to user mode. */
-    proc->tf->rax = 0;
+static void ReapProcess(Process *proc)
+{
+    ASSERT(proc->state == PROCESS_SLOT_ZOMBIE && proc->parent == NULL);
 
-    /* Append it to ready list. */
-    proc->state = PROCESS_SLOT_READY;
-    ListPushBack(list, (List *)proc);
+    /* Cleanup the process, kernel threads use the kernel page map, and the
+     * memory and the files of a thread belong to its leader. */
+    FreeKernelStack((void *)proc->stack);
+    if (proc->flags & (PROCESS_FLAG_KERNEL_THREAD | PROCESS_FLAG_THREAD)) {
+        FreeProcess(proc);
+        return;
+    }
 
-    /* For current process, we return pid of new process. */
-    return proc->pid;
+    FreeVM(proc->page_map);
+    ReleaseTemplate(proc);
+    ReleaseImage(proc);
+    CloseFiles(proc);
+
+    FreeProcess(proc);
 }
 
-int Exec(Process *proc, const char *filename)
+static void AddThread(Process *leader, Process *thread)
 {
-    int fd = 0;
-    int program_size = 0;
+    thread->next_thread = leader->first_thread;
+    leader->first_thread = thread;
+}
 
-    fd = Open(proc, filename);
-    if (fd < 0) {
-        /* If we cannot open the file, we exit current process. */
-        printk("DEBUG: Cannot open file.\n");
-        Exit();
-    }
+static void RemoveThread(Process *leader, Process *thread)
+{
+    Process **link = &leader->first_thread;
 
-    /* Clear all virtual memory. */
-    memset((void *)USER_VIRTUAL_ADDRESS_BASE, 0, PAGE_SIZE);
-    program_size = GetFileSize(proc, fd);
+    while (*link != thread) {
+        ASSERT(*link != NULL);
+        link = &(*link)->next_thread;
+    }
 
-    /* Copy all program file to virtual address base. */
-    program_size = Read(proc,
-                        fd,
-                        (void *)USER_VIRTUAL_ADDRESS_BASE,
-                        program_size);
+    *link = thread->next_thread;
+    thread->next_thread = NULL;
+    AddUsage(&leader->usage, &thread->usage);
+}
 
-    if (program_size < 0) {
-        /* Exit if we can not read data file. */
-        Exit();
+static void StopProcess(Process *proc)
+{
+    if (proc->state == PROCESS_SLOT_READY) {
+        ReadyListRemove(proc);
+    } else if (proc->state == PROCESS_SLOT_SLEEPING) {
+        WaitQueueRemove(proc);
+    } else if (proc->state == PROCESS_SLOT_RUNNING
+               && proc->cpu != GetCPU()->id) {
+        /* It leaves that CPU at its next kernel entry. */
+        SendReschedule(proc->cpu);
     }
 
-    Close(proc, fd);
+    CancelTimer(&proc->timer);
+    RemoveDeadlineProcess(proc);
+}
+
+static void StopThreads(Process *leader, Process *except, int status)
+{
+    Process **link = &leader->first_thread;
 
-    /* Clear trap frame and set it to default mode. */
-    memset(proc->tf, 0, sizeof(TrapFrame));
-    proc->tf->cs = 0x10 | 3;
-    proc->tf->rip = USER_VIRTUAL_ADDRESS_BASE;
-    proc->tf->ss = 0x18 | 3;
-    proc->tf->rsp = USER_STACK_START;
-    proc->tf->rflags = 0x202;
+    while (*link != NULL) {
+        Process *thread = *link;
 
-    return 0;
+        if (thread == except) {
+            link = &thread->next_thread;
+            continue;
+        }
+
+        *link = thread->next_thread;
+        thread->next_thread = NULL;
+        AddUsage(&leader->usage, &thread->usage);
+
+        if (thread->state != PROCESS_SLOT_ZOMBIE) {
+            StopProcess(thread);
+            thread->state = PROCESS_SLOT_ZOMBIE;
+            thread->exit_status = status;
+        }
+
+        DeferReap(thread);
+    }
 }
 
-/* Private function ----------------------------------------------------------*/
-static Process *FindFreeProcessSlot(void)
+static void ExitProcess(Process *proc, int status)
+{
+    Process *parent = proc->parent;
+
+    proc->state = PROCESS_SLOT_ZOMBIE;
+    proc->exit_status = status;
+    CancelTimer(&proc->timer);
+    RemoveDeadlineProcess(proc);
+    CloseRing(proc);
+
+    ReparentChildren(proc);
+
+    /* The zombie moves to the head of the child list, and only its parent is
+     * woken up. */
+    if (parent != NULL) {
+        RemoveChild(parent, proc);
+        AddChild(parent, proc);
+        WakeUpAll(&parent->child_exit_queue);
+    } else if (proc->flags & PROCESS_FLAG_KERNEL_THREAD) {
+        /* The worker runs after we switch away from this stack. */
+        DeferReap(proc);
+    }
+}
+
+static void DeferReap(Process *proc)
+{
+    proc->next = (List *)s_dead_procs;
+    s_dead_procs = proc;
+    QueueWork(GetSystemWorkQueue(), &s_reap_work);
+}
+
+static void ReapDeadProcesses(void *data)
 {
+    Process **link = &s_dead_procs;
     Process *proc = NULL;
 
-    for (int i = 0; i < MAXIMUM_NUMBER_OF_PROCESS; i++)
-    {
-        if (s_process_manager[i].state == PROCESS_SLOT_UNUSED) {
-            proc = &s_process_manager[i];
-            break;
+    /* A zombie still runs on another CPU until that CPU switches away. */
+    while (*link != NULL && IsRunningOnCPU(*link)) {
+        link = (Process **)&(*link)->next;
+    }
+
+    if (*link == NULL) {
+        /* Arming the timer can't fail, it is only refused when the work is
+         * already queued again by a new zombie, which retries as well. */
+        if (s_dead_procs != NULL) {
+            QueueDelayedWork(GetSystemWorkQueue(),
+                             &s_reap_work,
+                             REAP_RETRY_DELAY);
         }
+        return;
     }
 
-    return proc;
+    /* One zombie at a time, the worker yields between them. */
+    proc = *link;
+    *link = (Process *)proc->next;
+    ReapProcess(proc);
+
+    if (s_dead_procs != NULL) {
+        QueueWork(GetSystemWorkQueue(), &s_reap_work);
+    }
 }
 
-static void SetTSS(Process *proc)
+static void AddDeadlineProcess(Process *proc)
 {
-    /* We set TSS structure by assigning the top of the kernel stack to rsp0 in
-     * the TaskStateSegment. */
-    TaskStateSegment.rsp0 = proc->stack + STACK_SIZE;
+    Scheduler *scheduler = GetScheduler();
+
+    proc->sched_class = SCHEDULER_CLASS_DEADLINE;
+    scheduler->deadline_utilization += (uint64_t)proc->dl.runtime * 1000
+                                       / proc->dl.deadline;
+
+    proc->dl_prev = NULL;
+    proc->dl_next = scheduler->deadline_procs;
+    if (scheduler->deadline_procs != NULL) {
+        scheduler->deadline_procs->dl_prev = proc;
+    }
+    scheduler->deadline_procs = proc;
 }
 
-static void Schedule(void)
+static void RemoveDeadlineProcess(Process *proc)
 {
-    Process *prev_proc = NULL;
-    Process *current_proc = NULL;
-
     Scheduler *scheduler = GetScheduler();
-    HeadList *list = &scheduler->ready_proc_list;
-    prev_proc = scheduler->current_proc;
 
-    if (ListIsEmpty(list)) {
-        /* If the ready list is empty we run IDLE task next. */
-        current_proc = &s_process_manager[IDLE_PROCESS_PID];
+    if (proc->sched_class != SCHEDULER_CLASS_DEADLINE) {
+        return;
+    }
+
+    scheduler->deadline_utilization -= (uint64_t)proc->dl.runtime * 1000
+                                       / proc->dl.deadline;
+
+    if (proc->dl_prev != NULL) {
+        proc->dl_prev->dl_next = proc->dl_next;
     } else {
-        current_proc = (Process *)ListPopFront(list);
+        scheduler->deadline_procs = proc->dl_next;
     }
 
-    /* Get head ready process and make it as running. */
-    current_proc->state = PROCESS_SLOT_RUNNING;
-    scheduler->current_proc = current_proc;
+    if (proc->dl_next != NULL) {
+        proc->dl_next->dl_prev = proc->dl_prev;
+    }
 
-    /* Switch to new process. */
-    SwitchProcess(prev_proc, current_proc);
+    proc->dl_next = NULL;
+    proc->dl_prev = NULL;
+    proc->sched_class = SCHEDULER_CLASS_NORMAL;
+    memset(&proc->dl, 0, sizeof(DeadlineTask));
 }
 
-static void SwitchProcess(Process *prev, Process *new)
+static void ReadyListRemove(Process *proc)
 {
-    SetTSS(new);
-    SwitchVM(new->page_map);
-    ContextSwitch(&prev->context, new->context);
+    RunQueue *rq = GetRunQueue(proc->cpu);
+
+    if (proc->sched_class == SCHEDULER_CLASS_DEADLINE) {
+        RemoveProcessWithPID(&GetScheduler()->deadline_proc_list, proc->pid);
+        return;
+    }
+
+    RemoveProcessWithPID(&rq->ready_proc_list[proc->priority], proc->pid);
+    rq->ready_count--;
+    if (ListIsEmpty(&rq->ready_proc_list[proc->priority])) {
+        rq->ready_bitmap &= ~BIT(proc->priority);
+    }
 }
 
-List *WaitListRemoveReadyProcess(HeadList *list, int wait_id)
+static Process *ReadyListPop(RunQueue *rq)
 {
-    List *current = list->next;
-    List *prev = (List *)list;
-    List *item = NULL;
+    Process *proc = FindEarliestDeadline();
 
-    while(current !=NULL) {
-        /* Wakeup if matching id. */
-        if (((Process *)current)->wait_id == wait_id) {
-            /* If found a ready process return it. */
-            prev->next = current->next;
-            item = current;
+    if (proc != NULL) {
+        RemoveProcessWithPID(&GetScheduler()->deadline_proc_list, proc->pid);
+        return proc;
+    }
 
-            if (list->next == NULL) {
-                /* Current list is empty. */
-                list->tail = NULL;
-            } else if (current->next == NULL) {
-                /* The last one item in the list. */
-                list->tail = prev;
+    return RunQueuePop(rq);
+}
+
+static Process *RunQueuePop(RunQueue *rq)
+{
+    Process *proc = NULL;
+    int level = 0;
+
+    if (rq->ready_bitmap == 0) {
+        return NULL;
+    }
+
+    /* The lowest set bit is the highest priority non-empty queue. */
+    level = __builtin_ctz(rq->ready_bitmap);
+    proc = (Process *)ListPopFront(&rq->ready_proc_list[level]);
+    rq->ready_count--;
+
+    if (ListIsEmpty(&rq->ready_proc_list[level])) {
+        rq->ready_bitmap &= ~BIT(level);
+    }
+
+    return proc;
+}
+
+static void AgeReadyProcesses(RunQueue *rq)
+{
+    uint64_t ticks = GetTicks();
+
+    /* Levels are walked from the highest priority, so a raised process is not
+     * raised again in the same pass. */
+    for (int level = 1; level < SCHEDULER_PRIORITY_LEVELS; level++) {
+        HeadList *list = &rq->ready_proc_list[level];
+        HeadList waiting = *list;
+        Process *proc = NULL;
+
+        list->next = NULL;
+        list->tail = NULL;
+        rq->ready_bitmap &= ~BIT(level);
+
+        while ((proc = (Process *)ListPopFront(&waiting)) != NULL) {
+            uint64_t ready_ticks = proc->ready_ticks;
+
+            /* ReadyListPush() counts it again. */
+            rq->ready_count--;
+
+            if (ticks - ready_ticks >= SCHEDULER_AGING_TICKS
+                && level > GetBasePriority(proc)) {
+                proc->priority = level - 1;
             }
 
-            break;
+            /* Keep the time it entered the ready queue. */
+            ReadyListPush(proc);
+            proc->ready_ticks = ready_ticks;
         }
+    }
+}
 
-        /* Check next process in the list. */
-        prev = current;
-        current = current->next;
+static Process *FindEarliestDeadline(void)
+{
+    Process *earliest = NULL;
+
+    for (List *item = GetScheduler()->deadline_proc_list.next;
+         item != NULL;
+         item = item->next) {
+        Process *proc = (Process *)item;
+
+        if (earliest == NULL
+            || proc->dl.absolute_deadline < earliest->dl.absolute_deadline) {
+            earliest = proc;
+        }
     }
 
-    return item;
+    return earliest;
+}
+
+static void DeadlineTick(void)
+{
+    uint64_t ticks = GetTicks();
+
+    for (Process *proc = GetScheduler()->deadline_procs;
+         proc != NULL;
+         proc = proc->dl_next) {
+
+        if (proc->dl.active
+            && !proc->dl.missed
+            && ticks >= proc->dl.absolute_deadline) {
+            proc->dl.missed = true;
+            proc->dl.misses++;
+        }
+
+        if (ticks >= proc->dl.release) {
+            ReleaseJob(proc);
+        }
+    }
+}
+
+static void ReleaseJob(Process *proc)
+{
+    uint64_t ticks = GetTicks();
+    uint64_t start = proc->dl.release;
+
+    /* Periods are skipped if the process was not able to run at all. */
+    if (start + proc->dl.period <= ticks) {
+        start = ticks;
+    }
+
+    proc->dl.active = true;
+    proc->dl.missed = false;
+    proc->dl.budget = proc->dl.runtime;
+    proc->dl.absolute_deadline = start + proc->dl.deadline;
+    proc->dl.release = start + proc->dl.period;
+
+    if (proc->state == PROCESS_SLOT_SLEEPING
+        && proc->wait_id == DEADLINE_PROCESS_WAIT_ID) {
+        WakeUpProcess(proc);
+    }
 }
 
 List *RemoveProcessWithPID(HeadList *list, int pid)
@@ -399,52 +2373,57 @@ List *RemoveProcessWithPID(HeadList *list, int pid)
 }
 
 
-static void InitIDLEProcess(void)
-{
-    Process *proc;
-    proc = FindFreeProcessSlot();
-    proc->pid = IDLE_PROCESS_PID;
-    proc->page_map = PHY_TO_VIR(ReadCR3());
-    proc->state = PROCESS_SLOT_RUNNING;
-    GetScheduler()->current_proc = proc;
-}
-
 static void InitShellProcess(void)
 {
-    Scheduler *scheduler = GetScheduler();
-    HeadList *list = &scheduler->ready_proc_list;
-
-    Process *proc = CreateNewProcess();
+    Process *proc = CreateNewProcess(NULL);
 
     /* Map user memory (2MB) to the kernel virtual memory we just made. */
     ASSERT(SetupUVM(proc->page_map,
             (uint64_t)PHY_TO_VIR(USER_INIT_PROCESS_ADDRESS_BASE),
             SIZE_OF_INIT_PROCCESS));
 
-    proc->state = PROCESS_SLOT_READY;
-    ListPushBack(list, (List *)proc);
+    /* The shell is the init process, it adopts orphans. */
+    ASSERT(proc->pid == INIT_PROCESS_PID);
+    s_init_process = proc;
+
+    Enqueue(proc);
 }
 
-Process* CreateNewProcess(void)
+Process* CreateNewProcess(Process *leader)
 {
     uint64_t stack_top = 0;
-    Process * proc = FindFreeProcessSlot();
+    Process * proc = NULL;
+
+    /* The threads of a clone don't share copy-on-write frames. */
+    if (leader != NULL && UnshareTemplate(leader) < 0) {
+        return NULL;
+    }
+
+    proc = AllocProcess(leader != NULL ? leader->files : NULL);
     if (proc == NULL) {
         return NULL;
     }
 
-    /* Each process has 2MB its own kernel stack. */
-    proc->stack = (uint64_t)kalloc();
+    if (leader != NULL) {
+        proc->flags = PROCESS_FLAG_THREAD;
+        proc->leader = leader;
+    }
+
+    /* Each process has its own kernel stack, it isn't zeroed: only the
+     * context and the trap frame on its top are initialized. */
+    proc->stack = (uint64_t)AllocKernelStack();
     if (proc->stack == 0) {
+        FreeProcess(proc);
         return NULL;
     }
 
     proc->state = PROCESS_SLOT_INITIALIZED;
-    proc->pid = s_pid_num++;
     proc->wait_id = 0;
 
-    memset((void *)proc->stack, 0, STACK_SIZE);
-    stack_top = proc->stack + STACK_SIZE;
+    stack_top = proc->stack + KERNEL_STACK_SIZE;
+    memset((void *)(stack_top - sizeof(TrapFrame) - 7*8),
+           0,
+           sizeof(TrapFrame) + 7*8);
 
     /* Because the process is not run until now, so it don't have the context.
      * We make a empty context to it. That include 6 context registers, and
@@ -457,18 +2436,31 @@ Process* CreateNewProcess(void)
     /* We save stack frame at top of kernel stack. */
     proc->tf = (TrapFrame *)(stack_top - sizeof(TrapFrame));
 
-    proc->tf->cs = 0x10 | 3;
+    proc->tf->cs = USER_CODE_SELECTOR;
     proc->tf->rip = USER_VIRTUAL_ADDRESS_BASE;
-    proc->tf->ss = 0x18 | 3;
+    proc->tf->ss = USER_DATA_SELECTOR;
     proc->tf->rsp = USER_STACK_START;
     proc->tf->rflags = 0x202;
 
+    /* A thread runs in the virtual memory of its leader. */
+    if (leader != NULL) {
+        proc->page_map = leader->page_map;
+        return proc;
+    }
+
     /* We create a virtual memory that is mapped with kernel, so the kernel will
      * reside at the same address in every user virtual memory. */
     proc->page_map = SetupKVM();
     if (proc->page_map == 0) {
-        kfree(proc->stack);
-        memset(proc, 0, sizeof(Process));
+        FreeKernelStack((void *)proc->stack);
+        FreeProcess(proc);
+        return NULL;
+    }
+
+    if (!MapVDSO(proc)) {
+        FreeVM(proc->page_map);
+        FreeKernelStack((void *)proc->stack);
+        FreeProcess(proc);
         return NULL;
     }
 
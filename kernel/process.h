@@ -1,34 +1,65 @@
 /**
  * @file    process.h
  * @author  Cong Nguyen (congnt264@gmail.com)
- * @brief   A process is a program in execution. In our system we limit at 
- *          `MAXIMUM_NUMBER_OF_PROCESS` process. To schedule process, we create
- *          a structure that is Scheduler to manage them. We use the round-robin
- *          scheduling mechanism in our system, we achieved that by using the
- *          timer interrupt, the timer handler we be called every 10ms, so in
- *          this, we perform context switch between processes.
+ * @brief   A process is a program in execution. The number of processes is
+ *          limited at boot from the available memory. To schedule process, we
+ *          create a structure that is Scheduler to manage them. We use a
+ *          multi-level feedback queue scheduling mechanism in our system, we
+ *          achieved that by using the timer interrupt, the timer handler we be
+ *          called every tick, so in this, we charge the running process and
+ *          perform context switch between processes.
  * 
- *          The scheduler structure maintain three queues: ready queue, waiting
- *          queue and killed queue.
- *          + The ready queue to push and pop ready processes, so we can run
- *            them round robin. Particularly, when the context switch occurs, we
- *            make current task as ready and push it to queue tail. And pop the
- *            next task from queue head, run it, and mark it as running.
- *          + The waiting queue contains processes which are in sleeping state.
- *            We push current process to this queue when it call Sleep() system
- *            call and pop them when Wakeup() is called.
- *          + The kill queue contains killed processes. We push killed processes
- *            to it, and the init process will pop and cleanup their resource.
+ *          The scheduler structure maintain three kinds of queues: ready
+ *          queues, waiting queue and killed queue.
+ *          + There is one ready queue for each priority level, level 0 is the
+ *            highest priority. A bitmap tells which queues are not empty, so
+ *            the next process is found with one find-first-set instruction.
+ *            Processes in the same level run round robin, each level has its
+ *            own time quantum, longer for lower levels.
+ *            + A process which uses its whole quantum is CPU bound, it is
+ *              demoted one level.
+ *            + A process which blocks (keyboard, sleep, etc.) is interactive,
+ *              it is boosted one level, and it preempts a running process of
+ *              a lower level as soon as it is woken up.
+ *            + Every SCHEDULER_AGING_TICKS, processes which waited in a ready
+ *              queue for so long are raised one level, so CPU bound processes
+ *              don't starve.
+ *            + A CPU only ticks while its process has to share it (see
+ *              NeedsSchedulerTick()), a process which is alone on its CPU
+ *              runs until it blocks.
+ *            + The nice value of a process limits the highest level it can
+ *              reach.
+ *          + Real-time processes (SCHEDULER_CLASS_DEADLINE) declare a runtime,
+ *            a period and a relative deadline, they are kept in their own
+ *            ready queue and always run before normal processes, the one with
+ *            the earliest absolute deadline first (EDF). Every period a new
+ *            job is released with a budget of `runtime` ticks, a job which
+ *            uses its whole budget is throttled until the next period, and a
+ *            job which is not finished at its deadline is counted as missed.
+ *            A new real-time process is only admitted if the sum of
+ *            runtime / deadline of all of them stays below
+ *            SCHEDULER_DEADLINE_UTILIZATION_LIMIT.
+ *          + Sleeping processes are kept in wait queues, every object which
+ *            makes processes wait (the keyboard, a timer, etc.) owns its
+ *            queue, so a wakeup only walks its own waiters. The queues are
+ *            doubly linked, a process is removed from its queue in O(1) when
+ *            its timer expires. The legacy Sleep()/Wakeup() API with a
+ *            wait_id uses WAIT_CHANNEL_BUCKETS queues hashed by the id.
+ *          + Every process keeps the list of its children, exited children
+ *            stay there as zombies until the parent reaps them with Wait().
  * 
  *          In this section, we are going to analyze each state of process.
  *          Let's get started.
  *
- *          1. Every process object is also maintained by `s_process_manager`
- *          (that actually is array of processes). So, if user does not request
- *          to create new process, we mark them as `PROCESS_SLOT_UNUSED`.
+ *          1. Process objects are allocated from an object cache, a free PID
+ *          is taken from a bitmap, and the process is added to a hash table
+ *          of PIDs, so FindProcess() doesn't scan every process. The file
+ *          descriptor table is only used by system calls, it is allocated
+ *          apart from the process object, so the fields which the scheduler
+ *          touches stay together.
  *
- *          2. When user request to create a new process, we find a free process
- *          slot using `FindFreeProcessSlot()`, initialize the process object
+ *          2. When user request to create a new process, we allocate a process
+ *          object using `AllocProcess()`, initialize the process object
  *          (stack, virtual memory map, context, trap frame, etc.) and mark it
  *          as `PROCESS_SLOT_INITIALIZED`.
  * 
@@ -39,7 +70,7 @@
  *          pop from the ready queue and mark as `PROCESS_SLOT_RUNNING`, it take
  *          CPU control from previous process. In the state, the process object
  *          not belong to any queue, this is maintain by
- *          scheduler->current_proc.
+ *          run queue->current_proc of its CPU.
  * 
  *          5. When process is running state, if it doesn't call sleep() and
  *          exit(), and when the context switch occurs again, out of it's turn.
@@ -47,27 +78,72 @@
  *          process, and marked as `PROCESS_SLOT_READY`.
  *
  *          6. If a process is running state, and it call sleep() system call,
- *          we will push it to the while loop until the time is achieved. And in
- *          the while loop, we push it to the sleep queue, mark it as
- *          `PROCESS_SLOT_SLEEPING`, and pop it out of ready queue, so this
- *          process will never be run until we call the Wakeup(). Every 10ms
- *          the timer handler is called, we wakeup it, check the time is reached
- *          or not, if it is, we return the system call to user mode, if it is
- *          not, we sleep it again in the while loop().
+ *          we arm its timer at the wakeup time, mark it as
+ *          `PROCESS_SLOT_SLEEPING`, and it is not in any ready queue, so this
+ *          process will never be run until it is woken up. When the timer
+ *          expires, the timer interrupt removes it from its wait queue and
+ *          pushes it back to the ready queue.
  * 
- *          7. The `PROCESS_SLOT_KILLED` state is reached by three ways:
+ *          7. The `PROCESS_SLOT_ZOMBIE` state is reached by three ways:
  *              + User call Exit() system call.
  *              + the user main() function return.
  *              + The process cause CPU generated a error exception (page fault, 
  *                segmentation fault, for example.)
  *          In this state we will not release process's resource intermediately,
- *          because, the process still running. So, we pop it out ready queue,
- *          and push it to the killed queue, by the way, the process will never
- *          be run again. And when init process wakeup, it call cleanup all
- *          resource of the process such as: kernel stack, virtual memory page
- *          map, etc. And finally, it marked the process as
- *          `PROCESS_SLOT_UNUSED`, to the next user create process request could
- *          reuse it's slot.
+ *          because, the process still running. So, we only keep its exit
+ *          status, move it to the head of the child list of its parent and
+ *          wake up the parent, the process will never be run again. Its own
+ *          children are adopted by the init process. When the parent calls
+ *          Wait(), it takes the exit status and hands the process to a worker
+ *          of the system work queue, which cleans up all resource of the
+ *          process such as: kernel stack, virtual memory page map, etc. And
+ *          finally, the process object and its PID are released, to the next
+ *          user create process request could reuse them.
+ *
+ *          Kernel threads are processes which only run kernel code on the
+ *          kernel page map, they have no user memory and no parent, a kernel
+ *          thread which exits is reaped by a worker at once.
+ *
+ *          User threads are processes which share the page map, the file
+ *          descriptor table and the program of their leader (the process
+ *          which created them), they only have their own kernel stack and
+ *          trap frame. Switching between threads of the same process doesn't
+ *          reload CR3. A thread which exits stays a zombie until another
+ *          thread joins it, and when any thread calls exit(), every thread of
+ *          the process exits, and the leader is the zombie which the parent
+ *          reaps.
+ *
+ *          On a multiprocessor, every CPU has its own run queue (the ready
+ *          queues of the normal processes), its idle process and its running
+ *          process, the real-time processes, the wait queues and the process
+ *          objects stay shared:
+ *          + A process which becomes ready goes back to the CPU it last ran
+ *            on, its data may still be in the cache, unless that CPU is busy
+ *            and another one is idle. A CPU which gets a process from another
+ *            one sends it a reschedule IPI.
+ *          + A CPU whose run queue is empty steals the next ready process of
+ *            the CPU with the longest run queue before it runs its idle
+ *            process, and an idle CPU looks for work on every tick.
+ *          + The kernel runs under one lock (see smp.h), so the scheduler is
+ *            never run by two CPUs at once. A thread which runs on another CPU
+ *            when its process exits is only marked as a zombie, its CPU is
+ *            interrupted and leaves it, and it is reaped once no CPU runs it.
+ *
+ *          System calls run with the interrupts enabled, so a key press or a
+ *          timer is handled at once, but the process is only switched out
+ *          where the kernel allows it. Every process has a preempt count, a
+ *          system call raises it, and an interrupt which finds it above 0 in
+ *          the kernel only records the tick or the preemption, which is done
+ *          when the count drops back to 0. Long operations on private data
+ *          (a disk transfer, the copy of the memory of fork()) lower it, so
+ *          the scheduling latency doesn't depend on them. A thread which is
+ *          switched out there is not stopped by exit() until it is done.
+ *
+ *          The CPU time of every process is read from the TSC at each entry
+ *          to the kernel from ring 3 (user time), at each return there and at
+ *          each context switch (system time), and between the time it is made
+ *          ready and the time it runs (wait time). getrusage() and the process
+ *          list report it with the context switches and the system calls.
  * 
  * @version 0.1
  * @date 2023-08-07
@@ -81,17 +157,57 @@
 #include <list.h>
 #include "common.h"
 #include "trap.h"
+#include "cpu.h"
 #include "memory.h"
+#include "timer.h"
 
 /* Public define -------------------------------------------------------------*/
-#define STACK_SIZE                          PAGE_SIZE    /* 2MB. */
-#define MAXIMUM_NUMBER_OF_PROCESS           10
+/* PIDs go from 0 (IDLE) to PID_MAXIMUM - 1, the limit of processes is set at
+ * boot from the memory, below PID_MAXIMUM. */
+#define PID_MAXIMUM                         32768
+#define PID_HASH_BUCKETS                    1024
 #define USER_STACK_START                    (USER_VIRTUAL_ADDRESS_BASE \
-                                            + STACK_SIZE)
-#define NORMAL_PROCESS_WAIT_ID              -1
-#define INIT_PROCESS_WAIT_ID                1
-#define WAITING_KEYBOARD_PROCESS_WAIT_ID    -2
+                                            + PAGE_SIZE)
+#define IDLE_PROCESS_PID                    0
+#define INIT_PROCESS_PID                    1
+/* Process flags. */
+#define PROCESS_FLAG_KERNEL_THREAD          BIT(0)
+#define PROCESS_FLAG_THREAD                 BIT(1)
+#define PROCESS_FLAG_PREEMPTED              BIT(2)
+#define DEADLINE_PROCESS_WAIT_ID            -3
 #define PROCESS_MAXIMUM_FILE_DESCRIPTOR     100
+#define PROCESS_MAXIMUM_VMAS                8
+#define WAIT_CHANNEL_BUCKETS                16
+
+/* ArchPrctl() codes. */
+#define ARCH_SET_FS                         0x1002
+#define ARCH_GET_FS                         0x1003
+
+/* Wait() options, and exit status of the processes which don't call exit(). */
+#define WAIT_NO_HANG                        BIT(0)
+#define EXIT_STATUS_EXEC_FAILURE            127
+#define EXIT_STATUS_EXCEPTION(trapno)       (128 + (trapno))
+
+/* Spawn() file actions, and limit of the arguments. */
+#define SPAWN_FILE_CLOSE                    1
+#define SPAWN_FILE_DUP2                     2
+#define SPAWN_ARGUMENTS_MAXIMUM             32
+
+/* GetResourceUsage() targets, the values are the ones of Linux. */
+#define RUSAGE_SELF                         0
+#define RUSAGE_CHILDREN                     (-1)
+
+#define SCHEDULER_PRIORITY_LEVELS           4
+#define SCHEDULER_AGING_TICKS               TIMER_FREQUENCY_HZ  /* 1 second.  */
+#define PROCESS_NICE_MAXIMUM                19
+
+#define SCHEDULER_CLASS_NORMAL              0
+#define SCHEDULER_CLASS_DEADLINE            1
+/* Maximum utilization of real-time processes in per mille, the rest is kept
+ * for normal processes. */
+#define SCHEDULER_DEADLINE_UTILIZATION_LIMIT    900
+/* Longest period of a real-time process in milliseconds (1 hour). */
+#define SCHEDULER_DEADLINE_MAXIMUM_PERIOD       3600000
 /* Public type ---------------------------------------------------------------*/
 typedef enum  {
     PROCESS_SLOT_UNUSED = 0,
@@ -99,69 +215,298 @@ typedef enum  {
     PROCESS_SLOT_READY,
     PROCESS_SLOT_RUNNING,
     PROCESS_SLOT_SLEEPING,
-    PROCESS_SLOT_KILLED
+    PROCESS_SLOT_ZOMBIE
 } ProcessState;
 
+/**
+ * @brief   Parameters and state of a real-time process, all times are in timer
+ *          ticks.
+ *
+ * @property runtime            - Budget of each job.
+ * @property period             - A new job is released every period.
+ * @property deadline           - Deadline of each job, relative to its release.
+ * @property budget             - Budget left of the current job.
+ * @property misses             - Number of jobs which missed their deadline.
+ * @property release            - Release time of the next job.
+ * @property absolute_deadline  - Deadline of the current job.
+ * @property active             - The current job is not finished.
+ * @property missed             - The current job missed its deadline.
+ */
+typedef struct {
+    uint32_t runtime;
+    uint32_t period;
+    uint32_t deadline;
+    uint32_t budget;
+    uint32_t misses;
+    uint64_t release;
+    uint64_t absolute_deadline;
+    bool active;
+    bool missed;
+} DeadlineTask;
+
+/**
+ * @brief   File action of spawn(), applied in order to the descriptors which
+ *          the new process inherits. A list ends with an action of 0. The
+ *          layout is shared with user space `struct spawn_file_action`.
+ *
+ * @property action     - SPAWN_FILE_CLOSE closes `fd`, SPAWN_FILE_DUP2 makes
+ *                        `new_fd` a copy of `fd`.
+ */
+typedef struct {
+    int action;
+    int fd;
+    int new_fd;
+} SpawnFileAction;
+
+/**
+ * @brief   CPU accounting of a process, the times are in TSC cycles.
+ *
+ * @property user_cycles        - Time run in ring 3.
+ * @property system_cycles      - Time run in the kernel: system calls, faults
+ *                                and interrupts taken while it ran.
+ * @property wait_cycles        - Time spent ready in a run queue.
+ * @property voluntary_switches - The process blocked, or exited.
+ * @property involuntary_switches
+ *                              - The process was switched out while it could
+ *                                still run.
+ * @property system_calls       - System calls made.
+ */
+typedef struct {
+    uint64_t user_cycles;
+    uint64_t system_cycles;
+    uint64_t wait_cycles;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+    uint64_t system_calls;
+} ProcessUsage;
+
+/**
+ * @brief   Resource usage of getrusage(), the layout is shared with user space
+ *          `struct rusage`.
+ */
+typedef struct {
+    TimeSpec user_time;
+    TimeSpec system_time;
+    TimeSpec wait_time;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+    uint64_t system_calls;
+} ResourceUsage;
+
+/**
+ * @brief   Entry of the process list, the layout is shared with user space
+ *          `struct procinfo`. The times are in nanoseconds.
+ *
+ * @property parent_pid - 0 for a thread, a kernel thread and init.
+ * @property leader_pid - PID of the process a thread belongs to, or `pid`.
+ * @property name       - Program file, "NAME.EXT", empty if the process runs
+ *                        no program file (init and the kernel threads).
+ */
+typedef struct {
+    int32_t pid;
+    int32_t parent_pid;
+    int32_t leader_pid;
+    uint8_t state;
+    uint8_t priority;
+    uint8_t nice;
+    uint8_t cpu;
+    uint32_t flags;
+    char name[16];
+    uint64_t user_time;
+    uint64_t system_time;
+    uint64_t wait_time;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+    uint64_t system_calls;
+} ProcessInfo;
+
+
+/**
+ * @brief   Link of a sleeping process in a wait queue.
+ */
+typedef struct WaitLink {
+    struct WaitLink *next;
+    struct WaitLink *prev;
+} WaitLink;
+
+/**
+ * @brief   Processes which wait for the same event, in FIFO order. A zeroed
+ *          queue is empty.
+ */
+typedef struct {
+    WaitLink *first;
+    WaitLink *last;
+} WaitQueue;
+
+/**
+ * @brief   Files opened by a process.
+ */
+struct FD;
+struct FCB;
+struct Ring;
+
+typedef struct {
+    struct FD *file[PROCESS_MAXIMUM_FILE_DESCRIPTOR];
+} ProcessFiles;
 
 /**
  * @brief   Process Control Block structure. This structure is used to store the
  *          essential data of the process. It is maintained in the kernel space,
- *          user program is not allowed to access it.
+ *          user program is not allowed to access it. The fields used by the
+ *          scheduler come first, the file descriptor table is allocated apart.
  *
  * @property next       - Next process to run.
  * @property pid        - Process Identification number of a process.
  * @property wait_id    - Save the process wait id.
  * @property state      - Current state of process
+ * @property flags      - PROCESS_FLAG_KERNEL_THREAD for kernel threads,
+ *                        PROCESS_FLAG_THREAD for user threads,
+ *                        PROCESS_FLAG_PREEMPTED while it is switched out in
+ *                        the middle of the kernel.
+ * @property preempt_count
+ *                      - The process can be preempted in the kernel only at
+ *                        0, it is 1 in a system call and in a kernel thread.
  * @property page_map   - Saves the address of page map level 4 table, when we
  *                        run the process, we use this to switch to the process
  *                        's virtual memory.
  * @property stack      - Stack pointer is used when enter the kernel mode. A
  *                        Process has two stack, one for user code, and one for
  *                        kernel code. The one for user code is saved in trap
- *                        frame.
+ *                        frame. The kernel stack is KERNEL_STACK_SIZE bytes,
+ *                        `stack` is its bottom.
  * @property tf         - 
+ * @property hash_next  - Next process in the same PID hash bucket.
+ * @property files      - File descriptor table.
+ * @property image      - File control block of the running program, frames of
+ *                        the program are read from it on demand.
+ * @property vma        - Virtual memory areas of the user window.
+ * @property priority   - Current priority level, the ready queue index.
+ * @property nice       - Nice value, from 0 to PROCESS_NICE_MAXIMUM.
+ * @property used_ticks - Ticks used of the current time quantum.
+ * @property ready_ticks- Tick when the process entered the ready queue.
+ * @property sched_class- SCHEDULER_CLASS_NORMAL or SCHEDULER_CLASS_DEADLINE.
+ * @property dl         - Real-time parameters of a deadline process.
+ * @property dl_next, dl_prev
+ *                      - Links in the list of real-time processes.
+ * @property timer      - Wakes up the process at the end of SleepOnUntil().
+ * @property wait_link  - Link in the wait queue of a sleeping process.
+ * @property wait_queue - Wait queue of a sleeping process, NULL if only its
+ *                        timer can wake it up.
+ * @property parent     - Process which forked this one, or init if it exited.
+ * @property first_child, last_child
+ *                      - Children of the process, the zombies are always at
+ *                        the head of the list.
+ * @property next_sibling, prev_sibling
+ *                      - Links in the child list of the parent.
+ * @property child_exit_queue
+ *                      - The process waits here for a child to exit.
+ * @property exit_status- Exit status of a zombie, kept until the parent reaps
+ *                        it.
+ * @property leader     - Process whose page map, files and program a user
+ *                        thread shares, NULL for a process.
+ * @property first_thread, next_thread
+ *                      - Threads of a process, zombies stay in the list until
+ *                        they are joined.
+ * @property thread_exit_queue
+ *                      - Threads of the process wait here in JoinThread().
+ * @property fs_base    - FS base of a user thread, its TLS pointer. It is only
+ *                        up to date while the thread isn't running.
+ * @property cpu        - CPU which runs the process, or whose run queue holds
+ *                        it, or which ran it last.
+ * @property ring       - Submission and completion rings of the process (see
+ *                        ring.h), NULL until it sets them up.
+ * @property usage      - CPU accounting of the process. A leader also counts
+ *                        the threads which are released.
+ * @property children_usage
+ *                      - Usage of the children which were reaped, with their
+ *                        own children_usage.
+ * @property account_tsc- TSC of the last accounting point: the switch to the
+ *                        process, or its last entry to or exit from ring 3.
+ * @property ready_tsc  - TSC when the process entered a ready queue, 0 while
+ *                        it isn't ready.
+ * @property template   - Template whose frames the process maps (see
+ *                        template.h), NULL if it wasn't cloned from one.
+ * @property checkpoint - Checkpoint file whose saved frames the process reads
+ *                        on demand (see checkpoint.h), NULL if it wasn't
+ *                        restored from one.
  */
-struct FD;
-
-typedef struct {
+typedef struct Process {
     List *next;
     int pid;
     int wait_id;
     ProcessState state;
+    uint32_t flags;
+    int preempt_count;
+    int priority;
+    int nice;
+    uint32_t used_ticks;
+    uint64_t ready_ticks;
+    int sched_class;
     uint64_t page_map;
     uint64_t context;
     uint64_t stack;
     TrapFrame *tf;
-    struct FD *file[PROCESS_MAXIMUM_FILE_DESCRIPTOR];
+    struct Process *hash_next;
+    ProcessFiles *files;
+    struct FCB *image;
+    VMArea vma[PROCESS_MAXIMUM_VMAS];
+    int vma_count;
+    DeadlineTask dl;
+    struct Process *dl_next;
+    struct Process *dl_prev;
+    Timer timer;
+    WaitLink wait_link;
+    WaitQueue *wait_queue;
+    struct Process *parent;
+    struct Process *first_child;
+    struct Process *last_child;
+    struct Process *next_sibling;
+    struct Process *prev_sibling;
+    WaitQueue child_exit_queue;
+    int exit_status;
+    struct Process *leader;
+    struct Process *first_thread;
+    struct Process *next_thread;
+    WaitQueue thread_exit_queue;
+    uint64_t fs_base;
+    int cpu;
+    struct Ring *ring;
+    ProcessUsage usage;
+    ProcessUsage children_usage;
+    uint64_t account_tsc;
+    uint64_t ready_tsc;
+    struct Template *template;
+    struct CheckpointImage *checkpoint;
 } Process;
 
 /**
- * @brief   The TSS (Task state segment) structure is used only for setting up
- *          stack pointer for ring 0.
+ * @brief   Processes of one CPU.
+ *
+ * @property current_proc   - Process which runs on the CPU.
+ * @property idle_proc      - Runs when there is nothing else to run.
+ * @property ready_proc_list- Ready queue of each priority level.
+ * @property ready_bitmap   - Bit `level` is set if its ready queue isn't empty.
+ * @property ready_count    - Number of processes in the ready queues.
+ * @property aged_ticks     - Tick of the last aging of the ready queues.
+ * @property deferred       - Tick or preemption which an interrupt found the
+ *                            current process not preemptible for.
  */
 typedef struct {
-    uint32_t res0;
-    uint64_t rsp0;
-    uint64_t rsp1;
-    uint64_t rsp2;
-    uint64_t res1;
-    uint64_t ist1;
-    uint64_t ist2;
-    uint64_t ist3;
-    uint64_t ist4;
-    uint64_t ist5;
-    uint64_t ist6;
-    uint64_t ist7;
-    uint64_t res2;
-    uint16_t res3;
-    uint16_t iopb;
-} __attribute__ ((packed)) TSS;
+    Process *current_proc;
+    Process *idle_proc;
+    HeadList ready_proc_list[SCHEDULER_PRIORITY_LEVELS];
+    uint32_t ready_bitmap;
+    uint32_t ready_count;
+    uint64_t aged_ticks;
+    uint32_t deferred;
+} RunQueue;
 
 typedef struct {
-    Process *current_proc;
-    HeadList ready_proc_list;
-    HeadList wait_proc_list;
-    HeadList kill_proc_list;
+    RunQueue run_queues[CPU_MAXIMUM];
+    HeadList deadline_proc_list;
+    Process *deadline_procs;
+    uint32_t deadline_utilization;
+    WaitQueue wait_channels[WAIT_CHANNEL_BUCKETS];
 } Scheduler;
 
 /* Public function prototype -------------------------------------------------*/
@@ -170,6 +515,33 @@ void InitProcess(void);
 void ProcessStart(TrapFrame *tf);
 Scheduler *GetScheduler(void);
 
+/**
+ * @brief       Process which runs on the current CPU.
+ */
+Process *GetCurrentProcess(void);
+
+/**
+ * @brief       Set up the idle process of a CPU, it runs on the stack which
+ *              the CPU starts with (0 for the boot stack), and it is the
+ *              current process of the CPU until the first switch.
+ */
+void InitIdleProcess(int cpu, uint64_t stack);
+
+/**
+ * @brief       Leave the current process if it was stopped by another CPU (it
+ *              is a thread of a process which exited), it is called when the
+ *              CPU enters the kernel.
+ */
+void ScheduleIfStopped(void);
+
+/**
+ * @brief       Check if the current CPU needs scheduler ticks: its process
+ *              shares the CPU with ready processes, or it is a real-time
+ *              process whose budget is counted. The boot CPU also ticks while
+ *              there are real-time processes, it releases their jobs.
+ */
+bool NeedsSchedulerTick(void);
+
 /**
  * @brief       Stop current process, mark it as ready state, context switch,
  *              and gave CPU control to next process to run.
@@ -177,6 +549,90 @@ Scheduler *GetScheduler(void);
  */
 void Yield(void);
 
+/**
+ * @brief       Charge the current process one timer tick. It is demoted and
+ *              switched out when its time quantum is over, or it is preempted
+ *              by a process of higher priority. Processes waiting too long are
+ *              aged here too.
+ */
+void SchedulerTick(void);
+
+/**
+ * @brief       Switch to a ready process of higher priority than the current
+ *              one, if there is any. It is called after an interrupt wakes up
+ *              processes.
+ */
+void Preempt(void);
+
+/**
+ * @brief       Do the scheduler work of an interrupt: charge the tick if `tick`
+ *              is true, else switch to a process of higher priority. If the
+ *              CPU was in the kernel and the process isn't preemptible there,
+ *              it is only recorded until EnablePreemption().
+ */
+void PreemptInterrupted(TrapFrame *tf, bool tick);
+
+/**
+ * @brief       Raise the preempt count of the current process.
+ */
+void DisablePreemption(void);
+
+/**
+ * @brief       Lower the preempt count of the current process, it is switched
+ *              out at 0 if an interrupt asked for it meanwhile.
+ */
+void EnablePreemption(void);
+
+/**
+ * @brief       Make a long operation on private data of a system call
+ *              preemptible. Nothing changes for a page fault of user code, or
+ *              in a section which disabled preemption itself.
+ *
+ * @return      true if the caller must call LeavePreemptible(true) after the
+ *              operation.
+ */
+bool EnterPreemptible(void);
+
+/**
+ * @brief       End the window of EnterPreemptible(), `entered` is its result.
+ */
+void LeavePreemptible(bool entered);
+
+/**
+ * @brief       Add `increment` to the nice value of the current process, the
+ *              result is kept in [0, PROCESS_NICE_MAXIMUM].
+ *
+ * @return      The new nice value.
+ */
+int Nice(int increment);
+
+/**
+ * @brief       Make the current process a real-time process, or a normal one
+ *              again if `runtime` is 0. The first job is released at once.
+ *
+ * @param[in]   runtime     - Budget of each job in milliseconds.
+ * @param[in]   period      - Period in milliseconds.
+ * @param[in]   deadline    - Relative deadline in milliseconds.
+ * @return      0           - Success.
+ *              -EINVAL     - runtime <= deadline <= period is not satisfied,
+ *                            or the period is over
+ *                            SCHEDULER_DEADLINE_MAXIMUM_PERIOD.
+ *              -EBUSY      - Admission control failed, the total utilization
+ *                            would be over the limit.
+ */
+int SetDeadline(uint32_t runtime, uint32_t period, uint32_t deadline);
+
+/**
+ * @brief       The current job of the real-time process is done, sleep until
+ *              the next one is released. A normal process just yields.
+ */
+void DeadlineYield(void);
+
+/**
+ * @brief       Number of deadline misses of the current process.
+ */
+int GetDeadlineMisses(void);
+
 /**
  * @brief       Switch context between two process, save old context to `old`,
  *              And retrieve new context from `new`.
@@ -188,12 +644,42 @@ void Yield(void);
 void ContextSwitch(uint64_t *old, uint64_t new);
 
 /**
- * @brief       Add current process to wait list wih wait_id.
+ * @brief       Add current process to the wait channel of wait_id.
  * 
  * @param[in]   wait_id     - Current process wait id.
  */
 void Sleep(int wait_id);
 
+/**
+ * @brief       Add current process to the tail of `queue` until it is woken up.
+ *
+ * @param[in]   queue       - Wait queue of the awaited event.
+ */
+void SleepOn(WaitQueue *queue);
+
+/**
+ * @brief       Add current process to the tail of `queue` until it is woken up
+ *              or the monotonic clock reaches `expiry`.
+ *
+ * @param[in]   queue       - Wait queue of the awaited event, or NULL to only
+ *                            wait for the time.
+ * @param[in]   expiry      - Absolute wakeup time in nanoseconds.
+ */
+void SleepOnUntil(WaitQueue *queue, uint64_t expiry);
+
+/**
+ * @brief       Wake up the first process of `queue`, for events which only one
+ *              waiter can consume.
+ *
+ * @return      true if a process was woken up.
+ */
+bool WakeUpOne(WaitQueue *queue);
+
+/**
+ * @brief       Wake up every process of `queue`.
+ */
+void WakeUpAll(WaitQueue *queue);
+
 /**
  * @brief       Wakeup processes which match wait_id.
  * 
@@ -202,20 +688,163 @@ void Sleep(int wait_id);
 void Wakeup(int wait_id);
 
 /**
- * @brief       Exit current process, remove it from ready list.
+ * @brief       Exit current process, it becomes a zombie until its parent reaps
+ *              it. Its children are adopted by the init process.
  * 
+ * @param[in]   status      - Exit status reported to the parent.
  */
-void Exit(void);
+void Exit(int status);
 
 /**
- * @brief       Waiting for children process exit, the init process call this to
- *              cleanup exiting processes. This system call never return from
- *              kernel mode, so, this function should be called when the init
- *              process has done it's job in user space.
+ * @brief       Wait for a child of the current process to exit, its resources
+ *              are released by a worker thread. Only the parent is woken up by
+ *              the exit.
  * 
+ * @param[in]   pid         - Child to wait for, or -1 for any child.
+ * @param[out]  status      - Receives the exit status of the child, can be
+ *                            NULL.
+ * @param[in]   options     - WAIT_NO_HANG returns at once if no child exited.
+ * @return      The pid of the reaped child, 0 if WAIT_NO_HANG is set and no
+ *              child exited, or -ECHILD if there is no such child.
  */
-void Wait(int pid);
+int Wait(int pid, int *status, int options);
 
 int Fork(void);
 
+/**
+ * @brief       Create a process which runs the program `path`, without copying
+ *              the memory of the current process like fork() and exec() do.
+ *              The program headers are checked here, so a missing or invalid
+ *              program is reported to the caller. The new process inherits
+ *              the file descriptors, changed by `actions`, and it binds the
+ *              shared runtime and pushes its arguments on its own stack before
+ *              it enters user mode: main() gets argc and argv. A program which
+ *              has a template (see template.h) is cloned from it.
+ * @param[in]   path        - Program file.
+ * @param[in]   argv        - Arguments ending with NULL, or NULL for none.
+ * @param[in]   actions     - File actions ending with action 0, or NULL.
+ * @return      The pid of the new process, or:
+ *              -ENOENT     - The file doesn't exist.
+ *              -ENOEXEC    - The file isn't a valid program.
+ *              -E2BIG      - Too many arguments, or too long.
+ *              -EBADF      - A file action uses a descriptor which isn't open.
+ *              -EINVAL     - Unknown file action.
+ *              -ENOMEM     - Out of memory, or of processes.
+ */
+int Spawn(const char *path, char *const argv[], const SpawnFileAction *actions);
+
+/**
+ * @brief       Create a process from the checkpoint file `path` (see
+ *              checkpoint.h), a child of the current process like spawn()
+ *              makes. It resumes where it was saved, with the files it had
+ *              opened, its frames are read from the file on demand.
+ * @return      The pid of the new process, -ENOMEM, or an error of
+ *              LoadCheckpoint().
+ */
+int Restore(const char *path);
+
+/**
+ * @brief       Charge the time since the last accounting point of the current
+ *              process to its user time (`user` is true), when the CPU enters
+ *              the kernel from ring 3, or to its system time, when it returns
+ *              there.
+ */
+void AccountCPUTime(bool user);
+
+/**
+ * @brief       Resource usage of the current process and all its threads
+ *              (RUSAGE_SELF), or of its reaped children (RUSAGE_CHILDREN).
+ * @return      0, or -EINVAL for another target.
+ */
+int GetResourceUsage(int who, ResourceUsage *usage);
+
+/**
+ * @brief       Fill `list` with up to `count` processes and threads, in PID
+ *              order. The idle processes are not listed.
+ * @return      Number of entries filled.
+ */
+int GetProcessList(ProcessInfo *list, int count);
+
+/**
+ * @brief       Create a kernel thread which runs `entry(data)`. It only uses the
+ *              kernel page map, it is scheduled like a process and it exits
+ *              when `entry` returns. Kernel threads have no parent, they are
+ *              reaped by a worker of the system work queue.
+ * @return      The thread, or NULL if the limit of processes is reached or the
+ *              system is out of memory.
+ */
+Process *CreateKernelThread(void (*entry)(void *data), void *data);
+
+/**
+ * @brief       Create a kernel thread in the process `leader`: it only runs
+ *              kernel code, but on the page map and with the files of the
+ *              process, so it reaches the user memory like a system call does.
+ *              It is a thread of the process, it is stopped with the other
+ *              threads when the process exits, `entry` never returns.
+ * @return      The thread, or NULL if the limit of processes is reached or the
+ *              system is out of memory.
+ */
+Process *CreateProcessKernelThread(Process *leader,
+                                   void (*entry)(void *data),
+                                   void *data);
+
+/**
+ * @brief       Create a user thread in the current process. It shares the page
+ *              map, the file descriptor table and the program of the process,
+ *              but it has its own kernel stack and trap frame.
+ * @param[in]   entry       - User address where the thread starts.
+ * @param[in]   stack       - Top of the user stack of the thread.
+ * @param[in]   arg         - Passed to the thread in `rdi`.
+ * @return      The thread id, -EINVAL if `entry` or `stack` is out of user
+ *              memory, or -ENOMEM.
+ */
+int CreateThread(uint64_t entry, uint64_t stack, uint64_t arg);
+
+/**
+ * @brief       Exit the current thread, it stays a zombie until it is joined.
+ *              The main thread exits the whole process.
+ */
+void ExitThread(int status);
+
+/**
+ * @brief       Wait for a thread of the current process to exit, and release
+ *              it.
+ * @param[out]  status      - Receives the exit status, can be NULL.
+ * @return      The thread id, or -ESRCH if `tid` isn't another thread of the
+ *              process.
+ */
+int JoinThread(int tid, int *status);
+
+/**
+ * @brief       Set (ARCH_SET_FS) or get (ARCH_GET_FS) the FS base of the
+ *              current thread. GS belongs to the kernel.
+ * @param[in]   addr        - New base, or the user variable which receives the
+ *                            base.
+ * @return      0, -EPERM if the address isn't in the memory of the program,
+ *              -EFAULT if the user variable isn't writable, or -EINVAL for
+ *              another code.
+ */
+int ArchPrctl(int code, uint64_t addr);
+
+/**
+ * @brief       Process which owns the memory and the files of `proc`: its
+ *              leader for a thread, the process itself otherwise.
+ */
+static inline Process *GetThreadLeader(Process *proc)
+{
+    return proc->leader != NULL ? proc->leader : proc;
+}
+
+/**
+ * @brief       Find a live or zombie process from its PID.
+ *
+ * @return      The process, or NULL.
+ */
+Process *FindProcess(int pid);
+
+/**
+ * @brief       Maximum number of processes, set at boot from the memory.
+ */
+uint32_t GetProcessLimit(void);
+
 int Exec(Process *proc, const char *filename);
\ No newline at end of file
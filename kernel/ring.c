@@ -0,0 +1,460 @@
+#include <stddef.h>
+#include <errno.h>
+
+#include "ring.h"
+#include "file.h"
+#include "keyboard.h"
+#include "memory.h"
+#include "timer.h"
+#include "printk.h"
+#include "assert.h"
+#include "spinlock.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Operations which wait for a key or for their timeout, per ring. */
+#define RING_MAXIMUM_PENDING        16
+/* A polling worker looks at the submission ring every millisecond, and goes
+ * to sleep after 100 milliseconds without work. */
+#define RING_POLL_INTERVAL          NANOSECONDS_PER_MILLISECOND
+#define RING_POLL_IDLE              (100 * NANOSECONDS_PER_MILLISECOND)
+
+/* Private type --------------------------------------------------------------*/
+struct Ring;
+
+/**
+ * @brief   Operation which completes after its submission.
+ *
+ * @property timer      - Timer of a timeout.
+ * @property ring       - Ring of the operation, for the timer callback.
+ * @property user_data  - Of the submission entry.
+ * @property buffer     - Buffer of a read.
+ * @property length     - Length of a read.
+ * @property opcode     - RING_OP_READ or RING_OP_TIMEOUT, RING_OP_NOP if the
+ *                        slot is free.
+ */
+typedef struct {
+    Timer timer;
+    struct Ring *ring;
+    uint64_t user_data;
+    char *buffer;
+    uint64_t length;
+    uint8_t opcode;
+} RingOperation;
+
+/**
+ * @brief   Kernel side of a ring, one frame. The rings are seen through their
+ *          kernel addresses, so a timer completes an operation whatever page
+ *          map is loaded.
+ *
+ * @property owner          - Process of the ring.
+ * @property worker         - Ring worker thread.
+ * @property sq, cq         - Submission and completion rings.
+ * @property flags          - Flags of ring_setup().
+ * @property pending        - Operations whose completion is not posted yet.
+ * @property pending_reads  - Reads of the standard input among them.
+ * @property completion_wait- ring_enter() waits here for completions.
+ * @property worker_wait    - The ring worker sleeps here.
+ * @property operation      - Pending operations.
+ */
+typedef struct Ring {
+    Process *owner;
+    Process *worker;
+    RingSubmissionQueue *sq;
+    RingCompletionQueue *cq;
+    uint32_t flags;
+    uint32_t pending;
+    uint32_t pending_reads;
+    WaitQueue completion_wait;
+    WaitQueue worker_wait;
+    RingOperation operation[RING_MAXIMUM_PENDING];
+} Ring;
+
+_Static_assert(sizeof(Ring) <= FRAME_SIZE, "Ring must fit in a frame");
+_Static_assert(sizeof(RingSubmissionQueue) <= FRAME_SIZE,
+               "Submission ring must fit in a frame");
+_Static_assert(sizeof(RingCompletionQueue) <= FRAME_SIZE,
+               "Completion ring must fit in a frame");
+
+/* Private function prototype ------------------------------------------------*/
+/**
+ * @brief   Take the entries of the submission ring and run them, as long as
+ *          their completions have room in the completion ring.
+ *
+ * @return  Number of entries taken.
+ */
+static uint32_t SubmitEntries(Ring *ring, uint32_t count);
+
+/**
+ * @brief   Run one operation, post its completion or keep it pending.
+ */
+static void RunOperation(Ring *ring, const RingSubmission *sqe);
+
+/**
+ * @brief   Add a completion entry and wake up ring_enter().
+ */
+static void PostCompletion(Ring *ring, uint64_t user_data, int32_t result);
+
+/**
+ * @brief   Complete the pending reads of the standard input while keys are
+ *          buffered. It runs in the process, the buffers are in its memory.
+ */
+static void CompleteReads(Ring *ring);
+
+/**
+ * @brief   Free slot for a pending operation, or NULL.
+ */
+static RingOperation *AllocOperation(Ring *ring);
+
+/**
+ * @brief   Release the slot of a pending operation which completed.
+ */
+static void FreeOperation(RingOperation *op);
+
+/**
+ * @brief   Timer callback of a timeout.
+ */
+static void RingTimeoutExpired(void *data);
+
+/**
+ * @brief   Entry of the ring worker.
+ */
+static void RingWorker(void *data);
+
+static inline uint32_t GetCompletionSpace(Ring *ring)
+{
+    return RING_COMPLETION_ENTRIES
+           - (ring->cq->tail - ring->cq->head)
+           - ring->pending;
+}
+
+/* Public function -----------------------------------------------------------*/
+int SetupRing(uint32_t flags)
+{
+    Process *proc = GetThreadLeader(GetCurrentProcess());
+    Ring *ring = NULL;
+
+    if (proc->ring != NULL) {
+        return -EBUSY;
+    }
+
+    if (flags & ~RING_SETUP_POLL) {
+        return -EINVAL;
+    }
+
+    ring = AllocFrame();
+    if (ring == NULL) {
+        return -ENOMEM;
+    }
+
+    ring->owner = proc;
+    ring->flags = flags;
+    ring->sq = AllocFrame();
+    ring->cq = AllocFrame();
+    if (ring->sq != NULL && ring->cq != NULL) {
+        ring->worker = CreateProcessKernelThread(proc, RingWorker, ring);
+    }
+
+    if (ring->worker == NULL) {
+        if (ring->sq != NULL) {
+            FreeFrame(ring->sq);
+        }
+        if (ring->cq != NULL) {
+            FreeFrame(ring->cq);
+        }
+        FreeFrame(ring);
+        return -ENOMEM;
+    }
+
+    /* The page table is the one of the vDSO pages, the frames are mapped
+     * without allocation. They are owned by the page map from now on. */
+    ASSERT(MapUserFrame(proc->page_map,
+                        RING_SUBMISSION_ADDRESS,
+                        ring->sq,
+                        VMA_READ | VMA_WRITE));
+    ASSERT(MapUserFrame(proc->page_map,
+                        RING_COMPLETION_ADDRESS,
+                        ring->cq,
+                        VMA_READ | VMA_WRITE));
+
+    proc->ring = ring;
+
+    return 0;
+}
+
+int EnterRing(uint32_t to_submit, uint32_t min_complete)
+{
+    Ring *ring = GetThreadLeader(GetCurrentProcess())->ring;
+    uint32_t submitted = 0;
+    uint64_t flags = 0;
+
+    if (ring == NULL) {
+        return -EINVAL;
+    }
+
+    submitted = SubmitEntries(ring, to_submit);
+
+    if (ring->sq->flags & RING_NEED_WAKEUP) {
+        WakeUpAll(&ring->worker_wait);
+    }
+
+    /* Only the pending operations, and the entries which a polling worker
+     * will take, can still complete. A timeout may complete from the timer
+     * interrupt between the check and the sleep. */
+    flags = SaveInterrupts();
+    while (ring->cq->tail - ring->cq->head < min_complete) {
+        if (ring->pending == 0
+            && (!(ring->flags & RING_SETUP_POLL)
+                || ring->sq->head == ring->sq->tail)) {
+            break;
+        }
+
+        SleepOn(&ring->completion_wait);
+    }
+
+    RestoreInterrupts(flags);
+    return submitted;
+}
+
+void CloseRing(Process *proc)
+{
+    Ring *ring = proc->ring;
+
+    if (ring == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < RING_MAXIMUM_PENDING; i++) {
+        CancelTimer(&ring->operation[i].timer);
+    }
+
+    proc->ring = NULL;
+    FreeFrame(ring);
+}
+
+/* Private function ----------------------------------------------------------*/
+static uint32_t SubmitEntries(Ring *ring, uint32_t count)
+{
+    RingSubmissionQueue *sq = ring->sq;
+    uint32_t head = sq->head;
+    uint32_t submitted = 0;
+
+    while (submitted < count
+           && head != sq->tail
+           && GetCompletionSpace(ring) > 0) {
+        /* User space can change the entry under us, it is copied first. */
+        RingSubmission sqe = sq->entry[head % RING_SUBMISSION_ENTRIES];
+
+        sq->head = ++head;
+        RunOperation(ring, &sqe);
+        submitted++;
+    }
+
+    return submitted;
+}
+
+static void RunOperation(Ring *ring, const RingSubmission *sqe)
+{
+    RingOperation *op = NULL;
+    int32_t result = 0;
+
+    switch (sqe->opcode) {
+    case RING_OP_NOP:
+        break;
+
+    case RING_OP_READ:
+        if (sqe->fd != STANDARD_INPUT) {
+            result = Read(ring->owner,
+                          sqe->fd,
+                          (void *)sqe->addr,
+                          sqe->length);
+            break;
+        }
+
+        /* The worker completes it when a key is pressed. */
+        op = AllocOperation(ring);
+        if (op == NULL) {
+            result = -EAGAIN;
+            break;
+        }
+
+        op->opcode = RING_OP_READ;
+        op->user_data = sqe->user_data;
+        op->buffer = (char *)sqe->addr;
+        op->length = sqe->length;
+        ring->pending_reads++;
+        CompleteReads(ring);
+        WakeUpAll(&ring->worker_wait);
+        return;
+
+    case RING_OP_WRITE:
+        /* Like write(), everything goes to the console. */
+        WriteConsole((const char *)sqe->addr, sqe->length);
+        result = sqe->length;
+        break;
+
+    case RING_OP_OPEN:
+        result = Open(ring->owner, (const char *)sqe->addr);
+        break;
+
+    case RING_OP_CLOSE:
+        Close(ring->owner, sqe->fd);
+        break;
+
+    case RING_OP_TIMEOUT:
+        op = AllocOperation(ring);
+        if (op == NULL) {
+            result = -EAGAIN;
+            break;
+        }
+
+        op->opcode = RING_OP_TIMEOUT;
+        op->user_data = sqe->user_data;
+        AddTimer(&op->timer,
+                 GetClockNanoseconds() + sqe->addr,
+                 RingTimeoutExpired,
+                 op);
+        return;
+
+    default:
+        result = -EINVAL;
+        break;
+    }
+
+    PostCompletion(ring, sqe->user_data, result);
+}
+
+static void PostCompletion(Ring *ring, uint64_t user_data, int32_t result)
+{
+    /* Timeouts complete from the timer interrupt. */
+    uint64_t flags = SaveInterrupts();
+    RingCompletionQueue *cq = ring->cq;
+    RingCompletion *cqe = &cq->entry[cq->tail % RING_COMPLETION_ENTRIES];
+
+    cqe->user_data = user_data;
+    cqe->result = result;
+    cqe->flags = 0;
+
+    /* The entry is written before user space sees the new tail. */
+    __asm__ __volatile__("" : : : "memory");
+    cq->tail++;
+
+    WakeUpAll(&ring->completion_wait);
+    RestoreInterrupts(flags);
+}
+
+static void CompleteReads(Ring *ring)
+{
+    for (int i = 0; i < RING_MAXIMUM_PENDING; i++) {
+        RingOperation *op = &ring->operation[i];
+        int count = GetKeyBufferCount();
+
+        if (count == 0) {
+            return;
+        }
+
+        if (op->opcode != RING_OP_READ) {
+            continue;
+        }
+
+        /* Like a terminal, a read returns the keys which are buffered. */
+        if ((uint64_t)count > op->length) {
+            count = op->length;
+        }
+
+        for (int j = 0; j < count; j++) {
+            op->buffer[j] = ReadKeyBuffer();
+        }
+
+        ring->pending_reads--;
+        FreeOperation(op);
+        PostCompletion(ring, op->user_data, count);
+    }
+}
+
+static RingOperation *AllocOperation(Ring *ring)
+{
+    uint64_t flags = SaveInterrupts();
+    RingOperation *op = NULL;
+
+    for (int i = 0; i < RING_MAXIMUM_PENDING; i++) {
+        if (ring->operation[i].opcode == RING_OP_NOP) {
+            op = &ring->operation[i];
+            op->ring = ring;
+            ring->pending++;
+            break;
+        }
+    }
+
+    RestoreInterrupts(flags);
+    return op;
+}
+
+static void FreeOperation(RingOperation *op)
+{
+    uint64_t flags = SaveInterrupts();
+
+    op->opcode = RING_OP_NOP;
+    op->ring->pending--;
+    RestoreInterrupts(flags);
+}
+
+static void RingTimeoutExpired(void *data)
+{
+    RingOperation *op = data;
+
+    FreeOperation(op);
+    PostCompletion(op->ring, op->user_data, -ETIME);
+}
+
+static void RingWorker(void *data)
+{
+    Ring *ring = data;
+    RingSubmissionQueue *sq = ring->sq;
+    uint64_t idle_since = GetClockNanoseconds();
+
+    /* The worker is stopped with the other threads when the process exits. */
+    while (1) {
+        bool polling = ring->flags & RING_SETUP_POLL;
+        uint64_t now = 0;
+
+        if (polling && SubmitEntries(ring, RING_SUBMISSION_ENTRIES) > 0) {
+            idle_since = GetClockNanoseconds();
+        }
+
+        CompleteReads(ring);
+
+        /* A key press wakes up the worker of a pending read, a polling worker
+         * also wakes up for the next look at the submission ring. It polls as
+         * long as reads are pending, ring_enter() can't reach it on the
+         * keyboard. */
+        now = GetClockNanoseconds();
+        if (polling
+            && (ring->pending_reads > 0 || now - idle_since < RING_POLL_IDLE)) {
+            SleepOnUntil(ring->pending_reads > 0 ? GetKeyboardWaitQueue()
+                                                 : &ring->worker_wait,
+                         now + RING_POLL_INTERVAL);
+            continue;
+        }
+
+        if (ring->pending_reads > 0) {
+            SleepOn(GetKeyboardWaitQueue());
+            continue;
+        }
+
+        /* User space may fill the ring while the flag is set, it is checked
+         * again before the worker sleeps. */
+        if (polling) {
+            sq->flags |= RING_NEED_WAKEUP;
+            __asm__ __volatile__("mfence" : : : "memory");
+            if (sq->head != sq->tail) {
+                sq->flags &= ~RING_NEED_WAKEUP;
+                idle_since = now;
+                continue;
+            }
+        }
+
+        SleepOn(&ring->worker_wait);
+        sq->flags &= ~RING_NEED_WAKEUP;
+        idle_since = GetClockNanoseconds();
+    }
+}
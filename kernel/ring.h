@@ -0,0 +1,155 @@
+/**
+ * @file    ring.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Asynchronous system calls through rings shared with user space, in
+ *          the spirit of the Linux io_uring. A process maps a submission ring
+ *          and a completion ring, it queues many operations in the submission
+ *          ring and submits them with one system call, and it reads their
+ *          results in the completion ring:
+ *          + The submission ring is written by user space (the entries and the
+ *            tail) and read by the kernel, which moves the head.
+ *          + The completion ring is written by the kernel (the entries and the
+ *            tail) and read by user space, which moves the head.
+ *
+ *          Reads and writes of files, open() and close() are done when they
+ *          are submitted, the disk is read synchronously. A read of the
+ *          standard input which finds no key, and a timeout, stay pending and
+ *          complete later: the timeout from the timer interrupt, the read from
+ *          the ring worker, a kernel thread of the process which sleeps on the
+ *          keyboard. The kernel never posts more completions than the ring
+ *          holds, a submission entry is only taken if there is room for its
+ *          completion.
+ *
+ *          With RING_SETUP_POLL, the ring worker also polls the submission
+ *          ring, every RING_POLL_INTERVAL, so user space submits without any
+ *          system call. After RING_POLL_IDLE without work, it sets
+ *          RING_NEED_WAKEUP and sleeps until ring_enter() wakes it up.
+ *
+ *          Process virtual memory below the vDSO pages:
+ *           |0x1FE000          |   vDSO data
+ *           |  completion ring |   read-write
+ *           |0x1FD000          |
+ *           |  submission ring |   read-write
+ *           |0x1FC000          |
+ *
+ *          A process has one ring, it is not inherited by fork(), and the ring
+ *          worker is a thread of the process, so exec() returns -EBUSY once
+ *          the ring is set up. The layout is shared with
+ *          usr/runtime/include/ring.h.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include "process.h"
+
+/* Public define -------------------------------------------------------------*/
+#define RING_SUBMISSION_ADDRESS         0x1FC000
+#define RING_COMPLETION_ADDRESS         0x1FD000
+#define RING_SUBMISSION_ENTRIES         64
+#define RING_COMPLETION_ENTRIES         128
+
+/* ring_setup() flags. */
+#define RING_SETUP_POLL                 BIT(0)
+
+/* Flags of the submission ring. */
+#define RING_NEED_WAKEUP                BIT(0)
+
+/* Operations. */
+#define RING_OP_NOP                     0
+#define RING_OP_READ                    1
+#define RING_OP_WRITE                   2
+#define RING_OP_OPEN                    3
+#define RING_OP_CLOSE                   4
+#define RING_OP_TIMEOUT                 5
+
+/* Public type ---------------------------------------------------------------*/
+/**
+ * @brief   Submission entry.
+ *
+ * @property opcode     - RING_OP_*.
+ * @property fd         - File descriptor of a read, a write or a close.
+ * @property addr       - Buffer of a read or a write, path of an open, or the
+ *                        relative timeout in nanoseconds.
+ * @property length     - Bytes to read or to write.
+ * @property user_data  - Copied to the completion entry.
+ */
+typedef struct {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t reserved;
+    int32_t fd;
+    uint64_t addr;
+    uint64_t length;
+    uint64_t user_data;
+} RingSubmission;
+
+/**
+ * @brief   Completion entry.
+ *
+ * @property user_data  - Of the submission entry.
+ * @property result     - Result of the system call, or -errno. A timeout
+ *                        completes with -ETIME.
+ */
+typedef struct {
+    uint64_t user_data;
+    int32_t result;
+    uint32_t flags;
+} RingCompletion;
+
+/**
+ * @brief   Submission ring, one frame. The indexes are free running, the
+ *          entry of index `i` is entry[i % RING_SUBMISSION_ENTRIES].
+ */
+typedef struct {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t flags;
+    uint32_t reserved;
+    RingSubmission entry[RING_SUBMISSION_ENTRIES];
+} RingSubmissionQueue;
+
+/**
+ * @brief   Completion ring, one frame.
+ */
+typedef struct {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t reserved[2];
+    RingCompletion entry[RING_COMPLETION_ENTRIES];
+} RingCompletionQueue;
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Map the rings to the current process and start its ring worker.
+ *
+ * @param   flags   - RING_SETUP_POLL to let the kernel poll the submission
+ *                    ring.
+ * @return  0       - Success.
+ *          -EBUSY  - The process already has a ring.
+ *          -EINVAL - Unknown flags.
+ *          -ENOMEM - Out of memory, or of processes.
+ */
+int SetupRing(uint32_t flags);
+
+/**
+ * @brief   Submit up to `to_submit` entries of the submission ring, then wait
+ *          until the completion ring holds at least `min_complete` entries,
+ *          or until nothing is pending anymore. It also wakes up a polling
+ *          ring worker which sleeps.
+ *
+ * @return  Number of submitted entries, or -EINVAL if the process has no
+ *          ring.
+ */
+int EnterRing(uint32_t to_submit, uint32_t min_complete);
+
+/**
+ * @brief   Cancel the pending operations of an exiting process and release
+ *          its ring. Its ring worker is already stopped with its other
+ *          threads, the ring frames go with its page map.
+ */
+void CloseRing(Process *proc);
@@ -0,0 +1,138 @@
+#include <errno.h>
+#include <string.h>
+
+#include "runtime.h"
+#include "file.h"
+#include "memory.h"
+#include "printk.h"
+#include "assert.h"
+
+/* Private variable ----------------------------------------------------------*/
+/* The runtime image, loaded once and shared by every process. */
+static RuntimeImageHeader *s_runtime_image = NULL;
+
+/* Private function prototypes -----------------------------------------------*/
+/**
+ * @brief   Read the runtime image to a new page and validate its header.
+ */
+static int LoadRuntimeImage(Process *proc);
+
+/* Public function -----------------------------------------------------------*/
+bool IsRuntimeProgram(void)
+{
+    RuntimeProgramHeader *header =
+        (RuntimeProgramHeader *)USER_VIRTUAL_ADDRESS_BASE;
+
+    return header->magic == RUNTIME_PROGRAM_MAGIC;
+}
+
+int BindRuntime(Process *proc)
+{
+    RuntimeProgramHeader *header =
+        (RuntimeProgramHeader *)USER_VIRTUAL_ADDRESS_BASE;
+    int status = MapRuntime(proc, header->build_id);
+
+    if (status < 0) {
+        return status;
+    }
+
+    /* The page was cleared by exec(), so the runtime bss is already zero. */
+    memcpy((void *)USER_RUNTIME_DATA_BASE,
+           (char *)s_runtime_image + s_runtime_image->data_offset,
+           s_runtime_image->data_size);
+
+    return 0;
+}
+
+bool InheritRuntime(uint64_t new_map, uint64_t map)
+{
+    uint64_t page = GetUVMPage(map, USER_RUNTIME_TEXT_BASE);
+
+    if (page == 0) {
+        return true;
+    }
+
+    return MapSharedUVM(new_map, USER_RUNTIME_TEXT_BASE, page);
+}
+
+int MapRuntime(Process *proc, uint32_t build_id)
+{
+    int status = 0;
+
+    if (s_runtime_image == NULL) {
+        status = LoadRuntimeImage(proc);
+        if (status < 0) {
+            return status;
+        }
+    }
+
+    /* The program calls the runtime at the addresses it was prelinked with,
+     * they are only valid for the same runtime build. */
+    if (build_id != s_runtime_image->build_id) {
+        printk("DEBUG: Program is linked with runtime %#x, loaded is %#x.\n",
+               build_id,
+               s_runtime_image->build_id);
+        return -ENOEXEC;
+    }
+
+    if (!MapSharedUVM(proc->page_map,
+                      USER_RUNTIME_TEXT_BASE,
+                      (uint64_t)s_runtime_image)) {
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+uint32_t GetRuntimeBuild(uint64_t map)
+{
+    if (GetUVMPage(map, USER_RUNTIME_TEXT_BASE) == 0) {
+        return 0;
+    }
+
+    return s_runtime_image->build_id;
+}
+
+/* Private function ----------------------------------------------------------*/
+static int LoadRuntimeImage(Process *proc)
+{
+    RuntimeImageHeader *image = NULL;
+    int fd = 0;
+    int size = 0;
+
+    fd = Open(proc, USER_RUNTIME_IMAGE_FILE);
+    if (fd < 0) {
+        printk("DEBUG: Cannot open %s.\n", USER_RUNTIME_IMAGE_FILE);
+        return -ENOENT;
+    }
+
+    /* The whole image is read in one page. */
+    if (GetFileSize(proc, fd) > PAGE_SIZE) {
+        printk("DEBUG: %s is too large.\n", USER_RUNTIME_IMAGE_FILE);
+        Close(proc, fd);
+        return -ENOEXEC;
+    }
+
+    image = kalloc();
+    if (image == NULL) {
+        Close(proc, fd);
+        return -ENOMEM;
+    }
+
+    memset(image, 0, PAGE_SIZE);
+    size = Read(proc, fd, image, GetFileSize(proc, fd));
+    Close(proc, fd);
+
+    if (size < (int)sizeof(RuntimeImageHeader)
+        || image->magic != RUNTIME_IMAGE_MAGIC
+        || image->data_offset + image->data_size > (uint64_t)size
+        || image->data_size > USER_RUNTIME_DATA_SIZE) {
+        printk("DEBUG: Invalid runtime image.\n");
+        kfree((uint64_t)image);
+        return -ENOEXEC;
+    }
+
+    s_runtime_image = image;
+
+    return 0;
+}
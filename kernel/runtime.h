@@ -0,0 +1,129 @@
+/**
+ * @file    runtime.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Shared user runtime. The user runtime (libc, system call wrappers,
+ *          printf, iostream, etc.) is built once as a separate image, and the
+ *          programs are prelinked against it instead of carrying their own
+ *          copy of runtime.a.
+ *
+ *          The image is read from the disk by the first exec() which needs it
+ *          and stays in memory. Its text and read-only data are mapped at the
+ *          same address in every process that uses it, and they refer to the
+ *          same physical page. The writable data can't be shared, so exec()
+ *          copies its initial values to a private region at the top of the
+ *          process page, the user stack starts right below it.
+ *
+ *          Process virtual memory with the shared runtime:
+ *           |0x600000          |
+ *           |  runtime data    |   private, initialized from the image
+ *           |0x5F0000          |
+ *           |  user stack      |
+ *           |      ...         |
+ *           |  user program    |   private
+ *           |0x400000          |
+ *           |  runtime text    |   read-only, same physical page in every
+ *           |0x200000          |   process
+ *
+ *          The program addresses runtime symbols directly, so a call costs
+ *          the same as with the static runtime. Both the image and every
+ *          program carry the build identifier of the runtime, exec() refuses
+ *          a program which was prelinked against another runtime build.
+ *
+ *          Programs linked statically (like the shell) don't have a program
+ *          header and are loaded as before.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include "process.h"
+
+/* Public define -------------------------------------------------------------*/
+#define USER_RUNTIME_TEXT_BASE      0x200000
+#define USER_RUNTIME_DATA_SIZE      0x10000                     /* 64KB.    */
+#define USER_RUNTIME_DATA_BASE      (USER_STACK_START - USER_RUNTIME_DATA_SIZE)
+#define USER_RUNTIME_IMAGE_FILE     "runtime.bin"
+
+#define RUNTIME_IMAGE_MAGIC         0x4D495452      /* "RTIM" */
+#define RUNTIME_PROGRAM_MAGIC       0x4E425452      /* "RTBN" */
+
+/* Public type ---------------------------------------------------------------*/
+/**
+ * @brief   Header at the beginning of the runtime image.
+ *
+ * @property magic          - RUNTIME_IMAGE_MAGIC.
+ * @property build_id       - Identifier of this runtime build.
+ * @property data_offset    - Offset of the initial data values in the image.
+ * @property data_size      - Size of the initial data values.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t build_id;
+    uint64_t data_offset;
+    uint64_t data_size;
+} __attribute__((packed)) RuntimeImageHeader;
+
+/**
+ * @brief   Header at the beginning of programs linked with the shared runtime.
+ *          It starts with a jump over the header, so the entry point stays at
+ *          USER_VIRTUAL_ADDRESS_BASE.
+ *
+ * @property jump           - Jump to the start code.
+ * @property magic          - RUNTIME_PROGRAM_MAGIC.
+ * @property build_id       - Build identifier of the runtime the program was
+ *                            prelinked against.
+ */
+typedef struct {
+    uint8_t jump[8];
+    uint32_t magic;
+    uint32_t build_id;
+} __attribute__((packed)) RuntimeProgramHeader;
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Check if the program loaded at USER_VIRTUAL_ADDRESS_BASE of the
+ *          current virtual memory needs the shared runtime.
+ */
+bool IsRuntimeProgram(void);
+
+/**
+ * @brief   Bind the program loaded at USER_VIRTUAL_ADDRESS_BASE of the current
+ *          virtual memory to the shared runtime: map the runtime text, and
+ *          initialize the runtime data. The runtime image is loaded at the
+ *          first call.
+ *
+ * @param   proc    - Current process, which is running exec().
+ * @return  0       - Success.
+ *          -ENOENT - The runtime image doesn't exist.
+ *          -ENOEXEC- The image is invalid, or the program is prelinked against
+ *                    another runtime build.
+ *          -ENOMEM - Out of memory.
+ */
+int BindRuntime(Process *proc);
+
+/**
+ * @brief   Map the shared runtime to the `new_map` virtual memory if `map`
+ *          uses it. It is used by fork(), the private runtime data is copied
+ *          with the process page.
+ */
+bool InheritRuntime(uint64_t new_map, uint64_t map);
+
+/**
+ * @brief   Map the shared runtime text to the virtual memory of `proc`, which
+ *          may not be the current one, without initializing the runtime data.
+ *          The runtime image is loaded at the first call.
+ *
+ * @param   build_id    - Runtime build which the program needs.
+ * @return  0, or -ENOENT, -ENOEXEC, -ENOMEM like BindRuntime().
+ */
+int MapRuntime(Process *proc, uint32_t build_id);
+
+/**
+ * @brief   Build identifier of the runtime mapped to `map`, or 0 if `map`
+ *          doesn't use the shared runtime.
+ */
+uint32_t GetRuntimeBuild(uint64_t map);
@@ -0,0 +1,197 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "smp.h"
+#include "spinlock.h"
+#include "acpi.h"
+#include "apic.h"
+#include "cpu.h"
+#include "memory.h"
+#include "kstack.h"
+#include "process.h"
+#include "timer.h"
+#include "vdso.h"
+#include "printk.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SECONDARY_CPU_START_TIMEOUT_US  100000
+#define SECONDARY_CPU_POLL_US           100
+
+/* Private type --------------------------------------------------------------*/
+/**
+ * @brief   Parameters of the trampoline, right after its first jump.
+ *
+ * @property jump       - Short jump over the parameters.
+ * @property page_map   - Physical address of the page tables to enable.
+ * @property stack      - Stack of the idle process of the CPU.
+ * @property cpu        - Per-CPU data, the argument of the entry.
+ * @property entry      - Function which never returns.
+ */
+typedef struct {
+    uint64_t jump;
+    uint64_t page_map;
+    uint64_t stack;
+    uint64_t cpu;
+    uint64_t entry;
+} TrampolineParameters;
+
+/* Private variable ----------------------------------------------------------*/
+/* Extern from ASM. */
+extern uint8_t TrampolineStart[];
+extern uint8_t TrampolineEnd[];
+
+static Spinlock s_kernel_lock = SPINLOCK_INITIALIZER;
+static volatile int s_kernel_lock_owner = -1;
+
+/* Private function prototypes -----------------------------------------------*/
+/**
+ * @brief   Start one CPU and wait until it runs the kernel.
+ */
+static void StartSecondaryCPU(uint8_t apic_id);
+
+/**
+ * @brief   First C function of a secondary CPU, it runs on the stack of its
+ *          idle process and ends in the idle loop.
+ */
+static void SecondaryMain(CPU *cpu);
+
+/**
+ * @brief   Idle loop, extern from ASM.
+ */
+void KernelEnd(void) __attribute__((noreturn));
+
+/* Public function -----------------------------------------------------------*/
+void StartSecondaryCPUs(void)
+{
+    const MADTInfo *madt = GetMADTInfo();
+
+    if (madt->cpu_count < 2) {
+        return;
+    }
+
+    memcpy((void *)PHY_TO_VIR(SMP_TRAMPOLINE_ADDRESS),
+           TrampolineStart,
+           TrampolineEnd - TrampolineStart);
+
+    for (int i = 0; i < madt->cpu_count; i++) {
+        if (madt->cpu_apic_ids[i] != GetCPU()->apic_id) {
+            StartSecondaryCPU(madt->cpu_apic_ids[i]);
+        }
+    }
+
+    printk("SMP: %d CPUs online.\n", GetCPUCount());
+}
+
+void LockKernel(void)
+{
+    int id = GetCPU()->id;
+
+    if (s_kernel_lock_owner == id) {
+        return;
+    }
+
+    AcquireSpinlock(&s_kernel_lock);
+    s_kernel_lock_owner = id;
+}
+
+void UnlockKernel(void)
+{
+    s_kernel_lock_owner = -1;
+    ReleaseSpinlock(&s_kernel_lock);
+}
+
+void EnterKernel(void)
+{
+    LockKernel();
+
+    /* The process may have been stopped while the CPU ran it in ring 3. */
+    ScheduleIfStopped();
+}
+
+void LeaveKernel(TrapFrame *tf)
+{
+    /* The timer is programmed for what the CPU runs now, a system call which
+     * was interrupted also ticks while it shares the CPU. */
+    ProgramTimerEvent(NeedsSchedulerTick());
+
+    /* The idle process returns to its loop in ring 0, it doesn't run kernel
+     * code there. A process which returns to ring 3 is charged the time of
+     * the trap as system time. */
+    if ((tf->cs & 3) == 3) {
+        AccountCPUTime(false);
+        UnlockKernel();
+    } else if (GetCurrentProcess()->pid == IDLE_PROCESS_PID) {
+        UnlockKernel();
+    }
+}
+
+void SendReschedule(int cpu)
+{
+    SendIPI(GetCPUById(cpu)->apic_id, RESCHEDULE_VECTOR);
+}
+
+void StartIdleLoop(void)
+{
+    /* Nothing ticks yet, the CPU would halt with processes ready. */
+    Yield();
+
+    ProgramTimerEvent(NeedsSchedulerTick());
+    UnlockKernel();
+    KernelEnd();
+}
+
+/* Private function ----------------------------------------------------------*/
+static void StartSecondaryCPU(uint8_t apic_id)
+{
+    TrampolineParameters *params =
+        (TrampolineParameters *)PHY_TO_VIR(SMP_TRAMPOLINE_ADDRESS);
+    CPU *cpu = AddCPU(apic_id);
+    uint64_t stack = 0;
+
+    if (cpu == NULL) {
+        printk("SMP: CPU with APIC ID %d is skipped.\n", apic_id);
+        return;
+    }
+
+    stack = (uint64_t)AllocKernelStack();
+    if (stack == 0) {
+        printk("SMP: No stack for CPU %d.\n", cpu->id);
+        return;
+    }
+
+    InitIdleProcess(cpu->id, stack);
+
+    params->page_map = SMP_BOOT_PAGE_MAP;
+    params->stack = stack + KERNEL_STACK_SIZE;
+    params->cpu = (uint64_t)cpu;
+    params->entry = (uint64_t)SecondaryMain;
+
+    StartCPU(apic_id, SMP_TRAMPOLINE_ADDRESS);
+
+    for (int us = 0; us < SECONDARY_CPU_START_TIMEOUT_US && !cpu->started;
+         us += SECONDARY_CPU_POLL_US) {
+        DelayMicroseconds(SECONDARY_CPU_POLL_US);
+    }
+
+    if (!cpu->started) {
+        printk("SMP: CPU %d doesn't respond.\n", cpu->id);
+    }
+}
+
+static void SecondaryMain(CPU *cpu)
+{
+    /* The boot CPU waits for this flag, it can reuse the trampoline after. */
+    cpu->started = true;
+
+    InitSecondaryMemory();
+    InitSecondaryCPU(cpu);
+    InitSecondaryIDT();
+    InitSecondaryLocalAPIC();
+
+    LockKernel();
+    cpu->online = true;
+    GetVDSOData()->cpu_count++;
+    printk("CPU %d (APIC ID %d) is online.\n", cpu->id, cpu->apic_id);
+
+    StartIdleLoop();
+}
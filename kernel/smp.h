@@ -0,0 +1,82 @@
+/**
+ * @file    smp.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Symmetric multiprocessing. The boot CPU starts the other CPUs
+ *          listed in the MADT, each one gets its own GDT, TSS, idle process
+ *          and run queue, and runs user processes like the boot CPU.
+ *
+ *          The kernel was written for one CPU, with the interrupts disabled
+ *          as its only lock. It keeps that model with one big kernel lock
+ *          (the interrupts are only enabled in system calls, which can't be
+ *          preempted outside of the parts which allow it, see process.h):
+ *          a CPU takes the lock when it enters the kernel (any interrupt,
+ *          exception or system call) and releases it when it returns to ring
+ *          3, or when it goes back to its idle loop. So the kernel code still
+ *          runs on one CPU at a time, while user code runs on all of them.
+ *          A process which switches to another one inside the kernel hands
+ *          the lock over with the switch. The few paths which are used
+ *          outside of the lock at boot (the frame allocator, the file
+ *          tables) have their own spinlocks.
+ *
+ *          A secondary CPU starts in real mode at the trampoline, which is
+ *          copied to SMP_TRAMPOLINE_ADDRESS. It enables long mode with the
+ *          page tables of the loader, which still map the kernel, and jumps
+ *          to SecondaryMain() on the stack of its idle process.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include "trap.h"
+
+/* Public define -------------------------------------------------------------*/
+/* The loader is not used anymore, the trampoline takes its place. */
+#define SMP_TRAMPOLINE_ADDRESS          0x8000
+/* Page tables of the loader, they map the first 1GB twice. */
+#define SMP_BOOT_PAGE_MAP               0x70000
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Start every CPU of the MADT but the boot CPU. It waits for each CPU
+ *          to run the kernel before the next one is started.
+ */
+void StartSecondaryCPUs(void);
+
+/**
+ * @brief   Take the big kernel lock. The owner can take it again, the lock
+ *          is not counted, it is released once.
+ */
+void LockKernel(void);
+
+/**
+ * @brief   Release the big kernel lock.
+ */
+void UnlockKernel(void);
+
+/**
+ * @brief   Called by every interrupt, exception and system call before it is
+ *          handled.
+ */
+void EnterKernel(void);
+
+/**
+ * @brief   Called by TrapReturn with the trap frame it is going to restore,
+ *          it releases the lock if the CPU leaves the kernel.
+ */
+void LeaveKernel(TrapFrame *tf);
+
+/**
+ * @brief   Interrupt another CPU, so it looks at its run queue.
+ */
+void SendReschedule(int cpu);
+
+/**
+ * @brief   End of the initialization of a CPU, in its idle process: run the
+ *          ready processes, then leave the kernel to the idle loop. It never
+ *          returns.
+ */
+void StartIdleLoop(void);
@@ -0,0 +1,78 @@
+/**
+ * @file    spinlock.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Spinlocks for the data which every CPU can touch. A lock is only
+ *          held for a few instructions, and a CPU which waits for it spins
+ *          with `pause`, which tells the CPU that it is a spin loop.
+ *
+ *          System calls run with the interrupts enabled, so the data which
+ *          interrupt handlers also touch (the run queues and wait queues, the
+ *          timers, the file tables) is changed in IRQ-safe critical
+ *          sections: SaveInterrupts() disables the interrupts of the CPU and
+ *          RestoreInterrupts() enables them again only if they were, so the
+ *          sections nest, and a handler never finds the data half changed
+ *          or a lock taken by the code it interrupted.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+
+/* Public define -------------------------------------------------------------*/
+#define SPINLOCK_INITIALIZER            { .locked = 0 }
+/* IF of RFLAGS. */
+#define INTERRUPT_FLAG                  (1ULL << 9)
+
+/* Public type ---------------------------------------------------------------*/
+typedef struct {
+    volatile uint32_t locked;
+} Spinlock;
+
+/* Public function prototype -------------------------------------------------*/
+static inline void AcquireSpinlock(Spinlock *lock)
+{
+    while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE) != 0) {
+        /* Wait on a plain read, so the cache line isn't pulled back and forth
+         * between the waiting CPUs. */
+        while (lock->locked != 0) {
+            __builtin_ia32_pause();
+        }
+    }
+}
+
+static inline void ReleaseSpinlock(Spinlock *lock)
+{
+    __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+void EnableInterrupts(void);
+void DisableInterrupts(void);
+
+/**
+ * @brief   Disable the interrupts, and return RFLAGS as it was before. It is
+ *          in trap.asm, like the other instructions which C can't reach.
+ */
+uint64_t SaveInterrupts(void);
+
+/**
+ * @brief   Enable the interrupts if they were enabled in `flags`.
+ */
+void RestoreInterrupts(uint64_t flags);
+
+static inline uint64_t AcquireSpinlockIRQ(Spinlock *lock)
+{
+    uint64_t flags = SaveInterrupts();
+
+    AcquireSpinlock(lock);
+    return flags;
+}
+
+static inline void ReleaseSpinlockIRQ(Spinlock *lock, uint64_t flags)
+{
+    ReleaseSpinlock(lock);
+    RestoreInterrupts(flags);
+}
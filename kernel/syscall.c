@@ -7,11 +7,18 @@
 #include "keyboard.h"
 #include "syscall.h"
 #include "memory.h"
+#include "timer.h"
+#include "vdso.h"
+#include "ring.h"
+#include "template.h"
+#include "checkpoint.h"
+#include "spinlock.h"
 #include "assert.h"
 #include "printk.h"
 
 /* Private define ------------------------------------------------------------*/
-#define MAXIMUM_SYSTEM_CALLS 20
+#define MAXIMUM_SYSTEM_CALLS 40
+#define MAXIMUM_SYSTEM_CALL_ARGUMENTS 6
 
 /* Private variable ----------------------------------------------------------*/
 static SYSTEM_CALL s_syscall_table[MAXIMUM_SYSTEM_CALLS] = {0};
@@ -26,8 +33,31 @@ static int SysOpen(int64_t *arg);
 static int SysClose(int64_t *arg);
 static int SysFork(int64_t *arg);
 static int SysExec(int64_t *arg);
+static int SysSpawn(int64_t *arg);
+static int SysGetRusage(int64_t *arg);
+static int SysGetProcs(int64_t *arg);
+static int SysTemplateCreate(int64_t *arg);
+static int SysTemplateDrop(int64_t *arg);
+static int SysTemplateReady(int64_t *arg);
+static int SysCheckpoint(int64_t *arg);
+static int SysRestore(int64_t *arg);
 static int SysLstat(int64_t *arg);
 static int SysClrSrc(int64_t *arg);
+static int SysPoll(int64_t *arg);
+static int SysUptime(int64_t *arg);
+static int SysNice(int64_t *arg);
+static int SysSchedDeadline(int64_t *arg);
+static int SysSchedYield(int64_t *arg);
+static int SysSchedMisses(int64_t *arg);
+static int SysNanosleep(int64_t *arg);
+static int SysThreadCreate(int64_t *arg);
+static int SysThreadExit(int64_t *arg);
+static int SysThreadJoin(int64_t *arg);
+static int SysArchPrctl(int64_t *arg);
+static int SysClockGettime(int64_t *arg);
+static int SysGetPid(int64_t *arg);
+static int SysRingSetup(int64_t *arg);
+static int SysRingEnter(int64_t *arg);
 
 static int SysMemInfo(int64_t *arg);
 
@@ -48,6 +78,29 @@ void InitSystemCall(void)
     RegisterSystemCall(9, SysExec);
     RegisterSystemCall(10, SysLstat);
     RegisterSystemCall(11, SysClrSrc);
+    RegisterSystemCall(12, SysPoll);
+    RegisterSystemCall(13, SysUptime);
+    RegisterSystemCall(14, SysNice);
+    RegisterSystemCall(15, SysSchedDeadline);
+    RegisterSystemCall(16, SysSchedYield);
+    RegisterSystemCall(17, SysSchedMisses);
+    RegisterSystemCall(18, SysNanosleep);
+    RegisterSystemCall(19, SysThreadCreate);
+    RegisterSystemCall(20, SysThreadExit);
+    RegisterSystemCall(21, SysThreadJoin);
+    RegisterSystemCall(22, SysArchPrctl);
+    RegisterSystemCall(23, SysClockGettime);
+    RegisterSystemCall(24, SysGetPid);
+    RegisterSystemCall(25, SysRingSetup);
+    RegisterSystemCall(26, SysRingEnter);
+    RegisterSystemCall(27, SysSpawn);
+    RegisterSystemCall(28, SysGetRusage);
+    RegisterSystemCall(29, SysGetProcs);
+    RegisterSystemCall(30, SysTemplateCreate);
+    RegisterSystemCall(31, SysTemplateDrop);
+    RegisterSystemCall(32, SysTemplateReady);
+    RegisterSystemCall(33, SysCheckpoint);
+    RegisterSystemCall(34, SysRestore);
 
 }
 
@@ -60,14 +113,40 @@ void SystemCall(TrapFrame *tf)
     int64_t syscall_number = tf->rax;
     int64_t param_count = tf->rdi;
     int64_t *arg = (int64_t *)tf->rsi;
+    int64_t registers[MAXIMUM_SYSTEM_CALL_ARGUMENTS];
+
+    GetVDSOData()->system_calls++;
+    GetCurrentProcess()->usage.system_calls++;
+
+    /* SYSCALL passes the arguments in registers, like Linux does. They are
+     * copied to an array, so the handlers don't tell the two entries apart. */
+    if (tf->trapno == SYSTEM_CALL_INSTRUCTION_TRAP) {
+        registers[0] = tf->rdi;
+        registers[1] = tf->rsi;
+        registers[2] = tf->rdx;
+        registers[3] = tf->r10;
+        registers[4] = tf->r8;
+        registers[5] = tf->r9;
+        param_count = MAXIMUM_SYSTEM_CALL_ARGUMENTS;
+        arg = registers;
+    }
 
     if (param_count < 0
-        || syscall_number > MAXIMUM_SYSTEM_CALLS) {
+        || syscall_number < 0
+        || syscall_number >= MAXIMUM_SYSTEM_CALLS
+        || s_syscall_table[syscall_number] == NULL) {
         tf->rax = -EINVAL;
         return;
     }
-    ASSERT(s_syscall_table[syscall_number] != NULL);
+
+    /* Both entries come in with the interrupts disabled. The handler runs
+     * with them enabled, but it is only preempted where it allows it, the
+     * rest waits for the end of the call. */
+    DisablePreemption();
+    EnableInterrupts();
     tf->rax = s_syscall_table[syscall_number](arg);
+    EnablePreemption();
+    DisableInterrupts();
 }
 
 /* Private function ----------------------------------------------------------*/
@@ -84,26 +163,22 @@ static int SysWrite(int64_t *arg)
     int16_t file_descriptor = arg[0];
     char *buffer = (char *)arg[1];
     int32_t length = arg[2];
-    printk(buffer);
+    WriteConsole(buffer, length);
     return length;
 }
 
 static int SysSleep(int64_t *arg)
 {
-    uint64_t old_ticks = 0;
-    uint64_t ticks = 0;
     uint64_t sleep_ticks = arg[0];
+    uint64_t expiry = GetClockNanoseconds()
+                      + sleep_ticks * MILLISECONDS_PER_TICK
+                        * NANOSECONDS_PER_MILLISECOND;
 
-    /* Get current ticks. */
-    ticks = GetTicks();
-    old_ticks = ticks;
-
-    /* Block current process here until wakeup time is retrieved. */
-    while (ticks - old_ticks < sleep_ticks) {
-        Sleep(NORMAL_PROCESS_WAIT_ID);
-        /* After wakeup from sleep, we get ticks again, and check process is
-         * ready to run or not. If the time is not achieved, we sleep again. */
-        ticks = GetTicks();
+    /* Block current process here until its timer expires, it is in no wait
+     * queue so nothing else wakes it up, but we check the clock again in case
+     * it is woken up early. */
+    while (GetClockNanoseconds() < expiry) {
+        SleepOnUntil(NULL, expiry);
     }
 
     return 0;
@@ -111,15 +186,21 @@ static int SysSleep(int64_t *arg)
 
 static int SysExit(int64_t *arg)
 {
-    Exit();
+    Exit((int)arg[0]);
     return 0;
 }
 
 static int SysWait(int64_t *arg)
 {
     int pid = arg[0];
-    Wait(pid);
-    return 0;
+    int *status = (int *)arg[1];
+    int options = arg[2];
+
+    if (pid != -1 && pid <= 0) {
+        return -EINVAL;
+    }
+
+    return Wait(pid, status, options);
 }
 
 static int SysRead(int64_t *arg)
@@ -138,7 +219,7 @@ static int SysRead(int64_t *arg)
     }
 
     /* Read file. */
-    return Read(GetScheduler()->current_proc, file_descriptor, buffer, length);
+    return Read(GetCurrentProcess(), file_descriptor, buffer, length);
 }
 
 static int SysMemInfo(int64_t *arg)
@@ -149,13 +230,13 @@ static int SysMemInfo(int64_t *arg)
 static int SysOpen(int64_t *arg)
 {
     char *file_name = arg[0];
-    return Open(GetScheduler()->current_proc, file_name);
+    return Open(GetCurrentProcess(), file_name);
 }
 
 static int SysClose(int64_t *arg)
 {
     int16_t file_descriptor = arg[0];
-    Close(GetScheduler()->current_proc, file_descriptor);
+    Close(GetCurrentProcess(), file_descriptor);
     return 0;
 }
 
@@ -167,7 +248,85 @@ static int SysFork(int64_t *arg)
 static int SysExec(int64_t *arg)
 {
     char *file_name = arg[0];
-    return Exec(GetScheduler()->current_proc, file_name);
+    return Exec(GetCurrentProcess(), file_name);
+}
+
+static int SysSpawn(int64_t *arg)
+{
+    const char *path = (const char *)arg[0];
+    char *const *argv = (char *const *)arg[1];
+    const SpawnFileAction *actions = (const SpawnFileAction *)arg[2];
+
+    return Spawn(path, argv, actions);
+}
+
+static int SysGetRusage(int64_t *arg)
+{
+    int who = arg[0];
+    ResourceUsage *usage = (ResourceUsage *)arg[1];
+
+    if (usage == NULL) {
+        return -EINVAL;
+    }
+
+    return GetResourceUsage(who, usage);
+}
+
+static int SysGetProcs(int64_t *arg)
+{
+    ProcessInfo *list = (ProcessInfo *)arg[0];
+    int count = arg[1];
+
+    if (count < 0 || (count > 0 && list == NULL)) {
+        return -EINVAL;
+    }
+
+    return GetProcessList(list, count);
+}
+
+static int SysTemplateCreate(int64_t *arg)
+{
+    const char *path = (const char *)arg[0];
+
+    if (path == NULL) {
+        return -EINVAL;
+    }
+
+    return CreateTemplate(path);
+}
+
+static int SysTemplateDrop(int64_t *arg)
+{
+    /* A null path drops every template. */
+    return DropTemplate((const char *)arg[0]);
+}
+
+static int SysTemplateReady(int64_t *arg)
+{
+    return CaptureTemplate();
+}
+
+static int SysCheckpoint(int64_t *arg)
+{
+    int pid = arg[0];
+    const char *path = (const char *)arg[1];
+
+    if (pid < 0 || path == NULL) {
+        return -EINVAL;
+    }
+
+    return Checkpoint(pid, path);
+}
+
+static int SysRestore(int64_t *arg)
+{
+    const char *path = (const char *)arg[0];
+
+    if (path == NULL) {
+        return -EINVAL;
+    }
+
+    return Restore(path);
 }
 
 static int SysLstat(int64_t *arg)
@@ -182,3 +341,180 @@ static int SysClrSrc(int64_t *arg)
     ClrSrc();
     return 0;
 }
+
+static int SysPoll(int64_t *arg)
+{
+    PollFD *fds = (PollFD *)arg[0];
+    int nfds = arg[1];
+    int timeout = arg[2];
+    Process *proc = GetCurrentProcess();
+    uint64_t expiry = 0;
+    uint64_t flags = 0;
+    int ready = 0;
+
+    if (nfds < 0 || (nfds > 0 && fds == NULL)) {
+        return -EINVAL;
+    }
+
+    if (timeout > 0) {
+        expiry = GetClockNanoseconds()
+                 + (uint64_t)timeout * NANOSECONDS_PER_MILLISECOND;
+    }
+
+    /* A key pressed between the check and the sleep would be missed. */
+    flags = SaveInterrupts();
+    while (1) {
+        ready = PollFiles(proc, fds, nfds);
+        if (ready != 0 || timeout == 0) {
+            break;
+        }
+
+        /* Only a key press can make a descriptor ready, so we sleep until the
+         * keyboard or the timeout wakes us up. */
+        if (timeout < 0) {
+            SleepOn(GetKeyboardWaitQueue());
+        } else if (GetClockNanoseconds() >= expiry) {
+            break;
+        } else {
+            SleepOnUntil(GetKeyboardWaitQueue(), expiry);
+        }
+    }
+
+    RestoreInterrupts(flags);
+    return ready;
+}
+
+static int SysUptime(int64_t *arg)
+{
+    /* Milliseconds since boot. */
+    return (int)(GetClockNanoseconds() / NANOSECONDS_PER_MILLISECOND);
+}
+
+static int SysNice(int64_t *arg)
+{
+    int increment = arg[0];
+    return Nice(increment);
+}
+
+static int SysSchedDeadline(int64_t *arg)
+{
+    uint32_t runtime = arg[0];
+    uint32_t period = arg[1];
+    uint32_t deadline = arg[2];
+    return SetDeadline(runtime, period, deadline);
+}
+
+static int SysSchedYield(int64_t *arg)
+{
+    DeadlineYield();
+    return 0;
+}
+
+static int SysSchedMisses(int64_t *arg)
+{
+    return GetDeadlineMisses();
+}
+
+static int SysNanosleep(int64_t *arg)
+{
+    const TimeSpec *request = (const TimeSpec *)arg[0];
+    TimeSpec *remain = (TimeSpec *)arg[1];
+    uint64_t expiry = 0;
+
+    if (request == NULL
+        || request->tv_sec < 0
+        || request->tv_nsec < 0
+        || request->tv_nsec >= (int64_t)NANOSECONDS_PER_SECOND) {
+        return -EINVAL;
+    }
+
+    expiry = GetClockNanoseconds()
+             + request->tv_sec * NANOSECONDS_PER_SECOND
+             + request->tv_nsec;
+
+    while (GetClockNanoseconds() < expiry) {
+        SleepOnUntil(NULL, expiry);
+    }
+
+    /* Nothing interrupts the sleep, the whole interval has elapsed. */
+    if (remain != NULL) {
+        remain->tv_sec = 0;
+        remain->tv_nsec = 0;
+    }
+
+    return 0;
+}
+
+static int SysThreadCreate(int64_t *arg)
+{
+    uint64_t entry = arg[0];
+    uint64_t stack = arg[1];
+    uint64_t thread_arg = arg[2];
+    return CreateThread(entry, stack, thread_arg);
+}
+
+static int SysThreadExit(int64_t *arg)
+{
+    ExitThread((int)arg[0]);
+    return 0;
+}
+
+static int SysThreadJoin(int64_t *arg)
+{
+    int tid = arg[0];
+    int *status = (int *)arg[1];
+    return JoinThread(tid, status);
+}
+
+static int SysArchPrctl(int64_t *arg)
+{
+    int code = arg[0];
+    uint64_t addr = arg[1];
+    return ArchPrctl(code, addr);
+}
+
+static int SysClockGettime(int64_t *arg)
+{
+    int clock = arg[0];
+    TimeSpec *time = (TimeSpec *)arg[1];
+    uint64_t ns = 0;
+
+    /* The runtime reads the clocks from the vDSO data page, this is the slow
+     * path for the programs which don't. */
+    if (clock == CLOCK_MONOTONIC) {
+        ns = GetClockNanoseconds();
+    } else if (clock == CLOCK_REALTIME) {
+        ns = GetRealTimeNanoseconds();
+    } else {
+        return -EINVAL;
+    }
+
+    if (time == NULL) {
+        return -EINVAL;
+    }
+
+    time->tv_sec = ns / NANOSECONDS_PER_SECOND;
+    time->tv_nsec = ns % NANOSECONDS_PER_SECOND;
+
+    return 0;
+}
+
+static int SysGetPid(int64_t *arg)
+{
+    /* The runtime reads it from the vDSO, the system call does nothing else,
+     * it measures the cost of entering the kernel. */
+    return GetThreadLeader(GetCurrentProcess())->pid;
+}
+
+static int SysRingSetup(int64_t *arg)
+{
+    uint32_t flags = arg[0];
+    return SetupRing(flags);
+}
+
+static int SysRingEnter(int64_t *arg)
+{
+    uint32_t to_submit = arg[0];
+    uint32_t min_complete = arg[1];
+    return EnterRing(to_submit, min_complete);
+}
@@ -85,6 +85,17 @@
  *          service actually run in interrupt 0x80 context.
  *          And also note that when we switch to kernel mode, the stack we use
  *          actually is the process's kernel stack.
+ *
+ *          The runtime now uses the SYSCALL instruction instead, `int 0x80`
+ *          is kept for the old programs. SYSCALL doesn't go through the IDT
+ *          and SYSRET doesn't pop a frame like `iretq`, the arguments are
+ *          passed in registers with the Linux convention:
+ *              + `rax`: system call number, and the return value.
+ *              + `rdi`, `rsi`, `rdx`, `r10`, `r8`, `r9`: arguments.
+ *              + `rcx` and `r11` are clobbered (return address and RFLAGS).
+ *          `SystemCallEntry` builds the same trap frame as `Trap` does, with
+ *          the trap number SYSTEM_CALL_INSTRUCTION_TRAP, and SystemCall()
+ *          copies the registers to the argument array of the handlers.
  * 
  * 
  * @version 0.1
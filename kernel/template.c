@@ -0,0 +1,407 @@
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+
+#include "template.h"
+#include "loader.h"
+#include "memory.h"
+#include "runtime.h"
+#include "vdso.h"
+#include "cpu.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Templates in the cache, and dropped ones which still have clones. */
+#define TEMPLATE_SLOTS                  (2 * TEMPLATE_MAXIMUM)
+/* "NAME.EXT" and its '\0'. */
+#define TEMPLATE_PATH_SIZE              13
+
+/* Private type --------------------------------------------------------------*/
+typedef enum {
+    TEMPLATE_UNUSED = 0,
+    TEMPLATE_BUILDING,
+    TEMPLATE_READY,
+    TEMPLATE_DROPPED
+} TemplateState;
+
+/**
+ * @brief   Template of a program.
+ *
+ * @property state      - A dropped template isn't found anymore, it waits for
+ *                        its last clone.
+ * @property path       - Name the program is spawned with.
+ * @property entry      - Directory entry of the program when the template was
+ *                        built.
+ * @property builder    - PID of the process which builds the template.
+ * @property page_map   - Page map of the builder at its template point, the
+ *                        template owns every frame of it.
+ * @property tf         - Registers of the builder at its template point.
+ * @property fs_base    - TLS base of the builder.
+ * @property image, vma, vma_count
+ *                      - Program of the builder. The frames of the file are
+ *                        all in the template, the clones only fill the zero
+ *                        frames which the builder never touched on demand.
+ * @property frame_count- Frames of the user window of the template.
+ * @property clone_count- Processes which map the frames of the template.
+ * @property last_use   - s_template_clock when it was built or last cloned.
+ */
+typedef struct Template {
+    TemplateState state;
+    char path[TEMPLATE_PATH_SIZE];
+    DirEntry entry;
+    int builder;
+    uint64_t page_map;
+    TrapFrame tf;
+    uint64_t fs_base;
+    FCB *image;
+    VMArea vma[PROCESS_MAXIMUM_VMAS];
+    int vma_count;
+    uint32_t frame_count;
+    int clone_count;
+    uint64_t last_use;
+} Template;
+
+/* Private variable ----------------------------------------------------------*/
+/* The templates are only used with the kernel lock. */
+static Template s_templates[TEMPLATE_SLOTS];
+static uint64_t s_template_clock = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+/**
+ * @brief   Take a free slot, the least recently used template without clones
+ *          makes room if there is none.
+ *
+ * @return  The template in TEMPLATE_BUILDING state, or NULL.
+ */
+static Template *AllocTemplate(void);
+
+/**
+ * @brief   Remove a template from the cache, it is freed with its last clone.
+ */
+static void Drop(Template *template);
+static void FreeTemplate(Template *template);
+
+/**
+ * @brief   Drop the least recently used templates until the cache is within
+ *          TEMPLATE_MAXIMUM and TEMPLATE_MAXIMUM_FRAMES, `keep` stays.
+ */
+static void EvictTemplates(Template *keep);
+
+/**
+ * @brief   Load the frames of the program file which the builder didn't touch
+ *          yet, so the clones never read the file.
+ */
+static bool LoadProgramFrames(Process *proc);
+
+static bool IsSameEntry(const DirEntry *entry, const DirEntry *other);
+
+/* Public function -----------------------------------------------------------*/
+int CreateTemplate(const char *path)
+{
+    Template *template = NULL;
+    DirEntry entry = {0};
+    int status = 0;
+    int pid = 0;
+
+    if (strlen(path) >= TEMPLATE_PATH_SIZE) {
+        return -ENAMETOOLONG;
+    }
+
+    if (FindTemplate(path) != NULL) {
+        return 0;
+    }
+
+    if (FindFileInRootDir(path, &entry) < 0) {
+        return -ENOENT;
+    }
+
+    template = AllocTemplate();
+    if (template == NULL) {
+        return -ENOMEM;
+    }
+
+    /* A building template isn't found, so the builder is loaded from the
+     * file. The kernel lock is held, it doesn't run before it is marked. */
+    pid = Spawn(path, NULL, NULL);
+    if (pid < 0) {
+        template->state = TEMPLATE_UNUSED;
+        return pid;
+    }
+
+    strcpy(template->path, path);
+    template->entry = entry;
+    template->builder = pid;
+    SetVDSOProcessFlags(FindProcess(pid), VDSO_PROCESS_TEMPLATE);
+
+    /* The builder exits at its template point, or before if it fails. */
+    Wait(pid, &status, 0);
+    if (template->state != TEMPLATE_READY) {
+        template->state = TEMPLATE_UNUSED;
+        return -ENOEXEC;
+    }
+
+    /* Another template of the program was maybe built in the meantime. */
+    for (int i = 0; i < TEMPLATE_SLOTS; i++) {
+        if (&s_templates[i] != template
+            && s_templates[i].state == TEMPLATE_READY
+            && strcasecmp(s_templates[i].path, path) == 0) {
+            Drop(&s_templates[i]);
+        }
+    }
+
+    EvictTemplates(template);
+
+    return 0;
+}
+
+int DropTemplate(const char *path)
+{
+    int status = -ENOENT;
+
+    for (int i = 0; i < TEMPLATE_SLOTS; i++) {
+        if (s_templates[i].state == TEMPLATE_READY
+            && (path == NULL || strcasecmp(s_templates[i].path, path) == 0)) {
+            Drop(&s_templates[i]);
+            status = 0;
+        }
+    }
+
+    return status;
+}
+
+int CaptureTemplate(void)
+{
+    Process *proc = GetCurrentProcess();
+    Template *template = NULL;
+    uint64_t page_map = 0;
+
+    for (int i = 0; i < TEMPLATE_SLOTS; i++) {
+        if (s_templates[i].state == TEMPLATE_BUILDING
+            && s_templates[i].builder == proc->pid) {
+            template = &s_templates[i];
+        }
+    }
+
+    if (template == NULL) {
+        return -EINVAL;
+    }
+
+    /* Threads started by the constructors would lose their page map. */
+    if (proc->first_thread != NULL || !LoadProgramFrames(proc)) {
+        Exit(EXIT_STATUS_EXEC_FAILURE);
+    }
+
+    page_map = SetupKVM();
+    if (page_map == 0) {
+        Exit(EXIT_STATUS_EXEC_FAILURE);
+    }
+
+    /* The clones return from template_ready() with 0. */
+    template->tf = *proc->tf;
+    template->tf.rax = 0;
+    template->fs_base = SaveFSBase();
+    template->page_map = proc->page_map;
+    template->frame_count = GetUserFrameCount(proc->page_map);
+    template->image = proc->image;
+    template->vma_count = proc->vma_count;
+    memcpy(template->vma, proc->vma, sizeof(proc->vma));
+    RetainFile(template->image);
+
+    template->state = TEMPLATE_READY;
+    template->last_use = ++s_template_clock;
+
+    /* The builder exits in an empty page map, its own is the template. */
+    proc->page_map = page_map;
+    SwitchVM(page_map);
+    Exit(0);
+
+    return 0;
+}
+
+struct Template *FindTemplate(const char *path)
+{
+    for (int i = 0; i < TEMPLATE_SLOTS; i++) {
+        if (s_templates[i].state == TEMPLATE_READY
+            && strcasecmp(s_templates[i].path, path) == 0) {
+            s_templates[i].last_use = ++s_template_clock;
+            return &s_templates[i];
+        }
+    }
+
+    return NULL;
+}
+
+int CloneTemplate(Process *proc, struct Template *template)
+{
+    /* The frames stay owned by the template, the caller frees the page map
+     * on failure. */
+    if (!ShareUserFrames(proc->page_map, template->page_map)
+        || !InheritRuntime(proc->page_map, template->page_map)) {
+        return -ENOMEM;
+    }
+
+    proc->image = template->image;
+    proc->vma_count = template->vma_count;
+    memcpy(proc->vma, template->vma, sizeof(template->vma));
+    RetainFile(proc->image);
+
+    *proc->tf = template->tf;
+    proc->fs_base = template->fs_base;
+
+    proc->template = template;
+    template->clone_count++;
+
+    return 0;
+}
+
+void ReleaseTemplate(Process *proc)
+{
+    Template *template = proc->template;
+
+    if (template == NULL) {
+        return;
+    }
+
+    proc->template = NULL;
+    template->clone_count--;
+
+    if (template->clone_count == 0 && template->state == TEMPLATE_DROPPED) {
+        FreeTemplate(template);
+    }
+}
+
+int UnshareTemplate(Process *leader)
+{
+    bool copied = false;
+
+    if (leader->template == NULL) {
+        return 0;
+    }
+
+    /* The frames of the template stay mapped read-only, they never change.
+     * This CPU may still translate the copied ones to the template. */
+    copied = BreakCopyOnWrite(leader->page_map);
+    SwitchVM(leader->page_map);
+
+    return copied ? 0 : -ENOMEM;
+}
+
+void CheckTemplates(int index, const DirEntry *entry)
+{
+    for (int i = 0; i < TEMPLATE_SLOTS; i++) {
+        if (s_templates[i].state == TEMPLATE_READY
+            && s_templates[i].image->dir_entry == (uint32_t)index
+            && !IsSameEntry(&s_templates[i].entry, entry)) {
+            Drop(&s_templates[i]);
+        }
+    }
+}
+
+/* Private function ----------------------------------------------------------*/
+static Template *AllocTemplate(void)
+{
+    Template *template = NULL;
+
+    for (int i = 0; i < TEMPLATE_SLOTS; i++) {
+        if (s_templates[i].state == TEMPLATE_UNUSED) {
+            template = &s_templates[i];
+            break;
+        }
+
+        if (s_templates[i].state == TEMPLATE_READY
+            && s_templates[i].clone_count == 0
+            && (template == NULL
+                || s_templates[i].last_use < template->last_use)) {
+            template = &s_templates[i];
+        }
+    }
+
+    if (template == NULL) {
+        return NULL;
+    }
+
+    if (template->state == TEMPLATE_READY) {
+        Drop(template);
+    }
+
+    memset(template, 0, sizeof(Template));
+    template->state = TEMPLATE_BUILDING;
+
+    return template;
+}
+
+static void Drop(Template *template)
+{
+    template->state = TEMPLATE_DROPPED;
+
+    if (template->clone_count == 0) {
+        FreeTemplate(template);
+    }
+}
+
+static void FreeTemplate(Template *template)
+{
+    FreeVM(template->page_map);
+    ReleaseFile(template->image);
+    memset(template, 0, sizeof(Template));
+}
+
+static void EvictTemplates(Template *keep)
+{
+    while (1) {
+        Template *oldest = NULL;
+        uint32_t frames = 0;
+        int count = 0;
+
+        for (int i = 0; i < TEMPLATE_SLOTS; i++) {
+            Template *template = &s_templates[i];
+
+            if (template->state != TEMPLATE_READY) {
+                continue;
+            }
+
+            count++;
+            frames += template->frame_count;
+
+            if (template != keep
+                && (oldest == NULL || template->last_use < oldest->last_use)) {
+                oldest = template;
+            }
+        }
+
+        if (oldest == NULL
+            || (count <= TEMPLATE_MAXIMUM
+                && frames <= TEMPLATE_MAXIMUM_FRAMES)) {
+            return;
+        }
+
+        Drop(oldest);
+    }
+}
+
+static bool LoadProgramFrames(Process *proc)
+{
+    for (int i = 0; i < proc->vma_count; i++) {
+        VMArea *vma = &proc->vma[i];
+
+        for (uint64_t page = vma->start;
+             page < vma->end && page < vma->file_end;
+             page += FRAME_SIZE) {
+            if (!HandlePageFault(proc, page, 0)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool IsSameEntry(const DirEntry *entry, const DirEntry *other)
+{
+    return memcmp(entry->name, other->name, sizeof(entry->name)) == 0
+           && memcmp(entry->ext, other->ext, sizeof(entry->ext)) == 0
+           && entry->cluster_index == other->cluster_index
+           && entry->file_size == other->file_size
+           && entry->m_time == other->m_time
+           && entry->m_date == other->m_date;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file    template.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Process templates, in the spirit of the Android zygote. The same
+ *          few programs are launched again and again, and every launch reads
+ *          the program from the disk, runs the global constructors and zeroes
+ *          its memory again. The kernel can keep a warm template of a program
+ *          instead: its address space, loaded and constructed, at the point
+ *          right before main().
+ *
+ *          template_create() spawns the program with VDSO_PROCESS_TEMPLATE in
+ *          its process data page. Its start code runs the runtime and TLS
+ *          setup and the global constructors as usual, then it sees the flag
+ *          and calls template_ready() instead of main(). The kernel loads the
+ *          frames of the program which are still on the disk, takes the page
+ *          map and the registers of the process for the template, and the
+ *          process exits.
+ *
+ *          spawn() of a program which has a template clones it: the frames of
+ *          the template are mapped to the new process, the read-only ones are
+ *          shared and the writable ones are copied at their first write, and
+ *          the process resumes in the start code, after template_ready(), with
+ *          its own arguments in rdi and rsi. The disk, the constructors and
+ *          the zeroing are skipped.
+ *
+ *          + Templates are found by the name the program is spawned with.
+ *          + At most TEMPLATE_MAXIMUM templates, of TEMPLATE_MAXIMUM_FRAMES
+ *            frames together, are kept, the least recently spawned ones are
+ *            dropped first.
+ *          + A template is dropped by template_drop(), or when open() finds
+ *            that the directory entry of its program changed.
+ *          + A dropped template lives until its last clone exits or calls
+ *            exec().
+ *          + The threads of a process never share a copy-on-write frame, the
+ *            kernel has no TLB shootdown: a clone copies all of them before
+ *            its first thread (or ring worker) is created.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include "process.h"
+#include "file.h"
+
+/* Public define -------------------------------------------------------------*/
+#define TEMPLATE_MAXIMUM                4
+#define TEMPLATE_MAXIMUM_FRAMES         1024        /* 4MB.                   */
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Build the template of a program, it returns when the program
+ *          reached the template point, or exited.
+ *
+ * @param   path    - Program file, like spawn().
+ * @return  0       - Success, or the program already has a template.
+ *          -ENOENT - The file doesn't exist.
+ *          -ENOEXEC- The file isn't a valid program, or it exited before the
+ *                    template point.
+ *          -ENOMEM - Out of memory, or of templates.
+ *          -ENAMETOOLONG
+ *                  - The path is longer than a 8.3 name.
+ */
+int CreateTemplate(const char *path);
+
+/**
+ * @brief   Drop the template of a program, or every template if `path` is
+ *          NULL.
+ *
+ * @return  0, or -ENOENT if the program has no template.
+ */
+int DropTemplate(const char *path);
+
+/**
+ * @brief   Take the address space and the registers of the current process
+ *          for its template, at its template point, and exit the process.
+ *
+ * @return  -EINVAL if the process doesn't build a template, else it doesn't
+ *          return.
+ */
+int CaptureTemplate(void);
+
+/**
+ * @brief   Find the template of a program, and count it as used.
+ *
+ * @return  The template, or NULL if the program has none.
+ */
+struct Template *FindTemplate(const char *path);
+
+/**
+ * @brief   Clone a template to a new process which spawn() builds: map the
+ *          frames and set the registers, the program and the TLS base of the
+ *          template. The process holds the template until ReleaseTemplate().
+ *
+ * @return  0, or -ENOMEM.
+ */
+int CloneTemplate(Process *proc, struct Template *template);
+
+/**
+ * @brief   Drop the template of a process whose user window is released (by
+ *          exit() or exec()), the process may have none.
+ */
+void ReleaseTemplate(Process *proc);
+
+/**
+ * @brief   Copy the copy-on-write frames of a process before another thread
+ *          runs in its page map. The caller runs in the page map of `leader`.
+ *
+ * @return  0, or -ENOMEM.
+ */
+int UnshareTemplate(Process *leader);
+
+/**
+ * @brief   Drop the template of the program at directory entry `index` if the
+ *          entry changed since the template was built. open() calls it with
+ *          every entry it reads.
+ */
+void CheckTemplates(int index, const DirEntry *entry);
@@ -0,0 +1,435 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "timer.h"
+#include "trap.h"
+#include "cpu.h"
+#include "apic.h"
+#include "smp.h"
+#include "io.h"
+#include "printk.h"
+#include "assert.h"
+#include "common.h"
+#include "spinlock.h"
+
+/* Private define ------------------------------------------------------------*/
+#define NANOSECONDS_PER_TICK            (NANOSECONDS_PER_SECOND                \
+                                         / TIMER_FREQUENCY_HZ)
+
+#define PIT_FREQUENCY_HZ                1193182
+#define PIT_COMMAND_PORT                0x43
+#define PIT_CHANNEL2_DATA_PORT          0x42
+#define PIT_CHANNEL2_ONE_SHOT           0xB0    /* lobyte/hibyte, mode 0.     */
+#define PIT_CHANNEL2_MAXIMUM_US         50000
+
+#define TSC_CALIBRATION_US              10000
+
+/* Channel 2 is gated by the system control port, its output can be read back
+ * there, the speaker is left off. */
+#define SYSTEM_CONTROL_PORT             0x61
+#define SYSTEM_CONTROL_PIT2_GATE        BIT(0)
+#define SYSTEM_CONTROL_SPEAKER          BIT(1)
+#define SYSTEM_CONTROL_PIT2_OUTPUT      BIT(5)
+
+/* The CMOS clock, the century is assumed to be 2000. */
+#define CMOS_ADDRESS_PORT               0x70
+#define CMOS_DATA_PORT                  0x71
+#define CMOS_SECONDS                    0x00
+#define CMOS_MINUTES                    0x02
+#define CMOS_HOURS                      0x04
+#define CMOS_DAY                        0x07
+#define CMOS_MONTH                      0x08
+#define CMOS_YEAR                       0x09
+#define CMOS_STATUS_A                   0x0A
+#define CMOS_STATUS_B                   0x0B
+#define CMOS_STATUS_A_UPDATING          BIT(7)
+#define CMOS_STATUS_B_24_HOUR           BIT(1)
+#define CMOS_STATUS_B_BINARY            BIT(2)
+#define CMOS_HOURS_PM                   BIT(7)
+#define CMOS_CENTURY_YEAR               2000
+
+#define SECONDS_PER_DAY                 86400
+
+/* Private variable ----------------------------------------------------------*/
+/* Root of the pairing heap, the earliest timer. */
+static Timer *s_timer_heap = NULL;
+
+/* The TSC frequency, and its conversion to the clocks. */
+static uint64_t s_tsc_frequency = 0;
+static ClockParameters s_clock = {0};
+
+/* Private function prototypes -----------------------------------------------*/
+static void FireTimers(uint64_t now);
+
+/**
+ * @brief   Merge two heaps, the root with the later expiry becomes the first
+ *          child of the other one.
+ *
+ * @return  Root of the merged heap.
+ */
+static Timer *MergeTimers(Timer *a, Timer *b);
+
+/**
+ * @brief   Merge the sibling list of `first` to one heap: two by two from the
+ *          left, then the pairs from the right.
+ *
+ * @return  Root of the merged heap.
+ */
+static Timer *MergeTimerPairs(Timer *first);
+
+/**
+ * @brief   Read the CMOS clock.
+ *
+ * @return  Seconds since the epoch.
+ */
+static uint64_t ReadCMOSClock(void);
+static uint8_t ReadCMOS(uint8_t reg);
+static uint8_t BCDToBinary(uint8_t value);
+
+/**
+ * @brief   Days from the epoch to a date of the Gregorian calendar.
+ */
+static uint64_t DaysSinceEpoch(uint32_t year, uint32_t month, uint32_t day);
+
+/* Public function -----------------------------------------------------------*/
+uint64_t GetClockNanoseconds(void)
+{
+    return CyclesToNanoseconds(__builtin_ia32_rdtsc() - s_clock.tsc_base);
+}
+
+uint64_t CyclesToNanoseconds(uint64_t cycles)
+{
+    return (uint64_t)(((unsigned __int128)cycles * s_clock.multiplier)
+                      >> CLOCK_SHIFT);
+}
+
+uint64_t GetRealTimeNanoseconds(void)
+{
+    return s_clock.realtime_offset + GetClockNanoseconds();
+}
+
+void InitTimer(void)
+{
+    uint64_t start = __builtin_ia32_rdtsc();
+    uint64_t seconds = 0;
+
+    DelayMicroseconds(TSC_CALIBRATION_US);
+
+    s_clock.tsc_base = __builtin_ia32_rdtsc();
+    s_tsc_frequency = (s_clock.tsc_base - start)
+                      * (1000000 / TSC_CALIBRATION_US);
+    s_clock.multiplier = (uint64_t)(((unsigned __int128)NANOSECONDS_PER_SECOND
+                                     << CLOCK_SHIFT) / s_tsc_frequency);
+
+    seconds = ReadCMOSClock();
+    s_clock.realtime_offset = seconds * NANOSECONDS_PER_SECOND
+                              - GetClockNanoseconds();
+
+    printk("TSC: %lu kHz, real time: %lu s.\n",
+           s_tsc_frequency / 1000,
+           seconds);
+}
+
+const ClockParameters *GetClockParameters(void)
+{
+    return &s_clock;
+}
+
+uint64_t ClockToTSC(uint64_t ns)
+{
+    return s_clock.tsc_base + NanosecondsToCycles(ns, s_tsc_frequency);
+}
+
+bool TimerInterrupt(void)
+{
+    CPU *cpu = GetCPU();
+    uint64_t now = GetClockNanoseconds();
+
+    /* The one-shot event is over, the next one is programmed on the way out of
+     * the kernel. */
+    cpu->timer_event = 0;
+
+    if (cpu->id == BOOT_CPU_ID) {
+        FireTimers(now);
+    }
+
+    if (cpu->next_tick == 0 || now < cpu->next_tick) {
+        return false;
+    }
+
+    /* Ticks which were missed are not made up for. */
+    cpu->next_tick += NANOSECONDS_PER_TICK;
+    if (cpu->next_tick <= now) {
+        cpu->next_tick = now + NANOSECONDS_PER_TICK;
+    }
+
+    return true;
+}
+
+void ProgramTimerEvent(bool tick)
+{
+    CPU *cpu = GetCPU();
+    uint64_t event = 0;
+
+    if (!tick) {
+        cpu->next_tick = 0;
+    } else {
+        /* The tick restarts one period after it is needed again. */
+        if (cpu->next_tick == 0) {
+            cpu->next_tick = GetClockNanoseconds() + NANOSECONDS_PER_TICK;
+        }
+
+        event = cpu->next_tick;
+    }
+
+    if (cpu->id == BOOT_CPU_ID
+        && s_timer_heap != NULL
+        && (event == 0 || s_timer_heap->expiry < event)) {
+        event = s_timer_heap->expiry;
+    }
+
+    if (event != cpu->timer_event) {
+        cpu->timer_event = event;
+        SetLocalAPICTimer(event);
+    }
+}
+
+void AddTimer(Timer *timer,
+              uint64_t expiry,
+              void (*callback)(void *data),
+              void *data)
+{
+    /* The timer interrupt pops the heap. */
+    uint64_t flags = SaveInterrupts();
+
+    CancelTimer(timer);
+
+    timer->expiry = expiry;
+    timer->callback = callback;
+    timer->data = data;
+    timer->child = NULL;
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->pending = true;
+
+    s_timer_heap = MergeTimers(s_timer_heap, timer);
+
+    /* The boot CPU fires the timers, it may sleep until a later event. */
+    if (s_timer_heap == timer && GetCPU()->id != BOOT_CPU_ID) {
+        SendReschedule(BOOT_CPU_ID);
+    }
+
+    RestoreInterrupts(flags);
+}
+
+void CancelTimer(Timer *timer)
+{
+    uint64_t flags = SaveInterrupts();
+    Timer *children = NULL;
+
+    if (!timer->pending) {
+        RestoreInterrupts(flags);
+        return;
+    }
+
+    timer->pending = false;
+    children = MergeTimerPairs(timer->child);
+
+    /* The children of the timer take its place, as one heap merged back to
+     * the root. */
+    if (timer == s_timer_heap) {
+        s_timer_heap = children;
+    } else {
+        if (timer->prev->child == timer) {
+            timer->prev->child = timer->next;
+        } else {
+            timer->prev->next = timer->next;
+        }
+
+        if (timer->next != NULL) {
+            timer->next->prev = timer->prev;
+        }
+
+        s_timer_heap = MergeTimers(s_timer_heap, children);
+    }
+
+    timer->child = NULL;
+    timer->next = NULL;
+    timer->prev = NULL;
+
+    RestoreInterrupts(flags);
+}
+
+void DelayMicroseconds(uint32_t us)
+{
+    while (us > 0) {
+        uint32_t chunk = us < PIT_CHANNEL2_MAXIMUM_US ?
+                         us : PIT_CHANNEL2_MAXIMUM_US;
+        uint32_t count = (uint64_t)chunk * PIT_FREQUENCY_HZ / 1000000;
+        uint8_t control = InByte(SYSTEM_CONTROL_PORT)
+                          & ~(SYSTEM_CONTROL_PIT2_GATE
+                              | SYSTEM_CONTROL_SPEAKER);
+
+        if (count == 0) {
+            count = 1;
+        }
+
+        /* In mode 0, the output goes high when the count reaches zero, the
+         * count starts when the gate is raised. */
+        OutByte(SYSTEM_CONTROL_PORT, control);
+        OutByte(PIT_COMMAND_PORT, PIT_CHANNEL2_ONE_SHOT);
+        OutByte(PIT_CHANNEL2_DATA_PORT, (uint8_t)count);
+        OutByte(PIT_CHANNEL2_DATA_PORT, (uint8_t)(count >> 8));
+        OutByte(SYSTEM_CONTROL_PORT, control | SYSTEM_CONTROL_PIT2_GATE);
+
+        while (!(InByte(SYSTEM_CONTROL_PORT) & SYSTEM_CONTROL_PIT2_OUTPUT)) {
+        }
+
+        us -= chunk;
+    }
+}
+
+/* Private function ----------------------------------------------------------*/
+static void FireTimers(uint64_t now)
+{
+    while (s_timer_heap != NULL && s_timer_heap->expiry <= now) {
+        Timer *timer = s_timer_heap;
+
+        CancelTimer(timer);
+        timer->callback(timer->data);
+    }
+}
+
+static Timer *MergeTimers(Timer *a, Timer *b)
+{
+    Timer *timer = NULL;
+
+    if (a == NULL) {
+        return b;
+    }
+
+    if (b == NULL) {
+        return a;
+    }
+
+    /* Timers of the same expiry fire in the order they were armed. */
+    if (b->expiry < a->expiry) {
+        timer = a;
+        a = b;
+        b = timer;
+    }
+
+    b->prev = a;
+    b->next = a->child;
+    if (a->child != NULL) {
+        a->child->prev = b;
+    }
+    a->child = b;
+
+    return a;
+}
+
+static Timer *MergeTimerPairs(Timer *first)
+{
+    Timer *pairs = NULL;
+    Timer *root = NULL;
+
+    /* The merged pairs are stacked through `next`, the last one on top. */
+    while (first != NULL) {
+        Timer *a = first;
+        Timer *b = a->next;
+
+        first = b != NULL ? b->next : NULL;
+        a->next = NULL;
+        a->prev = NULL;
+        if (b != NULL) {
+            b->next = NULL;
+            b->prev = NULL;
+        }
+
+        a = MergeTimers(a, b);
+        a->next = pairs;
+        pairs = a;
+    }
+
+    while (pairs != NULL) {
+        Timer *next = pairs->next;
+
+        pairs->next = NULL;
+        root = MergeTimers(root, pairs);
+        pairs = next;
+    }
+
+    return root;
+}
+
+static uint64_t ReadCMOSClock(void)
+{
+    static const uint8_t registers[] = {
+        CMOS_SECONDS, CMOS_MINUTES, CMOS_HOURS,
+        CMOS_DAY, CMOS_MONTH, CMOS_YEAR
+    };
+    uint8_t time[sizeof(registers)] = {0};
+    uint8_t last[sizeof(registers)] = {0};
+    uint8_t status = ReadCMOS(CMOS_STATUS_B);
+    bool pm = false;
+
+    /* The clock may tick between two registers, it is read until two reads in
+     * a row agree. */
+    do {
+        memcpy(last, time, sizeof(time));
+
+        while (ReadCMOS(CMOS_STATUS_A) & CMOS_STATUS_A_UPDATING) {
+        }
+
+        for (uint32_t i = 0; i < sizeof(registers); i++) {
+            time[i] = ReadCMOS(registers[i]);
+        }
+    } while (memcmp(last, time, sizeof(time)) != 0);
+
+    pm = (time[2] & CMOS_HOURS_PM) != 0;
+    time[2] &= ~CMOS_HOURS_PM;
+
+    if (!(status & CMOS_STATUS_B_BINARY)) {
+        for (uint32_t i = 0; i < sizeof(registers); i++) {
+            time[i] = BCDToBinary(time[i]);
+        }
+    }
+
+    /* 12 AM is midnight, 12 PM is noon. */
+    if (!(status & CMOS_STATUS_B_24_HOUR)) {
+        time[2] = time[2] % 12 + (pm ? 12 : 0);
+    }
+
+    return DaysSinceEpoch(CMOS_CENTURY_YEAR + time[5], time[4], time[3])
+           * SECONDS_PER_DAY
+           + time[2] * 3600
+           + time[1] * 60
+           + time[0];
+}
+
+static uint8_t ReadCMOS(uint8_t reg)
+{
+    OutByte(CMOS_ADDRESS_PORT, reg);
+    return InByte(CMOS_DATA_PORT);
+}
+
+static uint8_t BCDToBinary(uint8_t value)
+{
+    return (value >> 4) * 10 + (value & 0x0F);
+}
+
+static uint64_t DaysSinceEpoch(uint32_t year, uint32_t month, uint32_t day)
+{
+    /* The year starts in March, so the leap day is the last day of the year. */
+    uint32_t y = year - (month <= 2);
+    uint32_t era = y / 400;
+    uint32_t year_of_era = y - era * 400;
+    uint32_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5
+                           + day - 1;
+    uint32_t day_of_era = year_of_era * 365 + year_of_era / 4
+                          - year_of_era / 100 + day_of_year;
+
+    /* 719468 days from 0000-03-01 to 1970-01-01. */
+    return (uint64_t)era * 146097 + day_of_era - 719468;
+}
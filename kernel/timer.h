@@ -0,0 +1,183 @@
+/**
+ * @file    timer.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Kernel timers and the monotonic clock.
+ *
+ *          Pending timers are kept in a min-heap keyed by their absolute
+ *          expiry time, so the timer interrupt only looks at the head of the
+ *          heap and only the expired timers are fired, instead of waking up
+ *          every sleeping process on every tick. The heap is a pairing heap
+ *          linked through the timers themselves, so it has no capacity and
+ *          arming a timer never fails.
+ *
+ *          The clock counts the TSC, its frequency is measured against the PIT
+ *          once at boot. The PIT doesn't interrupt anymore, every CPU programs
+ *          its local APIC timer in one-shot mode (or TSC-deadline mode) for
+ *          its next event only:
+ *          + The earliest pending timer, on the boot CPU, which fires the
+ *            timers of all CPUs.
+ *          + The next scheduler tick, only while the scheduler needs one: a
+ *            CPU which is idle, or which runs a process with nothing else
+ *            ready, doesn't tick.
+ *
+ *           tick       tick       timer          (no tick, one process)
+ *            |----------|-----------|----------------------------------|
+ *
+ *          The next event is programmed when the CPU leaves the kernel, so
+ *          every change of the timers or of the run queues is seen. The tick
+ *          is TIMER_FREQUENCY_HZ, it is set at build time.
+ *
+ *          The TSC is converted with a multiply and a shift, the same
+ *          ClockParameters are published to user space (see vdso.h), which
+ *          reads the clocks without entering the kernel. The real time clock
+ *          is the CMOS clock read at boot, plus the monotonic clock.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Public define -------------------------------------------------------------*/
+#define NANOSECONDS_PER_SECOND          1000000000ULL
+#define NANOSECONDS_PER_MILLISECOND     1000000ULL
+
+/* ns = ((tsc - tsc_base) * multiplier) >> CLOCK_SHIFT */
+#define CLOCK_SHIFT                     32
+
+/* Clocks of clock_gettime(), the values are the ones of Linux. */
+#define CLOCK_REALTIME                  0
+#define CLOCK_MONOTONIC                 1
+
+/* Public type ---------------------------------------------------------------*/
+/**
+ * @brief   Time interval, the layout is shared with user space
+ *          `struct timespec`.
+ */
+typedef struct {
+    int64_t tv_sec;
+    int64_t tv_nsec;
+} TimeSpec;
+
+/**
+ * @brief   Conversion of the TSC to the clocks, the layout is shared with user
+ *          space.
+ *
+ * @property tsc_base           - TSC at the start of the monotonic clock.
+ * @property multiplier         - Nanoseconds per TSC cycle, shifted left by
+ *                                CLOCK_SHIFT.
+ * @property realtime_offset    - Nanoseconds since the epoch at the start of
+ *                                the monotonic clock.
+ */
+typedef struct {
+    uint64_t tsc_base;
+    uint64_t multiplier;
+    uint64_t realtime_offset;
+} ClockParameters;
+
+/**
+ * @brief   Kernel timer.
+ *
+ * @property expiry     - Absolute expiry time in nanoseconds of the monotonic
+ *                        clock.
+ * @property callback   - Function called from the timer interrupt when the
+ *                        timer expires.
+ * @property data       - Argument of the callback.
+ * @property child      - First child in the timer heap.
+ * @property next       - Next sibling in the timer heap.
+ * @property prev       - Previous sibling, or the parent of a first child.
+ * @property pending    - The timer is in the heap.
+ */
+typedef struct Timer {
+    uint64_t expiry;
+    void (*callback)(void *data);
+    void *data;
+    struct Timer *child;
+    struct Timer *next;
+    struct Timer *prev;
+    bool pending;
+} Timer;
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Nanoseconds since the TSC was calibrated at boot.
+ */
+uint64_t GetClockNanoseconds(void);
+
+/**
+ * @brief   Nanoseconds of an interval of TSC cycles.
+ */
+uint64_t CyclesToNanoseconds(uint64_t cycles);
+
+/**
+ * @brief   Nanoseconds since the epoch (1970-01-01 00:00:00 UTC).
+ */
+uint64_t GetRealTimeNanoseconds(void);
+
+/**
+ * @brief   Measure the TSC frequency, start the clock and read the real time
+ *          from the CMOS clock.
+ */
+void InitTimer(void);
+
+/**
+ * @brief   Parameters of the clocks, for user space.
+ */
+const ClockParameters *GetClockParameters(void);
+
+/**
+ * @brief   TSC value at `ns` of the monotonic clock.
+ */
+uint64_t ClockToTSC(uint64_t ns);
+
+/**
+ * @brief   Handle the local APIC timer interrupt: fire the expired timers on
+ *          the boot CPU, and check the scheduler tick of the CPU.
+ *
+ * @return  true    - The scheduler tick of the CPU is due.
+ * @return  false   - The interrupt only expires timers.
+ */
+bool TimerInterrupt(void);
+
+/**
+ * @brief   Program the local APIC timer of the CPU for its next event, it is
+ *          called before the CPU leaves the kernel.
+ *
+ * @param   tick    - The scheduler needs a tick on this CPU.
+ */
+void ProgramTimerEvent(bool tick);
+
+/**
+ * @brief   Arm `timer` to call `callback(data)` at `expiry`. A pending timer is
+ *          moved to the new expiry.
+ */
+void AddTimer(Timer *timer,
+              uint64_t expiry,
+              void (*callback)(void *data),
+              void *data);
+
+/**
+ * @brief   Remove `timer` from the pending timers, if it is pending.
+ */
+void CancelTimer(Timer *timer);
+
+/**
+ * @brief   Busy wait for `us` microseconds with the channel 2 of the PIT, it
+ *          doesn't need the interrupts. It is used at boot, to calibrate other
+ *          timers and to start the CPUs.
+ */
+void DelayMicroseconds(uint32_t us);
+
+/**
+ * @brief   Convert a duration in nanoseconds to the cycles of a clock of `hz`,
+ *          without overflow for durations of years.
+ */
+static inline uint64_t NanosecondsToCycles(uint64_t ns, uint64_t hz)
+{
+    return ns / NANOSECONDS_PER_SECOND * hz
+           + ns % NANOSECONDS_PER_SECOND * hz / NANOSECONDS_PER_SECOND;
+}
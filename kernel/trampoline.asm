@@ -0,0 +1,79 @@
+; Start of a secondary CPU. The STARTUP IPI starts the CPU in real mode at
+; 0x8000 (CS=0x0800, IP=0), the boot CPU copies this file there and fills the
+; parameters before. The CPU goes through protected mode to long mode like the
+; loader does, with the page tables of the loader, which map the kernel in the
+; higher half, and jumps to the entry with the per-CPU data in rdi.
+
+[BITS 16]
+[ORG 0x8000]
+
+TrampolineStart:
+    jmp short RealModeEntry
+
+align 8
+PageMap:    dq 0    ; Physical address of PML4.
+StackTop:   dq 0    ; Top of the stack of the idle process.
+CPUData:    dq 0    ; Argument of the entry.
+Entry:      dq 0    ; Entry in the higher half, it never returns.
+
+RealModeEntry:
+    cli
+    xor ax, ax
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    lgdt [TemporaryGDT32Pointer]    ; DS is 0, so the offsets are the linear
+                                    ; addresses of ORG.
+    mov eax, cr0
+    or eax, 1                       ; Set PE.
+    mov cr0, eax
+
+    jmp 0x08:ProtectedModeEntry
+
+[BITS 32]
+ProtectedModeEntry:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    mov eax, cr4
+    or eax, (1 << 5)                ; Set PAE.
+    mov cr4, eax
+
+    mov eax, [PageMap]
+    mov cr3, eax
+
+    mov ecx, 0xC0000080             ; EFER.
+    rdmsr
+    or eax, (1 << 8)                ; Set LME.
+    wrmsr
+
+    mov eax, cr0
+    or eax, (1 << 31)               ; Set PG.
+    mov cr0, eax
+
+    jmp 0x18:LongModeEntry
+
+[BITS 64]
+LongModeEntry:
+    mov rsp, [StackTop]
+    mov rdi, [CPUData]
+    xor eax, eax
+    push rax                        ; No return address, the stack is aligned
+    mov rax, [Entry]                ; as after a call.
+    jmp rax
+
+align 8
+TemporaryGDT32:
+    dq 0
+    dq 0x00CF9A000000FFFF           ; 32-bit code, 4GB.
+    dq 0x00CF92000000FFFF           ; 32-bit data, 4GB.
+    dq 0x0020980000000000           ; 64-bit code.
+
+TemporaryGDT32Len: equ $-TemporaryGDT32
+
+TemporaryGDT32Pointer:
+    dw TemporaryGDT32Len - 1
+    dd TemporaryGDT32
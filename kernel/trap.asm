@@ -1,6 +1,15 @@
 section .text
 
+; Offsets in the per-CPU data (cpu.h), and the selectors of the GDT.
+%define CPU_KERNEL_STACK        8
+%define CPU_USER_STACK          16
+%define USER_DATA_SELECTOR      (0x18 | 3)
+%define USER_CODE_SELECTOR      (0x20 | 3)
+%define SYSTEM_CALL_INSTRUCTION_TRAP 0x100
+
 extern InterruptHandler
+extern LeaveKernel
+extern Exit
 
 ; Interrupt handler WRAPPER, some vector numbers are reserved (9, 15, etc). 
 global Vector0      ; Divide by zero.
@@ -21,26 +30,49 @@ global Vector16
 global Vector17
 global Vector18
 global Vector19
-global Vector32
 global Vector33
 global Vector39
+global Vector46     ; Primary ATA disk.
+global Vector64     ; Local APIC timer.
+global Vector65     ; Reschedule IPI.
+global Vector255    ; Local APIC spurious interrupt.
 global Syscall
+global SystemCallEntry
 
-global EOI          ; The end of interrupt.
-global ReadISR
 global LoadIDT
 global LoadCR3
 global ReadCR2
 global ReadCR3
 global ProcessStart
 global TrapReturn
+global KernelThreadStart
 global ContextSwitch
 global InByte
 global InWord
 global OutByte
 global OutWord
-
-Trap:               ; Trap procedure: Save the CPU state by pushing the general
+global ReadMSR
+global WriteMSR
+global CPUID
+global ReadCR0
+global WriteCR0
+global ReadCR4
+global WriteCR4
+global ReadFSBase
+global WriteFSBase
+global GetCPU
+global LoadGDT
+global LoadTR
+global EnableInterrupts
+global DisableInterrupts
+global SaveInterrupts
+global RestoreInterrupts
+
+Trap:                       ; A trap from ring 3 (the saved CS) runs with the
+    test byte [rsp + 24], 3 ; user GS base, swap in the per-CPU data.
+    jz .save_state
+    swapgs
+.save_state:        ; Trap procedure: Save the CPU state by pushing the general
     push rax        ; purpose registers. Print character to debug. And call the
     push rbx        ; InterruptHandler in C and pass the first argument to the 
     push rcx        ; RDI register (Follow system V AMD64 calling convention).
@@ -60,7 +92,10 @@ Trap:               ; Trap procedure: Save the CPU state by pushing the general
     mov rdi, rsp    ; Pass stack pointer to the InterruptHandler.
     call InterruptHandler 
 TrapReturn:         ; When InterruptHandler return, we back to the trap, and
-    pop r15         ; restore state of the CPU.
+    mov rdi, rsp    ; restore state of the CPU. The CPU may leave the kernel,
+    call LeaveKernel; the kernel lock is released before.
+.restore_state:
+    pop r15
     pop r14
     pop r13
     pop r12
@@ -77,12 +112,23 @@ TrapReturn:         ; When InterruptHandler return, we back to the trap, and
     pop rax
 
     add rsp, 0x10   ; Before we return, we need to adjust RSP register to make
-    iretq           ; it point to correct location. Because we push 128 bytes
+                    ; it point to correct location. Because we push 128 bytes
                     ; before jump to trap. We add 2 bytes to make the RSP point
                     ; to the original location when the exception or interrupt
                     ; gets called by the processor. If the error code is pushed
                     ; by processor (for example Vector8), we still need add 8
                     ; bytes manually.
+    test byte [rsp + 8], 3  ; The user GS base comes back when we return to
+    jz .return              ; ring 3.
+    swapgs
+.return:
+    iretq
+
+KernelThreadStart:  ; A new kernel thread returns here from ContextSwitch, its
+    mov rdi, r13    ; entry function is in r12 and the argument in r13. The
+    call r12        ; thread exits when the function returns.
+    xor edi, edi
+    call Exit
 
 Vector0:
     push 0          ; Error code, we need to push it in the system exception.
@@ -168,11 +214,6 @@ Vector19:
     push 19
     jmp Trap
 
-Vector32:
-    push 0
-    push 32
-    jmp Trap
-
 Vector33:           ; Keyboard interrupt.
     push 0
     push 33
@@ -183,22 +224,99 @@ Vector39:
     push 39
     jmp Trap
 
+Vector46:
+    push 0
+    push 46
+    jmp Trap
+
+Vector64:
+    push 0
+    push 64
+    jmp Trap
+
+Vector65:
+    push 0
+    push 65
+    jmp Trap
+
+Vector255:
+    push 0
+    push 255
+    jmp Trap
+
 Syscall:
     push 0
     push 0x80       ; Push trap number 0x80, so we know it is software
     jmp Trap        ; interrupt.
 
+; SYSCALL entry (LSTAR). The CPU only saved the user RIP in rcx and RFLAGS in
+; r11, and cleared IF (SFMASK), it is still on the user stack. The entry
+; builds the same trap frame as an interrupt from ring 3 on the kernel stack
+; of the process, so fork(), exec() and the scheduler see no difference, but
+; there is no error code from the CPU, no test of the ring and no iretq.
+SystemCallEntry:
+    swapgs                              ; Always from ring 3.
+    mov [gs:CPU_USER_STACK], rsp
+    mov rsp, [gs:CPU_KERNEL_STACK]
+
+    push USER_DATA_SELECTOR             ; ss
+    push qword [gs:CPU_USER_STACK]      ; rsp
+    push r11                            ; rflags
+    push USER_CODE_SELECTOR             ; cs
+    push rcx                            ; rip
+    push 0                              ; error code
+    push SYSTEM_CALL_INSTRUCTION_TRAP
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+
+    mov rdi, rsp
+    call InterruptHandler
 
-EOI:                ; Send EOI to PIC.
-    mov al, 0x20
-    out 0x20, al
-    ret
+    mov rdi, rsp
+    call LeaveKernel
+
+    ; SYSRET loads RIP from rcx, a non-canonical one would fault in ring 0 on
+    ; the user stack, such a frame goes back through iretq.
+    mov rax, [rsp + 17 * 8]             ; rip
+    sar rax, 47
+    jnz TrapReturn.restore_state
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    add rsp, 8                          ; r11 is loaded with RFLAGS below.
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    add rsp, 8                          ; rcx is loaded with RIP below.
+    pop rbx
+    pop rax
+    add rsp, 0x10                       ; Trap number and error code.
+
+    mov rcx, [rsp]                      ; rip
+    mov r11, [rsp + 16]                 ; rflags
+    mov rsp, [rsp + 24]                 ; rsp
+    swapgs
+    o64 sysret
 
-ReadISR:
-    mov al, 0xB
-    out 0x20, al
-    in al, 0x20
-    ret
 
 LoadIDT:
     lidt [rdi]
@@ -261,4 +379,96 @@ OutWord:
     mov rdx, rdi
     mov rax, rsi
     out dx, ax
+    ret
+
+ReadMSR:            ; uint64_t ReadMSR(uint32_t msr)
+    mov ecx, edi
+    rdmsr           ; Value is returned in edx:eax.
+    shl rdx, 32
+    or rax, rdx
+    ret
+
+WriteMSR:           ; void WriteMSR(uint32_t msr, uint64_t value)
+    mov ecx, edi
+    mov rax, rsi
+    mov rdx, rsi
+    shr rdx, 32
+    wrmsr
+    ret
+
+ReadCR0:
+    mov rax, cr0
+    ret
+
+WriteCR0:
+    mov cr0, rdi
+    ret
+
+ReadCR4:
+    mov rax, cr4
+    ret
+
+WriteCR4:
+    mov cr4, rdi
+    ret
+
+ReadFSBase:         ; Only with CR4.FSGSBASE.
+    rdfsbase rax
+    ret
+
+WriteFSBase:
+    wrfsbase rdi
+    ret
+
+GetCPU:             ; The per-CPU data starts with its own address.
+    mov rax, [gs:0]
+    ret
+
+LoadGDT:            ; void LoadGDT(void *pointer)
+    lgdt [rdi]
+    xor eax, eax
+    mov ss, ax
+    mov ds, ax
+    mov es, ax
+    pop rax         ; Reload CS with a far return to the caller, like
+    push 0x08       ; kernel.asm does.
+    push rax
+    db 0x48
+    retf
+
+LoadTR:             ; void LoadTR(uint16_t selector)
+    ltr di
+    ret
+
+CPUID:              ; void CPUID(uint32_t leaf, uint32_t *regs)
+    push rbx        ; rbx is callee-saved.
+    mov eax, edi
+    xor ecx, ecx
+    cpuid
+    mov [rsi], eax
+    mov [rsi + 4], ebx
+    mov [rsi + 8], ecx
+    mov [rsi + 12], edx
+    pop rbx
+    ret
+
+EnableInterrupts:
+    sti
+    ret
+
+DisableInterrupts:
+    cli
+    ret
+
+SaveInterrupts:     ; uint64_t SaveInterrupts(void)
+    pushfq          ; RFLAGS before the interrupts are disabled.
+    pop rax
+    cli
+    ret
+
+RestoreInterrupts:  ; void RestoreInterrupts(uint64_t flags)
+    test edi, 0x200 ; IF.
+    jz .disabled
+    sti
+.disabled:
     ret
\ No newline at end of file
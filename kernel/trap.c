@@ -1,9 +1,16 @@
+#include <format.h>
 #include "trap.h"
 #include "assert.h"
 #include "printk.h"
 #include "syscall.h"
 #include "process.h"
 #include "keyboard.h"
+#include "loader.h"
+#include "timer.h"
+#include "apic.h"
+#include "smp.h"
+#include "ioapic.h"
+#include "disk.h"
 
 /* Private define ------------------------------------------------------------*/
 #define MAXIMUM_IRQ_NUMBER 256
@@ -11,7 +18,6 @@
 /* Private variable ----------------------------------------------------------*/
 static IDTPointer s_IDT_ptr;
 static IDTEntry s_interrupt_entries[MAXIMUM_IRQ_NUMBER];
-static uint64_t s_system_ticks = 0;
 
 /* Private function prototypes -----------------------------------------------*/
 /**
@@ -53,9 +59,15 @@ void InitIDT(void)
     InitIDTEntry(&s_interrupt_entries[17], (uint64_t)Vector17, 0x8E);
     InitIDTEntry(&s_interrupt_entries[18], (uint64_t)Vector18, 0x8E);
     InitIDTEntry(&s_interrupt_entries[19], (uint64_t)Vector19, 0x8E);
-    InitIDTEntry(&s_interrupt_entries[32], (uint64_t)Vector32, 0x8E);
     InitIDTEntry(&s_interrupt_entries[33], (uint64_t)Vector33, 0x8E);
     InitIDTEntry(&s_interrupt_entries[39], (uint64_t)Vector39, 0x8E);
+    InitIDTEntry(&s_interrupt_entries[46], (uint64_t)Vector46, 0x8E);
+    InitIDTEntry(&s_interrupt_entries[LOCAL_APIC_TIMER_VECTOR],
+                 (uint64_t)Vector64, 0x8E);
+    InitIDTEntry(&s_interrupt_entries[RESCHEDULE_VECTOR],
+                 (uint64_t)Vector65, 0x8E);
+    InitIDTEntry(&s_interrupt_entries[LOCAL_APIC_SPURIOUS_VECTOR],
+                 (uint64_t)Vector255, 0x8E);
     
     
     /* Init system call handler, DPL attribute is set to 3 instead of 0,
@@ -70,9 +82,15 @@ void InitIDT(void)
     LoadIDT(&s_IDT_ptr);
 }
 
+void InitSecondaryIDT(void)
+{
+    LoadIDT(&s_IDT_ptr);
+}
+
 uint64_t GetTicks(void)
 {
-    return s_system_ticks;
+    return GetClockNanoseconds() / (MILLISECONDS_PER_TICK
+                                    * NANOSECONDS_PER_MILLISECOND);
 }
 
 /* Private function ----------------------------------------------------------*/
@@ -87,51 +105,87 @@ static void InitIDTEntry(IDTEntry *entry, uint64_t address, uint8_t attribute)
 
 void InterruptHandler(TrapFrame *tf)
 {
+    /* Only one CPU runs the kernel at a time. */
+    EnterKernel();
+
+    /* The process ran user code until this trap. */
+    if ((tf->cs & 3) == 3) {
+        AccountCPUTime(true);
+    }
+
     switch (tf->trapno) {
-    case 32: {      /* Timer interrupt which is called every 10ms. */
-        /* Increase system ticks and wakeup processes which have wait_id -1. */
-        s_system_ticks++;
-        Wakeup(NORMAL_PROCESS_WAIT_ID);
+    case LOCAL_APIC_TIMER_VECTOR: { /* Next timer event of the CPU. */
+        /* Expired timers wake up their sleeping processes, the others are not
+         * touched. The timer also fires between two ticks for a timer which
+         * expires there, it doesn't count as a tick. */
+        bool tick = TimerInterrupt();
 
-        EOI();
+        LocalAPICEOI();
 
-        /* If the handler is called when running in the user mode, we Yield()
-         * to make current process give up the CPU resource, and choose another
-         * another process. */
-        Yield();
+        /* We charge the tick to the current process, it gives up the CPU
+         * resource when its time quantum is over, and we choose another
+         * process. A woken process of higher priority runs without waiting
+         * for the tick. In a system call, it waits for a preemptible part. */
+        PreemptInterrupted(tf, tick);
     }
     break;
-    case 33: {      /* Keyboard interrupt. */
+    case IRQ_VECTOR_BASE + ISA_IRQ_KEYBOARD: {
         KeyboardHandler();
-        EOI();
+        LocalAPICEOI();
+
+        /* Run the process waiting for the key right away, instead of at the
+         * end of the current time quantum. */
+        PreemptInterrupted(tf, false);
     }
     break;
-    case 39: {      /* Spurious interrupt. */
-        uint8_t isr_value = ReadISR();
-        if ((isr_value & (1<<7)) != 0) {
-            EOI();
-        }
+    case IRQ_VECTOR_BASE + ISA_IRQ_PRIMARY_ATA: {
+        DiskInterrupt();
+        LocalAPICEOI();
     }
     break;
-    case SYSTEM_CALL_INTERRUPT_NUMBER: {
+    case 39: {      /* Spurious interrupt of the masked PIC, no EOI. */
+    }
+    break;
+    case RESCHEDULE_VECTOR: {       /* Another CPU made a process ready. */
+        LocalAPICEOI();
+        PreemptInterrupted(tf, false);
+    }
+    break;
+    case LOCAL_APIC_SPURIOUS_VECTOR: {
+        /* No EOI for the spurious interrupt. */
+    }
+    break;
+    case SYSTEM_CALL_INTERRUPT_NUMBER:
+    case SYSTEM_CALL_INSTRUCTION_TRAP: {
         SystemCall(tf);
     }
     break;
+    case 14: {      /* Page fault. */
+        /* Program frames are loaded at the first access, by user code or by
+         * the kernel on behalf of a system call. */
+        if (HandlePageFault(GetThreadLeader(GetCurrentProcess()),
+                            ReadCR2(),
+                            tf->error_code)) {
+            break;
+        }
+    }
+    /* fall through */
 
     default: {
         if ((tf->cs & 3) == 3) {
             /* If the exception is generated by user mode, we force exit current
              * process. */
-            printk("[Exception: %d][%x:%x]: Terminating process.\n",
+            printk("[Exception: %ld][%#lx:%#lx]: Terminating process.\n",
                     tf->trapno,
                     ReadCR2(),
                     tf->rip);
-            Exit();
+            Exit(EXIT_STATUS_EXCEPTION(tf->trapno));
         } else {
             /* If the exception is generated by kernel mode, we halt CPU. */
             char msg[70] = {0};
-            sprintk(msg,
-                "[Error %d at ring: %d] %d:%x %x",
+            snprintf(msg,
+                sizeof(msg),
+                "[Error %ld at ring: %ld] %ld:%#lx %#lx",
                 tf->trapno,         /* Trap number. */
                 (tf->cs & 3),       /* Ring number. */
                 tf->error_code,     /* Error code. */
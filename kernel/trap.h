@@ -4,6 +4,14 @@
 
 /* Public define -------------------------------------------------------------*/
 #define SYSTEM_CALL_INTERRUPT_NUMBER    0x80
+/* Trap number of the frames built by the SYSCALL entry, it isn't a vector. */
+#define SYSTEM_CALL_INSTRUCTION_TRAP    0x100
+/* Scheduler tick, it is set at build time (make TIMER_FREQUENCY_HZ=250), it
+ * must divide 1000. */
+#ifndef TIMER_FREQUENCY_HZ
+#define TIMER_FREQUENCY_HZ              100
+#endif
+#define MILLISECONDS_PER_TICK           (1000 / TIMER_FREQUENCY_HZ)
 
 /* Public type ---------------------------------------------------------------*/
 
@@ -63,6 +71,15 @@ typedef struct {
  */
 void InitIDT(void);
 
+/**
+ * @brief   Load the IDT of the boot CPU on a secondary CPU, they share it.
+ */
+void InitSecondaryIDT(void);
+
+/**
+ * @brief   Scheduler ticks since boot, counted from the clock, so they go on
+ *          while the CPUs don't tick.
+ */
 uint64_t GetTicks(void);
 
 void Vector0(void);
@@ -83,18 +100,29 @@ void Vector16(void);
 void Vector17(void);
 void Vector18(void);
 void Vector19(void);
-void Vector32(void);
 void Vector33(void);
 void Vector39(void);
+void Vector46(void);
+void Vector64(void);
+void Vector65(void);
+void Vector255(void);
 void Syscall(void);
+void SystemCallEntry(void);
 
-/**
- * @brief       Call this to send end of interrupt, so we can re-fire interrupt
- *              after that.
- */
-void EOI(void);
-uint8_t ReadISR(void);
 void LoadIDT(IDTPointer *ptr);
 uint64_t ReadCR2(void);
 uint64_t ReadCR3(void);
-void TrapReturn(void);
\ No newline at end of file
+void TrapReturn(void);
+void KernelThreadStart(void);
+
+/**
+ * @brief   Read and write model specific registers.
+ */
+uint64_t ReadMSR(uint32_t msr);
+void WriteMSR(uint32_t msr, uint64_t value);
+
+/**
+ * @brief   Execute CPUID with `leaf` (sub-leaf 0), `regs` receives eax, ebx,
+ *          ecx and edx in this order.
+ */
+void CPUID(uint32_t leaf, uint32_t *regs);
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include <stddef.h>
+
+#include "vdso.h"
+#include "memory.h"
+
+/* Private variable ----------------------------------------------------------*/
+/* The data page is in the kernel image, it is never freed. It fills the whole
+ * frame, so no other kernel data is seen by user space. */
+static union {
+    VDSOData data;
+    uint8_t frame[FRAME_SIZE];
+} s_vdso_page __attribute__((aligned(FRAME_SIZE)));
+
+/* Public function -----------------------------------------------------------*/
+void InitVDSO(void)
+{
+    s_vdso_page.data.clock = *GetClockParameters();
+    s_vdso_page.data.cpu_count = 1;
+}
+
+VDSOData *GetVDSOData(void)
+{
+    return &s_vdso_page.data;
+}
+
+bool MapVDSO(Process *proc)
+{
+    VDSOProcessData *process_data = NULL;
+
+    if (!MapUserFrame(proc->page_map,
+                      VDSO_DATA_ADDRESS,
+                      &s_vdso_page,
+                      VMA_READ | VMA_SHARED)) {
+        return false;
+    }
+
+    /* The frame is released with the page map. */
+    process_data = AllocFrame();
+    if (process_data == NULL) {
+        return false;
+    }
+
+    process_data->pid = proc->pid;
+
+    if (!MapUserFrame(proc->page_map,
+                      VDSO_PROCESS_DATA_ADDRESS,
+                      process_data,
+                      VMA_READ)) {
+        FreeFrame(process_data);
+        return false;
+    }
+
+    return true;
+}
+
+void SetVDSOProcessFlags(Process *proc, uint32_t flags)
+{
+    VDSOProcessData *process_data = GetUserFrame(proc->page_map,
+                                                 VDSO_PROCESS_DATA_ADDRESS);
+
+    if (process_data != NULL) {
+        process_data->flags |= flags;
+    }
+}
@@ -0,0 +1,100 @@
+/**
+ * @file    vdso.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Data pages shared with user space, in the spirit of the Linux
+ *          vDSO data page. They are mapped read-only in every process, below
+ *          the shared runtime, and the kernel keeps them up to date, so the
+ *          runtime reads the time, its PID and a few counters with plain loads
+ *          instead of a system call:
+ *          + The data page is one frame of the kernel, the same for every
+ *            process. It holds the clock parameters, the user space converts
+ *            the TSC to nanoseconds exactly like GetClockNanoseconds(), and the
+ *            system wide counters.
+ *          + The process data page is a frame of each process, it holds the
+ *            PID and the process flags. It is kept by exec() and shared by
+ *            the threads.
+ *
+ *          Process virtual memory below the runtime:
+ *           |0x200000          |   runtime text
+ *           |  process data    |   read-only, private
+ *           |0x1FF000          |
+ *           |  data            |   read-only, same frame in every process
+ *           |0x1FE000          |
+ *
+ *          The layout is shared with usr/runtime/include/vdso.h.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include "timer.h"
+#include "process.h"
+
+/* Public define -------------------------------------------------------------*/
+#define VDSO_DATA_ADDRESS               0x1FE000
+#define VDSO_PROCESS_DATA_ADDRESS       0x1FF000
+
+/* Process flags: the start code stops before main for a template (see
+ * template.h). */
+#define VDSO_PROCESS_TEMPLATE           BIT(0)
+
+/* Public type ---------------------------------------------------------------*/
+/**
+ * @brief   Data page shared by every process.
+ *
+ * @property clock              - Parameters of the monotonic and real time
+ *                                clocks, they don't change after boot.
+ * @property system_calls       - System calls since boot.
+ * @property context_switches   - Context switches since boot, on all CPUs.
+ * @property process_count      - Processes and threads which exist.
+ * @property cpu_count          - CPUs which are online.
+ */
+typedef struct {
+    ClockParameters clock;
+    uint64_t system_calls;
+    uint64_t context_switches;
+    uint32_t process_count;
+    uint32_t cpu_count;
+} VDSOData;
+
+/**
+ * @brief   Data page of one process.
+ *
+ * @property pid                - PID of the process (of the leader for its
+ *                                threads).
+ * @property flags              - VDSO_PROCESS_TEMPLATE.
+ */
+typedef struct {
+    int32_t pid;
+    uint32_t flags;
+} VDSOProcessData;
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Publish the clock parameters, it is called once the clock is
+ *          calibrated, before the first process.
+ */
+void InitVDSO(void);
+
+/**
+ * @brief   The data page, the kernel updates the counters through it.
+ */
+VDSOData *GetVDSOData(void);
+
+/**
+ * @brief   Map the data pages to a new process: the shared data page, and a
+ *          new process data page.
+ *
+ * @return  true    - Success.
+ * @return  false   - Out of memory.
+ */
+bool MapVDSO(Process *proc);
+
+/**
+ * @brief   Set flags in the process data page of a process.
+ */
+void SetVDSOProcessFlags(Process *proc, uint32_t flags);
@@ -0,0 +1,190 @@
+#include <stddef.h>
+
+#include "workqueue.h"
+#include "printk.h"
+#include "assert.h"
+#include "spinlock.h"
+
+/* Private variable ----------------------------------------------------------*/
+static WorkQueue s_system_work_queue;
+
+/* Private function prototypes -----------------------------------------------*/
+/**
+ * @brief   Main loop of a worker thread: run the work items of the queue, and
+ *          sleep while it is empty.
+ */
+static void WorkerThread(void *data);
+
+/**
+ * @brief   Timer callback of delayed work, it queues the work item.
+ */
+static void DelayedWorkTimerExpired(void *data);
+
+static void WorkQueuePush(WorkQueue *queue, Work *work);
+static Work *WorkQueuePop(WorkQueue *queue);
+
+/* Public function -----------------------------------------------------------*/
+void InitWorkQueues(void)
+{
+    ASSERT(CreateWorkQueue(&s_system_work_queue,
+                           "system",
+                           SYSTEM_WORK_QUEUE_WORKERS));
+}
+
+WorkQueue *GetSystemWorkQueue(void)
+{
+    return &s_system_work_queue;
+}
+
+bool CreateWorkQueue(WorkQueue *queue, const char *name, int workers)
+{
+    ASSERT(workers > 0 && workers <= WORK_QUEUE_MAXIMUM_WORKERS);
+
+    /* Work items queued before the queue was created are kept. */
+    queue->name = name;
+
+    for (int i = queue->worker_count; i < workers; i++) {
+        Process *worker = CreateKernelThread(WorkerThread, queue);
+
+        if (worker == NULL) {
+            printk("DEBUG: Failed to create a worker of %s.\n", name);
+            return false;
+        }
+
+        queue->workers[queue->worker_count++] = worker;
+    }
+
+    return true;
+}
+
+void InitWork(Work *work, void (*func)(void *data), void *data)
+{
+    work->next = NULL;
+    work->func = func;
+    work->data = data;
+    work->queue = NULL;
+    work->pending = false;
+}
+
+bool QueueWork(WorkQueue *queue, Work *work)
+{
+    /* Delayed work is queued by the timer interrupt. */
+    uint64_t flags = SaveInterrupts();
+    bool queued = !work->pending;
+
+    if (queued) {
+        work->pending = true;
+        WorkQueuePush(queue, work);
+        WakeUpOne(&queue->idle_workers);
+    }
+
+    RestoreInterrupts(flags);
+    return queued;
+}
+
+bool QueueDelayedWork(WorkQueue *queue, Work *work, uint64_t delay)
+{
+    if (work->pending) {
+        return false;
+    }
+
+    /* Pending before the timer is armed, it may expire at once. */
+    work->queue = queue;
+    work->pending = true;
+    AddTimer(&work->timer,
+             GetClockNanoseconds() + delay,
+             DelayedWorkTimerExpired,
+             work);
+
+    return true;
+}
+
+bool CancelWork(WorkQueue *queue, Work *work)
+{
+    uint64_t flags = SaveInterrupts();
+    Work **link = &queue->first;
+    Work *prev = NULL;
+    bool pending = work->pending;
+
+    work->pending = false;
+
+    if (!pending || work->timer.pending) {
+        CancelTimer(&work->timer);
+        RestoreInterrupts(flags);
+        return pending;
+    }
+
+    while (*link != work) {
+        ASSERT(*link != NULL);
+        prev = *link;
+        link = &(*link)->next;
+    }
+
+    *link = work->next;
+    if (queue->last == work) {
+        queue->last = prev;
+    }
+
+    work->next = NULL;
+
+    RestoreInterrupts(flags);
+    return true;
+}
+
+/* Private function ----------------------------------------------------------*/
+static void WorkerThread(void *data)
+{
+    WorkQueue *queue = data;
+
+    while (1) {
+        Work *work = WorkQueuePop(queue);
+
+        if (work == NULL) {
+            SleepOn(&queue->idle_workers);
+            continue;
+        }
+
+        /* The work item can be queued again by its own function. */
+        work->pending = false;
+        work->func(work->data);
+
+        Yield();
+    }
+}
+
+static void DelayedWorkTimerExpired(void *data)
+{
+    Work *work = data;
+
+    work->pending = false;
+    QueueWork(work->queue, work);
+}
+
+static void WorkQueuePush(WorkQueue *queue, Work *work)
+{
+    work->next = NULL;
+
+    if (queue->last == NULL) {
+        queue->first = work;
+    } else {
+        queue->last->next = work;
+    }
+
+    queue->last = work;
+}
+
+static Work *WorkQueuePop(WorkQueue *queue)
+{
+    Work *work = queue->first;
+
+    if (work != NULL) {
+        queue->first = work->next;
+        if (queue->first == NULL) {
+            queue->last = NULL;
+        }
+
+        work->next = NULL;
+    }
+
+    return work;
+}
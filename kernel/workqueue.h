@@ -0,0 +1,130 @@
+/**
+ * @file    workqueue.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Deferred work. System calls and interrupts queue the work which can
+ *          be done later (releasing the resources of a dead process, zeroing
+ *          free frames, etc.) instead of doing it before they return, and the
+ *          work is run by the worker threads of the queue.
+ *
+ *          Workers are kernel threads, they sleep on the wait queue of their
+ *          work queue while it is empty. Like the rest of the kernel, they run
+ *          with interrupts disabled, so a worker yields the CPU after every
+ *          work item, and a work function must not run for long.
+ *
+ *          A work item is only queued once: queueing a pending work item does
+ *          nothing, so a work item which is queued many times before it runs
+ *          runs once. Delayed work arms the timer of the work item, and it is
+ *          queued when the timer expires.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "process.h"
+#include "timer.h"
+
+/* Public define -------------------------------------------------------------*/
+#define WORK_QUEUE_MAXIMUM_WORKERS      4
+#define SYSTEM_WORK_QUEUE_WORKERS       1
+
+/**
+ * @brief   Static initializer of a work item.
+ */
+#define WORK_INITIALIZER(function, argument)                                   \
+    { .func = (function), .data = (argument) }
+
+/* Public type ---------------------------------------------------------------*/
+/**
+ * @brief   Function deferred to a worker thread.
+ *
+ * @property next       - Next work item in the queue.
+ * @property func       - Function run by the worker.
+ * @property data       - Argument of the function.
+ * @property queue      - Queue of delayed work, used when the timer expires.
+ * @property timer      - Timer of delayed work.
+ * @property pending    - The work item is queued, or its timer is armed.
+ */
+typedef struct Work {
+    struct Work *next;
+    void (*func)(void *data);
+    void *data;
+    struct WorkQueue *queue;
+    Timer timer;
+    bool pending;
+} Work;
+
+/**
+ * @brief   Work items waiting for the workers of the queue, in FIFO order.
+ *
+ * @property name           - Name of the queue, for debugging.
+ * @property first, last    - Pending work items.
+ * @property idle_workers   - Workers sleep here while the queue is empty.
+ * @property workers        - Worker threads.
+ * @property worker_count   - Number of worker threads.
+ */
+typedef struct WorkQueue {
+    const char *name;
+    Work *first;
+    Work *last;
+    WaitQueue idle_workers;
+    Process *workers[WORK_QUEUE_MAXIMUM_WORKERS];
+    int worker_count;
+} WorkQueue;
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Create the system work queue, it must be called after the process
+ *          manager is initialized.
+ */
+void InitWorkQueues(void);
+
+/**
+ * @brief   Shared work queue for short work items of the kernel.
+ */
+WorkQueue *GetSystemWorkQueue(void);
+
+/**
+ * @brief   Initialize an empty work queue, and start its worker threads.
+ *
+ * @param   queue       - Work queue.
+ * @param   name        - Name of the queue.
+ * @param   workers     - Number of worker threads, up to
+ *                        WORK_QUEUE_MAXIMUM_WORKERS.
+ * @return  true        - Success.
+ * @return  false       - A worker thread can't be created.
+ */
+bool CreateWorkQueue(WorkQueue *queue, const char *name, int workers);
+
+/**
+ * @brief   Initialize a work item which runs `func(data)`.
+ */
+void InitWork(Work *work, void (*func)(void *data), void *data);
+
+/**
+ * @brief   Add the work item to the tail of the queue, and wake up a worker.
+ *
+ * @return  true        - The work item is queued.
+ * @return  false       - The work item is already pending.
+ */
+bool QueueWork(WorkQueue *queue, Work *work);
+
+/**
+ * @brief   Queue the work item after `delay` nanoseconds.
+ *
+ * @return  true        - The timer of the work item is armed.
+ * @return  false       - The work item is already pending.
+ */
+bool QueueDelayedWork(WorkQueue *queue, Work *work, uint64_t delay);
+
+/**
+ * @brief   Remove a pending work item from its queue, or cancel its timer. A
+ *          running work item is not waited for.
+ *
+ * @return  true if the work item was pending.
+ */
+bool CancelWork(WorkQueue *queue, Work *work);
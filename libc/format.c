@@ -0,0 +1,467 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <format.h>
+
+/* Private define ------------------------------------------------------------*/
+#define FORMAT_FLAG_LEFT        (1 << 0)    /* '-' */
+#define FORMAT_FLAG_ZERO        (1 << 1)    /* '0' */
+#define FORMAT_FLAG_PLUS        (1 << 2)    /* '+' */
+#define FORMAT_FLAG_SPACE       (1 << 3)    /* ' ' */
+#define FORMAT_FLAG_ALTERNATE   (1 << 4)    /* '#' */
+#define FORMAT_FLAG_UPPER       (1 << 5)    /* 'X' */
+
+/* A 64 bits integer has at most 22 octal digits. */
+#define FORMAT_MAX_DIGITS       24
+
+/* Private type --------------------------------------------------------------*/
+typedef enum {
+    LENGTH_DEFAULT = 0,
+    LENGTH_CHAR,
+    LENGTH_SHORT,
+    LENGTH_LONG,
+    LENGTH_LONG_LONG,
+    LENGTH_SIZE
+} LengthModifier;
+
+/**
+ * @brief   Bounded output cursor. `pos` keeps counting when the buffer is full,
+ *          so we can return the length the output would have had.
+ */
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t pos;
+} FormatOutput;
+
+/* Private variable ----------------------------------------------------------*/
+
+/* "00" "01" ... "99", we convert two decimal digits per division. */
+static const char s_digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char s_lower_hex_digits[16] = "0123456789abcdef";
+static const char s_upper_hex_digits[16] = "0123456789ABCDEF";
+
+/* Private function prototypes -----------------------------------------------*/
+static inline void PutChar(FormatOutput *out, char c);
+static void PutString(FormatOutput *out, const char *str, size_t length);
+static void PutPadding(FormatOutput *out, char c, int count);
+
+/**
+ * @brief    Convert `value` to decimal digits. The digits are written backward
+ *           and end right before `end`.
+ *
+ * @param[in] value         - Unsigned value to convert.
+ * @param[in] end           - End of the digits buffer.
+ * @return    Pointer to the first digit.
+ */
+static char *ConvertDecimal(uint64_t value, char *end);
+
+/**
+ * @brief    Convert `value` to hex (shift = 4) or octal (shift = 3) digits.
+ *           The digits are written backward and end right before `end`.
+ */
+static char *ConvertPowerOfTwo(uint64_t value,
+                               char *end,
+                               int shift,
+                               const char *digits_map);
+
+static void PutInteger(FormatOutput *out,
+                       uint64_t value,
+                       bool negative,
+                       int base,
+                       int flags,
+                       int width,
+                       int precision);
+
+/* Public function -----------------------------------------------------------*/
+int vsnprintf(char *buffer, size_t size, const char *format, va_list args)
+{
+    FormatOutput out = {buffer, size, 0};
+    const char *run = NULL;
+    LengthModifier length = LENGTH_DEFAULT;
+    uint64_t value = 0;
+    int64_t signed_value = 0;
+    int flags = 0;
+    int width = 0;
+    int precision = -1;
+
+    while (*format != '\0') {
+        if (*format != '%') {
+            /* Copy the run of regular characters at once. */
+            run = format;
+            while (*format != '\0' && *format != '%') {
+                format++;
+            }
+
+            PutString(&out, run, format - run);
+            continue;
+        }
+
+        /* 1. Flags. */
+        run = format++;
+        flags = 0;
+        while (1) {
+            if (*format == '-') {
+                flags |= FORMAT_FLAG_LEFT;
+            } else if (*format == '0') {
+                flags |= FORMAT_FLAG_ZERO;
+            } else if (*format == '+') {
+                flags |= FORMAT_FLAG_PLUS;
+            } else if (*format == ' ') {
+                flags |= FORMAT_FLAG_SPACE;
+            } else if (*format == '#') {
+                flags |= FORMAT_FLAG_ALTERNATE;
+            } else {
+                break;
+            }
+            format++;
+        }
+
+        /* 2. Width. */
+        width = 0;
+        if (*format == '*') {
+            width = va_arg(args, int);
+            if (width < 0) {
+                flags |= FORMAT_FLAG_LEFT;
+                width = -width;
+            }
+            format++;
+        } else {
+            while (*format >= '0' && *format <= '9') {
+                width = width * 10 + (*format++ - '0');
+            }
+        }
+
+        /* 3. Precision. */
+        precision = -1;
+        if (*format == '.') {
+            format++;
+            precision = 0;
+            if (*format == '*') {
+                precision = va_arg(args, int);
+                format++;
+            } else {
+                while (*format >= '0' && *format <= '9') {
+                    precision = precision * 10 + (*format++ - '0');
+                }
+            }
+        }
+
+        /* 4. Length modifier. */
+        length = LENGTH_DEFAULT;
+        if (*format == 'h') {
+            length = LENGTH_SHORT;
+            if (*++format == 'h') {
+                length = LENGTH_CHAR;
+                format++;
+            }
+        } else if (*format == 'l') {
+            length = LENGTH_LONG;
+            if (*++format == 'l') {
+                length = LENGTH_LONG_LONG;
+                format++;
+            }
+        } else if (*format == 'z') {
+            length = LENGTH_SIZE;
+            format++;
+        }
+
+        /* 5. Specifier. */
+        switch (*format) {
+            case 'd':
+            case 'i': {
+                if (length == LENGTH_LONG || length == LENGTH_LONG_LONG
+                    || length == LENGTH_SIZE) {
+                    signed_value = va_arg(args, int64_t);
+                } else {
+                    signed_value = va_arg(args, int);
+                    if (length == LENGTH_CHAR) {
+                        signed_value = (signed char)signed_value;
+                    } else if (length == LENGTH_SHORT) {
+                        signed_value = (short)signed_value;
+                    }
+                }
+
+                if (signed_value < 0) {
+                    PutInteger(&out, -(uint64_t)signed_value, true, 10,
+                               flags, width, precision);
+                } else {
+                    PutInteger(&out, (uint64_t)signed_value, false, 10,
+                               flags, width, precision);
+                }
+            }
+            break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o': {
+                if (length == LENGTH_LONG || length == LENGTH_LONG_LONG
+                    || length == LENGTH_SIZE) {
+                    value = va_arg(args, uint64_t);
+                } else {
+                    value = va_arg(args, unsigned int);
+                    if (length == LENGTH_CHAR) {
+                        value = (unsigned char)value;
+                    } else if (length == LENGTH_SHORT) {
+                        value = (unsigned short)value;
+                    }
+                }
+
+                if (*format == 'X') {
+                    flags |= FORMAT_FLAG_UPPER;
+                }
+
+                PutInteger(&out,
+                           value,
+                           false,
+                           *format == 'u' ? 10 : (*format == 'o' ? 8 : 16),
+                           flags & ~(FORMAT_FLAG_PLUS | FORMAT_FLAG_SPACE),
+                           width,
+                           precision);
+            }
+            break;
+            case 'p': {
+                value = (uint64_t)va_arg(args, void *);
+                PutInteger(&out,
+                           value,
+                           false,
+                           16,
+                           (flags & ~(FORMAT_FLAG_PLUS | FORMAT_FLAG_SPACE))
+                           | FORMAT_FLAG_ALTERNATE,
+                           width,
+                           precision);
+            }
+            break;
+            case 'c': {
+                if (!(flags & FORMAT_FLAG_LEFT)) {
+                    PutPadding(&out, ' ', width - 1);
+                }
+                PutChar(&out, (char)va_arg(args, int));
+                if (flags & FORMAT_FLAG_LEFT) {
+                    PutPadding(&out, ' ', width - 1);
+                }
+            }
+            break;
+            case 's': {
+                const char *string = va_arg(args, const char *);
+                size_t string_length = 0;
+
+                if (string == NULL) {
+                    string = "(null)";
+                }
+
+                /* Precision is the maximum number of characters to print, so
+                 * we must not read past it. */
+                while ((precision < 0 || string_length < (size_t)precision)
+                       && string[string_length] != '\0') {
+                    string_length++;
+                }
+
+                if (!(flags & FORMAT_FLAG_LEFT)) {
+                    PutPadding(&out, ' ', width - (int)string_length);
+                }
+                PutString(&out, string, string_length);
+                if (flags & FORMAT_FLAG_LEFT) {
+                    PutPadding(&out, ' ', width - (int)string_length);
+                }
+            }
+            break;
+            case '%': {
+                PutChar(&out, '%');
+            }
+            break;
+            default: {
+                /* If specifier is not supported, we copy the whole
+                 * specification as is. */
+                if (*format == '\0') {
+                    PutString(&out, run, format - run);
+                    continue;
+                }
+                PutString(&out, run, format - run + 1);
+            }
+            break;
+        }
+
+        format++;
+    }
+
+    /* Terminate the string, truncate it if the buffer is full. */
+    if (out.size > 0) {
+        out.buffer[out.pos < out.size ? out.pos : out.size - 1] = '\0';
+    }
+
+    return (int)out.pos;
+}
+
+int snprintf(char *buffer, size_t size, const char *format, ...)
+{
+    int length = 0;
+    va_list args;
+
+    va_start(args, format);
+    length = vsnprintf(buffer, size, format, args);
+    va_end(args);
+
+    return length;
+}
+
+/* Private function ----------------------------------------------------------*/
+static inline void PutChar(FormatOutput *out, char c)
+{
+    /* Keep the last byte for the null character. */
+    if (out->pos + 1 < out->size) {
+        out->buffer[out->pos] = c;
+    }
+    out->pos++;
+}
+
+static void PutString(FormatOutput *out, const char *str, size_t length)
+{
+    size_t room = 0;
+
+    if (out->pos + 1 < out->size) {
+        room = out->size - 1 - out->pos;
+        if (room > length) {
+            room = length;
+        }
+
+        for (size_t i = 0; i < room; i++) {
+            out->buffer[out->pos + i] = str[i];
+        }
+    }
+
+    out->pos += length;
+}
+
+static void PutPadding(FormatOutput *out, char c, int count)
+{
+    while (count-- > 0) {
+        PutChar(out, c);
+    }
+}
+
+static char *ConvertDecimal(uint64_t value, char *end)
+{
+    unsigned int pair = 0;
+
+    while (value >= 100) {
+        pair = (unsigned int)(value % 100) * 2;
+        value /= 100;
+        *--end = s_digit_pairs[pair + 1];
+        *--end = s_digit_pairs[pair];
+    }
+
+    if (value >= 10) {
+        pair = (unsigned int)value * 2;
+        *--end = s_digit_pairs[pair + 1];
+        *--end = s_digit_pairs[pair];
+    } else {
+        *--end = (char)('0' + value);
+    }
+
+    return end;
+}
+
+static char *ConvertPowerOfTwo(uint64_t value,
+                               char *end,
+                               int shift,
+                               const char *digits_map)
+{
+    uint64_t mask = (1 << shift) - 1;
+
+    do {
+        *--end = digits_map[value & mask];
+        value >>= shift;
+    } while (value != 0);
+
+    return end;
+}
+
+static void PutInteger(FormatOutput *out,
+                       uint64_t value,
+                       bool negative,
+                       int base,
+                       int flags,
+                       int width,
+                       int precision)
+{
+    char digits_buffer[FORMAT_MAX_DIGITS];
+    char *end = digits_buffer + sizeof(digits_buffer);
+    char *digits = end;
+    char prefix[2] = {0};
+    int prefix_length = 0;
+    int digits_length = 0;
+    int zeros = 0;
+    int padding = 0;
+
+    /* 1. Digits. A zero value with zero precision prints no digit. */
+    if (!(value == 0 && precision == 0)) {
+        if (base == 10) {
+            digits = ConvertDecimal(value, end);
+        } else if (base == 16) {
+            digits = ConvertPowerOfTwo(value,
+                                       end,
+                                       4,
+                                       (flags & FORMAT_FLAG_UPPER)
+                                       ? s_upper_hex_digits
+                                       : s_lower_hex_digits);
+        } else {
+            digits = ConvertPowerOfTwo(value, end, 3, s_lower_hex_digits);
+        }
+    }
+    digits_length = end - digits;
+
+    /* 2. Sign and base prefix. */
+    if (negative) {
+        prefix[prefix_length++] = '-';
+    } else if (flags & FORMAT_FLAG_PLUS) {
+        prefix[prefix_length++] = '+';
+    } else if (flags & FORMAT_FLAG_SPACE) {
+        prefix[prefix_length++] = ' ';
+    }
+
+    if ((flags & FORMAT_FLAG_ALTERNATE) && value != 0) {
+        if (base == 16) {
+            prefix[prefix_length++] = '0';
+            prefix[prefix_length++] = (flags & FORMAT_FLAG_UPPER) ? 'X' : 'x';
+        } else if (base == 8 && precision <= digits_length) {
+            /* Octal alternate form only forces a leading zero. */
+            precision = digits_length + 1;
+        }
+    }
+
+    /* 3. Leading zeros required by precision or by the '0' flag. */
+    if (precision > digits_length) {
+        zeros = precision - digits_length;
+    } else if (precision < 0
+               && (flags & FORMAT_FLAG_ZERO)
+               && !(flags & FORMAT_FLAG_LEFT)
+               && width > prefix_length + digits_length) {
+        zeros = width - prefix_length - digits_length;
+    }
+
+    padding = width - prefix_length - zeros - digits_length;
+
+    /* 4. Output. */
+    if (!(flags & FORMAT_FLAG_LEFT)) {
+        PutPadding(out, ' ', padding);
+    }
+
+    PutString(out, prefix, prefix_length);
+    PutPadding(out, '0', zeros);
+    PutString(out, digits, digits_length);
+
+    if (flags & FORMAT_FLAG_LEFT) {
+        PutPadding(out, ' ', padding);
+    }
+}
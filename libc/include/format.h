@@ -0,0 +1,50 @@
+/**
+ * @file    format.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   String formatting engine shared by the kernel (printk) and the user
+ *          runtime (printf). Every output is bounded by the size of the
+ *          destination buffer, the result is always null terminated when the
+ *          buffer size is not zero.
+ *
+ *          Supported conversion specification:
+ *              %[flags][width][.precision][length]specifier
+ *              + flags     : '-' left justify, '0' zero pad, '+' and ' ' sign,
+ *                            '#' alternate form ("0x" prefix for hex).
+ *              + width     : decimal number or '*'.
+ *              + precision : decimal number or '*'. Minimum digits for
+ *                            integers, maximum characters for strings.
+ *              + length    : 'hh', 'h', 'l', 'll', 'z'.
+ *              + specifier : 'd', 'i', 'u', 'x', 'X', 'o', 'p', 'c', 's', '%'.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdarg.h>
+
+/* Public function prototype -------------------------------------------------*/
+
+/**
+ * @brief   Write formatted output to `buffer`, at most `size` bytes including
+ *          the terminating null character.
+ *
+ * @param[out] buffer       - Destination buffer, may be NULL if `size` is 0.
+ * @param[in]  size         - Size of the destination buffer.
+ * @param[in]  format       - Format string.
+ * @param[in]  args         - Variable argument list.
+ * @return    The number of characters that would have been written if `size`
+ *            had been large enough, not counting the terminating null
+ *            character. So the output was truncated if the return value is
+ *            greater than or equal to `size`.
+ */
+int vsnprintf(char *buffer, size_t size, const char *format, va_list args);
+
+/**
+ * @brief   Same as vsnprintf() but takes a variable number of arguments.
+ */
+int snprintf(char *buffer, size_t size, const char *format, ...);
@@ -2,9 +2,26 @@
 
 umount /mnt/d/
 mount -t vfat boot.img /mnt/d/
+cp usr/runtime/runtime.bin /mnt/d/
 cp usr/process4.bin /mnt/d/
 cp usr/process2.bin /mnt/d/
+cp usr/fmtbench.bin /mnt/d/
+cp usr/fibbench.bin /mnt/d/
+cp usr/corodemo.bin /mnt/d/
+cp usr/edftest.bin /mnt/d/
+cp usr/threaddemo.bin /mnt/d/
+cp usr/smpbench.bin /mnt/d/
+cp usr/clockbench.bin /mnt/d/
+cp usr/syscallbench.bin /mnt/d/
+cp usr/ringbench.bin /mnt/d/
 cp usr/cmd/ls.bin /mnt/d/
 cp usr/cmd/clr.bin /mnt/d/
+cp usr/cmd/top.bin /mnt/d/
+cp usr/cmd/zygote.bin /mnt/d/
+cp usr/cmd/ckpt.bin /mnt/d/
+
+# The kernel can't grow files, a checkpoint is written over this one: a header
+# frame and the 512 frames of the user window.
+dd if=/dev/zero of=/mnt/d/job.ckp bs=4096 count=513
 
 echo "Test reading file." > /mnt/d/test.txt
\ No newline at end of file
@@ -1,2 +1,2 @@
 #!/bin/bash
-qemu-system-x86_64 -cpu qemu64,pdpe1gb -hda boot.img
\ No newline at end of file
+qemu-system-x86_64 -cpu qemu64,pdpe1gb -smp 4 -hda boot.img
\ No newline at end of file
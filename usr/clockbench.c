@@ -0,0 +1,69 @@
+/**
+ * Clock benchmark: the cost of clock_gettime() from the vDSO data page
+ * against the same clock read with a system call, then the values the kernel
+ * publishes in the data pages.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <vdso.h>
+#include <syscall.h>
+
+/* Private define ------------------------------------------------------------*/
+#define ROUNDS              100000
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t Nanoseconds(const struct timespec *time);
+
+/* Public function -----------------------------------------------------------*/
+int main(void)
+{
+    const volatile struct vdso_data *data = vdso_data();
+    struct timespec start;
+    struct timespec end;
+    struct timespec time;
+    uint64_t calls = 0;
+
+    /* 1. Read the clock from the data page. */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ROUNDS; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &time);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("clockbench: vDSO clock_gettime %lu ns/call\n",
+           (Nanoseconds(&end) - Nanoseconds(&start)) / ROUNDS);
+
+    /* 2. Read the same clock through a system call. */
+    calls = data->system_calls;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ROUNDS; i++) {
+        syscall2((int64_t)SYS_CLOCK_GETTIME,
+                 (int64_t)CLOCK_MONOTONIC,
+                 (int64_t)&time);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("clockbench: syscall clock_gettime %lu ns/call, %lu system calls\n",
+           (Nanoseconds(&end) - Nanoseconds(&start)) / ROUNDS,
+           data->system_calls - calls);
+
+    /* 3. The rest of the data pages. */
+    clock_gettime(CLOCK_REALTIME, &time);
+    printf("clockbench: pid %d, real time %lu s, %u processes on %u CPUs, "
+           "%lu context switches\n",
+           getpid(),
+           (uint64_t)time.tv_sec,
+           data->process_count,
+           data->cpu_count,
+           data->context_switches);
+
+    return 0;
+}
+
+/* Private function ----------------------------------------------------------*/
+static uint64_t Nanoseconds(const struct timespec *time)
+{
+    return time->tv_sec * 1000000000ULL + time->tv_nsec;
+}
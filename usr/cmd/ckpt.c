@@ -0,0 +1,86 @@
+/**
+ * ckpt: save a process to a checkpoint file, and restart it from there later
+ * without its initialization. `ckpt <pid> <file>` saves the process `pid`,
+ * `ckpt -r <file>` restores it as a child and waits for it. The file must
+ * exist and be large enough, mount.sh makes job.ckp for the whole user
+ * window. A program can also save itself with checkpoint(0, file), which
+ * returns CHECKPOINT_RESTORED once it is restored.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* Private function prototypes -----------------------------------------------*/
+static const char *GetErrorText(int error);
+
+/* Public function -----------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+    int status = 0;
+    int pid = 0;
+
+    if (argc != 3) {
+        printf("Usage: ckpt <pid> <file> | ckpt -r <file>\n");
+        return 1;
+    }
+
+    if (strncmp(argv[1], "-r", 3) == 0) {
+        pid = restore(argv[2]);
+        if (pid < 0) {
+            printf("ckpt: %s: %s\n", argv[2], GetErrorText(pid));
+            return 1;
+        }
+
+        waitpid(pid, &status, 0);
+        return status;
+    }
+
+    for (const char *digit = argv[1]; *digit >= '0' && *digit <= '9';
+         digit++) {
+        pid = pid * 10 + (*digit - '0');
+    }
+
+    /* 0 would save ckpt itself. */
+    if (pid == 0) {
+        printf("ckpt: %s: invalid pid\n", argv[1]);
+        return 1;
+    }
+
+    status = checkpoint(pid, argv[2]);
+    if (status < 0) {
+        printf("ckpt: %d: %s\n", pid, GetErrorText(status));
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Private function ----------------------------------------------------------*/
+static const char *GetErrorText(int error)
+{
+    switch (error) {
+    case -ESRCH:
+        return "no such process";
+    case -EINVAL:
+        return "threads, rings, or not a program";
+    case -EBUSY:
+        return "process is running";
+    case -EMFILE:
+        return "too many open files";
+    case -ENOENT:
+        return "no such file, or the program or a file is gone";
+    case -ETXTBSY:
+        return "file is in use";
+    case -ENOSPC:
+        return "file is too small";
+    case -ENOEXEC:
+        return "not a checkpoint, or another runtime";
+    case -ESTALE:
+        return "program changed since the checkpoint";
+    case -ENOMEM:
+        return "out of memory";
+    default:
+        return "error";
+    }
+}
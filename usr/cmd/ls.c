@@ -63,7 +63,7 @@ int main(void) {
         GetRelativeFileName(&buffer[i], tmp);
         toLowers(tmp);
 
-        printf("%s %d %d:%d %d/%d/%d %s\n",
+        printf("%s %u %d:%d %d/%d/%d %s\n",
                 buffer[i].attributes & FILE_ATTR_DIRECTORY ? "d":"f",
                 buffer[i].file_size,
                 hours,
@@ -0,0 +1,184 @@
+/**
+ * top: list the processes and threads with the CPU share they used over the
+ * last interval, the busiest first, with their user, system and ready-queue
+ * wait times, their context switches and system calls. The list is refreshed
+ * every second until a key is pressed, or `top <count>` refreshes it `count`
+ * times.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <resource.h>
+#include <vdso.h>
+
+/* Private define ------------------------------------------------------------*/
+#define MAXIMUM_PROCESSES       64
+#define REFRESH_INTERVAL_MS     1000
+#define NANOSECONDS_PER_MS      1000000ULL
+
+/* Private variable ----------------------------------------------------------*/
+static struct procinfo s_procs[MAXIMUM_PROCESSES];
+static struct procinfo s_prev_procs[MAXIMUM_PROCESSES];
+static int s_prev_count = 0;
+
+/* Share of the interval of each entry of s_procs, in tenths of a percent. */
+static uint32_t s_share[MAXIMUM_PROCESSES];
+
+/* Entries of s_procs, the busiest first. */
+static int s_order[MAXIMUM_PROCESSES];
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t GetNanoseconds(void);
+static uint64_t GetPrevCPUTime(int32_t pid);
+static void SortByShare(int count);
+static void PrintProcesses(int count, uint64_t interval);
+static char GetStateLetter(uint8_t state);
+
+/* Public function -----------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+    struct pollfd key = {.fd = 0, .events = POLLIN};
+    uint64_t last = GetNanoseconds();
+    int refreshes = -1;
+    int count = 0;
+
+    if (argc > 1) {
+        refreshes = 0;
+        for (const char *digit = argv[1]; *digit >= '0' && *digit <= '9';
+             digit++) {
+            refreshes = refreshes * 10 + (*digit - '0');
+        }
+    }
+
+    /* The first list only gives the times to compare with. */
+    s_prev_count = getprocs(s_prev_procs, MAXIMUM_PROCESSES);
+
+    while (refreshes != 0) {
+        uint64_t now = 0;
+
+        if (poll(&key, 1, REFRESH_INTERVAL_MS) > 0) {
+            char c = 0;
+
+            read(0, &c, 1);
+            break;
+        }
+
+        now = GetNanoseconds();
+        count = getprocs(s_procs, MAXIMUM_PROCESSES);
+
+        for (int i = 0; i < count; i++) {
+            uint64_t used = s_procs[i].user_time + s_procs[i].system_time
+                            - GetPrevCPUTime(s_procs[i].pid);
+
+            s_share[i] = used * 1000 / (now - last);
+        }
+
+        SortByShare(count);
+        clrscr();
+        PrintProcesses(count, now - last);
+
+        for (int i = 0; i < count; i++) {
+            s_prev_procs[i] = s_procs[i];
+        }
+        s_prev_count = count;
+        last = now;
+
+        if (refreshes > 0) {
+            refreshes--;
+        }
+    }
+
+    return 0;
+}
+
+/* Private function ----------------------------------------------------------*/
+static uint64_t GetNanoseconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000 * NANOSECONDS_PER_MS + now.tv_nsec;
+}
+
+static uint64_t GetPrevCPUTime(int32_t pid)
+{
+    /* A process which is new since the last list used its whole time in the
+     * interval. */
+    for (int i = 0; i < s_prev_count; i++) {
+        if (s_prev_procs[i].pid == pid) {
+            return s_prev_procs[i].user_time + s_prev_procs[i].system_time;
+        }
+    }
+
+    return 0;
+}
+
+static void SortByShare(int count)
+{
+    /* Insertion sort, the list is short and mostly sorted from the last
+     * refresh. */
+    for (int i = 0; i < count; i++) {
+        int j = i;
+
+        while (j > 0 && s_share[s_order[j - 1]] < s_share[i]) {
+            s_order[j] = s_order[j - 1];
+            j--;
+        }
+        s_order[j] = i;
+    }
+}
+
+static void PrintProcesses(int count, uint64_t interval)
+{
+    printf("%d processes, %u CPUs, %u ms interval, times in ms\n",
+           count,
+           vdso_data()->cpu_count,
+           (unsigned int)(interval / NANOSECONDS_PER_MS));
+    printf("  PID  PPID S CPU  %%CPU   USER    SYS   WAIT  VCSW IVCSW SYSCALLS"
+           " NAME\n");
+
+    for (int i = 0; i < count; i++) {
+        struct procinfo *proc = &s_procs[s_order[i]];
+        uint32_t share = s_share[s_order[i]];
+        const char *name = proc->name;
+
+        if (proc->flags & PROC_KERNEL_THREAD) {
+            name = "[kernel]";
+        } else if (name[0] == '\0') {
+            name = "init";
+        }
+
+        /* Threads have the name of their process. */
+        printf("%5d %5d %c %3u %3u.%u %6lu %6lu %6lu %5lu %5lu %8lu %s\n",
+               proc->pid,
+               proc->parent_pid,
+               GetStateLetter(proc->state),
+               proc->cpu,
+               share / 10,
+               share % 10,
+               proc->user_time / NANOSECONDS_PER_MS,
+               proc->system_time / NANOSECONDS_PER_MS,
+               proc->wait_time / NANOSECONDS_PER_MS,
+               proc->voluntary_switches,
+               proc->involuntary_switches,
+               proc->system_calls,
+               name);
+    }
+}
+
+static char GetStateLetter(uint8_t state)
+{
+    switch (state) {
+    case PROC_STATE_READY:
+    case PROC_STATE_RUNNING:
+        return 'R';
+    case PROC_STATE_SLEEPING:
+        return 'S';
+    case PROC_STATE_ZOMBIE:
+        return 'Z';
+    default:
+        return '-';
+    }
+}
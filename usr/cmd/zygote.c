@@ -0,0 +1,60 @@
+/**
+ * zygote: keep warm templates of programs, spawn() then clones a program from
+ * its template instead of loading it from the disk and running its global
+ * constructors again. `zygote <program>...` builds the templates of the
+ * programs, `zygote -d <program>...` drops them, and `zygote -d` drops every
+ * template. Compare with the `time` builtin of the shell.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* Private function prototypes -----------------------------------------------*/
+static const char *GetErrorText(int error);
+
+/* Public function -----------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+    int drop = argc > 1 && strncmp(argv[1], "-d", 3) == 0;
+    int first = drop ? 2 : 1;
+    int failures = 0;
+
+    if (argc < 2) {
+        printf("Usage: zygote <program>... | zygote -d [program]...\n");
+        return 1;
+    }
+
+    if (drop && argc == 2) {
+        template_drop(NULL);
+        return 0;
+    }
+
+    for (int i = first; i < argc; i++) {
+        int status = drop ? template_drop(argv[i]) : template_create(argv[i]);
+
+        if (status < 0) {
+            printf("zygote: %s: %s\n", argv[i], GetErrorText(status));
+            failures++;
+        }
+    }
+
+    return failures != 0;
+}
+
+/* Private function ----------------------------------------------------------*/
+static const char *GetErrorText(int error)
+{
+    switch (error) {
+    case -ENOENT:
+        return "no such program, or no template";
+    case -ENOEXEC:
+        return "not a program, or it exited before main";
+    case -ENOMEM:
+        return "out of memory";
+    case -ENAMETOOLONG:
+        return "name too long";
+    default:
+        return "error";
+    }
+}
@@ -0,0 +1,82 @@
+/**
+ * Coroutine demo: a ticker sleeping between its lines, an echo task reading
+ * the keyboard and a generator, all multiplexed by the coroutine executor in
+ * one process. Press keys to see them echoed while the ticker keeps running,
+ * 'q' stops the demo.
+ */
+#include <coro.hh>
+
+extern "C"
+{
+#include <stdio.h>
+#include <unistd.h>
+}
+
+/* Private variable ----------------------------------------------------------*/
+static bool s_quit = false;
+
+/* Private function ----------------------------------------------------------*/
+static coro::generator<int> Fibonacci(int count)
+{
+    int a = 0;
+    int b = 1;
+
+    for (int i = 0; i < count; i++) {
+        co_yield a;
+
+        int next = a + b;
+        a = b;
+        b = next;
+    }
+}
+
+static coro::task<int> Sum(int count)
+{
+    int sum = 0;
+
+    for (int value : Fibonacci(count)) {
+        sum += value;
+    }
+
+    co_return sum;
+}
+
+static coro::task<void> Ticker(uint32_t period)
+{
+    unsigned int start = uptime();
+    int tick = 0;
+
+    while (!s_quit) {
+        co_await coro::sleep(period);
+        printf("tick %d at %u ms\n", ++tick, uptime() - start);
+    }
+}
+
+static coro::task<void> Echo()
+{
+    printf("sum of 10 fibonacci numbers: %d\n", co_await Sum(10));
+
+    while (!s_quit) {
+        char key = co_await coro::read_key();
+
+        if (key == 'q') {
+            s_quit = true;
+        } else {
+            printf("key '%c'\n", key);
+        }
+    }
+}
+
+/* Public function -----------------------------------------------------------*/
+int main(void)
+{
+    coro::executor &executor = coro::executor::instance();
+
+    executor.spawn(Ticker(500));
+    executor.spawn(Echo());
+    executor.run();
+
+    printf("corodemo: done\n");
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+/**
+ * Earliest deadline first test: a real-time process runs a 10ms job every
+ * 100ms (30ms budget, deadline at the end of the period) while background
+ * processes keep the CPU busy, and reports the number of missed deadlines.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define BACKGROUND_PROCESSES    3
+#define JOB_RUNTIME_MS          30
+#define JOB_PERIOD_MS           100
+#define JOB_DEADLINE_MS         100
+#define JOB_WORK_MS             10
+#define JOBS                    50
+#define CALIBRATION_MS          200
+#define CALIBRATION_CHUNK       100000
+
+/* Private function prototypes -----------------------------------------------*/
+static void Work(uint64_t iterations);
+static uint64_t CalibrateIterationsPerMillisecond(void);
+static void Background(unsigned int duration_ms);
+
+/* Public function -----------------------------------------------------------*/
+int main(void)
+{
+    int pids[BACKGROUND_PROCESSES] = {0};
+    uint64_t iterations_per_ms = 0;
+    unsigned int start = 0;
+    int status = 0;
+    int misses = 0;
+
+    /* 1. Measure the speed of the work loop before the CPU is loaded. */
+    iterations_per_ms = CalibrateIterationsPerMillisecond();
+
+    /* 2. Saturate the CPU with normal processes for the whole test. */
+    for (int i = 0; i < BACKGROUND_PROCESSES; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            Background(JOBS * JOB_PERIOD_MS + 500);
+            exit(0);
+        }
+    }
+
+    /* 3. Run the periodic jobs as a real-time process. */
+    status = sched_deadline(JOB_RUNTIME_MS, JOB_PERIOD_MS, JOB_DEADLINE_MS);
+    if (status < 0) {
+        printf("edftest: sched_deadline failed: %d\n", status);
+        return 0;
+    }
+
+    start = uptime();
+    for (int i = 0; i < JOBS; i++) {
+        Work(JOB_WORK_MS * iterations_per_ms);
+        sched_yield();
+    }
+
+    misses = sched_misses();
+    sched_deadline(0, 0, 0);
+
+    printf("edftest: %d jobs in %u ms with %d background processes, "
+           "%d deadline misses\n",
+           JOBS,
+           uptime() - start,
+           BACKGROUND_PROCESSES,
+           misses);
+
+    for (int i = 0; i < BACKGROUND_PROCESSES; i++) {
+        wait(pids[i]);
+    }
+
+    return 0;
+}
+
+/* Private function ----------------------------------------------------------*/
+static void Work(uint64_t iterations)
+{
+    volatile uint64_t value = 0;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        value += i;
+    }
+}
+
+static uint64_t CalibrateIterationsPerMillisecond(void)
+{
+    uint64_t iterations = 0;
+    unsigned int start = uptime();
+    unsigned int elapsed = 0;
+
+    /* Start at a tick boundary. */
+    while (uptime() == start) {
+    }
+
+    start = uptime();
+    while (elapsed < CALIBRATION_MS) {
+        Work(CALIBRATION_CHUNK);
+        iterations += CALIBRATION_CHUNK;
+        elapsed = uptime() - start;
+    }
+
+    return iterations / elapsed;
+}
+
+static void Background(unsigned int duration_ms)
+{
+    unsigned int end = uptime() + duration_ms;
+
+    while (uptime() < end) {
+        Work(CALIBRATION_CHUNK);
+    }
+}
@@ -0,0 +1,75 @@
+/**
+ * Fiber switch latency benchmark: two fibers ping-pong through fiber_yield(),
+ * every yield is one switch. Also measures the cost of fiber_create() plus
+ * fiber_join() for a fiber that returns immediately.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <fiber.h>
+
+/* Private define ------------------------------------------------------------*/
+#define PING_PONG_ROUNDS    100000
+#define SPAWN_ROUNDS        10000
+
+/* Private function prototypes -----------------------------------------------*/
+static inline uint64_t ReadTSC(void);
+static void PingPong(void *arg);
+static void Nothing(void *arg);
+
+/* Public function -----------------------------------------------------------*/
+int main(void)
+{
+    uint64_t start = 0;
+    uint64_t cycles = 0;
+    int ping = 0;
+    int pong = 0;
+
+    /* 1. Switch latency. */
+    ping = fiber_create(PingPong, (void *)PING_PONG_ROUNDS);
+    pong = fiber_create(PingPong, (void *)PING_PONG_ROUNDS);
+
+    start = ReadTSC();
+    fiber_join(ping);
+    fiber_join(pong);
+    cycles = ReadTSC() - start;
+
+    printf("fibbench: %d switches, %lu cycles/switch\n",
+           2 * PING_PONG_ROUNDS,
+           cycles / (2 * PING_PONG_ROUNDS));
+
+    /* 2. Create + join latency. */
+    start = ReadTSC();
+    for (int i = 0; i < SPAWN_ROUNDS; i++) {
+        fiber_join(fiber_create(Nothing, NULL));
+    }
+    cycles = ReadTSC() - start;
+
+    printf("fibbench: %d create+join, %lu cycles/fiber\n",
+           SPAWN_ROUNDS,
+           cycles / SPAWN_ROUNDS);
+
+    return 0;
+}
+
+/* Private function ----------------------------------------------------------*/
+static inline uint64_t ReadTSC(void)
+{
+    uint32_t low = 0;
+    uint32_t high = 0;
+
+    __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static void PingPong(void *arg)
+{
+    uint64_t rounds = (uint64_t)arg;
+
+    for (uint64_t i = 0; i < rounds; i++) {
+        fiber_yield();
+    }
+}
+
+static void Nothing(void *arg)
+{
+}
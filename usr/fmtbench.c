@@ -0,0 +1,166 @@
+/**
+ * Formatting throughput benchmark: the shared vsnprintf() in libc against the
+ * old per-digit division routines that used to be copied in printk.c and
+ * stdio.c. Both sides format the same values, the cost is measured in TSC
+ * cycles per formatted number.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <format.h>
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_ITERATIONS    20000
+#define BENCH_BUFFER_SIZE   64
+
+/* Private function prototypes -----------------------------------------------*/
+static inline uint64_t ReadTSC(void);
+static int LegacyWriteHexToBuffer(char *buffer, int pos, uint64_t integer);
+static int LegacyWriteUDecimalToBuffer(char *buffer, int pos, uint64_t integer);
+static int LegacyWriteDecimalToBuffer(char *buffer, int pos, int64_t integer);
+static uint64_t NextValue(uint64_t value);
+
+/* Public function -----------------------------------------------------------*/
+int main(void)
+{
+    char buffer[BENCH_BUFFER_SIZE];
+    uint64_t value = 1;
+    uint64_t start = 0;
+    uint64_t legacy_cycles[3] = {0};
+    uint64_t new_cycles[3] = {0};
+    uint64_t checksum = 0;
+    const char *names[3] = {"decimal", "unsigned", "hex"};
+
+    /* 1. Old routines. */
+    value = 1;
+    start = ReadTSC();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        checksum += LegacyWriteDecimalToBuffer(buffer, 0, -(int64_t)value);
+        value = NextValue(value);
+    }
+    legacy_cycles[0] = ReadTSC() - start;
+
+    value = 1;
+    start = ReadTSC();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        checksum += LegacyWriteUDecimalToBuffer(buffer, 0, value);
+        value = NextValue(value);
+    }
+    legacy_cycles[1] = ReadTSC() - start;
+
+    value = 1;
+    start = ReadTSC();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        checksum += LegacyWriteHexToBuffer(buffer, 0, value);
+        value = NextValue(value);
+    }
+    legacy_cycles[2] = ReadTSC() - start;
+
+    /* 2. Shared vsnprintf(). */
+    value = 1;
+    start = ReadTSC();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        checksum += snprintf(buffer, sizeof(buffer), "%ld", -(int64_t)value);
+        value = NextValue(value);
+    }
+    new_cycles[0] = ReadTSC() - start;
+
+    value = 1;
+    start = ReadTSC();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        checksum += snprintf(buffer, sizeof(buffer), "%lu", value);
+        value = NextValue(value);
+    }
+    new_cycles[1] = ReadTSC() - start;
+
+    value = 1;
+    start = ReadTSC();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        checksum += snprintf(buffer, sizeof(buffer), "%#lx", value);
+        value = NextValue(value);
+    }
+    new_cycles[2] = ReadTSC() - start;
+
+    printf("fmtbench: %d numbers per case (checksum %lu)\n",
+           BENCH_ITERATIONS,
+           checksum);
+
+    for (int i = 0; i < 3; i++) {
+        printf("%-8s old: %6lu cycles/op   new: %6lu cycles/op\n",
+               names[i],
+               legacy_cycles[i] / BENCH_ITERATIONS,
+               new_cycles[i] / BENCH_ITERATIONS);
+    }
+
+    return 0;
+}
+
+/* Private function ----------------------------------------------------------*/
+static inline uint64_t ReadTSC(void)
+{
+    uint32_t low = 0;
+    uint32_t high = 0;
+
+    __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static uint64_t NextValue(uint64_t value)
+{
+    /* Spread the values over every digit count. */
+    value = value * 6364136223846793005ULL + 1442695040888963407ULL;
+    return value >> (value & 0x3F);
+}
+
+/* The routines below are the old implementation, kept only as a baseline. */
+static int LegacyWriteHexToBuffer(char *buffer, int pos, uint64_t integer)
+{
+    char digits_buffer[25] = {0};
+    char digits_map[16] = "0123456789ABCDEF";
+    int size = 0;
+
+    do {
+        digits_buffer[size++] = digits_map[integer % 16];
+        integer /= 16;
+    } while (integer != 0);
+
+    buffer[pos++] = '0';
+    buffer[pos++] = 'x';
+
+    for (int i = size - 1; i >= 0; i--) {
+        buffer[pos++] = digits_buffer[i];
+    }
+
+    return size + 2;
+}
+
+static int LegacyWriteUDecimalToBuffer(char *buffer, int pos, uint64_t integer)
+{
+    char digits_buffer[25] = {0};
+    char digits_map[10] = "0123456789";
+    int size = 0;
+
+    do {
+        digits_buffer[size++] = digits_map[integer % 10];
+        integer /= 10;
+    } while (integer != 0);
+
+    for (int i = size - 1; i >= 0; i--) {
+        buffer[pos++] = digits_buffer[i];
+    }
+
+    return size;
+}
+
+static int LegacyWriteDecimalToBuffer(char *buffer, int pos, int64_t integer)
+{
+    int size = 0;
+
+    if (integer < 0) {
+        integer = -integer;
+        buffer[pos++] = '-';
+        size = 1;
+    }
+
+    size += LegacyWriteUDecimalToBuffer(buffer, pos, (uint64_t)integer);
+    return size;
+}
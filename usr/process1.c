@@ -10,7 +10,7 @@ int main(void)
 
     } else {
         printf("this is old process, we fork successfully new process: %d\n",
-            (int64_t)pid);
+            pid);
         printf("waiting for child exit. \n");
         wait(pid);
     }
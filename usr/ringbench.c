@@ -0,0 +1,134 @@
+/**
+ * Ring benchmark: small reads of a file with one system call each, against
+ * the same reads submitted in batches through the rings, then submitted with
+ * no system call to the polling kernel, and a timeout. The system calls are
+ * counted from the vDSO data page.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <vdso.h>
+#include <ring.h>
+
+/* Private define ------------------------------------------------------------*/
+#define ROUNDS              100
+#define BATCH               16
+#define TIMEOUT_NS          10000000        /* 10 ms. */
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t Nanoseconds(void);
+static void Report(const char *name, uint64_t start_ns, uint64_t start_calls);
+static void QueueReads(int fd, char *buffer);
+static int ReapCompletions(int count);
+
+/* Public function -----------------------------------------------------------*/
+int main(void)
+{
+    char buffer[BATCH];
+    uint64_t start_ns = 0;
+    uint64_t start_calls = 0;
+    struct ring_sqe *sqe = NULL;
+    struct ring_cqe *cqe = NULL;
+    int fd = open("test.txt");
+
+    if (fd < 0 || ring_setup(RING_SETUP_POLL) < 0) {
+        printf("ringbench: setup failed\n");
+        return 1;
+    }
+
+    /* 1. One system call per read. */
+    start_ns = Nanoseconds();
+    start_calls = vdso_data()->system_calls;
+    for (int i = 0; i < ROUNDS; i++) {
+        for (int j = 0; j < BATCH; j++) {
+            read(fd, &buffer[j], 1);
+        }
+    }
+    Report("read()", start_ns, start_calls);
+
+    /* 2. One system call per batch, which waits for the batch. */
+    start_ns = Nanoseconds();
+    start_calls = vdso_data()->system_calls;
+    for (int i = 0; i < ROUNDS; i++) {
+        QueueReads(fd, buffer);
+        ring_submit(BATCH);
+        ReapCompletions(BATCH);
+    }
+    Report("ring", start_ns, start_calls);
+
+    /* 3. The polling kernel takes the batches, the completions are polled
+     *    too. */
+    start_ns = Nanoseconds();
+    start_calls = vdso_data()->system_calls;
+    for (int i = 0; i < ROUNDS; i++) {
+        QueueReads(fd, buffer);
+        ring_submit(0);
+        for (int done = 0; done < BATCH;) {
+            done += ReapCompletions(BATCH - done);
+        }
+    }
+    Report("ring poll", start_ns, start_calls);
+
+    /* 4. A timeout completes while the process waits. */
+    start_ns = Nanoseconds();
+    sqe = ring_get_sqe();
+    sqe->opcode = RING_OP_TIMEOUT;
+    sqe->addr = TIMEOUT_NS;
+    ring_submit(1);
+    cqe = ring_peek_cqe();
+    if (cqe != NULL) {
+        printf("ringbench: timeout %d (-ETIME) after %lu us\n",
+               cqe->result,
+               (Nanoseconds() - start_ns) / 1000);
+        ring_cqe_seen();
+    }
+
+    close(fd);
+    return 0;
+}
+
+/* Private function ----------------------------------------------------------*/
+static uint64_t Nanoseconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void Report(const char *name, uint64_t start_ns, uint64_t start_calls)
+{
+    uint64_t ns = Nanoseconds() - start_ns;
+    uint64_t calls = vdso_data()->system_calls - start_calls;
+
+    printf("ringbench: %s %lu ns/op, %lu system calls for %d reads\n",
+           name,
+           ns / (ROUNDS * BATCH),
+           calls,
+           ROUNDS * BATCH);
+}
+
+static void QueueReads(int fd, char *buffer)
+{
+    for (int j = 0; j < BATCH; j++) {
+        struct ring_sqe *sqe = ring_get_sqe();
+
+        sqe->opcode = RING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)&buffer[j];
+        sqe->length = 1;
+    }
+}
+
+static int ReapCompletions(int count)
+{
+    int reaped = 0;
+
+    while (reaped < count && ring_peek_cqe() != NULL) {
+        ring_cqe_seen();
+        reaped++;
+    }
+
+    return reaped;
+}
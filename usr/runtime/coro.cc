@@ -0,0 +1,341 @@
+#include <coro.hh>
+
+extern "C"
+{
+#include <poll.h>
+#include <unistd.h>
+}
+
+/* Private define ------------------------------------------------------------*/
+namespace
+{
+    constexpr int k_standard_input = 0;
+
+    /* Frame size classes are 64, 128, ..., 4096 bytes. */
+    constexpr std::size_t k_min_frame_shift = 6;
+    constexpr int k_frame_classes = 7;
+    constexpr std::size_t k_frame_arena_size = 128 * 1024;
+
+    struct free_frame
+    {
+        free_frame *next;
+    };
+
+    alignas(16) char s_frame_arena[k_frame_arena_size];
+    std::size_t s_frame_arena_used = 0;
+    free_frame *s_free_frames[k_frame_classes] = {};
+
+    coro::executor s_executor;
+
+    int frame_class(std::size_t size)
+    {
+        int index = 0;
+
+        while (index < k_frame_classes
+               && ((std::size_t)1 << (index + k_min_frame_shift)) < size) {
+            index++;
+        }
+
+        return index;
+    }
+
+    /* Compare timestamps of the millisecond clock, which wraps after about
+     * 49 days. */
+    bool is_expired(uint32_t deadline, uint32_t now)
+    {
+        return (int32_t)(deadline - now) <= 0;
+    }
+}
+
+namespace coro
+{
+    namespace detail
+    {
+        /* Wrapper of the tasks given to executor::spawn(). Nobody awaits it,
+         * so it destroys its own frame when it finishes. */
+        struct root_task
+        {
+            struct promise_type : frame_allocator
+            {
+                root_task get_return_object() noexcept
+                {
+                    return {std::coroutine_handle<promise_type>::from_promise(
+                        *this)};
+                }
+
+                static root_task
+                get_return_object_on_allocation_failure() noexcept
+                {
+                    return {nullptr};
+                }
+
+                std::suspend_always initial_suspend() const noexcept
+                {
+                    return {};
+                }
+
+                std::suspend_never final_suspend() const noexcept
+                {
+                    s_executor.m_live_roots--;
+                    return {};
+                }
+
+                void return_void() noexcept {}
+                void unhandled_exception() noexcept {}
+            };
+
+            std::coroutine_handle<> handle;
+        };
+
+        root_task run_root(task<void> work)
+        {
+            co_await work;
+        }
+    }
+
+    /* Frame pool --------------------------------------------------------*/
+    void *frame_pool::allocate(std::size_t size) noexcept
+    {
+        int index = frame_class(size);
+        std::size_t class_size = (std::size_t)1 << (index + k_min_frame_shift);
+        free_frame *frame = nullptr;
+
+        if (index == k_frame_classes) {
+            return nullptr;
+        }
+
+        frame = s_free_frames[index];
+        if (frame != nullptr) {
+            s_free_frames[index] = frame->next;
+            return frame;
+        }
+
+        if (s_frame_arena_used + class_size > k_frame_arena_size) {
+            return nullptr;
+        }
+
+        frame = (free_frame *)&s_frame_arena[s_frame_arena_used];
+        s_frame_arena_used += class_size;
+
+        return frame;
+    }
+
+    void frame_pool::deallocate(void *ptr, std::size_t size) noexcept
+    {
+        int index = frame_class(size);
+        free_frame *frame = (free_frame *)ptr;
+
+        if (ptr == nullptr) {
+            return;
+        }
+
+        frame->next = s_free_frames[index];
+        s_free_frames[index] = frame;
+    }
+
+    /* Awaitables --------------------------------------------------------*/
+    sleep_awaiter sleep(uint32_t milliseconds) noexcept
+    {
+        return sleep_awaiter{uptime() + milliseconds, nullptr, nullptr};
+    }
+
+    bool sleep_awaiter::await_ready() const noexcept
+    {
+        return is_expired(deadline, uptime());
+    }
+
+    void sleep_awaiter::await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle = awaiting;
+        s_executor.add_timer(this);
+    }
+
+    read_awaiter read(int fd, char *buffer, size_t count) noexcept
+    {
+        return read_awaiter{fd, buffer, count, 0, 0, 0, nullptr, nullptr};
+    }
+
+    read_key_awaiter read_key() noexcept
+    {
+        return read_key_awaiter{
+            {k_standard_input, nullptr, 1, 0, 0, 0, nullptr, nullptr}};
+    }
+
+    bool read_awaiter::poll_input() noexcept
+    {
+        struct pollfd pfd = {k_standard_input, POLLIN, 0};
+        char *target = buffer != nullptr ? buffer : &key;
+        int status = 0;
+
+        /* Only take what is buffered, so the read below never sleeps. */
+        while (done < count && poll(&pfd, 1, 0) > 0) {
+            status = ::read(fd, &target[done], 1);
+            if (status < 0) {
+                error = status;
+                return true;
+            }
+            done++;
+        }
+
+        return done == count;
+    }
+
+    bool read_awaiter::await_ready() noexcept
+    {
+        int status = 0;
+
+        if (fd != k_standard_input) {
+            status = ::read(fd, buffer != nullptr ? buffer : &key, count);
+            if (status < 0) {
+                error = status;
+            } else {
+                done = status;
+            }
+            return true;
+        }
+
+        return count == 0 || poll_input();
+    }
+
+    void read_awaiter::await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle = awaiting;
+        s_executor.add_input_waiter(this);
+    }
+
+    /* Executor ----------------------------------------------------------*/
+    executor &executor::instance() noexcept
+    {
+        return s_executor;
+    }
+
+    void executor::spawn(task<void> &&work) noexcept
+    {
+        detail::root_task root = detail::run_root(coro::move(work));
+
+        /* Without a free frame, the work is dropped like a failed fork. */
+        if (root.handle) {
+            m_live_roots++;
+            schedule(root.handle);
+        }
+    }
+
+    void executor::schedule(std::coroutine_handle<> handle) noexcept
+    {
+        if (m_ready_count == k_max_ready) {
+            /* The ring is full, so run it now rather than losing it. */
+            handle.resume();
+            return;
+        }
+
+        m_ready[(m_ready_head + m_ready_count) % k_max_ready] = handle;
+        m_ready_count++;
+    }
+
+    void executor::add_timer(sleep_awaiter *timer) noexcept
+    {
+        sleep_awaiter **link = &m_timers;
+
+        /* Keep the list sorted, timers of the same deadline in FIFO order. */
+        while (*link != nullptr
+               && (int32_t)((*link)->deadline - timer->deadline) <= 0) {
+            link = &(*link)->next;
+        }
+
+        timer->next = *link;
+        *link = timer;
+    }
+
+    void executor::add_input_waiter(read_awaiter *waiter) noexcept
+    {
+        waiter->next = nullptr;
+
+        if (m_input_head == nullptr) {
+            m_input_head = waiter;
+        } else {
+            m_input_tail->next = waiter;
+        }
+
+        m_input_tail = waiter;
+    }
+
+    bool executor::expire_timers() noexcept
+    {
+        uint32_t now = 0;
+        bool expired = false;
+
+        if (m_timers == nullptr) {
+            return false;
+        }
+
+        now = uptime();
+        while (m_timers != nullptr && is_expired(m_timers->deadline, now)) {
+            sleep_awaiter *timer = m_timers;
+
+            m_timers = timer->next;
+            schedule(timer->handle);
+            expired = true;
+        }
+
+        return expired;
+    }
+
+    bool executor::serve_input() noexcept
+    {
+        bool served = false;
+
+        /* Characters go to the oldest reader until its request is complete. */
+        while (m_input_head != nullptr && m_input_head->poll_input()) {
+            read_awaiter *waiter = m_input_head;
+
+            m_input_head = waiter->next;
+            if (m_input_head == nullptr) {
+                m_input_tail = nullptr;
+            }
+
+            schedule(waiter->handle);
+            served = true;
+        }
+
+        return served;
+    }
+
+    void executor::run() noexcept
+    {
+        struct pollfd pfd = {k_standard_input, POLLIN, 0};
+        int timeout = 0;
+
+        while (true) {
+            while (m_ready_count > 0) {
+                std::coroutine_handle<> handle = m_ready[m_ready_head];
+
+                m_ready_head = (m_ready_head + 1) % k_max_ready;
+                m_ready_count--;
+                handle.resume();
+            }
+
+            if (expire_timers() || serve_input()) {
+                continue;
+            }
+
+            if (m_live_roots == 0
+                || (m_timers == nullptr && m_input_head == nullptr)) {
+                /* Every coroutine has finished, or the remaining ones wait for
+                 * each other and can never be resumed. */
+                break;
+            }
+
+            /* Every coroutine waits, park the process in one system call
+             * until the nearest timer expires or a key is pressed. */
+            timeout = -1;
+            if (m_timers != nullptr) {
+                timeout = (int32_t)(m_timers->deadline - uptime());
+                if (timeout < 0) {
+                    timeout = 0;
+                }
+            }
+
+            poll(&pfd, m_input_head != nullptr ? 1 : 0, timeout);
+        }
+    }
+}
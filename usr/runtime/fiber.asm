@@ -0,0 +1,37 @@
+section .text
+global FiberSwitch
+global FiberStart
+extern fiber_exit
+
+; void FiberSwitch(uint64_t *old, uint64_t new)
+; Same as the kernel ContextSwitch: save callee-saved registers of the current
+; fiber on its stack, save the stack pointer to `old`, and resume the fiber
+; whose stack pointer is `new`.
+FiberSwitch:
+    push rbx
+    push rbp
+    push r12
+    push r13
+    push r14
+    push r15
+
+    mov [rdi], rsp      ; Save stack pointer of the current fiber.
+    mov rsp, rsi        ; Load stack pointer of the next fiber.
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbp
+    pop rbx
+
+    ret
+
+; A new fiber returns here from its first FiberSwitch. The initial context
+; prepared by fiber_create() holds the entry function in r12 and its argument in
+; r13.
+FiberStart:
+    mov rdi, r13
+    call r12
+    call fiber_exit
+    jmp $
@@ -0,0 +1,371 @@
+#include <stdbool.h>
+#include <errno.h>
+#include <fiber.h>
+#include <poll.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define MAIN_FIBER_ID                   0
+#define STANDARD_INPUT                  0
+
+/* Initial context: 6 callee-saved registers, return address and two padding
+ * words, so the stack is 16 bytes aligned when FiberStart calls the entry. */
+#define FIBER_INITIAL_CONTEXT_WORDS     9
+#define FIBER_CONTEXT_R13_INDEX         2
+#define FIBER_CONTEXT_R12_INDEX         3
+#define FIBER_CONTEXT_RETURN_INDEX      6
+
+/* Private type --------------------------------------------------------------*/
+typedef enum {
+    FIBER_UNUSED = 0,
+    FIBER_READY,
+    FIBER_RUNNING,
+    FIBER_BLOCKED,
+    FIBER_FINISHED
+} FiberState;
+
+/**
+ * @brief   Fiber control block.
+ *
+ * @property next       - Next fiber in the run queue, I/O wait list or free
+ *                        list.
+ * @property context    - Saved stack pointer when the fiber is switched out.
+ * @property stack      - Stack from the pool, NULL for main fiber.
+ * @property joiner     - Fiber which is blocked in fiber_join() on this one.
+ */
+typedef struct Fiber {
+    struct Fiber *next;
+    uint64_t context;
+    char *stack;
+    int id;
+    FiberState state;
+    bool detached;
+    struct Fiber *joiner;
+} Fiber;
+
+typedef struct {
+    Fiber *head;
+    Fiber *tail;
+} FiberQueue;
+
+/* Private variable ----------------------------------------------------------*/
+static Fiber s_fibers[FIBER_MAX_FIBERS];
+static Fiber *s_current = NULL;
+static FiberQueue s_run_queue = {NULL, NULL};
+static FiberQueue s_io_wait_queue = {NULL, NULL};
+static Fiber *s_free_fibers = NULL;
+
+/* Stack pool. Stacks are carved from the arena on demand, and stacks of
+ * finished fibers are kept in a LIFO free list. */
+static char s_stack_arena[FIBER_MAX_FIBERS - 1][FIBER_STACK_SIZE]
+    __attribute__((aligned(16)));
+static int s_stack_arena_used = 0;
+static char *s_free_stacks[FIBER_MAX_FIBERS - 1];
+static int s_free_stacks_count = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+void FiberSwitch(uint64_t *old, uint64_t new);
+void FiberStart(void);
+
+static void FiberInit(void);
+static void QueuePush(FiberQueue *queue, Fiber *fiber);
+static Fiber *QueuePop(FiberQueue *queue);
+static char *AllocStack(void);
+static void FreeStack(char *stack);
+static void ReleaseFiber(Fiber *fiber);
+static Fiber *GetFiber(int id);
+
+/**
+ * @brief   Switch to the next ready fiber. The caller must have set its own
+ *          state and queued itself if it wants to run again.
+ */
+static void Schedule(void);
+
+/* Public function -----------------------------------------------------------*/
+int fiber_create(fiber_entry entry, void *arg)
+{
+    Fiber *fiber = NULL;
+    uint64_t *context = NULL;
+
+    FiberInit();
+
+    if (s_free_fibers == NULL) {
+        return -EAGAIN;
+    }
+
+    fiber = s_free_fibers;
+    s_free_fibers = fiber->next;
+
+    fiber->stack = AllocStack();
+    fiber->state = FIBER_READY;
+    fiber->detached = false;
+    fiber->joiner = NULL;
+
+    /* Make an initial context, so the first switch to this fiber "returns" to
+     * FiberStart with the entry function and its argument in r12 and r13. */
+    context = (uint64_t *)(fiber->stack + FIBER_STACK_SIZE)
+              - FIBER_INITIAL_CONTEXT_WORDS;
+    for (int i = 0; i < FIBER_INITIAL_CONTEXT_WORDS; i++) {
+        context[i] = 0;
+    }
+    context[FIBER_CONTEXT_R12_INDEX] = (uint64_t)entry;
+    context[FIBER_CONTEXT_R13_INDEX] = (uint64_t)arg;
+    context[FIBER_CONTEXT_RETURN_INDEX] = (uint64_t)FiberStart;
+    fiber->context = (uint64_t)context;
+
+    QueuePush(&s_run_queue, fiber);
+
+    return fiber->id;
+}
+
+void fiber_yield(void)
+{
+    FiberInit();
+
+    if (s_run_queue.head == NULL) {
+        return;
+    }
+
+    s_current->state = FIBER_READY;
+    QueuePush(&s_run_queue, s_current);
+    Schedule();
+}
+
+int fiber_join(int id)
+{
+    Fiber *fiber = NULL;
+
+    FiberInit();
+
+    fiber = GetFiber(id);
+    if (fiber == NULL) {
+        return -ESRCH;
+    }
+
+    if (fiber == s_current || fiber->detached || fiber->joiner != NULL) {
+        return -EINVAL;
+    }
+
+    if (fiber->state != FIBER_FINISHED) {
+        /* fiber_exit() of the target puts us back to the run queue. */
+        fiber->joiner = s_current;
+        s_current->state = FIBER_BLOCKED;
+        Schedule();
+    }
+
+    ReleaseFiber(fiber);
+
+    return 0;
+}
+
+int fiber_detach(int id)
+{
+    Fiber *fiber = NULL;
+
+    FiberInit();
+
+    fiber = GetFiber(id);
+    if (fiber == NULL || id == MAIN_FIBER_ID) {
+        return -ESRCH;
+    }
+
+    if (fiber->detached || fiber->joiner != NULL) {
+        return -EINVAL;
+    }
+
+    if (fiber->state == FIBER_FINISHED) {
+        ReleaseFiber(fiber);
+    } else {
+        fiber->detached = true;
+    }
+
+    return 0;
+}
+
+void fiber_exit(void)
+{
+    Fiber *fiber = NULL;
+
+    FiberInit();
+
+    fiber = s_current;
+    if (fiber->id == MAIN_FIBER_ID) {
+        exit(0);
+    }
+
+    fiber->state = FIBER_FINISHED;
+
+    if (fiber->joiner != NULL) {
+        fiber->joiner->state = FIBER_READY;
+        QueuePush(&s_run_queue, fiber->joiner);
+    }
+
+    /* We still run on the stack, but it is safe to give it back to the pool
+     * because nothing can allocate a stack before we switch away. */
+    FreeStack(fiber->stack);
+    fiber->stack = NULL;
+
+    if (fiber->detached) {
+        ReleaseFiber(fiber);
+    }
+
+    Schedule();
+}
+
+int fiber_self(void)
+{
+    FiberInit();
+    return s_current->id;
+}
+
+int fiber_read(int fd, char *buf, size_t count)
+{
+    struct pollfd pfd = {STANDARD_INPUT, POLLIN, 0};
+    int status = 0;
+
+    FiberInit();
+
+    if (fd != STANDARD_INPUT) {
+        /* Files are read synchronously by the kernel, they never sleep. */
+        return read(fd, buf, count);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        /* Park until a key is buffered, so the read below can't sleep. */
+        while (poll(&pfd, 1, 0) == 0) {
+            s_current->state = FIBER_BLOCKED;
+            QueuePush(&s_io_wait_queue, s_current);
+            Schedule();
+        }
+
+        status = read(fd, &buf[i], 1);
+        if (status < 0) {
+            return status;
+        }
+    }
+
+    return count;
+}
+
+/* Private function ----------------------------------------------------------*/
+static void FiberInit(void)
+{
+    if (s_current != NULL) {
+        return;
+    }
+
+    for (int i = FIBER_MAX_FIBERS - 1; i >= 0; i--) {
+        s_fibers[i].id = i;
+        s_fibers[i].state = FIBER_UNUSED;
+
+        if (i != MAIN_FIBER_ID) {
+            s_fibers[i].next = s_free_fibers;
+            s_free_fibers = &s_fibers[i];
+        }
+    }
+
+    /* The caller becomes main fiber, it uses the process stack. */
+    s_current = &s_fibers[MAIN_FIBER_ID];
+    s_current->state = FIBER_RUNNING;
+}
+
+static void Schedule(void)
+{
+    struct pollfd pfd = {STANDARD_INPUT, POLLIN, 0};
+    Fiber *prev = s_current;
+    Fiber *next = QueuePop(&s_run_queue);
+
+    while (next == NULL) {
+        if (s_io_wait_queue.head == NULL) {
+            /* Every fiber is waiting for another one, this is a deadlock. We
+             * can't do better than continue the current one, unless it is
+             * finished: its stack is gone, nothing can run any more. */
+            if (prev->state == FIBER_FINISHED || prev->state == FIBER_UNUSED) {
+                exit(EDEADLK);
+            }
+
+            next = prev;
+            break;
+        }
+
+        /* Only fibers waiting for the keyboard are left, so we park the whole
+         * process in the kernel until a key arrives. */
+        poll(&pfd, 1, -1);
+
+        while ((next = QueuePop(&s_io_wait_queue)) != NULL) {
+            next->state = FIBER_READY;
+            QueuePush(&s_run_queue, next);
+        }
+
+        next = QueuePop(&s_run_queue);
+    }
+
+    next->state = FIBER_RUNNING;
+    s_current = next;
+
+    if (next != prev) {
+        FiberSwitch(&prev->context, next->context);
+    }
+}
+
+static void QueuePush(FiberQueue *queue, Fiber *fiber)
+{
+    fiber->next = NULL;
+
+    if (queue->head == NULL) {
+        queue->head = fiber;
+    } else {
+        queue->tail->next = fiber;
+    }
+
+    queue->tail = fiber;
+}
+
+static Fiber *QueuePop(FiberQueue *queue)
+{
+    Fiber *fiber = queue->head;
+
+    if (fiber != NULL) {
+        queue->head = fiber->next;
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        }
+    }
+
+    return fiber;
+}
+
+static char *AllocStack(void)
+{
+    /* The fiber slots and stacks have the same limit, so a stack is always
+     * available for a free slot. */
+    if (s_free_stacks_count > 0) {
+        return s_free_stacks[--s_free_stacks_count];
+    }
+
+    return s_stack_arena[s_stack_arena_used++];
+}
+
+static void FreeStack(char *stack)
+{
+    s_free_stacks[s_free_stacks_count++] = stack;
+}
+
+static void ReleaseFiber(Fiber *fiber)
+{
+    fiber->state = FIBER_UNUSED;
+    fiber->joiner = NULL;
+    fiber->detached = false;
+    fiber->next = s_free_fibers;
+    s_free_fibers = fiber;
+}
+
+static Fiber *GetFiber(int id)
+{
+    if (id < 0 || id >= FIBER_MAX_FIBERS
+        || s_fibers[id].state == FIBER_UNUSED) {
+        return NULL;
+    }
+
+    return &s_fibers[id];
+}
@@ -0,0 +1,424 @@
+#pragma once
+
+/**
+ * Coroutine library for C++ programs (start.cpp.asm + linker.cpp.ld).
+ *
+ *  + coro::task<T>       - Lazily started coroutine, `co_await` it to run it
+ *                          and get its result. The awaiting coroutine is
+ *                          resumed directly when the task finishes.
+ *  + coro::generator<T>  - Synchronous generator, used with range-for.
+ *  + coro::sleep(ms)     - Awaitable, resume after `ms` milliseconds.
+ *  + coro::read(fd, ...) - Awaitable, read from a file or the keyboard.
+ *  + coro::read_key()    - Awaitable, read one character from the keyboard.
+ *  + coro::executor      - Single threaded event loop. It resumes ready
+ *                          coroutines, and when every coroutine is waiting for
+ *                          a timer or the keyboard, it parks the process in a
+ *                          single poll() system call until the first of them
+ *                          can make progress.
+ *
+ * Coroutine frames are allocated from a recycling pool with one free list per
+ * size class (see coro.cc), there is no general heap in the runtime. When the
+ * pool is exhausted the coroutine function returns an empty task/generator.
+ *
+ * The value type of task<T> must be default constructible.
+ */
+
+#include <coroutine>
+
+extern "C"
+{
+#include <stddef.h>
+#include <stdint.h>
+}
+
+namespace coro
+{
+    template <typename T>
+    T &&move(T &value) noexcept
+    {
+        return static_cast<T &&>(value);
+    }
+
+    class frame_pool
+    {
+    public:
+        static void *allocate(std::size_t size) noexcept;
+        static void deallocate(void *ptr, std::size_t size) noexcept;
+    };
+
+    namespace detail
+    {
+        struct root_task;
+
+        /* Every promise type inherits this, so the compiler allocates their
+         * frames from the pool. */
+        struct frame_allocator
+        {
+            static void *operator new(std::size_t size) noexcept
+            {
+                return frame_pool::allocate(size);
+            }
+
+            static void operator delete(void *ptr, std::size_t size) noexcept
+            {
+                frame_pool::deallocate(ptr, size);
+            }
+        };
+
+        struct task_promise_base : frame_allocator
+        {
+            /* Coroutine to resume when this task finishes. */
+            std::coroutine_handle<> continuation;
+
+            struct final_awaiter
+            {
+                bool await_ready() const noexcept { return false; }
+
+                template <typename Promise>
+                std::coroutine_handle<>
+                await_suspend(std::coroutine_handle<Promise> handle) noexcept
+                {
+                    std::coroutine_handle<> next =
+                        handle.promise().continuation;
+
+                    if (next) {
+                        return next;
+                    }
+
+                    return std::noop_coroutine();
+                }
+
+                void await_resume() const noexcept {}
+            };
+
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+            final_awaiter final_suspend() const noexcept { return {}; }
+            void unhandled_exception() noexcept {}
+        };
+
+        template <typename Promise>
+        struct task_awaiter
+        {
+            std::coroutine_handle<Promise> handle;
+
+            bool await_ready() const noexcept
+            {
+                return !handle || handle.done();
+            }
+
+            std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                /* Symmetric transfer: start the task right away, it resumes
+                 * us from its final suspend point. */
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+        };
+    }
+
+    template <typename T = void>
+    class task
+    {
+    public:
+        struct promise_type : detail::task_promise_base
+        {
+            T value{};
+
+            task get_return_object() noexcept
+            {
+                return task{
+                    std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            static task get_return_object_on_allocation_failure() noexcept
+            {
+                return task{};
+            }
+
+            void return_value(T result) noexcept { value = coro::move(result); }
+        };
+
+        task() noexcept = default;
+        explicit task(std::coroutine_handle<promise_type> handle) noexcept
+            : m_handle(handle)
+        {
+        }
+
+        task(task &&other) noexcept : m_handle(other.m_handle)
+        {
+            other.m_handle = nullptr;
+        }
+
+        task(const task &) = delete;
+        task &operator=(const task &) = delete;
+
+        ~task()
+        {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+        }
+
+        bool valid() const noexcept { return bool(m_handle); }
+
+        auto operator co_await() noexcept
+        {
+            struct awaiter : detail::task_awaiter<promise_type>
+            {
+                T await_resume() noexcept
+                {
+                    if (!this->handle) {
+                        return T{};
+                    }
+                    return coro::move(this->handle.promise().value);
+                }
+            };
+
+            return awaiter{{m_handle}};
+        }
+
+    private:
+        std::coroutine_handle<promise_type> m_handle = nullptr;
+    };
+
+    template <>
+    class task<void>
+    {
+    public:
+        struct promise_type : detail::task_promise_base
+        {
+            task get_return_object() noexcept
+            {
+                return task{
+                    std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            static task get_return_object_on_allocation_failure() noexcept
+            {
+                return task{};
+            }
+
+            void return_void() noexcept {}
+        };
+
+        task() noexcept = default;
+        explicit task(std::coroutine_handle<promise_type> handle) noexcept
+            : m_handle(handle)
+        {
+        }
+
+        task(task &&other) noexcept : m_handle(other.m_handle)
+        {
+            other.m_handle = nullptr;
+        }
+
+        task(const task &) = delete;
+        task &operator=(const task &) = delete;
+
+        ~task()
+        {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+        }
+
+        bool valid() const noexcept { return bool(m_handle); }
+
+        auto operator co_await() noexcept
+        {
+            struct awaiter : detail::task_awaiter<promise_type>
+            {
+                void await_resume() noexcept {}
+            };
+
+            return awaiter{{m_handle}};
+        }
+
+    private:
+        std::coroutine_handle<promise_type> m_handle = nullptr;
+    };
+
+    template <typename T>
+    class generator
+    {
+    public:
+        struct promise_type : detail::frame_allocator
+        {
+            const T *current = nullptr;
+
+            generator get_return_object() noexcept
+            {
+                return generator{
+                    std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            static generator get_return_object_on_allocation_failure() noexcept
+            {
+                return generator{};
+            }
+
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+            std::suspend_always final_suspend() const noexcept { return {}; }
+
+            std::suspend_always yield_value(const T &value) noexcept
+            {
+                current = &value;
+                return {};
+            }
+
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept {}
+
+            /* A generator is synchronous, it can't wait for anything. */
+            template <typename U>
+            void await_transform(U &&) = delete;
+        };
+
+        struct sentinel
+        {
+        };
+
+        class iterator
+        {
+        public:
+            explicit iterator(std::coroutine_handle<promise_type> handle)
+                : m_handle(handle)
+            {
+            }
+
+            const T &operator*() const { return *m_handle.promise().current; }
+
+            iterator &operator++()
+            {
+                m_handle.resume();
+                return *this;
+            }
+
+            bool operator!=(sentinel) const
+            {
+                return m_handle && !m_handle.done();
+            }
+
+        private:
+            std::coroutine_handle<promise_type> m_handle;
+        };
+
+        generator() noexcept = default;
+        explicit generator(std::coroutine_handle<promise_type> handle) noexcept
+            : m_handle(handle)
+        {
+        }
+
+        generator(generator &&other) noexcept : m_handle(other.m_handle)
+        {
+            other.m_handle = nullptr;
+        }
+
+        generator(const generator &) = delete;
+        generator &operator=(const generator &) = delete;
+
+        ~generator()
+        {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+        }
+
+        iterator begin()
+        {
+            if (m_handle) {
+                m_handle.resume();
+            }
+            return iterator{m_handle};
+        }
+
+        sentinel end() const noexcept { return {}; }
+
+    private:
+        std::coroutine_handle<promise_type> m_handle = nullptr;
+    };
+
+    /* Awaitable returned by coro::sleep(). It is linked in the executor timer
+     * list while the coroutine is suspended, so waiting allocates nothing. */
+    struct sleep_awaiter
+    {
+        uint32_t deadline;
+        std::coroutine_handle<> handle;
+        sleep_awaiter *next;
+
+        bool await_ready() const noexcept;
+        void await_suspend(std::coroutine_handle<> awaiting) noexcept;
+        void await_resume() const noexcept {}
+    };
+
+    /* Awaitable returned by coro::read() and coro::read_key(). Reading the
+     * keyboard takes the characters one by one when they are available, so
+     * other coroutines keep running meanwhile. Files never sleep in the
+     * kernel, they are read synchronously. */
+    struct read_awaiter
+    {
+        int fd;
+        char *buffer;           /* NULL: read into `key`. */
+        size_t count;
+        size_t done;
+        int error;
+        char key;
+        std::coroutine_handle<> handle;
+        read_awaiter *next;
+
+        /* Read every character which is available without sleeping, return
+         * true when the request is complete. */
+        bool poll_input() noexcept;
+
+        bool await_ready() noexcept;
+        void await_suspend(std::coroutine_handle<> awaiting) noexcept;
+        int await_resume() const noexcept
+        {
+            return error < 0 ? error : (int)done;
+        }
+    };
+
+    struct read_key_awaiter : read_awaiter
+    {
+        char await_resume() const noexcept { return key; }
+    };
+
+    sleep_awaiter sleep(uint32_t milliseconds) noexcept;
+    read_awaiter read(int fd, char *buffer, size_t count) noexcept;
+    read_key_awaiter read_key() noexcept;
+
+    class executor
+    {
+    public:
+        static executor &instance() noexcept;
+
+        /* Run `work` as a detached root coroutine. */
+        void spawn(task<void> &&work) noexcept;
+
+        /* Queue a suspended coroutine to be resumed by run(). */
+        void schedule(std::coroutine_handle<> handle) noexcept;
+
+        /* Run until every spawned coroutine has finished. */
+        void run() noexcept;
+
+        void add_timer(sleep_awaiter *timer) noexcept;
+        void add_input_waiter(read_awaiter *waiter) noexcept;
+
+    private:
+        friend struct detail::root_task;
+
+        static constexpr int k_max_ready = 512;
+
+        bool expire_timers() noexcept;
+        bool serve_input() noexcept;
+
+        std::coroutine_handle<> m_ready[k_max_ready];
+        int m_ready_head = 0;
+        int m_ready_count = 0;
+        sleep_awaiter *m_timers = nullptr;      /* Sorted by deadline. */
+        read_awaiter *m_input_head = nullptr;   /* FIFO. */
+        read_awaiter *m_input_tail = nullptr;
+        int m_live_roots = 0;
+    };
+}
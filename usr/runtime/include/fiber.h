@@ -0,0 +1,91 @@
+/**
+ * @file    fiber.h
+ * @author  Cong Nguyen (congnt264@gmail.com)
+ * @brief   Fibers are stackful user space tasks which are scheduled
+ *          cooperatively inside one process. Creating or switching a fiber
+ *          never enters the kernel: a switch only saves the callee-saved
+ *          registers on the current stack and loads the stack pointer of the
+ *          next fiber (see fiber.asm).
+ *
+ *          + Every fiber has its own stack taken from a pool. Stacks of
+ *            finished fibers are pushed back to the pool and reused first, so
+ *            their memory is most likely still in the cache.
+ *          + Ready fibers are kept in a FIFO run queue and run round-robin.
+ *          + The first call to any fiber function turns the caller (main) into
+ *            fiber 0, it keeps running on the process stack.
+ *          + fiber_read() on the standard input never blocks the process while
+ *            other fibers are runnable. The waiting fiber is parked, and when
+ *            no fiber can run, the scheduler waits for the keyboard with one
+ *            poll() system call.
+ *
+ *          Every process has only one 2MB page for its code, data and stacks,
+ *          so the pool is limited to FIBER_MAX_FIBERS stacks of
+ *          FIBER_STACK_SIZE bytes.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Public define -------------------------------------------------------------*/
+#define FIBER_MAX_FIBERS        256             /* Including main fiber.     */
+#define FIBER_STACK_SIZE        (4 * 1024)
+
+/* Public type ---------------------------------------------------------------*/
+typedef void (*fiber_entry)(void *arg);
+
+/* Public function prototype -------------------------------------------------*/
+
+/**
+ * @brief   Create a new fiber and append it to the run queue. The new fiber
+ *          runs `entry(arg)` the next time the caller yields.
+ *
+ * @return int          - Fiber id (> 0), or -EAGAIN if there is no free fiber.
+ */
+int fiber_create(fiber_entry entry, void *arg);
+
+/**
+ * @brief   Give the CPU to the next ready fiber. Return immediately if no
+ *          other fiber is ready.
+ */
+void fiber_yield(void);
+
+/**
+ * @brief   Wait until fiber `id` finishes and release it.
+ *
+ * @return int          - 0 on success, -ESRCH if `id` is not a fiber, -EINVAL
+ *                        if it is detached, joined by another fiber or is the
+ *                        caller itself.
+ */
+int fiber_join(int id);
+
+/**
+ * @brief   Release fiber `id` automatically when it finishes, it can't be
+ *          joined after that.
+ */
+int fiber_detach(int id);
+
+/**
+ * @brief   Finish the calling fiber. Returning from the entry function does
+ *          the same thing. Calling it from main fiber exits the process, so
+ *          does the last fiber able to run, with EDEADLK as status, if every
+ *          other one is blocked.
+ */
+void fiber_exit(void);
+
+/**
+ * @brief   Get id of the calling fiber, main fiber is 0.
+ */
+int fiber_self(void);
+
+/**
+ * @brief   Read `count` bytes from `fd`. When reading the standard input, only
+ *          the calling fiber waits for key presses, other fibers keep running.
+ */
+int fiber_read(int fd, char *buf, size_t count);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Public define -------------------------------------------------------------*/
+#define POLLIN          0x0001  /* There is data to read.                     */
+#define POLLNVAL        0x0020  /* Invalid file descriptor.                   */
+
+/* Public type ---------------------------------------------------------------*/
+struct pollfd {
+    int fd;
+    int16_t events;
+    int16_t revents;
+};
+
+/* Public function prototype -------------------------------------------------*/
+
+/**
+ * @brief   Wait for one of the file descriptors to become ready.
+ *
+ * @param fds           - File descriptors and requested events.
+ * @param nfds          - Number of entries in `fds`.
+ * @param timeout       - Milliseconds to wait, 0 returns immediately and a
+ *                        negative value waits forever.
+ * @return int          - Number of ready descriptors, 0 on timeout.
+ */
+int poll(struct pollfd *fds, int nfds, int timeout);
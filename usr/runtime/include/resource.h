@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Public define -------------------------------------------------------------*/
+#define RUSAGE_SELF         0       /* The process and all its threads.       */
+#define RUSAGE_CHILDREN     (-1)    /* The children which were waited for.    */
+
+/* procinfo flags. */
+#define PROC_KERNEL_THREAD  0x0001  /* Runs kernel code only.                 */
+#define PROC_THREAD         0x0002  /* Thread of the process `leader_pid`.    */
+
+/* procinfo states. */
+#define PROC_STATE_READY    2
+#define PROC_STATE_RUNNING  3
+#define PROC_STATE_SLEEPING 4
+#define PROC_STATE_ZOMBIE   5
+
+/* Public type ---------------------------------------------------------------*/
+struct rusage {
+    struct timespec ru_utime;       /* Time run in user mode.               */
+    struct timespec ru_stime;       /* Time run in the kernel.              */
+    struct timespec ru_wtime;       /* Time spent ready, waiting for a CPU. */
+    uint64_t ru_nvcsw;              /* Voluntary context switches.          */
+    uint64_t ru_nivcsw;             /* Involuntary context switches.        */
+    uint64_t ru_nsyscalls;          /* System calls.                        */
+};
+
+/* One process or thread, the times are in nanoseconds. */
+struct procinfo {
+    int32_t pid;
+    int32_t parent_pid;             /* 0 for threads and kernel threads.    */
+    int32_t leader_pid;
+    uint8_t state;
+    uint8_t priority;
+    uint8_t nice;
+    uint8_t cpu;
+    uint32_t flags;
+    char name[16];                  /* "NAME.EXT", empty for init and the
+                                       kernel threads.                      */
+    uint64_t user_time;
+    uint64_t system_time;
+    uint64_t wait_time;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+    uint64_t system_calls;
+};
+
+/* Public function prototype -------------------------------------------------*/
+
+/**
+ * @brief   CPU usage of the process (RUSAGE_SELF) or of its children which
+ *          were waited for (RUSAGE_CHILDREN). The times are measured with the
+ *          TSC, at every entry to and exit from the kernel.
+ *
+ * @return int          - 0 on success, -EINVAL for another `who`.
+ */
+int getrusage(int who, struct rusage *usage);
+
+/**
+ * @brief   List the processes and threads of the system, in PID order.
+ *
+ * @param list          - Receives the entries.
+ * @param count         - Maximum number of entries.
+ * @return int          - Number of entries filled.
+ */
+int getprocs(struct procinfo *list, int count);
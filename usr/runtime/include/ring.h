@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Submission and completion rings shared with the kernel (see kernel/ring.h).
+ * Operations are queued with ring_get_sqe() and submitted together with
+ * ring_submit(), their results are read with ring_peek_cqe():
+ *
+ *      struct ring_sqe *sqe = ring_get_sqe();
+ *      sqe->opcode = RING_OP_READ;
+ *      sqe->fd = fd;
+ *      sqe->addr = (uint64_t)buffer;
+ *      sqe->length = sizeof(buffer);
+ *      ring_submit(1);
+ *      struct ring_cqe *cqe = ring_peek_cqe();
+ *      ... cqe->result ...
+ *      ring_cqe_seen();
+ *
+ * With RING_SETUP_POLL, the kernel takes the entries by itself, ring_submit()
+ * only enters the kernel to wake it up, or to wait for completions. The ring
+ * is used by one thread of the process.
+ */
+
+/* Public define -------------------------------------------------------------*/
+#define RING_SUBMISSION_ADDRESS     0x1FC000
+#define RING_COMPLETION_ADDRESS     0x1FD000
+#define RING_SUBMISSION_ENTRIES     64
+#define RING_COMPLETION_ENTRIES     128
+
+#define RING_SETUP_POLL             0x1     /* The kernel polls the ring.     */
+#define RING_NEED_WAKEUP            0x1     /* The polling kernel sleeps.     */
+
+#define RING_OP_NOP                 0
+#define RING_OP_READ                1
+#define RING_OP_WRITE               2
+#define RING_OP_OPEN                3
+#define RING_OP_CLOSE               4
+#define RING_OP_TIMEOUT             5       /* addr: nanoseconds, -ETIME.     */
+
+/* Public type ---------------------------------------------------------------*/
+struct ring_sqe {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t reserved;
+    int32_t fd;
+    uint64_t addr;                  /* Buffer, path or timeout.             */
+    uint64_t length;
+    uint64_t user_data;             /* Copied to the completion.            */
+};
+
+struct ring_cqe {
+    uint64_t user_data;
+    int32_t result;                 /* Result of the operation, or -errno.  */
+    uint32_t flags;
+};
+
+struct ring_sq {
+    volatile uint32_t head;         /* Moved by the kernel.                 */
+    volatile uint32_t tail;         /* Moved by the process.                */
+    volatile uint32_t flags;
+    uint32_t reserved;
+    struct ring_sqe entry[RING_SUBMISSION_ENTRIES];
+};
+
+struct ring_cq {
+    volatile uint32_t head;         /* Moved by the process.                */
+    volatile uint32_t tail;         /* Moved by the kernel.                 */
+    uint32_t reserved[2];
+    struct ring_cqe entry[RING_COMPLETION_ENTRIES];
+};
+
+/* Public function prototype -------------------------------------------------*/
+/**
+ * @brief   Map the rings to the process.
+ *
+ * @param flags         - RING_SETUP_POLL to let the kernel poll the ring.
+ * @return int          - 0, -EBUSY if the rings are already set up, or
+ *                        -ENOMEM.
+ */
+int ring_setup(unsigned int flags);
+
+/**
+ * @brief   Next free submission entry, zeroed, or NULL if the ring is full.
+ *          It is not seen by the kernel before ring_submit().
+ */
+struct ring_sqe *ring_get_sqe(void);
+
+/**
+ * @brief   Submit the entries from ring_get_sqe(), and wait until at least
+ *          `min_complete` completions are in the ring.
+ *
+ * @return int          - Number of entries the kernel took in the system call
+ *                        (0 if none was needed), or -errno.
+ */
+int ring_submit(unsigned int min_complete);
+
+/**
+ * @brief   Oldest completion, or NULL if there is none. It stays in the ring
+ *          until ring_cqe_seen().
+ */
+struct ring_cqe *ring_peek_cqe(void);
+
+/**
+ * @brief   Release the completion from ring_peek_cqe().
+ */
+void ring_cqe_seen(void);
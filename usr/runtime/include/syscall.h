@@ -12,7 +12,30 @@ enum SYSCALL {
     SYS_FORK = 8,
     SYS_EXEC = 9,
     SYS_LSTAT = 10,
-    SYS_CLRSRC = 11
+    SYS_CLRSRC = 11,
+    SYS_POLL = 12,
+    SYS_UPTIME = 13,
+    SYS_NICE = 14,
+    SYS_SCHED_DEADLINE = 15,
+    SYS_SCHED_YIELD = 16,
+    SYS_SCHED_MISSES = 17,
+    SYS_NANOSLEEP = 18,
+    SYS_THREAD_CREATE = 19,
+    SYS_THREAD_EXIT = 20,
+    SYS_THREAD_JOIN = 21,
+    SYS_ARCH_PRCTL = 22,
+    SYS_CLOCK_GETTIME = 23,
+    SYS_GETPID = 24,
+    SYS_RING_SETUP = 25,
+    SYS_RING_ENTER = 26,
+    SYS_SPAWN = 27,
+    SYS_GETRUSAGE = 28,
+    SYS_GETPROCS = 29,
+    SYS_TEMPLATE_CREATE = 30,
+    SYS_TEMPLATE_DROP = 31,
+    SYS_TEMPLATE_READY = 32,
+    SYS_CHECKPOINT = 33,
+    SYS_RESTORE = 34
 };
 
 int syscall0(int64_t number);
@@ -22,3 +45,7 @@ int syscall3(int32_t number, int64_t p1, int64_t p2, int64_t p3);
 int syscall4(int32_t number, int64_t p1, int64_t p2, int64_t p3, int64_t p4);
 int syscall5(int32_t number, int64_t p1, int64_t p2, int64_t p3, int64_t p4,
                 int64_t p5);
+
+/* System call without argument through the interrupt 0x80 instead of
+ * SYSCALL, to compare the two entries. */
+int int80_syscall0(int64_t number);
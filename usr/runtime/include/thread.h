@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Public define -------------------------------------------------------------*/
+/* Bytes of the thread stack which thread_create() uses to start the thread,
+ * beside the TLS block of the thread (tls_area_size()). */
+#define THREAD_START_SIZE   32
+
+/* Public function prototype -------------------------------------------------*/
+
+/**
+ * @brief   Create a thread which runs `entry(arg)` in the same memory and with
+ *          the same files as the caller. The thread exits with the value
+ *          returned by `entry`.
+ *
+ * @param entry         - Function run by the thread.
+ * @param stack         - Top of the stack of the thread, the caller owns the
+ *                        memory, it must stay valid until the thread is joined.
+ *                        The TLS block of the thread is kept on its top.
+ * @param arg           - Argument of `entry`.
+ * @return int          - Thread id, or a negative error code.
+ */
+int thread_create(int (*entry)(void *arg), void *stack, void *arg);
+
+/**
+ * @brief   Exit the calling thread. In the main thread, it exits the process.
+ */
+void thread_exit(int status);
+
+/**
+ * @brief   Wait for the thread `tid` of the process to exit.
+ *
+ * @param tid           - Thread id returned by thread_create().
+ * @param status        - Receives the exit status of the thread, can be NULL.
+ * @return int          - `tid`, or -ESRCH if it isn't a thread of the process.
+ */
+int thread_join(int tid, int *status);
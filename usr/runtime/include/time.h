@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Public define -------------------------------------------------------------*/
+#define CLOCK_REALTIME      0
+#define CLOCK_MONOTONIC     1
+
+/* Public type ---------------------------------------------------------------*/
+typedef int clockid_t;
+
+struct timespec {
+    int64_t tv_sec;
+    int64_t tv_nsec;
+};
+
+/* Public function prototype -------------------------------------------------*/
+
+/**
+ * @brief   Suspend the process for at least the interval in `req`, with the
+ *          resolution of the TSC clock, not of the scheduler tick.
+ *
+ * @param req           - Interval to sleep, tv_nsec is from 0 to 999999999.
+ * @param rem           - Receives the remaining interval, it is always zero
+ *                        because nothing interrupts the sleep. Can be NULL.
+ * @return int          - 0 on success, -EINVAL if `req` is invalid.
+ */
+int nanosleep(const struct timespec *req, struct timespec *rem);
+
+/**
+ * @brief   Read a clock, from the vDSO data page: it costs a TSC read and a
+ *          multiply, no system call.
+ *
+ * @param clock         - CLOCK_MONOTONIC, nanoseconds since boot, or
+ *                        CLOCK_REALTIME, nanoseconds since the epoch (the
+ *                        CMOS clock read at boot).
+ * @param tp            - Receives the time.
+ * @return int          - 0 on success, -EINVAL for an unknown clock.
+ */
+int clock_gettime(clockid_t clock, struct timespec *tp);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Thread-local storage (`__thread` variables), x86-64 ABI variant II.
+ *
+ * The linker gathers the TLS variables of the program into a template
+ * (.tdata, .tbss). Every thread gets its own copy of it, the TLS block, and
+ * the FS base of the thread points right above the block, to the thread
+ * control block, whose first word holds its own address:
+ *
+ *  |  TCB: self        |   <- FS base, thread pointer
+ *  |  .tbss (zeroed)   |
+ *  |  .tdata (copied)  |   <- thread pointer - size of the template
+ *
+ * The compiler reaches the variables at a negative offset from %fs, so an
+ * access costs no more than a global variable. The block of the main thread
+ * is set up by the start code on the top of the stack, the block of the other
+ * threads on the top of their stack by thread_create().
+ */
+
+/* Public define -------------------------------------------------------------*/
+/* arch_prctl() codes. GS is owned by the kernel, it can't be set. */
+#define ARCH_SET_FS     0x1002
+#define ARCH_GET_FS     0x1003
+
+/* Public function prototype -------------------------------------------------*/
+
+/**
+ * @brief   Set (ARCH_SET_FS) or get (ARCH_GET_FS) the FS base of the calling
+ *          thread. For ARCH_GET_FS, `addr` points to the variable which
+ *          receives the base.
+ *
+ * @return int          - 0, -EINVAL for an unknown code, -EPERM if the
+ *                        base isn't a user address, or -EFAULT if the
+ *                        variable isn't writable.
+ */
+int arch_prctl(int code, uint64_t addr);
+
+/**
+ * @brief   Thread pointer of the calling thread, the address of its thread
+ *          control block.
+ */
+void *tls_self(void);
+
+/**
+ * @brief   Size of the TLS block of a thread, with its thread control block.
+ */
+size_t tls_area_size(void);
+
+/**
+ * @brief   Called by the start code: keep the TLS template of the program,
+ *          its initialized part is [start, data_end), and the whole template
+ *          is [start, end).
+ *
+ * @return size_t       - Size of the TLS block of a thread.
+ */
+size_t TlsInit(const char *start, const char *data_end, const char *end);
+
+/**
+ * @brief   Make `area` the TLS block of the calling thread: copy the template
+ *          to it and load the FS base. `area` must have tls_area_size() bytes
+ *          and be aligned to 64 bytes.
+ */
+void TlsSetup(void *area);
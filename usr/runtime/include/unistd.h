@@ -2,13 +2,86 @@
 #include <stdint.h>
 #include <stddef.h>
 
+/* waitpid() option: return 0 at once if no child exited. */
+#define WNOHANG         1
+
 int open(const char* filename);
 int close(int fd);
 int write(int fd, const char *buf, size_t count);
 int read(int fd, char *buf, size_t count);
 unsigned int sleep(unsigned int seconds);
-void exit(void);
+void exit(int status);
 int wait(int pid);
+
+/* Wait for the child `pid`, or any child if it is -1, to exit and reap it.
+ * Return the pid of the child, 0 with WNOHANG if none exited yet, or -ECHILD.
+ * `status` receives the value passed to exit(), 127 if exec() failed, or
+ * 128 + the exception number if the process was killed. */
+int waitpid(int pid, int *status, int options);
 int mem(void);
 int fork(void);
 int exec(const char* filename);
+
+/* spawn() file actions, a list ends with an action of 0. */
+#define SPAWN_FILE_CLOSE    1   /* Close `fd` in the child.             */
+#define SPAWN_FILE_DUP2     2   /* Make `new_fd` a copy of `fd`.        */
+
+struct spawn_file_action {
+    int action;
+    int fd;
+    int new_fd;
+};
+
+/* Create a process which runs `path` with the arguments `argv` (ending with
+ * NULL, can be NULL), without copying the memory of the caller. The child
+ * inherits the file descriptors, changed by `actions` (can be NULL), and its
+ * main() gets argc and argv. Return the pid of the child, or -ENOENT,
+ * -ENOEXEC, -E2BIG, -EBADF, -EINVAL, -ENOMEM. */
+int spawn(const char *path,
+          char *const argv[],
+          const struct spawn_file_action *actions);
+
+/* Keep a template of the program `path`: it is run once up to right before
+ * main(), after its runtime setup and global constructors, and spawn() of
+ * the program then clones it instead of loading it from the disk. Return 0,
+ * or -ENOENT, -ENOEXEC, -ENOMEM, -ENAMETOOLONG. */
+int template_create(const char *path);
+
+/* Drop the template of `path`, or every template if `path` is NULL. Return 0,
+ * or -ENOENT if there is none. */
+int template_drop(const char *path);
+
+/* checkpoint() returns it in a process restored from its own checkpoint. */
+#define CHECKPOINT_RESTORED 1
+
+/* Save the process `pid`, or the caller if `pid` is 0, to the file `path`: its
+ * memory, registers, opened files and scheduling state. The file must exist
+ * and be large enough, 4KB per frame of the process plus 4KB. Return 0, or
+ * -ESRCH, -EINVAL, -EBUSY, -EMFILE, -ENOENT, -ETXTBSY, -ENOSPC, -ENOMEM. */
+int checkpoint(int pid, const char *path);
+
+/* Create a child process from the checkpoint file `path`, it resumes where it
+ * was saved. Return its pid, or -ENOENT, -ENOEXEC, -ESTALE, -ENOMEM. */
+int restore(const char *path);
+
+/* Milliseconds since boot, read from the vDSO data page. */
+unsigned int uptime(void);
+
+/* PID of the process, read from the vDSO data page. */
+int getpid(void);
+
+/* Add `inc` to the nice value of the process, return the new value. */
+int nice(int inc);
+
+/* Run as a real-time process: a job of `runtime_ms` is released every
+ * `period_ms`, and must be done `deadline_ms` after its release. The period is
+ * at most one hour. A runtime of 0 makes the process a normal one again. */
+int sched_deadline(unsigned int runtime_ms,
+                   unsigned int period_ms,
+                   unsigned int deadline_ms);
+
+/* The current job is done, wait for the next period. */
+int sched_yield(void);
+
+/* Number of jobs which missed their deadline. */
+int sched_misses(void);
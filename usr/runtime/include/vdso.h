@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Data pages of the kernel, mapped read-only in every process (see
+ * kernel/vdso.h). The kernel keeps them up to date, so the clocks, the PID
+ * and the counters are read with plain loads, without a system call:
+ *
+ *  |0x200000          |   runtime text
+ *  |  process data    |   PID and flags, private to the process
+ *  |0x1FF000          |
+ *  |  data            |   clocks and counters, shared by every process
+ *  |0x1FE000          |
+ *
+ * The clocks convert the TSC the same way as the kernel does:
+ *      ns = ((rdtsc() - tsc_base) * clock_multiplier) >> VDSO_CLOCK_SHIFT
+ */
+
+/* Public define -------------------------------------------------------------*/
+#define VDSO_DATA_ADDRESS           0x1FE000
+#define VDSO_PROCESS_DATA_ADDRESS   0x1FF000
+#define VDSO_CLOCK_SHIFT            32
+
+/* Process flags. */
+#define VDSO_PROCESS_TEMPLATE       0x1     /* Stop before main, see
+                                               template_create().           */
+
+/* Public type ---------------------------------------------------------------*/
+struct vdso_data {
+    uint64_t tsc_base;              /* TSC at the start of the clock.       */
+    uint64_t clock_multiplier;      /* ns per cycle << VDSO_CLOCK_SHIFT.    */
+    uint64_t realtime_offset;       /* ns since the epoch at tsc_base.      */
+    uint64_t system_calls;          /* Since boot.                          */
+    uint64_t context_switches;      /* Since boot, on all CPUs.             */
+    uint32_t process_count;         /* Processes and threads.               */
+    uint32_t cpu_count;             /* Online CPUs.                         */
+};
+
+struct vdso_process_data {
+    int32_t pid;
+    uint32_t flags;
+};
+
+/* Public function prototype -------------------------------------------------*/
+static inline const volatile struct vdso_data *vdso_data(void)
+{
+    return (const volatile struct vdso_data *)VDSO_DATA_ADDRESS;
+}
+
+static inline const volatile struct vdso_process_data *vdso_process_data(void)
+{
+    return (const volatile struct vdso_process_data *)
+           VDSO_PROCESS_DATA_ADDRESS;
+}
@@ -0,0 +1,11 @@
+#include <poll.h>
+#include <syscall.h>
+
+/* Public function -----------------------------------------------------------*/
+int poll(struct pollfd *fds, int nfds, int timeout)
+{
+    return syscall3((int64_t)SYS_POLL,
+                    (int64_t)fds,
+                    (int64_t)nfds,
+                    (int64_t)timeout);
+}
@@ -0,0 +1,17 @@
+#include <resource.h>
+#include <syscall.h>
+
+/* Public function -----------------------------------------------------------*/
+int getrusage(int who, struct rusage *usage)
+{
+    return syscall2((int64_t)SYS_GETRUSAGE,
+                    (int64_t)who,
+                    (int64_t)usage);
+}
+
+int getprocs(struct procinfo *list, int count)
+{
+    return syscall2((int64_t)SYS_GETPROCS,
+                    (int64_t)list,
+                    (int64_t)count);
+}
@@ -0,0 +1,87 @@
+#include <string.h>
+#include <ring.h>
+#include <syscall.h>
+
+/* Private variable ----------------------------------------------------------*/
+static unsigned int s_flags = 0;
+/* Entries from ring_get_sqe() which are not submitted yet end here. */
+static uint32_t s_sqe_tail = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static inline struct ring_sq *GetSubmissionRing(void)
+{
+    return (struct ring_sq *)RING_SUBMISSION_ADDRESS;
+}
+
+static inline struct ring_cq *GetCompletionRing(void)
+{
+    return (struct ring_cq *)RING_COMPLETION_ADDRESS;
+}
+
+/* Public function -----------------------------------------------------------*/
+int ring_setup(unsigned int flags)
+{
+    int result = syscall1((int64_t)SYS_RING_SETUP, (int64_t)flags);
+
+    if (result == 0) {
+        s_flags = flags;
+        s_sqe_tail = GetSubmissionRing()->tail;
+    }
+
+    return result;
+}
+
+struct ring_sqe *ring_get_sqe(void)
+{
+    struct ring_sq *sq = GetSubmissionRing();
+    struct ring_sqe *sqe = NULL;
+
+    if (s_sqe_tail - sq->head >= RING_SUBMISSION_ENTRIES) {
+        return NULL;
+    }
+
+    sqe = &sq->entry[s_sqe_tail++ % RING_SUBMISSION_ENTRIES];
+    memset(sqe, 0, sizeof(*sqe));
+
+    return sqe;
+}
+
+int ring_submit(unsigned int min_complete)
+{
+    struct ring_sq *sq = GetSubmissionRing();
+    uint32_t to_submit = s_sqe_tail - sq->tail;
+
+    /* The entries are written before the kernel sees the new tail. */
+    __asm__ __volatile__("" : : : "memory");
+    sq->tail = s_sqe_tail;
+
+    if (s_flags & RING_SETUP_POLL) {
+        /* The kernel sets the flag, then looks at the tail again. */
+        __asm__ __volatile__("mfence" : : : "memory");
+        if (!(sq->flags & RING_NEED_WAKEUP) && min_complete == 0) {
+            return 0;
+        }
+    }
+
+    return syscall2((int64_t)SYS_RING_ENTER,
+                    (int64_t)to_submit,
+                    (int64_t)min_complete);
+}
+
+struct ring_cqe *ring_peek_cqe(void)
+{
+    struct ring_cq *cq = GetCompletionRing();
+
+    if (cq->head == cq->tail) {
+        return NULL;
+    }
+
+    /* The entry is read after the tail which published it. */
+    __asm__ __volatile__("" : : : "memory");
+    return &cq->entry[cq->head % RING_COMPLETION_ENTRIES];
+}
+
+void ring_cqe_seen(void)
+{
+    GetCompletionRing()->head++;
+}
@@ -0,0 +1,32 @@
+; Header and initialization of the shared runtime image, which is mapped at
+; 0x200000 in every process (see kernel/runtime.h).
+section .header progbits alloc noexec nowrite align=8
+extern RuntimeBuildId
+extern __runtime_data_offset
+extern __runtime_data_size
+
+RuntimeHeader:
+    dd 0x4D495452                   ; Magic "RTIM".
+    dd RuntimeBuildId               ; Set by the linker (--defsym).
+    dq __runtime_data_offset        ; Initial values of the private data.
+    dq __runtime_data_size
+
+section .text
+global RuntimeInit
+extern __runtime_constructor_start
+extern __runtime_constructor_end
+
+; Call constructors of the global objects of the runtime (std::cout, etc.),
+; the program start code calls it before its own constructors.
+RuntimeInit:
+    push rbx
+    mov rbx, __runtime_constructor_start
+    jmp CheckRuntimeConstructorList
+CallRuntimeConstructor:
+    call [rbx]
+    add rbx, 0x08
+CheckRuntimeConstructorList:
+    cmp rbx, __runtime_constructor_end
+    jb CallRuntimeConstructor
+    pop rbx
+    ret
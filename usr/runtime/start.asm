@@ -4,6 +4,7 @@ extern main
 extern exit
 
 Start:
-    call main
+    call main           ; spawn() passes argc and argv in rdi and rsi.
+    mov edi, eax        ; The return value of main is the exit status.
     call exit
     jmp $
\ No newline at end of file
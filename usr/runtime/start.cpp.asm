@@ -1,14 +1,38 @@
+; Flags of the process data page of the vDSO (see vdso.h and syscall.h).
+VDSO_PROCESS_FLAGS      equ 0x1FF004
+VDSO_PROCESS_TEMPLATE   equ 0x1
+SYS_TEMPLATE_READY      equ 32
+
 section .text
 global Start
 extern main
 extern exit
+extern TlsInit
+extern TlsSetup
+extern __tls_start
+extern __tdata_end
+extern __tls_end
 extern __constructor_array_start
 extern __constructor_array_end
 extern __destructor_array_start
 extern __destructor_array_end
 
 Start:
-; 1. Call all global constructors of static, global objects.
+; 1. Set up the TLS block of the main thread on the top of the stack, before
+; the constructors which can use thread-local variables. argc and argv, which
+; spawn() passes in rdi and rsi, are kept for main.
+    mov r13, rdi
+    mov r14, rsi
+    mov rdi, __tls_start
+    mov rsi, __tdata_end
+    mov rdx, __tls_end
+    call TlsInit
+    sub rsp, rax        ; The block is aligned like the template, the stack
+    and rsp, -64        ; stays aligned to 16 bytes below it.
+    mov rdi, rsp
+    call TlsSetup
+
+; 2. Call all global constructors of static, global objects.
 CallGlobalConstructors:
    mov rbx, __constructor_array_start
    jmp CheckConstructorList
@@ -19,10 +43,21 @@ CheckConstructorList:
    cmp rbx, __constructor_array_end
    jb CallConstructor
 
-; 2. Call user main function.
+; 3. Call user main function, keep its return value for exit. A process which
+; builds a template of the program (see template_create()) stops right before,
+; the kernel keeps its memory and registers. The clones of the template resume
+; after template_ready(), with their own argc and argv in rdi and rsi.
+    mov rdi, r13
+    mov rsi, r14
+    test dword [VDSO_PROCESS_FLAGS], VDSO_PROCESS_TEMPLATE
+    jz CallMain
+    mov eax, SYS_TEMPLATE_READY
+    syscall
+CallMain:
     call main
+    mov r12d, eax
 
-; 3. Call all global destructors of static, global objects.
+; 4. Call all global destructors of static, global objects.
 CallGlobalDestructors: 
    mov rbx, __destructor_array_start
    jmp CheckDestructorList
@@ -33,6 +68,7 @@ CheckDestructorList:
    cmp rbx, __destructor_array_end
    jb CallDestructor
 
-; 4. Call exit.
+; 5. Call exit.
+    mov edi, r12d
     call exit
     jmp $
\ No newline at end of file
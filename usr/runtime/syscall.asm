@@ -5,107 +5,64 @@ global syscall2
 global syscall3
 global syscall4
 global syscall5
+global int80_syscall0
+
+; The system calls enter the kernel with the SYSCALL instruction, with the
+; Linux convention: the number in rax, the arguments in rdi, rsi, rdx, r10, r8
+; and r9, the result in rax. SYSCALL overwrites rcx (return address) and r11
+; (RFLAGS), they are scratch registers in the C calling convention, so are the
+; registers of the arguments, the wrappers only shift the arguments of
+; syscallN(number, p1, ..., p5) by one register.
 
 syscall0:
-    mov rax, rdi
-    mov rdi, 0
-    int 0x80
+    mov rax, rdi            ; System call number.
+    syscall
     ret
 
 syscall1:
-    ; 1. Allocate 8 bytes space on the stack for one argument.
-    sub rsp, 0x08
-
-    ; 2. Prepare arguments.
     mov rax, rdi            ; System call number.
-    mov [rsp], rsi          ; Copy first argument to the stack.
-    mov rdi, 0x01
-    mov rsi, rsp
-    
-    ; 3. Execute syscall interrupt instruction.
-    int 0x80
-
-    ; 4. Restore the stack and return to the caller.
-    add rsp, 0x08
+    mov rdi, rsi            ; First argument.
+    syscall
     ret
 
 syscall2:
-    ; 1. Allocate 16 bytes space on the stack for two arguments.
-    sub rsp, 0x10
-
-    ; 2. Prepare arguments.
     mov rax, rdi            ; System call number.
-    mov [rsp], rsi          ; Copy first argument to the stack.
-    mov [rsp + 0x08], rdx   ; Copy second argument to the stack.
-    mov rdi, 0x02
-    mov rsi, rsp
-    
-    ; 3. Execute syscall interrupt instruction.
-    int 0x80
-
-    ; 4. Restore the stack and return to the caller.
-    add rsp, 0x10
+    mov rdi, rsi            ; First argument.
+    mov rsi, rdx            ; Second argument.
+    syscall
     ret
 
 syscall3:
-    ; 1. Allocate 24 bytes space on the stack for three arguments.
-    sub rsp, 0x18
-
-    ; 2. Prepare arguments.
     mov rax, rdi            ; System call number.
-    mov [rsp], rsi          ; Copy first argument to the stack.
-    mov [rsp + 0x08], rdx   ; Copy second argument to the stack.
-    mov [rsp + 0x10], rcx   ; Copy third argument to the stack.
-
-    mov rdi, 0x03
-    mov rsi, rsp
-    
-    ; 3. Execute syscall interrupt instruction.
-    int 0x80
-
-    ; 4. Restore the stack and return to the caller.
-    add rsp, 0x18
+    mov rdi, rsi            ; First argument.
+    mov rsi, rdx            ; Second argument.
+    mov rdx, rcx            ; Third argument.
+    syscall
     ret
 
 syscall4:
-    ; 1. Allocate 32 bytes space on the stack for three arguments.
-    sub rsp, 0x20
-
-    ; 2. Prepare arguments.
     mov rax, rdi            ; System call number.
-    mov [rsp], rsi          ; Copy first argument to the stack.
-    mov [rsp + 0x08], rdx   ; Copy second argument to the stack.
-    mov [rsp + 0x10], rcx   ; Copy third argument to the stack.
-    mov [rsp + 0x18], r8    ; Copy 4th argument to the stack.
-
-    mov rdi, 0x04
-    mov rsi, rsp
-    
-    ; 3. Execute syscall interrupt instruction.
-    int 0x80
-
-    ; 4. Restore the stack and return to the caller.
-    add rsp, 0x20
+    mov rdi, rsi            ; First argument.
+    mov rsi, rdx            ; Second argument.
+    mov rdx, rcx            ; Third argument.
+    mov r10, r8             ; 4th argument, rcx is taken by SYSCALL.
+    syscall
     ret
 
 syscall5:
-    ; 1. Allocate 40 bytes space on the stack for three arguments.
-    sub rsp, 0x28
-
-    ; 2. Prepare arguments.
     mov rax, rdi            ; System call number.
-    mov [rsp], rsi          ; Copy first argument to the stack.
-    mov [rsp + 0x08], rdx   ; Copy second argument to the stack.
-    mov [rsp + 0x10], rcx   ; Copy third argument to the stack.
-    mov [rsp + 0x18], r8    ; Copy 4th argument to the stack.
-    mov [rsp + 0x20], r9    ; Copy 5th argument to the stack.
+    mov rdi, rsi            ; First argument.
+    mov rsi, rdx            ; Second argument.
+    mov rdx, rcx            ; Third argument.
+    mov r10, r8             ; 4th argument, rcx is taken by SYSCALL.
+    mov r8, r9              ; 5th argument.
+    syscall
+    ret
 
-    mov rdi, 0x05
-    mov rsi, rsp
-    
-    ; 3. Execute syscall interrupt instruction.
+int80_syscall0:
+    ; The old entry, through the interrupt 0x80: the number in rax, the count
+    ; of arguments in rdi and their array in rsi, here none.
+    mov rax, rdi            ; System call number.
+    mov rdi, 0
     int 0x80
-
-    ; 4. Restore the stack and return to the caller.
-    add rsp, 0x28
-    ret
\ No newline at end of file
+    ret
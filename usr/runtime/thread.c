@@ -0,0 +1,61 @@
+#include <errno.h>
+#include <thread.h>
+#include <tls.h>
+#include <syscall.h>
+
+/* Private type --------------------------------------------------------------*/
+/* Kept on the top of the thread stack, right below the TLS block of the
+ * thread, it is read by ThreadStart(). */
+struct thread_start {
+    int (*entry)(void *arg);
+    void *arg;
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void ThreadStart(struct thread_start *start);
+
+/* Public function -----------------------------------------------------------*/
+int thread_create(int (*entry)(void *arg), void *stack, void *arg)
+{
+    uint64_t top = 0;
+    struct thread_start *start = NULL;
+
+    if (entry == NULL || stack == NULL) {
+        return -EINVAL;
+    }
+
+    /* The TLS block is set up by the thread itself, it loads its FS base. */
+    top = ((uint64_t)stack - tls_area_size()) & ~(uint64_t)0x3F;
+
+    /* The thread starts in ThreadStart() as if it was called: the stack is
+     * aligned to 16 bytes, below a null return address. */
+    start = (struct thread_start *)(top - sizeof(struct thread_start));
+    start->entry = entry;
+    start->arg = arg;
+    *(uint64_t *)(top - THREAD_START_SIZE + 8) = 0;
+
+    return syscall3((int64_t)SYS_THREAD_CREATE,
+                    (int64_t)ThreadStart,
+                    (int64_t)(top - THREAD_START_SIZE + 8),
+                    (int64_t)start);
+}
+
+void thread_exit(int status)
+{
+    syscall1((int64_t)SYS_THREAD_EXIT,
+             (int64_t)status);
+}
+
+int thread_join(int tid, int *status)
+{
+    return syscall2((int64_t)SYS_THREAD_JOIN,
+                    (int64_t)tid,
+                    (int64_t)status);
+}
+
+/* Private function ----------------------------------------------------------*/
+static void ThreadStart(struct thread_start *start)
+{
+    TlsSetup(start + 1);
+    thread_exit(start->entry(start->arg));
+}
@@ -0,0 +1,31 @@
+#include <errno.h>
+#include <time.h>
+#include <syscall.h>
+#include <vdso.h>
+
+/* Public function -----------------------------------------------------------*/
+int nanosleep(const struct timespec *req, struct timespec *rem)
+{
+    return syscall2((int64_t)SYS_NANOSLEEP,
+                    (int64_t)req,
+                    (int64_t)rem);
+}
+
+int clock_gettime(clockid_t clock, struct timespec *tp)
+{
+    const volatile struct vdso_data *data = vdso_data();
+    uint64_t cycles = __builtin_ia32_rdtsc() - data->tsc_base;
+    uint64_t ns = (uint64_t)(((unsigned __int128)cycles
+                              * data->clock_multiplier) >> VDSO_CLOCK_SHIFT);
+
+    if (clock == CLOCK_REALTIME) {
+        ns += data->realtime_offset;
+    } else if (clock != CLOCK_MONOTONIC) {
+        return -EINVAL;
+    }
+
+    tp->tv_sec = ns / 1000000000;
+    tp->tv_nsec = ns % 1000000000;
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include <string.h>
+#include <tls.h>
+#include <syscall.h>
+
+/* Private type --------------------------------------------------------------*/
+/* Thread control block, at the thread pointer (%fs:0). */
+struct tls_tcb {
+    struct tls_tcb *self;
+    uint64_t reserved;
+};
+
+/* Private variable ----------------------------------------------------------*/
+static const char *s_tls_template = NULL;
+static size_t s_tls_data_size = 0;
+static size_t s_tls_size = 0;
+
+/* Public function -----------------------------------------------------------*/
+int arch_prctl(int code, uint64_t addr)
+{
+    return syscall2((int64_t)SYS_ARCH_PRCTL,
+                    (int64_t)code,
+                    (int64_t)addr);
+}
+
+void *tls_self(void)
+{
+    void *self = NULL;
+
+    __asm__ __volatile__("mov %%fs:0, %0" : "=r"(self));
+    return self;
+}
+
+size_t tls_area_size(void)
+{
+    return s_tls_size + sizeof(struct tls_tcb);
+}
+
+size_t TlsInit(const char *start, const char *data_end, const char *end)
+{
+    s_tls_template = start;
+    s_tls_data_size = data_end - start;
+    s_tls_size = end - start;
+
+    return tls_area_size();
+}
+
+void TlsSetup(void *area)
+{
+    struct tls_tcb *tcb = (struct tls_tcb *)((char *)area + s_tls_size);
+
+    /* The linker script aligns the size of the template, the variables keep
+     * their alignment at the negative offsets from the thread pointer. */
+    memcpy(area, s_tls_template, s_tls_data_size);
+    memset((char *)area + s_tls_data_size, 0, s_tls_size - s_tls_data_size);
+
+    tcb->self = tcb;
+    tcb->reserved = 0;
+
+    arch_prctl(ARCH_SET_FS, (uint64_t)tcb);
+}
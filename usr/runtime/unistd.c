@@ -1,5 +1,7 @@
 #include <unistd.h>
 #include <syscall.h>
+#include <time.h>
+#include <vdso.h>
 
 int write(int fd, const char *buf, size_t count)
 {
@@ -23,15 +25,23 @@ unsigned int sleep(unsigned int seconds)
                     (int64_t)seconds);
 }
 
-void exit(void)
+void exit(int status)
 {
-    syscall0((int64_t)SYS_EXIT);
+    syscall1((int64_t)SYS_EXIT,
+             (int64_t)status);
 }
 
 int wait(int pid)
 {
-    return syscall1((int64_t)SYS_WAIT,
-                    (int64_t)pid);
+    return waitpid(pid, NULL, 0);
+}
+
+int waitpid(int pid, int *status, int options)
+{
+    return syscall3((int64_t)SYS_WAIT,
+                    (int64_t)pid,
+                    (int64_t)status,
+                    (int64_t)options);
 }
 
 int mem(void)
@@ -61,3 +71,72 @@ int exec(const char* filename)
     return syscall1((int64_t)SYS_EXEC,
                     (int64_t)filename);
 }
+
+int spawn(const char *path,
+          char *const argv[],
+          const struct spawn_file_action *actions)
+{
+    return syscall3((int64_t)SYS_SPAWN,
+                    (int64_t)path,
+                    (int64_t)argv,
+                    (int64_t)actions);
+}
+
+int template_create(const char *path)
+{
+    return syscall1((int64_t)SYS_TEMPLATE_CREATE, (int64_t)path);
+}
+
+int template_drop(const char *path)
+{
+    return syscall1((int64_t)SYS_TEMPLATE_DROP, (int64_t)path);
+}
+
+int checkpoint(int pid, const char *path)
+{
+    return syscall2((int64_t)SYS_CHECKPOINT, (int64_t)pid, (int64_t)path);
+}
+
+int restore(const char *path)
+{
+    return syscall1((int64_t)SYS_RESTORE, (int64_t)path);
+}
+
+unsigned int uptime(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+int getpid(void)
+{
+    return vdso_process_data()->pid;
+}
+
+int nice(int inc)
+{
+    return syscall1((int64_t)SYS_NICE,
+                    (int64_t)inc);
+}
+
+int sched_deadline(unsigned int runtime_ms,
+                   unsigned int period_ms,
+                   unsigned int deadline_ms)
+{
+    return syscall3((int64_t)SYS_SCHED_DEADLINE,
+                    (int64_t)runtime_ms,
+                    (int64_t)period_ms,
+                    (int64_t)deadline_ms);
+}
+
+int sched_yield(void)
+{
+    return syscall0((int64_t)SYS_SCHED_YIELD);
+}
+
+int sched_misses(void)
+{
+    return syscall0((int64_t)SYS_SCHED_MISSES);
+}
@@ -2,6 +2,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <resource.h>
+
+#define MAXIMUM_ARGUMENTS   8
 
 typedef void (*CmdFunc)(void);
 
@@ -11,11 +15,15 @@ uint64_t MemInfo(void);
 
 static int ReadCmd(char *buffer);
 static int ParseCmd(char *buffer, int length);
+static int SplitArguments(char *buffer, char **argv);
+static void RunProgram(char *line);
+static void TimeProgram(char *line);
+static void PrintTime(const char *label, int64_t sec, int64_t nsec);
 static void ExecuteCmd(int cmd);
 static void TotalMemCmd(void);
 
 int main(void) {
-    char buffer[80] = {0};
+    char buffer[80 + 1] = {0};
     int buffer_size = 0;
     int cmd = 0;
     s_cmd_list[0] = TotalMemCmd;
@@ -49,25 +57,16 @@ int main(void) {
 
 
         } else if (cmd < 0) {
-
-            /* Check file is exist. */
-            int fd = open(buffer);
-
-            if (fd < 0) {
-                buffer[buffer_size] = '\0';
-                printf("Command '%s' not found.\n", buffer);
-                continue;
+            buffer[buffer_size] = '\0';
+            if (!memcmp("time ", buffer, 5)) {
+                TimeProgram(&buffer[5]);
+            } else {
+                RunProgram(buffer);
             }
 
-            close(fd);
-
-            int pid = fork();
-            if (pid == 0) {
-                /* Exec command in another process. */
-                exec(buffer);
-            } else {
-                /* Wait command exit. */
-                wait(pid);
+            /* The shell is the init process, it reaps the orphans which
+             * exited meanwhile. */
+            while (waitpid(-1, NULL, WNOHANG) > 0) {
             }
 
         } else {
@@ -113,6 +112,90 @@ static int ParseCmd(char *buffer, int length)
     return cmd;
 }
 
+static int SplitArguments(char *buffer, char **argv)
+{
+    int argc = 0;
+
+    /* Words are separated by spaces, they are ended in place. */
+    while (*buffer != '\0' && argc < MAXIMUM_ARGUMENTS) {
+        if (*buffer == ' ') {
+            *buffer++ = '\0';
+            continue;
+        }
+
+        argv[argc++] = buffer;
+        while (*buffer != '\0' && *buffer != ' ') {
+            buffer++;
+        }
+    }
+
+    argv[argc] = NULL;
+    return argc;
+}
+
+static void RunProgram(char *line)
+{
+    char *argv[MAXIMUM_ARGUMENTS + 1];
+    int pid = 0;
+
+    if (SplitArguments(line, argv) == 0) {
+        return;
+    }
+
+    /* The command runs in a new process which is built from the program
+     * file, spawn() fails if the file doesn't exist. */
+    pid = spawn(argv[0], argv, NULL);
+    if (pid < 0) {
+        printf("Command '%s' not found.\n", argv[0]);
+        return;
+    }
+
+    /* Wait command exit. */
+    wait(pid);
+}
+
+static void TimeProgram(char *line)
+{
+    struct rusage before;
+    struct rusage after;
+    struct timespec start;
+    struct timespec end;
+
+    /* The usage of the children grows by the command once it is reaped. */
+    getrusage(RUSAGE_CHILDREN, &before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    RunProgram(line);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_CHILDREN, &after);
+
+    PrintTime("real", end.tv_sec - start.tv_sec, end.tv_nsec - start.tv_nsec);
+    PrintTime("user",
+              after.ru_utime.tv_sec - before.ru_utime.tv_sec,
+              after.ru_utime.tv_nsec - before.ru_utime.tv_nsec);
+    PrintTime("sys",
+              after.ru_stime.tv_sec - before.ru_stime.tv_sec,
+              after.ru_stime.tv_nsec - before.ru_stime.tv_nsec);
+    PrintTime("wait",
+              after.ru_wtime.tv_sec - before.ru_wtime.tv_sec,
+              after.ru_wtime.tv_nsec - before.ru_wtime.tv_nsec);
+    printf("%lu voluntary, %lu involuntary switches, %lu system calls\n",
+           after.ru_nvcsw - before.ru_nvcsw,
+           after.ru_nivcsw - before.ru_nivcsw,
+           after.ru_nsyscalls - before.ru_nsyscalls);
+}
+
+static void PrintTime(const char *label, int64_t sec, int64_t nsec)
+{
+    if (nsec < 0) {
+        sec--;
+        nsec += 1000000000;
+    }
+
+    printf("%-5s %ld.%03lds\n", label, sec, nsec / 1000000);
+}
+
 static void ExecuteCmd(int cmd)
 {
     CmdFunc func = s_cmd_list[cmd];
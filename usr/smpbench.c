@@ -0,0 +1,67 @@
+/**
+ * SMP scaling test: the same CPU-bound job is run by one process, then by
+ * WORKERS processes at once, and the times are compared. On one CPU the second
+ * run takes WORKERS times longer, with WORKERS CPUs it takes about as long as
+ * the first one.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define WORKERS                 4
+#define JOB_ITERATIONS          200000000ULL
+
+/* Private function prototypes -----------------------------------------------*/
+static void Work(uint64_t iterations);
+static unsigned int RunWorkers(int workers);
+
+/* Public function -----------------------------------------------------------*/
+int main(void)
+{
+    unsigned int single = RunWorkers(1);
+    unsigned int parallel = RunWorkers(WORKERS);
+
+    printf("smpbench: 1 worker in %u ms, %d workers in %u ms, "
+           "speedup x%u.%02u\n",
+           single,
+           WORKERS,
+           parallel,
+           WORKERS * single / parallel,
+           WORKERS * single * 100 / parallel % 100);
+
+    return 0;
+}
+
+/* Private function ----------------------------------------------------------*/
+static void Work(uint64_t iterations)
+{
+    volatile uint64_t value = 0;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        value += i;
+    }
+}
+
+static unsigned int RunWorkers(int workers)
+{
+    int pids[WORKERS] = {0};
+    unsigned int start = uptime();
+    unsigned int elapsed = 0;
+
+    for (int i = 0; i < workers; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            Work(JOB_ITERATIONS);
+            exit(0);
+        }
+    }
+
+    for (int i = 0; i < workers; i++) {
+        wait(pids[i]);
+    }
+
+    elapsed = uptime() - start;
+
+    return elapsed > 0 ? elapsed : 1;
+}
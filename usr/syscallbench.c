@@ -0,0 +1,72 @@
+/**
+ * Null system call benchmark: getpid() entered with the SYSCALL instruction
+ * against the same system call through the interrupt 0x80, the kernel does
+ * nothing but enter and leave.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <syscall.h>
+
+/* Private define ------------------------------------------------------------*/
+#define ROUNDS              100000
+
+/* Private function prototypes -----------------------------------------------*/
+static inline uint64_t ReadTSC(void);
+static uint64_t Nanoseconds(void);
+
+/* Public function -----------------------------------------------------------*/
+int main(void)
+{
+    uint64_t start = 0;
+    uint64_t start_ns = 0;
+    uint64_t syscall_cycles = 0;
+    uint64_t syscall_ns = 0;
+    uint64_t int80_cycles = 0;
+    uint64_t int80_ns = 0;
+
+    /* 1. SYSCALL/SYSRET. */
+    start_ns = Nanoseconds();
+    start = ReadTSC();
+    for (int i = 0; i < ROUNDS; i++) {
+        syscall0((int64_t)SYS_GETPID);
+    }
+    syscall_cycles = ReadTSC() - start;
+    syscall_ns = Nanoseconds() - start_ns;
+
+    /* 2. int 0x80/iretq. */
+    start_ns = Nanoseconds();
+    start = ReadTSC();
+    for (int i = 0; i < ROUNDS; i++) {
+        int80_syscall0((int64_t)SYS_GETPID);
+    }
+    int80_cycles = ReadTSC() - start;
+    int80_ns = Nanoseconds() - start_ns;
+
+    printf("syscallbench: syscall  %lu cycles, %lu ns/call\n",
+           syscall_cycles / ROUNDS,
+           syscall_ns / ROUNDS);
+    printf("syscallbench: int 0x80 %lu cycles, %lu ns/call\n",
+           int80_cycles / ROUNDS,
+           int80_ns / ROUNDS);
+
+    return 0;
+}
+
+/* Private function ----------------------------------------------------------*/
+static inline uint64_t ReadTSC(void)
+{
+    uint32_t low = 0;
+    uint32_t high = 0;
+
+    __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+static uint64_t Nanoseconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
@@ -0,0 +1,119 @@
+/**
+ * Thread test: worker threads sum the parts of an array which they share with
+ * the main thread, without any copy, and the main thread joins them and checks
+ * the total. The threads sum in a thread-local variable, so every thread must
+ * start from the TLS template and the main thread must not see their sums.
+ * Then it measures the cost of creating and joining a thread.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <thread.h>
+#include <tls.h>
+
+/* Private define ------------------------------------------------------------*/
+#define THREADS                 4
+#define THREAD_STACK_SIZE       (16 * 1024)
+#define VALUES                  (64 * 1024)
+#define ROUNDS                  100
+
+/* Private type --------------------------------------------------------------*/
+typedef struct {
+    int first;
+    int count;
+    uint64_t sum;
+} Part;
+
+/* Private variable ----------------------------------------------------------*/
+static uint32_t s_values[VALUES];
+static Part s_parts[THREADS];
+static uint8_t s_stacks[THREADS][THREAD_STACK_SIZE];
+static __thread uint64_t t_sum = 0;
+static __thread int t_first = -1;
+
+/* Private function prototypes -----------------------------------------------*/
+static int SumPart(void *arg);
+static int Nothing(void *arg);
+
+/* Public function -----------------------------------------------------------*/
+int main(void)
+{
+    int tids[THREADS] = {0};
+    uint64_t expected = 0;
+    uint64_t total = 0;
+    unsigned int start = 0;
+    int status = 0;
+
+    for (int i = 0; i < VALUES; i++) {
+        s_values[i] = i;
+        expected += i;
+    }
+
+    /* 1. Every thread sums its part of the shared array. */
+    for (int i = 0; i < THREADS; i++) {
+        s_parts[i].first = i * (VALUES / THREADS);
+        s_parts[i].count = VALUES / THREADS;
+
+        tids[i] = thread_create(SumPart,
+                                s_stacks[i] + THREAD_STACK_SIZE,
+                                &s_parts[i]);
+        if (tids[i] < 0) {
+            printf("threaddemo: thread_create failed: %d\n", tids[i]);
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < THREADS; i++) {
+        thread_join(tids[i], &status);
+        total += s_parts[i].sum;
+    }
+
+    printf("threaddemo: %d threads, sum %s, TLS %s\n",
+           THREADS,
+           total == expected ? "ok" : "wrong",
+           t_sum == 0 && t_first == -1 && tls_self() != NULL ? "ok" : "wrong");
+
+    /* 2. Create and join threads one by one. */
+    start = uptime();
+    for (int i = 0; i < ROUNDS; i++) {
+        int tid = thread_create(Nothing, s_stacks[0] + THREAD_STACK_SIZE, NULL);
+
+        thread_join(tid, &status);
+        if (status != i % 2) {
+            printf("threaddemo: wrong exit status %d\n", status);
+        }
+    }
+
+    printf("threaddemo: %d thread create/join in %u ms\n",
+           ROUNDS,
+           uptime() - start);
+
+    return 0;
+}
+
+/* Private function ----------------------------------------------------------*/
+static int SumPart(void *arg)
+{
+    Part *part = arg;
+
+    /* The variables start from the template in every thread. */
+    if (t_sum != 0 || t_first != -1) {
+        return 1;
+    }
+
+    t_first = part->first;
+    for (int i = t_first; i < t_first + part->count; i++) {
+        t_sum += s_values[i];
+    }
+
+    part->sum = t_sum;
+
+    return 0;
+}
+
+static int Nothing(void *arg)
+{
+    static int calls = 0;
+
+    return calls++ % 2;
+}